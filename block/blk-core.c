@@ -109,6 +109,7 @@ void blk_rq_init(struct request_queue *q, struct request *rq)
 	rq->cmd_len = BLK_MAX_CDB;
 	rq->tag = -1;
 	rq->start_time = jiffies;
+	rq->start_clock = sched_clock();
 	set_start_time_ns(rq);
 	rq->part = NULL;
 }
@@ -2147,6 +2148,11 @@ void blk_account_io_done(struct request *req)
 		part_stat_unlock();
 	}
 
+	if (req->cmd_type == REQ_TYPE_FS && rq_data_dir(req) == WRITE &&
+	    !(req->cmd_flags & (REQ_FLUSH_SEQ | REQ_DISCARD)))
+		bdi_account_write_latency(&req->q->backing_dev_info,
+					  sched_clock() - req->start_clock);
+
 	if (req->cmd_flags & REQ_FLUSH_SEQ)
 		req->q->flush_ios++;
 }
@@ -33,6 +33,13 @@
 #include <linux/cpuidle.h>
 #include <linux/timer.h>
 #include <linux/wakeup_reason.h>
+#include <linux/of.h>
+#include <linux/ctype.h>
+#include <linux/hashtable.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "../base.h"
 #include "power.h"
@@ -748,6 +755,515 @@ void dpm_resume_start(pm_message_t state)
 }
 EXPORT_SYMBOL_GPL(dpm_resume_start);
 
+/*
+ * Dependency graph used by dpm_resume().
+ *
+ * Resuming devices one by one in dpm_list order is what keeps suppliers
+ * ahead of their consumers, but it also serializes every driver that
+ * does not set power.async_suspend.  For devices described in the device
+ * tree the dependencies can be read from the node itself: the parent plus
+ * the clock, regulator, pinctrl, power domain, syscon, DMA, PHY, IOMMU,
+ * System MMU and GPIO providers it references.  Such devices are resumed
+ * asynchronously and wait for all of their suppliers, including the ones
+ * that come after them in dpm_list.  If those waits could form a cycle,
+ * the graph is only used to check the order and devices are resumed as
+ * before.
+ *
+ * The nodes of the last resume are kept for the debugfs timing report.
+ */
+#define DPM_RESUME_HASH_BITS	8
+
+struct dpm_resume_node {
+	struct hlist_node dev_hnode;
+	struct hlist_node np_hnode;
+	struct device *dev;
+	unsigned int seq;
+	unsigned int nr_deps;
+	unsigned int max_deps;
+	unsigned int *deps;
+	bool async;
+	bool resolved;
+	int error;
+	ktime_t start;		/* picked up by dpm_resume() or async thread */
+	ktime_t ready;		/* dependencies resumed */
+	ktime_t end;		/* callbacks done */
+	char name[40];
+};
+
+static struct dpm_resume_node *dpm_resume_nodes;
+static unsigned int dpm_resume_nr_nodes;
+static unsigned int dpm_resume_violations;
+static bool dpm_resume_in_list_order;
+static ktime_t dpm_resume_starttime, dpm_resume_endtime;
+static DEFINE_HASHTABLE(dpm_resume_dev_hash, DPM_RESUME_HASH_BITS);
+static DEFINE_HASHTABLE(dpm_resume_np_hash, DPM_RESUME_HASH_BITS);
+static DEFINE_MUTEX(dpm_resume_report_mtx);
+
+/* Properties holding "phandle args..." lists and their cells property. */
+static const struct {
+	const char *name;
+	const char *cells;
+} dpm_resume_phandle_props[] = {
+	{ "clocks",		"#clock-cells" },
+	{ "power-domains",	"#power-domain-cells" },
+	{ "dmas",		"#dma-cells" },
+	{ "phys",		"#phy-cells" },
+	{ "iommus",		"#iommu-cells" },
+	{ "gpios",		"#gpio-cells" },
+};
+
+/* Properties holding a single provider phandle. */
+static const char * const dpm_resume_phandle_single[] = {
+	"samsung,power-domain",
+	"samsung,syscon-phandle",
+};
+
+static struct dpm_resume_node *dpm_resume_find_dev(struct device *dev)
+{
+	struct dpm_resume_node *node;
+
+	hash_for_each_possible(dpm_resume_dev_hash, node, dev_hnode,
+			       (unsigned long)dev)
+		if (node->dev == dev)
+			return node;
+
+	return NULL;
+}
+
+static struct dpm_resume_node *dpm_resume_find_np(struct device_node *np)
+{
+	struct dpm_resume_node *node, *found = NULL;
+
+	/* several devices may share a node, the first one is the provider */
+	hash_for_each_possible(dpm_resume_np_hash, node, np_hnode,
+			       (unsigned long)np)
+		if (node->dev->of_node == np && (!found || node->seq < found->seq))
+			found = node;
+
+	return found;
+}
+
+static int dpm_resume_add_dep(struct dpm_resume_node *node,
+			      struct dpm_resume_node *sup)
+{
+	unsigned int i, *deps;
+
+	if (!sup || sup == node)
+		return 0;
+
+	for (i = 0; i < node->nr_deps; i++)
+		if (node->deps[i] == sup->seq)
+			return 0;
+
+	if (node->nr_deps == node->max_deps) {
+		i = node->max_deps ? 2 * node->max_deps : 4;
+		deps = krealloc(node->deps, i * sizeof(*deps), GFP_KERNEL);
+		if (!deps)
+			return -ENOMEM;
+		node->deps = deps;
+		node->max_deps = i;
+	}
+	node->deps[node->nr_deps++] = sup->seq;
+	return 0;
+}
+
+/* Pin configurations and clock outputs sit below their provider's node. */
+static int dpm_resume_add_np_dep(struct dpm_resume_node *node,
+				 struct device_node *np)
+{
+	struct device_node *p;
+	struct dpm_resume_node *sup = NULL;
+
+	for (p = np; p && !sup; p = p->parent)
+		sup = dpm_resume_find_np(p);
+
+	of_node_put(np);
+	return dpm_resume_add_dep(node, sup);
+}
+
+static int dpm_resume_find_deps(struct dpm_resume_node *node)
+{
+	struct device *dev = node->dev;
+	struct device_node *np = dev->of_node;
+	struct of_phandle_args args;
+	struct property *prop;
+	struct device_node *sup;
+	int error = 0;
+	int i, j;
+
+	if (dev->parent)
+		error = dpm_resume_add_dep(node,
+					   dpm_resume_find_dev(dev->parent));
+
+	if (!np)
+		return error;
+
+	for (i = 0; i < ARRAY_SIZE(dpm_resume_phandle_props); i++)
+		for (j = 0; !error && !of_parse_phandle_with_args(np,
+				dpm_resume_phandle_props[i].name,
+				dpm_resume_phandle_props[i].cells, j, &args);
+		     j++)
+			error = dpm_resume_add_np_dep(node, args.np);
+
+	for (i = 0; !error && i < ARRAY_SIZE(dpm_resume_phandle_single); i++) {
+		sup = of_parse_phandle(np, dpm_resume_phandle_single[i], 0);
+		if (sup)
+			error = dpm_resume_add_np_dep(node, sup);
+	}
+
+	for_each_property_of_node(np, prop) {
+		const char *suffix = strrchr(prop->name, '-');
+
+		if (error)
+			break;
+
+		if (suffix && !strcmp(suffix, "-supply")) {
+			sup = of_parse_phandle(np, prop->name, 0);
+			if (sup)
+				error = dpm_resume_add_np_dep(node, sup);
+		} else if (suffix && !strcmp(suffix, "-gpios")) {
+			for (j = 0; !error && !of_parse_phandle_with_args(np,
+					prop->name, "#gpio-cells", j, &args);
+			     j++)
+				error = dpm_resume_add_np_dep(node, args.np);
+		} else if (!strncmp(prop->name, "pinctrl-", 8) &&
+			   isdigit(prop->name[8])) {
+			for (j = 0; !error &&
+			     (sup = of_parse_phandle(np, prop->name, j)); j++)
+				error = dpm_resume_add_np_dep(node, sup);
+		}
+	}
+
+	return error;
+}
+
+/*
+ * An Exynos System MMU lists the masters behind it in its own node, so
+ * the edge has to be added from the System MMU's side.
+ */
+static int dpm_resume_find_sysmmu_deps(struct dpm_resume_node *node)
+{
+	struct dpm_resume_node *master;
+	struct device_node *pb_info, *child;
+	struct of_phandle_args args;
+	int error = 0;
+	int j;
+
+	pb_info = of_get_child_by_name(node->dev->of_node, "pb-info");
+	if (!pb_info)
+		return 0;
+
+	for_each_child_of_node(pb_info, child) {
+		for (j = 0; !error && !of_parse_phandle_with_args(child,
+				"master_axi_id_list", "#pb-id-cells", j, &args);
+		     j++) {
+			master = dpm_resume_find_np(args.np);
+			if (master)
+				error = dpm_resume_add_dep(master, node);
+			of_node_put(args.np);
+		}
+		if (error) {
+			of_node_put(child);
+			break;
+		}
+	}
+	of_node_put(pb_info);
+
+	return error;
+}
+
+/*
+ * Check that every device can start: its suppliers must be able to finish
+ * first and a sync device additionally runs only after the sync devices
+ * in front of it, as dpm_resume() handles those one at a time.  Each pass
+ * walks dpm_list order, so edges to earlier devices resolve in the first
+ * pass and only edges pointing forward need more.
+ */
+static bool dpm_resume_graph_acyclic(void)
+{
+	struct dpm_resume_node *node, *end;
+	unsigned int left = dpm_resume_nr_nodes;
+	bool progress = true;
+
+	end = dpm_resume_nodes + dpm_resume_nr_nodes;
+	while (left && progress) {
+		bool sync_done = true;
+
+		progress = false;
+		for (node = dpm_resume_nodes; node < end; node++) {
+			unsigned int i;
+
+			if (!node->resolved && (node->async || sync_done)) {
+				for (i = 0; i < node->nr_deps; i++)
+					if (!dpm_resume_nodes[node->deps[i]].resolved)
+						break;
+				if (i == node->nr_deps) {
+					node->resolved = true;
+					progress = true;
+					left--;
+				}
+			}
+			if (!node->async && !node->resolved)
+				sync_done = false;
+		}
+	}
+
+	return !left;
+}
+
+static void dpm_resume_graph_free(void)
+{
+	struct dpm_resume_node *node;
+
+	for (node = dpm_resume_nodes;
+	     node < dpm_resume_nodes + dpm_resume_nr_nodes; node++) {
+		kfree(node->deps);
+		node->deps = NULL;
+		if (node->dev) {
+			put_device(node->dev);
+			node->dev = NULL;
+		}
+	}
+	hash_init(dpm_resume_dev_hash);
+	hash_init(dpm_resume_np_hash);
+}
+
+static bool is_async_resume(struct device *dev)
+{
+	struct dpm_resume_node *node = dpm_resume_find_dev(dev);
+
+	return node ? node->async : is_async(dev);
+}
+
+static bool dpm_resume_async(struct device *dev)
+{
+	if (pm_trace_is_enabled())
+		return false;
+
+	return (pm_async_enabled && dev->power.async_suspend) ||
+		(pm_async_resume_enabled && dev->of_node);
+}
+
+/**
+ * dpm_resume_graph_build - Set up the dependency graph for dpm_resume().
+ *
+ * Must be called with dpm_list_mtx held.  On allocation failure there is
+ * no graph and dpm_resume() falls back to power.async_suspend only.
+ */
+static void dpm_resume_graph_build(void)
+{
+	struct dpm_resume_node *node, *end;
+	struct device *dev;
+	unsigned int nr = 0;
+	int error = 0;
+
+	mutex_lock(&dpm_resume_report_mtx);
+
+	vfree(dpm_resume_nodes);
+	dpm_resume_nodes = NULL;
+	dpm_resume_nr_nodes = 0;
+	dpm_resume_violations = 0;
+	dpm_resume_in_list_order = false;
+	hash_init(dpm_resume_dev_hash);
+	hash_init(dpm_resume_np_hash);
+
+	list_for_each_entry(dev, &dpm_suspended_list, power.entry)
+		nr++;
+
+	dpm_resume_nodes = vzalloc(nr * sizeof(*node));
+	if (!dpm_resume_nodes)
+		goto out;
+
+	node = dpm_resume_nodes;
+	list_for_each_entry(dev, &dpm_suspended_list, power.entry) {
+		node->dev = get_device(dev);
+		node->seq = node - dpm_resume_nodes;
+		node->async = dpm_resume_async(dev);
+		strlcpy(node->name, dev_name(dev), sizeof(node->name));
+		hash_add(dpm_resume_dev_hash, &node->dev_hnode,
+			 (unsigned long)dev);
+		if (dev->of_node)
+			hash_add(dpm_resume_np_hash, &node->np_hnode,
+				 (unsigned long)dev->of_node);
+		node++;
+	}
+	dpm_resume_nr_nodes = nr;
+	end = dpm_resume_nodes + nr;
+
+	for (node = dpm_resume_nodes; !error && node < end; node++) {
+		error = dpm_resume_find_deps(node);
+		if (!error && node->dev->of_node)
+			error = dpm_resume_find_sysmmu_deps(node);
+	}
+	if (error) {
+		dpm_resume_graph_free();
+		vfree(dpm_resume_nodes);
+		dpm_resume_nodes = NULL;
+		dpm_resume_nr_nodes = 0;
+		goto out;
+	}
+
+	if (!dpm_resume_graph_acyclic()) {
+		pr_warn("PM: circular resume dependencies, resuming in list order\n");
+		dpm_resume_in_list_order = true;
+		for (node = dpm_resume_nodes; node < end; node++)
+			node->async = is_async(node->dev);
+	}
+
+ out:
+	mutex_unlock(&dpm_resume_report_mtx);
+}
+
+/**
+ * dpm_resume_graph_done - Check the resume order and drop the graph.
+ *
+ * Every supplier found for a device must have completed its callbacks
+ * before that device started its own, whether or not the device actually
+ * waited for it.  Violations are logged and counted for
+ * dpm_resume_order_violations().
+ */
+static void dpm_resume_graph_done(ktime_t starttime)
+{
+	struct dpm_resume_node *node, *dep;
+	unsigned int i;
+
+	mutex_lock(&dpm_resume_report_mtx);
+
+	for (node = dpm_resume_nodes;
+	     node < dpm_resume_nodes + dpm_resume_nr_nodes; node++) {
+		for (i = 0; i < node->nr_deps; i++) {
+			dep = &dpm_resume_nodes[node->deps[i]];
+			if (ktime_after(dep->end, node->ready)) {
+				pr_err("PM: %s resumed before %s\n",
+				       node->name, dep->name);
+				dpm_resume_violations++;
+			}
+		}
+	}
+	dpm_resume_graph_free();
+	dpm_resume_starttime = starttime;
+	dpm_resume_endtime = ktime_get();
+
+	mutex_unlock(&dpm_resume_report_mtx);
+}
+
+/**
+ * dpm_resume_order_violations - Number of ordering errors in the last resume.
+ */
+unsigned int dpm_resume_order_violations(void)
+{
+	unsigned int ret;
+
+	mutex_lock(&dpm_resume_report_mtx);
+	ret = dpm_resume_violations;
+	mutex_unlock(&dpm_resume_report_mtx);
+
+	return ret;
+}
+
+static void dpm_resume_wait_deps(struct dpm_resume_node *node)
+{
+	unsigned int i;
+
+	if (dpm_resume_in_list_order)
+		return;
+
+	for (i = 0; i < node->nr_deps; i++) {
+		struct dpm_resume_node *dep = &dpm_resume_nodes[node->deps[i]];
+
+		wait_for_completion(&dep->dev->power.completion);
+	}
+}
+
+static void dpm_resume_mark_end(struct device *dev)
+{
+	struct dpm_resume_node *node = dpm_resume_find_dev(dev);
+
+	if (node)
+		node->end = ktime_get();
+}
+
+static int dpm_resume_report_show(struct seq_file *s, void *unused)
+{
+	struct dpm_resume_node *node;
+	unsigned int nr_async = 0;
+
+	mutex_lock(&dpm_resume_report_mtx);
+
+	for (node = dpm_resume_nodes;
+	     node < dpm_resume_nodes + dpm_resume_nr_nodes; node++)
+		nr_async += node->async;
+
+	seq_printf(s, "total: %lld us, devices: %u, async: %u, order violations: %u\n",
+		   ktime_us_delta(dpm_resume_endtime, dpm_resume_starttime),
+		   dpm_resume_nr_nodes, nr_async, dpm_resume_violations);
+	seq_printf(s, "%5s %5s %5s %10s %10s %10s %6s  %s\n", "seq", "async",
+		   "deps", "start_us", "wait_us", "resume_us", "error",
+		   "device");
+
+	for (node = dpm_resume_nodes;
+	     node < dpm_resume_nodes + dpm_resume_nr_nodes; node++) {
+		/* removed while resuming */
+		if (!ktime_to_ns(node->end))
+			continue;
+		seq_printf(s, "%5u %5d %5u %10lld %10lld %10lld %6d  %s\n",
+			   node->seq, node->async,
+			   node->nr_deps,
+			   ktime_us_delta(node->start, dpm_resume_starttime),
+			   ktime_us_delta(node->ready, node->start),
+			   ktime_us_delta(node->end, node->ready),
+			   node->error, node->name);
+	}
+
+	mutex_unlock(&dpm_resume_report_mtx);
+	return 0;
+}
+
+static int dpm_resume_report_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dpm_resume_report_show, NULL);
+}
+
+static const struct file_operations dpm_resume_report_fops = {
+	.open		= dpm_resume_report_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init dpm_resume_report_init(void)
+{
+	debugfs_create_file("dpm_resume_timing", S_IRUGO, NULL, NULL,
+			    &dpm_resume_report_fops);
+	return 0;
+}
+late_initcall(dpm_resume_report_init);
+
+/**
+ * dpm_resume_one - Wait for a device's dependencies and resume it.
+ * @dev: Device to handle.
+ * @state: PM transition of the system being carried out.
+ * @async: If true, the device is being resumed asynchronously.
+ */
+static int dpm_resume_one(struct device *dev, pm_message_t state, bool async)
+{
+	struct dpm_resume_node *node = dpm_resume_find_dev(dev);
+	int error;
+
+	if (node) {
+		node->start = ktime_get();
+		dpm_resume_wait_deps(node);
+		node->ready = ktime_get();
+	}
+
+	error = device_resume(dev, state, async);
+
+	if (node)
+		node->error = error;
+
+	return error;
+}
+
 /**
  * device_resume - Execute "resume" callbacks for given device.
  * @dev: Device to handle.
@@ -836,6 +1352,7 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 	dpm_watchdog_clear(&wd);
 
  Complete:
+	dpm_resume_mark_end(dev);
 	complete_all(&dev->power.completion);
 
 	TRACE_RESUME(error);
@@ -848,7 +1365,7 @@ static void async_resume(void *data, async_cookie_t cookie)
 	struct device *dev = (struct device *)data;
 	int error;
 
-	error = device_resume(dev, pm_transition, true);
+	error = dpm_resume_one(dev, pm_transition, true);
 	if (error)
 		pm_dev_err(dev, pm_transition, " async", error);
 	put_device(dev);
@@ -901,9 +1418,11 @@ void dpm_resume(pm_message_t state)
 	pm_transition = state;
 	async_error = 0;
 
+	dpm_resume_graph_build();
+
 	list_for_each_entry(dev, &dpm_suspended_list, power.entry) {
 		reinit_completion(&dev->power.completion);
-		if (is_async(dev)) {
+		if (is_async_resume(dev)) {
 			get_device(dev);
 			async_schedule(async_resume, dev);
 		}
@@ -912,12 +1431,12 @@ void dpm_resume(pm_message_t state)
 	while (!list_empty(&dpm_suspended_list)) {
 		dev = to_device(dpm_suspended_list.next);
 		get_device(dev);
-		if (!is_async(dev)) {
+		if (!is_async_resume(dev)) {
 			int error;
 
 			mutex_unlock(&dpm_list_mtx);
 
-			error = device_resume(dev, state, false);
+			error = dpm_resume_one(dev, state, false);
 			if (error) {
 				suspend_stats.failed_resume++;
 				dpm_save_failed_step(SUSPEND_RESUME);
@@ -933,6 +1452,7 @@ void dpm_resume(pm_message_t state)
 	}
 	mutex_unlock(&dpm_list_mtx);
 	async_synchronize_full();
+	dpm_resume_graph_done(starttime);
 	dpm_show_time(starttime, state, NULL);
 
 	cpufreq_resume();
@@ -196,6 +196,7 @@ static int dev_pm_qos_constraints_allocate(struct device *dev)
 
 	c = &qos->resume_latency;
 	plist_head_init(&c->list);
+	spin_lock_init(&c->lock);
 	c->target_value = PM_QOS_RESUME_LATENCY_DEFAULT_VALUE;
 	c->default_value = PM_QOS_RESUME_LATENCY_DEFAULT_VALUE;
 	c->no_constraint_value = PM_QOS_RESUME_LATENCY_DEFAULT_VALUE;
@@ -204,6 +205,7 @@ static int dev_pm_qos_constraints_allocate(struct device *dev)
 
 	c = &qos->latency_tolerance;
 	plist_head_init(&c->list);
+	spin_lock_init(&c->lock);
 	c->target_value = PM_QOS_LATENCY_TOLERANCE_DEFAULT_VALUE;
 	c->default_value = PM_QOS_LATENCY_TOLERANCE_DEFAULT_VALUE;
 	c->no_constraint_value = PM_QOS_LATENCY_TOLERANCE_NO_CONSTRAINT;
@@ -1969,7 +1969,8 @@ static int crypt_ctr(struct dm_target *ti, unsigned int argc, char **argv)
 		}
 
 		cc->crypt_queue = alloc_workqueue("kcryptd",
-						  WQ_CPU_INTENSIVE | WQ_MEM_RECLAIM, 1);
+						  WQ_CPU_INTENSIVE | WQ_MEM_RECLAIM |
+						  WQ_LATENCY_SENSITIVE, 1);
 		if (!cc->crypt_queue) {
 			ti->error = "Couldn't create kcryptd queue";
 			goto bad;
@@ -142,6 +142,16 @@ static unsigned long lowmem_scan(struct shrinker *s, struct shrink_control *sc)
 
 	selected_oom_score_adj = min_score_adj;
 
+	/*
+	 * A victim that already exited may still be handing its memory
+	 * back through the deferred mm teardown.
+	 */
+	if (mm_teardown_busy(NULL) &&
+	    time_before_eq(jiffies, lowmem_deathpending_timeout)) {
+		msleep_interruptible(20);
+		return 0;
+	}
+
 	rcu_read_lock();
 	for_each_process(tsk) {
 		struct task_struct *p;
@@ -40,6 +40,10 @@
 #include <linux/ramfs.h>
 #include <linux/percpu-refcount.h>
 #include <linux/mount.h>
+#include <linux/kthread.h>
+#include <linux/fdtable.h>
+#include <linux/cred.h>
+#include <linux/moduleparam.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -104,6 +108,9 @@ struct kioctx {
 	/* Size of ringbuffer, in units of struct io_event */
 	unsigned		nr_events;
 
+	/* IOCTX_FLAG_*, as passed to io_setup() */
+	unsigned		flags;
+
 	unsigned long		mmap_base;
 	unsigned long		mmap_size;
 
@@ -146,6 +153,25 @@ struct kioctx {
 		spinlock_t	completion_lock;
 	} ____cacheline_aligned_in_smp;
 
+	/*
+	 * Submission ring, see aio_sq_submit().  sq_head and sq_dropped
+	 * are the trusted copies of what userland sees in the ring.
+	 */
+	struct {
+		struct mutex	sq_lock;
+		struct aio_sq_ring __user *sq_ring;
+		unsigned	sq_nr;
+		unsigned	sq_head;
+		unsigned	sq_dropped;
+	} ____cacheline_aligned_in_smp;
+
+	/* Polling thread and the context it submits in */
+	struct task_struct	*sq_thread;
+	wait_queue_head_t	sq_wait;
+	struct mm_struct	*sq_mm;
+	struct files_struct	*sq_files;
+	const struct cred	*sq_creds;
+
 	struct page		*internal_pages[AIO_RING_PAGES];
 	struct file		*aio_ring_file;
 
@@ -158,6 +184,14 @@ unsigned long aio_nr;		/* current system wide number of aio requests */
 unsigned long aio_max_nr = 0x10000; /* system wide maximum number of aio requests */
 /*----end sysctl variables---*/
 
+/* How long the submission ring polling thread spins before it sleeps */
+static unsigned int sq_thread_idle_ms = 1000;
+module_param(sq_thread_idle_ms, uint, 0644);
+
+/* How long io_getevents() spins on an IOCTX_FLAG_IOPOLL context */
+static unsigned int iopoll_us = 100;
+module_param(iopoll_us, uint, 0644);
+
 static struct kmem_cache	*kiocb_cachep;
 static struct kmem_cache	*kioctx_cachep;
 
@@ -389,6 +423,7 @@ static int aio_setup_ring(struct kioctx *ctx)
 	int nr_pages;
 	int i;
 	struct file *file;
+	int ev_pages, sq_pages = 0;
 
 	/* Compensate for the ring buffer's head/tail overlap entry */
 	nr_events += 2;	/* 1 is required, 2 for good luck */
@@ -396,10 +431,21 @@ static int aio_setup_ring(struct kioctx *ctx)
 	size = sizeof(struct aio_ring);
 	size += sizeof(struct io_event) * nr_events;
 
-	nr_pages = PFN_UP(size);
-	if (nr_pages < 0)
+	ev_pages = PFN_UP(size);
+	if (ev_pages < 0)
 		return -EINVAL;
 
+	/*
+	 * The submission ring only has to hold what userland asked for,
+	 * max_reqs is twice that; plus one for the head/tail overlap.
+	 */
+	if (ctx->flags & IOCTX_FLAG_SQRING) {
+		size = sizeof(struct aio_sq_ring);
+		size += sizeof(struct iocb) * (ctx->max_reqs / 2 + 1);
+		sq_pages = PFN_UP(size);
+	}
+	nr_pages = ev_pages + sq_pages;
+
 	file = aio_private_file(ctx, nr_pages);
 	if (IS_ERR(file)) {
 		ctx->aio_ring_file = NULL;
@@ -407,7 +453,7 @@ static int aio_setup_ring(struct kioctx *ctx)
 	}
 
 	ctx->aio_ring_file = file;
-	nr_events = (PAGE_SIZE * nr_pages - sizeof(struct aio_ring))
+	nr_events = (PAGE_SIZE * ev_pages - sizeof(struct aio_ring))
 			/ sizeof(struct io_event);
 
 	ctx->ring_pages = ctx->internal_pages;
@@ -470,6 +516,20 @@ static int aio_setup_ring(struct kioctx *ctx)
 	kunmap_atomic(ring);
 	flush_dcache_page(ctx->ring_pages[0]);
 
+	if (sq_pages) {
+		struct aio_sq_ring *sq;
+
+		ctx->sq_ring = (void __user *)ctx->mmap_base +
+			       ev_pages * PAGE_SIZE;
+		ctx->sq_nr = (PAGE_SIZE * sq_pages - sizeof(struct aio_sq_ring))
+				/ sizeof(struct iocb);
+
+		sq = kmap_atomic(ctx->ring_pages[ev_pages]);
+		sq->nr = ctx->sq_nr;
+		kunmap_atomic(sq);
+		flush_dcache_page(ctx->ring_pages[ev_pages]);
+	}
+
 	return 0;
 }
 
@@ -514,6 +574,48 @@ static int kiocb_cancel(struct kiocb *kiocb)
 	return cancel(kiocb);
 }
 
+static int aio_sq_thread(void *data);
+
+/* aio_sq_setup
+ *	Creates the submission ring polling thread.  It is only woken up once
+ *	the kioctx is fully set up, and stopped by free_ioctx().
+ */
+static int aio_sq_setup(struct kioctx *ctx)
+{
+	struct task_struct *tsk;
+
+	tsk = kthread_create(aio_sq_thread, ctx, "aio_sq/%d",
+			     task_pid_nr(current));
+	if (IS_ERR(tsk))
+		return PTR_ERR(tsk);
+
+	get_task_struct(tsk);
+	ctx->sq_thread = tsk;
+
+	/*
+	 * Only pin mm_count: holding mm_users would keep exit_aio() from
+	 * ever running, the thread takes mm_users while it polls instead.
+	 */
+	atomic_inc(&current->mm->mm_count);
+	ctx->sq_mm = current->mm;
+	ctx->sq_files = get_files_struct(current);
+	ctx->sq_creds = get_current_cred();
+	return 0;
+}
+
+static void aio_sq_free(struct kioctx *ctx)
+{
+	if (!ctx->sq_thread)
+		return;
+
+	kthread_stop(ctx->sq_thread);
+	put_task_struct(ctx->sq_thread);
+	put_cred(ctx->sq_creds);
+	if (ctx->sq_files)
+		put_files_struct(ctx->sq_files);
+	mmdrop(ctx->sq_mm);
+}
+
 /*
  * free_ioctx() should be RCU delayed to synchronize against the RCU
  * protected lookup_ioctx() and also needs process context to call
@@ -526,6 +628,7 @@ static void free_ioctx(struct work_struct *work)
 
 	pr_debug("freeing %p\n", ctx);
 
+	aio_sq_free(ctx);
 	aio_free_ring(ctx);
 	free_percpu(ctx->cpu);
 	percpu_ref_exit(&ctx->reqs);
@@ -646,7 +749,7 @@ static void aio_nr_sub(unsigned nr)
 /* ioctx_alloc
  *	Allocates and initializes an ioctx.  Returns an ERR_PTR if it failed.
  */
-static struct kioctx *ioctx_alloc(unsigned nr_events)
+static struct kioctx *ioctx_alloc(unsigned nr_events, unsigned flags)
 {
 	struct mm_struct *mm = current->mm;
 	struct kioctx *ctx;
@@ -679,6 +782,7 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 		return ERR_PTR(-ENOMEM);
 
 	ctx->max_reqs = nr_events;
+	ctx->flags = flags;
 
 	spin_lock_init(&ctx->ctx_lock);
 	spin_lock_init(&ctx->completion_lock);
@@ -687,6 +791,8 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	 * the ring_lock mutex held until setup is complete. */
 	mutex_lock(&ctx->ring_lock);
 	init_waitqueue_head(&ctx->wait);
+	mutex_init(&ctx->sq_lock);
+	init_waitqueue_head(&ctx->sq_wait);
 
 	INIT_LIST_HEAD(&ctx->active_reqs);
 
@@ -704,6 +810,12 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	if (err < 0)
 		goto err;
 
+	if (flags & IOCTX_FLAG_SQTHREAD) {
+		err = aio_sq_setup(ctx);
+		if (err)
+			goto err_ctx;
+	}
+
 	atomic_set(&ctx->reqs_available, ctx->nr_events - 1);
 	ctx->req_batch = (ctx->nr_events - 1) / (num_possible_cpus() * 4);
 	if (ctx->req_batch < 1)
@@ -730,6 +842,9 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	/* Release the ring_lock mutex now that all setup is complete. */
 	mutex_unlock(&ctx->ring_lock);
 
+	if (ctx->sq_thread)
+		wake_up_process(ctx->sq_thread);
+
 	pr_debug("allocated ioctx %p[%ld]: mm=%p mask=0x%x\n",
 		 ctx, ctx->user_id, mm, ctx->nr_events);
 	return ctx;
@@ -743,6 +858,7 @@ err_ctx:
 	aio_free_ring(ctx);
 err:
 	mutex_unlock(&ctx->ring_lock);
+	aio_sq_free(ctx);
 	free_percpu(ctx->cpu);
 	percpu_ref_exit(&ctx->reqs);
 	percpu_ref_exit(&ctx->users);
@@ -783,6 +899,12 @@ static int kill_ioctx(struct mm_struct *mm, struct kioctx *ctx,
 	 */
 	aio_nr_sub(ctx->max_reqs);
 
+	/* Once ->dead is visible under sq_lock nobody writes to the ring */
+	if (ctx->sq_ring) {
+		mutex_lock(&ctx->sq_lock);
+		mutex_unlock(&ctx->sq_lock);
+	}
+
 	if (ctx->mmap_size)
 		vm_munmap(ctx->mmap_base, ctx->mmap_size);
 
@@ -1224,6 +1346,30 @@ static bool aio_read_events(struct kioctx *ctx, long min_nr, long nr,
 	return ret < 0 || *i >= min_nr;
 }
 
+/*
+ * Spins for up to *@ns waiting for min_nr events, for IOCTX_FLAG_IOPOLL
+ * contexts, before read_events() goes to sleep.  *@ns is set to the time
+ * actually spent.
+ */
+static bool aio_poll_events(struct kioctx *ctx, long min_nr, long nr,
+			    struct io_event __user *event, long *i, s64 *ns)
+{
+	u64 start = local_clock(), now;
+	bool ret;
+
+	do {
+		ret = aio_read_events(ctx, min_nr, nr, event, i);
+		if (ret)
+			break;
+		cpu_relax();
+		now = local_clock();
+	} while (!need_resched() && !signal_pending(current) &&
+		 now - start < *ns);
+
+	*ns = local_clock() - start;
+	return ret;
+}
+
 static long read_events(struct kioctx *ctx, long min_nr, long nr,
 			struct io_event __user *event,
 			struct timespec __user *timeout)
@@ -1240,6 +1386,19 @@ static long read_events(struct kioctx *ctx, long min_nr, long nr,
 		until = timespec_to_ktime(ts);
 	}
 
+	if (ctx->flags & IOCTX_FLAG_IOPOLL) {
+		s64 ns = min_t(s64, (s64)iopoll_us * NSEC_PER_USEC,
+			       ktime_to_ns(until));
+
+		if (ns > 0) {
+			if (aio_poll_events(ctx, min_nr, nr, event, &ret, &ns))
+				return ret;
+			if (until.tv64 != KTIME_MAX)
+				until = ktime_sub_ns(until, min(ns,
+						ktime_to_ns(until)));
+		}
+	}
+
 	/*
 	 * Note that aio_read_events() is being called as the conditional - i.e.
 	 * we're calling it after prepare_to_wait() has set task state to
@@ -1275,13 +1434,24 @@ static long read_events(struct kioctx *ctx, long min_nr, long nr,
  *	resources are available.  May fail with -EFAULT if an invalid
  *	pointer is passed for ctxp.  Will fail with -ENOSYS if not
  *	implemented.
+ *
+ *	IOCTX_FLAG_* flags may be or'ed into nr_events.  IOCTX_FLAG_SQRING
+ *	adds a submission ring to the mapping *ctxp points to,
+ *	IOCTX_FLAG_SQTHREAD has a kernel thread submit from it,
+ *	IOCTX_FLAG_IOPOLL has io_getevents() spin for completions before
+ *	sleeping.  May fail with -EINVAL for inconsistent flags or flags
+ *	from a compat task, and with -EPERM if IOCTX_FLAG_SQTHREAD is asked
+ *	for without CAP_SYS_ADMIN.
  */
 SYSCALL_DEFINE2(io_setup, unsigned, nr_events, aio_context_t __user *, ctxp)
 {
+	unsigned flags = nr_events & IOCTX_FLAG_MASK;
 	struct kioctx *ioctx = NULL;
 	unsigned long ctx;
 	long ret;
 
+	nr_events &= ~IOCTX_FLAG_MASK;
+
 	ret = get_user(ctx, ctxp);
 	if (unlikely(ret))
 		goto out;
@@ -1293,7 +1463,20 @@ SYSCALL_DEFINE2(io_setup, unsigned, nr_events, aio_context_t __user *, ctxp)
 		goto out;
 	}
 
-	ioctx = ioctx_alloc(nr_events);
+	if (flags) {
+		/* the submission ring only takes native iocbs */
+		if (is_compat_task())
+			goto out;
+		if ((flags & IOCTX_FLAG_SQTHREAD) &&
+		    !(flags & IOCTX_FLAG_SQRING))
+			goto out;
+		/* the thread may burn a CPU for sq_thread_idle_ms at a time */
+		ret = -EPERM;
+		if ((flags & IOCTX_FLAG_SQTHREAD) && !capable(CAP_SYS_ADMIN))
+			goto out;
+	}
+
+	ioctx = ioctx_alloc(nr_events, flags);
 	ret = PTR_ERR(ioctx);
 	if (!IS_ERR(ioctx)) {
 		ret = put_user(ioctx->user_id, ctxp);
@@ -1577,6 +1760,191 @@ out_put_req:
 	return ret;
 }
 
+/* aio_sq_submit
+ *	Submits the iocbs queued in the submission ring.  Returns the number
+ *	submitted, or the last error if none was.  Stops early, leaving the
+ *	rest queued, when the event ring is full; any other iocb that fails
+ *	is consumed and counted as dropped.
+ */
+static long aio_sq_submit(struct kioctx *ctx)
+{
+	struct aio_sq_ring __user *sq = ctx->sq_ring;
+	struct blk_plug plug;
+	unsigned tail;
+	long ret = 0;
+	int i = 0;
+
+	mutex_lock(&ctx->sq_lock);
+
+	if (unlikely(atomic_read(&ctx->dead))) {
+		ret = -EINVAL;
+		goto out;
+	}
+	if (unlikely(get_user(tail, &sq->tail))) {
+		ret = -EFAULT;
+		goto out;
+	}
+	if (unlikely(tail >= ctx->sq_nr)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	/* Pairs with the barrier userland has between the iocb and tail */
+	smp_rmb();
+
+	blk_start_plug(&plug);
+	while (ctx->sq_head != tail) {
+		struct iocb __user *user_iocb = &sq->iocbs[ctx->sq_head];
+		struct iocb tmp;
+
+		if (unlikely(copy_from_user(&tmp, user_iocb, sizeof(tmp))))
+			ret = -EFAULT;
+		else
+			ret = io_submit_one(ctx, user_iocb, &tmp, false);
+		if (ret == -EAGAIN)
+			break;
+
+		if (++ctx->sq_head >= ctx->sq_nr)
+			ctx->sq_head = 0;
+		if (ret) {
+			ctx->sq_dropped++;
+			continue;
+		}
+		i++;
+	}
+	blk_finish_plug(&plug);
+
+	if (put_user(ctx->sq_head, &sq->head) ||
+	    put_user(ctx->sq_dropped, &sq->dropped))
+		ret = -EFAULT;
+out:
+	mutex_unlock(&ctx->sq_lock);
+	return i ? i : ret;
+}
+
+static int aio_sq_set_flags(struct kioctx *ctx, unsigned flags)
+{
+	int ret = -EINVAL;
+
+	mutex_lock(&ctx->sq_lock);
+	if (!atomic_read(&ctx->dead))
+		ret = put_user(flags, &ctx->sq_ring->flags);
+	mutex_unlock(&ctx->sq_lock);
+	return ret;
+}
+
+/*
+ * The polling thread only touches the submission ring while it holds both
+ * a ctx->users reference and an mm_users reference, the same as a task in
+ * io_submit() does.
+ */
+static bool aio_sq_enter(struct kioctx *ctx)
+{
+	if (atomic_read(&ctx->dead) || !percpu_ref_tryget_live(&ctx->users))
+		return false;
+
+	if (!atomic_inc_not_zero(&ctx->sq_mm->mm_users)) {
+		percpu_ref_put(&ctx->users);
+		return false;
+	}
+
+	use_mm(ctx->sq_mm);
+	return true;
+}
+
+static void aio_sq_leave(struct kioctx *ctx)
+{
+	unuse_mm(ctx->sq_mm);
+	/*
+	 * Drop the kioctx first: if ours is the last mm_users reference,
+	 * mmput() ends up in exit_aio(), which waits for the kioctx to go.
+	 */
+	percpu_ref_put(&ctx->users);
+	mmput(ctx->sq_mm);
+}
+
+/*
+ * Submits from the ring until it has been empty for sq_thread_idle_ms,
+ * then flags the ring AIO_SQ_NEED_WAKEUP.  Always returns with @wait
+ * queued on ctx->sq_wait.
+ */
+static void aio_sq_poll(struct kioctx *ctx, wait_queue_t *wait)
+{
+	struct aio_sq_ring __user *sq = ctx->sq_ring;
+	unsigned long idle = jiffies + msecs_to_jiffies(sq_thread_idle_ms);
+	unsigned tail;
+	long ret;
+
+	aio_sq_set_flags(ctx, 0);
+
+	while (!kthread_should_stop() && !atomic_read(&ctx->dead)) {
+		ret = aio_sq_submit(ctx);
+		if (ret > 0)
+			idle = jiffies + msecs_to_jiffies(sq_thread_idle_ms);
+
+		if (ret > 0 || time_before(jiffies, idle)) {
+			cond_resched();
+			cpu_relax();
+			continue;
+		}
+
+		prepare_to_wait(&ctx->sq_wait, wait, TASK_INTERRUPTIBLE);
+		if (aio_sq_set_flags(ctx, AIO_SQ_NEED_WAKEUP))
+			return;
+
+		/* Order the flag store against the tail load, userland
+		 * does the reverse. */
+		smp_mb();
+
+		/*
+		 * On errors, typically a full event ring, sleep until
+		 * userland kicks us again.
+		 */
+		if (get_user(tail, &sq->tail) || tail == ctx->sq_head ||
+		    ret < 0)
+			return;
+
+		finish_wait(&ctx->sq_wait, wait);
+		aio_sq_set_flags(ctx, 0);
+	}
+
+	prepare_to_wait(&ctx->sq_wait, wait, TASK_INTERRUPTIBLE);
+}
+
+static int aio_sq_thread(void *data)
+{
+	struct kioctx *ctx = data;
+	struct files_struct *old_files = current->files;
+	const struct cred *old_cred;
+	DEFINE_WAIT(wait);
+
+	/* Look up file descriptors and check permissions as the owner */
+	task_lock(current);
+	current->files = ctx->sq_files;
+	task_unlock(current);
+	old_cred = override_creds(ctx->sq_creds);
+
+	while (!kthread_should_stop()) {
+		if (aio_sq_enter(ctx)) {
+			aio_sq_poll(ctx, &wait);
+			aio_sq_leave(ctx);
+		} else {
+			prepare_to_wait(&ctx->sq_wait, &wait,
+					TASK_INTERRUPTIBLE);
+		}
+
+		if (!kthread_should_stop())
+			schedule();
+		finish_wait(&ctx->sq_wait, &wait);
+	}
+
+	revert_creds(old_cred);
+	task_lock(current);
+	current->files = old_files;
+	task_unlock(current);
+	return 0;
+}
+
 long do_io_submit(aio_context_t ctx_id, long nr,
 		  struct iocb __user *__user *iocbpp, bool compat)
 {
@@ -1600,6 +1968,16 @@ long do_io_submit(aio_context_t ctx_id, long nr,
 		return -EINVAL;
 	}
 
+	/* io_submit(ctx, 0, NULL) kicks the submission ring */
+	if (!nr && ctx->sq_ring) {
+		if (ctx->sq_thread)
+			wake_up(&ctx->sq_wait);
+		else
+			ret = aio_sq_submit(ctx);
+		percpu_ref_put(&ctx->users);
+		return ret;
+	}
+
 	blk_start_plug(&plug);
 
 	/*
@@ -1639,8 +2017,10 @@ long do_io_submit(aio_context_t ctx_id, long nr,
  *	-EFAULT if any of the data structures point to invalid data.  May
  *	fail with -EBADF if the file descriptor specified in the first
  *	iocb is invalid.  May fail with -EAGAIN if insufficient resources
- *	are available to queue any iocbs.  Will return 0 if nr is 0.  Will
- *	fail with -ENOSYS if not implemented.
+ *	are available to queue any iocbs.  Will return 0 if nr is 0, unless
+ *	the context has a submission ring: then the iocbs queued there are
+ *	submitted, or its polling thread is woken up.  Will fail with
+ *	-ENOSYS if not implemented.
  */
 SYSCALL_DEFINE3(io_submit, aio_context_t, ctx_id, long, nr,
 		struct iocb __user * __user *, iocbpp)
@@ -28,6 +28,7 @@
 #include <linux/log2.h>
 #include <linux/cleancache.h>
 #include <linux/aio.h>
+#include <linux/task_io_accounting_ops.h>
 #include <asm/uaccess.h>
 #include "internal.h"
 
@@ -153,14 +154,121 @@ blkdev_get_block(struct inode *inode, sector_t iblock,
 	return 0;
 }
 
+/*
+ * Small synchronous direct I/O is done with a single bio built on the
+ * stack, skipping the struct dio and the block mapping of the generic code.
+ */
+#define DIO_INLINE_BIO_VECS	4
+
+static bool dio_fast_path = true;
+module_param(dio_fast_path, bool, 0644);
+
+static void blkdev_bio_end_io_simple(struct bio *bio, int error)
+{
+	struct task_struct *waiter = bio->bi_private;
+
+	ACCESS_ONCE(bio->bi_private) = NULL;
+	wake_up_process(waiter);
+}
+
+/*
+ * Returns -EAGAIN, with @iter untouched, when the request does not fit in
+ * one bio and the generic code has to deal with it.
+ */
+static ssize_t
+__blkdev_direct_IO_simple(int rw, struct block_device *bdev,
+			  struct iov_iter *iter, loff_t offset)
+{
+	struct bio_vec inline_vecs[DIO_INLINE_BIO_VECS];
+	struct page *pages[DIO_INLINE_BIO_VECS];
+	struct iov_iter orig = *iter;
+	size_t count = iov_iter_count(iter);
+	size_t start, len;
+	ssize_t size, ret;
+	struct bio bio;
+	int i, nr = 0;
+
+	bio_init(&bio);
+	bio.bi_io_vec = inline_vecs;
+	bio.bi_max_vecs = DIO_INLINE_BIO_VECS;
+	bio.bi_bdev = bdev;
+	bio.bi_iter.bi_sector = offset >> 9;
+	bio.bi_private = current;
+	bio.bi_end_io = blkdev_bio_end_io_simple;
+
+	while (iov_iter_count(iter)) {
+		size = iov_iter_get_pages(iter, pages + nr, count,
+					  DIO_INLINE_BIO_VECS - nr, &start);
+		if (size <= 0) {
+			ret = size ? size : -EFAULT;
+			goto out_release;
+		}
+		iov_iter_advance(iter, size);
+
+		i = nr;
+		nr += DIV_ROUND_UP(start + size, PAGE_SIZE);
+		for (; i < nr; i++, start = 0) {
+			len = min_t(size_t, PAGE_SIZE - start, size);
+			if (bio_add_page(&bio, pages[i], len, start) != len) {
+				ret = -EAGAIN;
+				goto out_release;
+			}
+			size -= len;
+		}
+	}
+
+	if (rw == WRITE_ODIRECT)
+		task_io_account_write(count);
+	/* flagged as direct I/O like the generic path, for the DMA mapping */
+	submit_bio(rw | REQ_KERNEL, &bio);
+
+	for (;;) {
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		if (!ACCESS_ONCE(bio.bi_private))
+			break;
+		io_schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+	bio_disassociate_task(&bio);
+
+	ret = test_bit(BIO_UPTODATE, &bio.bi_flags) ? count : -EIO;
+	for (i = 0; i < nr; i++) {
+		if (rw == READ && !PageCompound(pages[i]))
+			set_page_dirty_lock(pages[i]);
+		page_cache_release(pages[i]);
+	}
+	return ret;
+
+out_release:
+	for (i = 0; i < nr; i++)
+		page_cache_release(pages[i]);
+	*iter = orig;
+	return ret == -EFAULT ? ret : -EAGAIN;
+}
+
 static ssize_t
 blkdev_direct_IO(int rw, struct kiocb *iocb, struct iov_iter *iter,
 			loff_t offset)
 {
 	struct file *file = iocb->ki_filp;
 	struct inode *inode = file->f_mapping->host;
+	struct block_device *bdev = I_BDEV(inode);
+	ssize_t ret;
+
+	if (rw & WRITE)
+		rw = WRITE_ODIRECT;
+
+	if (dio_fast_path && is_sync_kiocb(iocb) && iov_iter_count(iter) &&
+	    !((offset | iov_iter_alignment(iter)) &
+	      (bdev_logical_block_size(bdev) - 1)) &&
+	    iov_iter_npages(iter, DIO_INLINE_BIO_VECS + 1) <=
+	    DIO_INLINE_BIO_VECS && !bdev_get_integrity(bdev)) {
+		ret = __blkdev_direct_IO_simple(rw, bdev, iter, offset);
+		if (ret != -EAGAIN)
+			return ret;
+	}
 
-	return __blockdev_direct_IO(rw, iocb, inode, I_BDEV(inode), iter,
+	return __blockdev_direct_IO(rw, iocb, inode, bdev, iter,
 				    offset, blkdev_get_block,
 				    NULL, NULL, 0);
 }
@@ -114,7 +114,11 @@
  *	next extent, adding a extent(a range of blocks) and removing a extent.
  *
  *   --	race on a extent status tree
- *	Extent status tree is protected by inode->i_es_lock.
+ *	Extent status tree is protected by inode->i_es_lock.  Writers also
+ *	bump inode->i_es_seq, so that ext4_es_lookup_extent() can walk the
+ *	tree under RCU without the lock and retry with it if the tree
+ *	changed meanwhile.  Extents are freed to a SLAB_DESTROY_BY_RCU
+ *	cache, so a lockless walker only ever reads extent memory.
  *
  *   --	memory consumption
  *      Fragmented extent tree will make extent status tree cost too much
@@ -155,8 +159,9 @@ static int __ext4_es_shrink(struct ext4_sb_info *sbi, int nr_to_scan,
 int __init ext4_init_es(void)
 {
 	ext4_es_cachep = kmem_cache_create("ext4_extent_status",
-					   sizeof(struct extent_status),
-					   0, (SLAB_RECLAIM_ACCOUNT), NULL);
+					   sizeof(struct extent_status), 0,
+					   (SLAB_RECLAIM_ACCOUNT |
+					    SLAB_DESTROY_BY_RCU), NULL);
 	if (ext4_es_cachep == NULL)
 		return -ENOMEM;
 	return 0;
@@ -174,6 +179,30 @@ void ext4_es_init_tree(struct ext4_es_tree *tree)
 	tree->cache_es = NULL;
 }
 
+/*
+ * Everything that modifies the tree or the extents in it does so inside
+ * a write section of i_es_seq, see ext4_es_lookup_extent().
+ */
+static inline void ext4_es_write_lock(struct ext4_inode_info *ei)
+{
+	write_lock(&ei->i_es_lock);
+	write_seqcount_begin(&ei->i_es_seq);
+}
+
+static inline int ext4_es_write_trylock(struct ext4_inode_info *ei)
+{
+	if (!write_trylock(&ei->i_es_lock))
+		return 0;
+	write_seqcount_begin(&ei->i_es_seq);
+	return 1;
+}
+
+static inline void ext4_es_write_unlock(struct ext4_inode_info *ei)
+{
+	write_seqcount_end(&ei->i_es_seq);
+	write_unlock(&ei->i_es_lock);
+}
+
 #ifdef ES_DEBUG__
 static void ext4_es_print_tree(struct inode *inode)
 {
@@ -685,7 +714,7 @@ int ext4_es_insert_extent(struct inode *inode, ext4_lblk_t lblk,
 
 	ext4_es_insert_extent_check(inode, &newes);
 
-	write_lock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_lock(EXT4_I(inode));
 	err = __es_remove_extent(inode, lblk, end);
 	if (err != 0)
 		goto error;
@@ -698,7 +727,7 @@ retry:
 		err = 0;
 
 error:
-	write_unlock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_unlock(EXT4_I(inode));
 
 	ext4_es_print_tree(inode);
 
@@ -728,18 +757,80 @@ void ext4_es_cache_extent(struct inode *inode, ext4_lblk_t lblk,
 
 	BUG_ON(end < lblk);
 
-	write_lock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_lock(EXT4_I(inode));
 
 	es = __es_tree_search(&EXT4_I(inode)->i_es_tree.root, lblk);
 	if (!es || es->es_lblk > end)
 		__es_insert_extent(inode, &newes);
-	write_unlock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_unlock(EXT4_I(inode));
+}
+
+/*
+ * A red-black tree of 2^32 extents is at most 64 levels deep, a walk
+ * going deeper than that has raced with a rebalance.
+ */
+#define ES_LOOKUP_MAX_DEPTH	64
+
+/*
+ * Look @lblk up without i_es_lock.  The extents and the tree links may
+ * change under us, or even be reused by another tree, so every value read
+ * is only trusted once i_es_seq proves that no writer ran meanwhile.
+ *
+ * Return: 1 on found, 0 on not, -EAGAIN if a writer got in the way
+ */
+static int __es_lookup_extent_rcu(struct ext4_inode_info *ei,
+				  ext4_lblk_t lblk, struct extent_status *es)
+{
+	struct ext4_es_tree *tree = &ei->i_es_tree;
+	struct extent_status *es1;
+	struct rb_node *node;
+	ext4_lblk_t es_lblk, es_len;
+	unsigned int seq, depth = 0;
+	int found = 0;
+
+	seq = raw_seqcount_begin(&ei->i_es_seq);
+
+	es1 = ACCESS_ONCE(tree->cache_es);
+	if (es1 && in_range(lblk, ACCESS_ONCE(es1->es_lblk),
+			    ACCESS_ONCE(es1->es_len))) {
+		found = 1;
+		goto out;
+	}
+
+	node = ACCESS_ONCE(tree->root.rb_node);
+	while (node) {
+		if (++depth > ES_LOOKUP_MAX_DEPTH)
+			return -EAGAIN;
+		es1 = rb_entry(node, struct extent_status, rb_node);
+		es_lblk = ACCESS_ONCE(es1->es_lblk);
+		es_len = ACCESS_ONCE(es1->es_len);
+		if (lblk < es_lblk)
+			node = ACCESS_ONCE(node->rb_left);
+		else if (lblk - es_lblk >= es_len)
+			node = ACCESS_ONCE(node->rb_right);
+		else {
+			found = 1;
+			break;
+		}
+	}
+
+out:
+	if (found) {
+		es->es_lblk = es1->es_lblk;
+		es->es_len = es1->es_len;
+		es->es_pblk = es1->es_pblk;
+	}
+	if (read_seqcount_retry(&ei->i_es_seq, seq))
+		return -EAGAIN;
+	return found;
 }
 
 /*
  * ext4_es_lookup_extent() looks up an extent in extent status tree.
  *
  * ext4_es_lookup_extent is called by ext4_map_blocks/ext4_da_map_blocks.
+ * The tree is walked under RCU first, and under i_es_lock only when that
+ * raced with a writer.
  *
  * Return: 1 on found, 0 on not
  */
@@ -755,6 +846,22 @@ int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
 	trace_ext4_es_lookup_extent_enter(inode, lblk);
 	es_debug("lookup extent in block %u\n", lblk);
 
+	stats = &EXT4_SB(inode->i_sb)->s_es_stats;
+	es->es_lblk = es->es_len = es->es_pblk = 0;
+
+	rcu_read_lock();
+	found = __es_lookup_extent_rcu(EXT4_I(inode), lblk, es);
+	rcu_read_unlock();
+	if (found >= 0) {
+		if (found)
+			percpu_counter_inc(&stats->es_stats_cache_hits);
+		else
+			percpu_counter_inc(&stats->es_stats_cache_misses);
+		goto out_trace;
+	}
+
+	stats->es_stats_lockless_retries++;
+	found = 0;
 	tree = &EXT4_I(inode)->i_es_tree;
 	read_lock(&EXT4_I(inode)->i_es_lock);
 
@@ -784,19 +891,19 @@ int ext4_es_lookup_extent(struct inode *inode, ext4_lblk_t lblk,
 	}
 
 out:
-	stats = &EXT4_SB(inode->i_sb)->s_es_stats;
 	if (found) {
 		BUG_ON(!es1);
 		es->es_lblk = es1->es_lblk;
 		es->es_len = es1->es_len;
 		es->es_pblk = es1->es_pblk;
-		stats->es_stats_cache_hits++;
+		percpu_counter_inc(&stats->es_stats_cache_hits);
 	} else {
-		stats->es_stats_cache_misses++;
+		percpu_counter_inc(&stats->es_stats_cache_misses);
 	}
 
 	read_unlock(&EXT4_I(inode)->i_es_lock);
 
+out_trace:
 	trace_ext4_es_lookup_extent_exit(inode, es, found);
 	return found;
 }
@@ -922,9 +1029,9 @@ int ext4_es_remove_extent(struct inode *inode, ext4_lblk_t lblk,
 	end = lblk + len - 1;
 	BUG_ON(end < lblk);
 
-	write_lock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_lock(EXT4_I(inode));
 	err = __es_remove_extent(inode, lblk, end);
-	write_unlock(&EXT4_I(inode)->i_es_lock);
+	ext4_es_write_unlock(EXT4_I(inode));
 	ext4_es_print_tree(inode);
 	return err;
 }
@@ -994,13 +1101,13 @@ retry:
 		}
 
 		if (ei->i_es_lru_nr == 0 || ei == locked_ei ||
-		    !write_trylock(&ei->i_es_lock))
+		    !ext4_es_write_trylock(ei))
 			continue;
 
 		shrunk = __es_try_to_reclaim_extents(ei, nr_to_scan);
 		if (ei->i_es_lru_nr == 0)
 			list_del_init(&ei->i_es_lru);
-		write_unlock(&ei->i_es_lock);
+		ext4_es_write_unlock(ei);
 
 		nr_shrunk += shrunk;
 		nr_to_scan -= shrunk;
@@ -1123,9 +1230,11 @@ static int ext4_es_seq_shrinker_info_show(struct seq_file *seq, void *v)
 	seq_printf(seq, "stats:\n  %lld objects\n  %lld reclaimable objects\n",
 		   percpu_counter_sum_positive(&es_stats->es_stats_all_cnt),
 		   percpu_counter_sum_positive(&es_stats->es_stats_lru_cnt));
-	seq_printf(seq, "  %lu/%lu cache hits/misses\n",
-		   es_stats->es_stats_cache_hits,
-		   es_stats->es_stats_cache_misses);
+	seq_printf(seq, "  %lld/%lld cache hits/misses\n",
+		   percpu_counter_sum_positive(&es_stats->es_stats_cache_hits),
+		   percpu_counter_sum_positive(&es_stats->es_stats_cache_misses));
+	seq_printf(seq, "  %lu lockless lookup retries\n",
+		   es_stats->es_stats_lockless_retries);
 	if (es_stats->es_stats_last_sorted != 0)
 		seq_printf(seq, "  %u ms last sorted interval\n",
 			   jiffies_to_msecs(jiffies -
@@ -1193,8 +1302,7 @@ int ext4_es_register_shrinker(struct ext4_sb_info *sbi)
 	spin_lock_init(&sbi->s_es_lru_lock);
 	sbi->s_es_stats.es_stats_last_sorted = 0;
 	sbi->s_es_stats.es_stats_shrunk = 0;
-	sbi->s_es_stats.es_stats_cache_hits = 0;
-	sbi->s_es_stats.es_stats_cache_misses = 0;
+	sbi->s_es_stats.es_stats_lockless_retries = 0;
 	sbi->s_es_stats.es_stats_scan_time = 0;
 	sbi->s_es_stats.es_stats_max_scan_time = 0;
 	err = percpu_counter_init(&sbi->s_es_stats.es_stats_all_cnt, 0, GFP_KERNEL);
@@ -1203,13 +1311,19 @@ int ext4_es_register_shrinker(struct ext4_sb_info *sbi)
 	err = percpu_counter_init(&sbi->s_es_stats.es_stats_lru_cnt, 0, GFP_KERNEL);
 	if (err)
 		goto err1;
+	err = percpu_counter_init(&sbi->s_es_stats.es_stats_cache_hits, 0, GFP_KERNEL);
+	if (err)
+		goto err2;
+	err = percpu_counter_init(&sbi->s_es_stats.es_stats_cache_misses, 0, GFP_KERNEL);
+	if (err)
+		goto err3;
 
 	sbi->s_es_shrinker.scan_objects = ext4_es_scan;
 	sbi->s_es_shrinker.count_objects = ext4_es_count;
 	sbi->s_es_shrinker.seeks = DEFAULT_SEEKS;
 	err = register_shrinker(&sbi->s_es_shrinker);
 	if (err)
-		goto err2;
+		goto err4;
 
 	if (sbi->s_proc)
 		proc_create_data("es_shrinker_info", S_IRUGO, sbi->s_proc,
@@ -1217,6 +1331,10 @@ int ext4_es_register_shrinker(struct ext4_sb_info *sbi)
 
 	return 0;
 
+err4:
+	percpu_counter_destroy(&sbi->s_es_stats.es_stats_cache_misses);
+err3:
+	percpu_counter_destroy(&sbi->s_es_stats.es_stats_cache_hits);
 err2:
 	percpu_counter_destroy(&sbi->s_es_stats.es_stats_lru_cnt);
 err1:
@@ -1228,6 +1346,8 @@ void ext4_es_unregister_shrinker(struct ext4_sb_info *sbi)
 {
 	if (sbi->s_proc)
 		remove_proc_entry("es_shrinker_info", sbi->s_proc);
+	percpu_counter_destroy(&sbi->s_es_stats.es_stats_cache_hits);
+	percpu_counter_destroy(&sbi->s_es_stats.es_stats_cache_misses);
 	percpu_counter_destroy(&sbi->s_es_stats.es_stats_all_cnt);
 	percpu_counter_destroy(&sbi->s_es_stats.es_stats_lru_cnt);
 	unregister_shrinker(&sbi->s_es_shrinker);
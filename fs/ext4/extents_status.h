@@ -67,10 +67,11 @@ struct ext4_es_tree {
 struct ext4_es_stats {
 	unsigned long es_stats_last_sorted;
 	unsigned long es_stats_shrunk;
-	unsigned long es_stats_cache_hits;
-	unsigned long es_stats_cache_misses;
+	unsigned long es_stats_lockless_retries;
 	u64 es_stats_scan_time;
 	u64 es_stats_max_scan_time;
+	struct percpu_counter es_stats_cache_hits;
+	struct percpu_counter es_stats_cache_misses;
 	struct percpu_counter es_stats_all_cnt;
 	struct percpu_counter es_stats_lru_cnt;
 };
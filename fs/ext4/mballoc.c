@@ -698,23 +698,38 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 
 /*
  * Cache the order of the largest free extent we have available in this block
- * group.
+ * group, and keep the group on the list of that order.  Groups whose buddy
+ * is not initialized yet are left off the lists, so that walking them never
+ * has to initialize one.  Called with the group lock held.
  */
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
-	int i;
-	int bits;
-
-	grp->bb_largest_free_order = -1; /* uninit */
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int i, old = grp->bb_largest_free_order, new = -1;
 
-	bits = sb->s_blocksize_bits + 1;
-	for (i = bits; i >= 0; i--) {
+	for (i = MB_NUM_ORDERS(sb) - 1; i >= 0; i--) {
 		if (grp->bb_counters[i] > 0) {
-			grp->bb_largest_free_order = i;
+			new = i;
 			break;
 		}
 	}
+
+	if (new == old && !list_empty(&grp->bb_largest_free_order_node))
+		return;
+
+	if (old >= 0 && !list_empty(&grp->bb_largest_free_order_node)) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[old]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[old]);
+	}
+	grp->bb_largest_free_order = new;
+	if (new >= 0 && grp->bb_free && !EXT4_MB_GRP_NEED_INIT(grp)) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[new]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[new]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[new]);
+	}
 }
 
 static noinline_for_stack
@@ -775,10 +790,10 @@ void ext4_mb_generate_buddy(struct super_block *sb,
 					   grp->bb_free);
 		set_bit(EXT4_GROUP_INFO_BBITMAP_CORRUPT_BIT, &grp->bb_state);
 	}
-	mb_set_largest_free_order(sb, grp);
-
 	clear_bit(EXT4_GROUP_INFO_NEED_INIT_BIT, &(grp->bb_state));
 
+	mb_set_largest_free_order(sb, grp);
+
 	period = get_cycles() - period;
 	spin_lock(&EXT4_SB(sb)->s_bal_lock);
 	EXT4_SB(sb)->s_mb_buddies_generated++;
@@ -1673,10 +1688,10 @@ static void ext4_mb_use_best_found(struct ext4_allocation_context *ac,
 	get_page(ac->ac_buddy_page);
 	/* store last allocated for subsequent stream allocation */
 	if (ac->ac_flags & EXT4_MB_STREAM_ALLOC) {
-		spin_lock(&sbi->s_md_lock);
-		sbi->s_mb_last_group = ac->ac_f_ex.fe_group;
-		sbi->s_mb_last_start = ac->ac_f_ex.fe_start;
-		spin_unlock(&sbi->s_md_lock);
+		struct ext4_mb_last *last = raw_cpu_ptr(sbi->s_mb_last);
+
+		last->group = ac->ac_f_ex.fe_group;
+		last->start = ac->ac_f_ex.fe_start;
 	}
 }
 
@@ -2094,6 +2109,132 @@ static int ext4_mb_good_group(struct ext4_allocation_context *ac,
 	return 0;
 }
 
+/*
+ * Scan @group for the allocation if it looks good enough for criteria @cr.
+ * Returns an error only if the buddy cannot be loaded.
+ */
+static int ext4_mb_scan_group(struct ext4_allocation_context *ac,
+			      ext4_group_t group, int cr, struct ext4_buddy *e4b)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int err;
+
+	/* This now checks without needing the buddy page */
+	if (!ext4_mb_good_group(ac, group, cr))
+		return 0;
+
+	err = ext4_mb_load_buddy(sb, group, e4b);
+	if (err)
+		return err;
+
+	ext4_lock_group(sb, group);
+
+	/*
+	 * We need to check again after locking the
+	 * block group
+	 */
+	if (!ext4_mb_good_group(ac, group, cr)) {
+		ext4_unlock_group(sb, group);
+		ext4_mb_unload_buddy(e4b);
+		return 0;
+	}
+
+	ac->ac_groups_scanned++;
+	if (cr == 0)
+		ext4_mb_simple_scan_group(ac, e4b);
+	else if (cr == 1 && sbi->s_stripe &&
+			!(ac->ac_g_ex.fe_len % sbi->s_stripe))
+		ext4_mb_scan_aligned(ac, e4b);
+	else
+		ext4_mb_complex_scan_group(ac, e4b);
+
+	ext4_unlock_group(sb, group);
+	ext4_mb_unload_buddy(e4b);
+	return 0;
+}
+
+/*
+ * Pick a group from the list of @order which looks good for criteria @cr.
+ * A group whose lock is held is most likely being allocated from by
+ * someone else, so prefer an idle one to spread concurrent allocators
+ * out.  The list is only read here, groups move between lists when their
+ * largest free order changes.
+ */
+static struct ext4_group_info *
+ext4_mb_index_next_group(struct ext4_allocation_context *ac, int order, int cr)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	struct list_head *head = &sbi->s_mb_largest_free_orders[order];
+	rwlock_t *lock = &sbi->s_mb_largest_free_orders_locks[order];
+	struct ext4_group_info *grp, *found = NULL, *busy = NULL;
+	ext4_group_t ngroups;
+	int nr_busy = 0;
+
+	if (list_empty(head))
+		return NULL;
+
+	ngroups = ext4_get_groups_count(ac->ac_sb);
+	if (!(ext4_test_inode_flag(ac->ac_inode, EXT4_INODE_EXTENTS)))
+		ngroups = sbi->s_blockfile_groups;
+
+	read_lock(lock);
+	list_for_each_entry(grp, head, bb_largest_free_order_node) {
+		/*
+		 * ext4_mb_good_group() initializes groups that need it, which
+		 * sleeps.  Indexed groups never do, but don't rely on it under
+		 * the list lock.
+		 */
+		if (grp->bb_group >= ngroups ||
+		    unlikely(EXT4_MB_GRP_NEED_INIT(grp)) ||
+		    !ext4_mb_good_group(ac, grp->bb_group, cr))
+			continue;
+		if (!spin_is_locked(ext4_group_lock_ptr(ac->ac_sb,
+							grp->bb_group))) {
+			found = grp;
+			break;
+		}
+		if (!busy)
+			busy = grp;
+		if (++nr_busy >= MB_INDEX_MAX_BUSY)
+			break;
+	}
+	read_unlock(lock);
+
+	return found ?: busy;
+}
+
+/*
+ * Try the groups whose largest free extent covers the request, smallest
+ * sufficient order first.  Used once the groups around the goal turned
+ * out to be too fragmented, before scanning the rest of the groups in
+ * order.
+ */
+static int ext4_mb_scan_index(struct ext4_allocation_context *ac, int cr,
+			      struct ext4_buddy *e4b)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_group_info *grp;
+	int order, err;
+
+	order = cr == 0 ? ac->ac_2order : fls(ac->ac_g_ex.fe_len - 1);
+	for (; order < MB_NUM_ORDERS(sb); order++) {
+		grp = ext4_mb_index_next_group(ac, order, cr);
+		if (!grp)
+			continue;
+
+		err = ext4_mb_scan_group(ac, grp->bb_group, cr, e4b);
+		if (err)
+			return err;
+		if (ac->ac_status != AC_STATUS_CONTINUE) {
+			if (EXT4_SB(sb)->s_mb_stats)
+				atomic_inc(&EXT4_SB(sb)->s_bal_index_hits);
+			break;
+		}
+	}
+	return 0;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
@@ -2143,13 +2284,19 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 			ac->ac_2order = i - 1;
 	}
 
-	/* if stream allocation is enabled, use global goal */
+	/*
+	 * if stream allocation is enabled, use the goal of this CPU, so
+	 * that parallel streams do not all fight for the same group
+	 */
 	if (ac->ac_flags & EXT4_MB_STREAM_ALLOC) {
-		/* TBD: may be hot point */
-		spin_lock(&sbi->s_md_lock);
-		ac->ac_g_ex.fe_group = sbi->s_mb_last_group;
-		ac->ac_g_ex.fe_start = sbi->s_mb_last_start;
-		spin_unlock(&sbi->s_md_lock);
+		struct ext4_mb_last *last = raw_cpu_ptr(sbi->s_mb_last);
+
+		ac->ac_g_ex.fe_group = last->group;
+		ac->ac_g_ex.fe_start = last->start;
+		if (ac->ac_g_ex.fe_group >= ngroups) {
+			ac->ac_g_ex.fe_group = 0;
+			ac->ac_g_ex.fe_start = 0;
+		}
 	}
 
 	/* Let's just scan groups to find more-less suitable blocks */
@@ -2161,6 +2308,7 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 repeat:
 	for (; cr < 4 && ac->ac_status == AC_STATUS_CONTINUE; cr++) {
 		ac->ac_criteria = cr;
+
 		/*
 		 * searching for the right group start
 		 * from the goal value specified
@@ -2176,37 +2324,25 @@ repeat:
 			if (group >= ngroups)
 				group = 0;
 
-			/* This now checks without needing the buddy page */
-			if (!ext4_mb_good_group(ac, group, cr))
-				continue;
-
-			err = ext4_mb_load_buddy(sb, group, &e4b);
-			if (err)
-				goto out;
-
-			ext4_lock_group(sb, group);
-
 			/*
-			 * We need to check again after locking the
-			 * block group
+			 * Nothing near the goal, ask the index before
+			 * walking the remaining groups.  Groups whose buddy
+			 * was never loaded are not indexed yet, the scan
+			 * goes on to initialize them.
 			 */
-			if (!ext4_mb_good_group(ac, group, cr)) {
-				ext4_unlock_group(sb, group);
-				ext4_mb_unload_buddy(&e4b);
-				continue;
+			if (i == MB_GOAL_WINDOW && cr < 2 &&
+			    sbi->s_mb_optimize_scan &&
+			    !(ac->ac_flags & EXT4_MB_HINT_FIRST)) {
+				err = ext4_mb_scan_index(ac, cr, &e4b);
+				if (err)
+					goto out;
+				if (ac->ac_status != AC_STATUS_CONTINUE)
+					break;
 			}
 
-			ac->ac_groups_scanned++;
-			if (cr == 0)
-				ext4_mb_simple_scan_group(ac, &e4b);
-			else if (cr == 1 && sbi->s_stripe &&
-					!(ac->ac_g_ex.fe_len % sbi->s_stripe))
-				ext4_mb_scan_aligned(ac, &e4b);
-			else
-				ext4_mb_complex_scan_group(ac, &e4b);
-
-			ext4_unlock_group(sb, group);
-			ext4_mb_unload_buddy(&e4b);
+			err = ext4_mb_scan_group(ac, group, cr, &e4b);
+			if (err)
+				goto out;
 
 			if (ac->ac_status != AC_STATUS_CONTINUE)
 				break;
@@ -2348,6 +2484,41 @@ static const struct file_operations ext4_mb_seq_groups_fops = {
 	.release	= seq_release,
 };
 
+static int ext4_mb_seq_latency_show(struct seq_file *seq, void *v)
+{
+	struct super_block *sb = seq->private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	unsigned long sum;
+	int i, cpu;
+
+	seq_puts(seq, "#    <us   calls\n");
+	for (i = 0; i < EXT4_MB_LAT_BUCKETS; i++) {
+		sum = 0;
+		for_each_possible_cpu(cpu)
+			sum += per_cpu_ptr(sbi->s_mb_latency, cpu)->bucket[i];
+		if (i == EXT4_MB_LAT_BUCKETS - 1)
+			seq_printf(seq, "%8s %7lu\n", "inf", sum);
+		else
+			seq_printf(seq, "%8lu %7lu\n", 1UL << i, sum);
+	}
+	seq_printf(seq, "index hits: %u\n",
+		   atomic_read(&sbi->s_bal_index_hits));
+	return 0;
+}
+
+static int ext4_mb_seq_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ext4_mb_seq_latency_show, PDE_DATA(inode));
+}
+
+static const struct file_operations ext4_mb_seq_latency_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ext4_mb_seq_latency_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static struct kmem_cache *get_groupinfo_cache(int blocksize_bits)
 {
 	int cache_index = blocksize_bits - EXT4_MIN_BLOCK_LOG_SIZE;
@@ -2447,6 +2618,8 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_group = group;
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
 
 #ifdef DOUBLE_CHECK
 	{
@@ -2620,11 +2793,29 @@ int ext4_mb_init(struct super_block *sb)
 	spin_lock_init(&sbi->s_md_lock);
 	spin_lock_init(&sbi->s_bal_lock);
 
+	i = MB_NUM_ORDERS(sb) * sizeof(struct list_head);
+	sbi->s_mb_largest_free_orders = kmalloc(i, GFP_KERNEL);
+	if (sbi->s_mb_largest_free_orders == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	i = MB_NUM_ORDERS(sb) * sizeof(rwlock_t);
+	sbi->s_mb_largest_free_orders_locks = kmalloc(i, GFP_KERNEL);
+	if (sbi->s_mb_largest_free_orders_locks == NULL) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+
 	sbi->s_mb_max_to_scan = MB_DEFAULT_MAX_TO_SCAN;
 	sbi->s_mb_min_to_scan = MB_DEFAULT_MIN_TO_SCAN;
 	sbi->s_mb_stats = MB_DEFAULT_STATS;
 	sbi->s_mb_stream_request = MB_DEFAULT_STREAM_THRESHOLD;
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
+	sbi->s_mb_optimize_scan = MB_DEFAULT_OPTIMIZE_SCAN;
 	/*
 	 * The default group preallocation is 512, which for 4k block
 	 * sizes translates to 2 megabytes.  However for bigalloc file
@@ -2666,21 +2857,56 @@ int ext4_mb_init(struct super_block *sb)
 		spin_lock_init(&lg->lg_prealloc_lock);
 	}
 
+	/*
+	 * Spread the stream goals of the CPUs over the filesystem, so
+	 * that parallel streaming writers start in different groups.
+	 */
+	sbi->s_mb_last = alloc_percpu(struct ext4_mb_last);
+	if (sbi->s_mb_last == NULL) {
+		ret = -ENOMEM;
+		goto out_free_locality_groups;
+	}
+	for_each_possible_cpu(i) {
+		struct ext4_mb_last *last = per_cpu_ptr(sbi->s_mb_last, i);
+
+		last->group = (u64)i * ext4_get_groups_count(sb) / nr_cpu_ids;
+		last->start = 0;
+	}
+
+	sbi->s_mb_latency = alloc_percpu(struct ext4_mb_latency);
+	if (sbi->s_mb_latency == NULL) {
+		ret = -ENOMEM;
+		goto out_free_last;
+	}
+
 	/* init file for buddy data */
 	ret = ext4_mb_init_backend(sb);
 	if (ret != 0)
-		goto out_free_locality_groups;
+		goto out_free_latency;
 
-	if (sbi->s_proc)
+	if (sbi->s_proc) {
 		proc_create_data("mb_groups", S_IRUGO, sbi->s_proc,
 				 &ext4_mb_seq_groups_fops, sb);
+		proc_create_data("mb_alloc_latency", S_IRUGO, sbi->s_proc,
+				 &ext4_mb_seq_latency_fops, sb);
+	}
 
 	return 0;
 
+out_free_latency:
+	free_percpu(sbi->s_mb_latency);
+	sbi->s_mb_latency = NULL;
+out_free_last:
+	free_percpu(sbi->s_mb_last);
+	sbi->s_mb_last = NULL;
 out_free_locality_groups:
 	free_percpu(sbi->s_locality_groups);
 	sbi->s_locality_groups = NULL;
 out:
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = NULL;
 	kfree(sbi->s_mb_offsets);
 	sbi->s_mb_offsets = NULL;
 	kfree(sbi->s_mb_maxs);
@@ -2715,8 +2941,10 @@ int ext4_mb_release(struct super_block *sb)
 	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	struct kmem_cache *cachep = get_groupinfo_cache(sb->s_blocksize_bits);
 
-	if (sbi->s_proc)
+	if (sbi->s_proc) {
+		remove_proc_entry("mb_alloc_latency", sbi->s_proc);
 		remove_proc_entry("mb_groups", sbi->s_proc);
+	}
 
 	if (sbi->s_group_info) {
 		for (i = 0; i < ngroups; i++) {
@@ -2738,6 +2966,8 @@ int ext4_mb_release(struct super_block *sb)
 	}
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
 	if (sbi->s_buddy_cache)
 		iput(sbi->s_buddy_cache);
 	if (sbi->s_mb_stats) {
@@ -2748,10 +2978,11 @@ int ext4_mb_release(struct super_block *sb)
 				atomic_read(&sbi->s_bal_success));
 		ext4_msg(sb, KERN_INFO,
 		      "mballoc: %u extents scanned, %u goal hits, "
-				"%u 2^N hits, %u breaks, %u lost",
+				"%u 2^N hits, %u index hits, %u breaks, %u lost",
 				atomic_read(&sbi->s_bal_ex_scanned),
 				atomic_read(&sbi->s_bal_goals),
 				atomic_read(&sbi->s_bal_2orders),
+				atomic_read(&sbi->s_bal_index_hits),
 				atomic_read(&sbi->s_bal_breaks),
 				atomic_read(&sbi->s_mb_lost_chunks));
 		ext4_msg(sb, KERN_INFO,
@@ -2764,6 +2995,8 @@ int ext4_mb_release(struct super_block *sb)
 				atomic_read(&sbi->s_mb_discarded));
 	}
 
+	free_percpu(sbi->s_mb_latency);
+	free_percpu(sbi->s_mb_last);
 	free_percpu(sbi->s_locality_groups);
 
 	return 0;
@@ -4426,6 +4659,8 @@ ext4_fsblk_t ext4_mb_new_blocks(handle_t *handle,
 	ext4_fsblk_t block = 0;
 	unsigned int inquota = 0;
 	unsigned int reserv_clstrs = 0;
+	u64 start = local_clock();
+	int bucket;
 
 	might_sleep();
 	sb = ar->inode->i_sb;
@@ -4554,6 +4789,10 @@ out:
 						reserv_clstrs);
 	}
 
+	bucket = fls64(div_u64(local_clock() - start, NSEC_PER_USEC));
+	this_cpu_inc(sbi->s_mb_latency->bucket[min(bucket,
+						   EXT4_MB_LAT_BUCKETS - 1)]);
+
 	trace_ext4_allocate_blocks(ar, (unsigned long long)block);
 
 	return block;
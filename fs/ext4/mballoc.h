@@ -89,6 +89,37 @@ extern ushort ext4_mballoc_debug;
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * look for groups with a large enough free extent in the per-order
+ * group lists before scanning the groups one after the other
+ */
+#define MB_DEFAULT_OPTIMIZE_SCAN	1
+
+/*
+ * number of groups from the goal on which are scanned in order before
+ * the per-order group lists are consulted, to keep allocations local
+ */
+#define MB_GOAL_WINDOW			4
+
+/* busy groups skipped in a per-order list before taking a busy one */
+#define MB_INDEX_MAX_BUSY		8
+
+/* number of buddy orders, order 0 being the block bitmap */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
+/* goal of the next stream allocation on a CPU */
+struct ext4_mb_last {
+	ext4_group_t		group;
+	ext4_grpblk_t		start;
+};
+
+/* ext4_mb_new_blocks() latency, bucket i counts calls below 2^i us */
+#define EXT4_MB_LAT_BUCKETS		16
+
+struct ext4_mb_latency {
+	unsigned long		bucket[EXT4_MB_LAT_BUCKETS];
+};
+
 
 struct ext4_free_data {
 	/* MUST be the first member */
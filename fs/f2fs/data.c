@@ -779,6 +779,7 @@ int do_write_data_page(struct page *page, struct f2fs_io_info *fio)
 		return err;
 
 	old_blkaddr = dn.data_blkaddr;
+	fio->old_blkaddr = old_blkaddr;
 
 	/* This page is already truncated */
 	if (old_blkaddr == NULL_ADDR)
@@ -805,6 +806,42 @@ out_writepage:
 	return err;
 }
 
+/*
+ * Undo the out-of-place write of an atomic page by do_write_data_page(),
+ * pointing its dnode back to @old_blkaddr.  Called under f2fs_lock_op()
+ * taken before the write, so no checkpoint could free @old_blkaddr.
+ */
+int revoke_data_page(struct page *page, block_t old_blkaddr)
+{
+	struct inode *inode = page->mapping->host;
+	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
+	block_t new_blkaddr;
+	struct dnode_of_data dn;
+	int err;
+
+	set_new_dnode(&dn, inode, NULL, NULL, 0);
+	err = get_dnode_of_data(&dn, page->index, LOOKUP_NODE);
+	if (err)
+		return err;
+
+	new_blkaddr = dn.data_blkaddr;
+	if (new_blkaddr == old_blkaddr || new_blkaddr == NULL_ADDR)
+		goto out;
+
+	if (old_blkaddr == NEW_ADDR) {
+		/* drop the new block from the extent cache first */
+		update_extent_cache(NULL_ADDR, &dn);
+		__set_data_blkaddr(&dn, NEW_ADDR);
+		invalidate_blocks(sbi, new_blkaddr);
+	} else {
+		update_extent_cache(old_blkaddr, &dn);
+		revoke_data_block(sbi, old_blkaddr, new_blkaddr);
+	}
+out:
+	f2fs_put_dnode(&dn);
+	return 0;
+}
+
 static int f2fs_write_data_page(struct page *page,
 					struct writeback_control *wbc)
 {
@@ -1050,10 +1087,12 @@ static int f2fs_write_end(struct file *file,
 
 	trace_f2fs_write_end(inode, pos, len, copied);
 
-	if (f2fs_is_atomic_file(inode) || f2fs_is_volatile_file(inode))
-		register_inmem_page(inode, page);
-	else
+	if (f2fs_is_atomic_file(inode) || f2fs_is_volatile_file(inode)) {
+		if (!IS_ATOMIC_WRITTEN_PAGE(page))
+			register_inmem_page(inode, page);
+	} else {
 		set_page_dirty(page);
+	}
 
 	if (pos + copied > i_size_read(inode)) {
 		i_size_write(inode, pos + copied);
@@ -1119,11 +1158,18 @@ static void f2fs_invalidate_data_page(struct page *page, unsigned int offset,
 
 	if (PageDirty(page))
 		inode_dec_dirty_pages(inode);
+
+	/* truncated while staged: commit_inmem_pages() will skip it */
+	set_page_private(page, 0);
 	ClearPagePrivate(page);
 }
 
 static int f2fs_release_data_page(struct page *page, gfp_t wait)
 {
+	/* staged pages are released by commit_inmem_pages() only */
+	if (IS_ATOMIC_WRITTEN_PAGE(page))
+		return 0;
+
 	ClearPagePrivate(page);
 	return 1;
 }
@@ -39,6 +39,7 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 	si->ndirty_dent = get_pages(sbi, F2FS_DIRTY_DENTS);
 	si->ndirty_dirs = sbi->n_dirty_dirs;
 	si->ndirty_meta = get_pages(sbi, F2FS_DIRTY_META);
+	si->inmem_pages = get_pages(sbi, F2FS_INMEM_PAGES);
 	si->total_count = (int)sbi->user_block_count / sbi->blocks_per_seg;
 	si->rsvd_segs = reserved_segments(sbi);
 	si->overp_segs = overprovision_segments(sbi);
@@ -77,6 +78,16 @@ static void update_general_status(struct f2fs_sb_info *sbi)
 		si->segment_count[i] = sbi->segment_count[i];
 		si->block_count[i] = sbi->block_count[i];
 	}
+
+	si->discard_ranges = SM_I(sbi)->nr_pending_ranges;
+	si->discard_pending = SM_I(sbi)->nr_pending_blocks;
+	si->discard_cmds = SM_I(sbi)->discard_cmds;
+	si->discard_blocks = SM_I(sbi)->discard_blocks;
+	si->discard_time = SM_I(sbi)->discard_time;
+	si->discard_merged = SM_I(sbi)->discard_merged;
+	si->discard_small = SM_I(sbi)->discard_small;
+	si->discard_reused = SM_I(sbi)->discard_reused;
+	si->discard_waits = SM_I(sbi)->discard_waits;
 }
 
 /*
@@ -169,6 +180,8 @@ get_cache:
 	si->cache_mem += npages << PAGE_CACHE_SHIFT;
 	si->cache_mem += sbi->n_orphans * sizeof(struct ino_entry);
 	si->cache_mem += sbi->n_dirty_dirs * sizeof(struct dir_inode_entry);
+	si->cache_mem += SM_I(sbi)->nr_pending_ranges *
+					sizeof(struct discard_range);
 }
 
 static int stat_show(struct seq_file *s, void *v)
@@ -250,6 +263,7 @@ static int stat_show(struct seq_file *s, void *v)
 			   si->ndirty_dent, si->ndirty_dirs);
 		seq_printf(s, "  - meta: %4d in %4d\n",
 			   si->ndirty_meta, si->meta_pages);
+		seq_printf(s, "  - atomic: %4d\n", si->inmem_pages);
 		seq_printf(s, "  - NATs: %9d\n  - SITs: %9d\n",
 			   si->nats, si->sits);
 		seq_printf(s, "  - free_nids: %9d\n",
@@ -273,6 +287,16 @@ static int stat_show(struct seq_file *s, void *v)
 			   si->block_count[SSR], si->segment_count[SSR]);
 		seq_printf(s, "LFS: %u blocks in %u segments\n",
 			   si->block_count[LFS], si->segment_count[LFS]);
+		seq_printf(s, "\nDiscard: %llu blocks in %llu cmds (avg. %llu us)\n",
+			   si->discard_blocks, si->discard_cmds,
+			   si->discard_cmds ?
+			   div64_u64(si->discard_time, si->discard_cmds) : 0);
+		seq_printf(s, "  - pending: %u blocks in %u ranges\n",
+			   si->discard_pending, si->discard_ranges);
+		seq_printf(s, "  - merged: %llu, small: %llu blocks\n",
+			   si->discard_merged, si->discard_small);
+		seq_printf(s, "  - reused: %llu blocks, waits: %llu\n",
+			   si->discard_reused, si->discard_waits);
 
 		/* segment usage info */
 		update_sit_info(si->sbi);
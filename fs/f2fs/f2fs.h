@@ -199,6 +199,7 @@ static inline bool __has_cursum_space(struct f2fs_summary_block *sum, int size,
 #define F2FS_IOC_START_ATOMIC_WRITE	_IO(F2FS_IOCTL_MAGIC, 1)
 #define F2FS_IOC_COMMIT_ATOMIC_WRITE	_IO(F2FS_IOCTL_MAGIC, 2)
 #define F2FS_IOC_START_VOLATILE_WRITE	_IO(F2FS_IOCTL_MAGIC, 3)
+#define F2FS_IOC_ABORT_VOLATILE_WRITE	_IO(F2FS_IOCTL_MAGIC, 5)
 
 #if defined(__KERNEL__) && defined(CONFIG_COMPAT)
 /*
@@ -271,6 +272,8 @@ struct f2fs_inode_info {
 
 	struct list_head inmem_pages;	/* inmemory pages managed by f2fs */
 	struct mutex inmem_lock;	/* lock for inmemory pages */
+	loff_t inmem_isize;		/* i_size when atomic write started */
+	struct file *inmem_file;	/* file that started the atomic write */
 };
 
 static inline void get_extent_info(struct extent_info *ext,
@@ -385,6 +388,24 @@ struct flush_cmd_control {
 	struct llist_node *dispatch_list;	/* list for command dispatch */
 };
 
+struct discard_range {
+	struct rb_node rb_node;		/* node in the pending tree */
+	block_t start;			/* first block of the range */
+	block_t len;			/* # of blocks of the range */
+};
+
+struct discard_cmd_control {
+	struct task_struct *f2fs_issue_discard;	/* discard thread */
+	wait_queue_head_t discard_wait_queue;	/* waiting queue for wake-up */
+	wait_queue_head_t discard_done_queue;	/* waiters for issued ranges */
+	spinlock_t lock;			/* protects the fields below */
+	struct rb_root root;			/* pending ranges, merged */
+	unsigned long queued_since;		/* jiffies of the oldest range */
+	block_t issue_start;			/* range being issued */
+	block_t issue_len;
+	int drain;				/* # of waiters for draining */
+};
+
 struct f2fs_sm_info {
 	struct sit_info *sit_info;		/* whole segment information */
 	struct free_segmap_info *free_info;	/* free segment information */
@@ -417,6 +438,21 @@ struct f2fs_sm_info {
 	/* for flush command control */
 	struct flush_cmd_control *cmd_control_info;
 
+	/* for discard command control */
+	struct discard_cmd_control *dcc_info;
+	unsigned int discard_granularity;	/* min. blocks of a discard */
+	unsigned int max_discard_delay;		/* max. ms to wait for idle */
+
+	/* discard statistics, kept across remounts */
+	unsigned int nr_pending_ranges;		/* # of queued ranges */
+	block_t nr_pending_blocks;		/* # of queued blocks */
+	unsigned long long discard_cmds;	/* # of issued commands */
+	unsigned long long discard_blocks;	/* # of issued blocks */
+	unsigned long long discard_merged;	/* # of merged ranges */
+	unsigned long long discard_small;	/* blocks under granularity */
+	unsigned long long discard_reused;	/* blocks dropped for reuse */
+	unsigned long long discard_waits;	/* waits on in-flight reuse */
+	unsigned long long discard_time;	/* total issue time in us */
 };
 
 /*
@@ -433,6 +469,7 @@ enum count_type {
 	F2FS_DIRTY_DENTS,
 	F2FS_DIRTY_NODES,
 	F2FS_DIRTY_META,
+	F2FS_INMEM_PAGES,
 	NR_COUNT_TYPE,
 };
 
@@ -459,6 +496,7 @@ enum page_type {
 struct f2fs_io_info {
 	enum page_type type;	/* contains DATA/NODE/META/META_FLUSH */
 	int rw;			/* contains R/RS/W/WS with REQ_META/REQ_PRIO */
+	block_t old_blkaddr;	/* data block address before the write */
 };
 
 #define is_read_io(rw)	(((rw) & 1) == READ)
@@ -1296,14 +1334,17 @@ void destroy_node_manager_caches(void);
  * segment.c
  */
 void register_inmem_page(struct inode *, struct page *);
-void commit_inmem_pages(struct inode *, bool);
+int commit_inmem_pages(struct inode *, bool);
 void f2fs_balance_fs(struct f2fs_sb_info *);
 void f2fs_balance_fs_bg(struct f2fs_sb_info *);
 int f2fs_issue_flush(struct f2fs_sb_info *);
 int create_flush_cmd_control(struct f2fs_sb_info *);
 void destroy_flush_cmd_control(struct f2fs_sb_info *);
+int create_discard_cmd_control(struct f2fs_sb_info *);
+void destroy_discard_cmd_control(struct f2fs_sb_info *);
 void invalidate_blocks(struct f2fs_sb_info *, block_t);
 void refresh_sit_entry(struct f2fs_sb_info *, block_t, block_t);
+void revoke_data_block(struct f2fs_sb_info *, block_t, block_t);
 void clear_prefree_segments(struct f2fs_sb_info *);
 void release_discard_addrs(struct f2fs_sb_info *);
 void discard_next_dnode(struct f2fs_sb_info *, block_t);
@@ -1373,6 +1414,7 @@ struct page *find_data_page(struct inode *, pgoff_t, bool);
 struct page *get_lock_data_page(struct inode *, pgoff_t);
 struct page *get_new_data_page(struct inode *, struct page *, pgoff_t, bool);
 int do_write_data_page(struct page *, struct f2fs_io_info *);
+int revoke_data_page(struct page *, block_t);
 int f2fs_fiemap(struct inode *inode, struct fiemap_extent_info *, u64, u64);
 
 /*
@@ -1403,6 +1445,7 @@ struct f2fs_stat_info {
 	int main_area_segs, main_area_sections, main_area_zones;
 	int hit_ext, total_ext;
 	int ndirty_node, ndirty_dent, ndirty_dirs, ndirty_meta;
+	int inmem_pages;
 	int nats, sits, fnids;
 	int total_count, utilization;
 	int bg_gc, inline_inode;
@@ -1420,6 +1463,10 @@ struct f2fs_stat_info {
 
 	unsigned int segment_count[2];
 	unsigned int block_count[2];
+	unsigned int discard_ranges, discard_pending;
+	unsigned long long discard_cmds, discard_blocks, discard_time;
+	unsigned long long discard_merged, discard_small;
+	unsigned long long discard_reused, discard_waits;
 	unsigned base_mem, cache_mem;
 };
 
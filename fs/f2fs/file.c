@@ -870,13 +870,41 @@ static int f2fs_ioc_start_atomic_write(struct file *filp)
 	if (!inode_owner_or_capable(inode))
 		return -EACCES;
 
+	if (f2fs_is_atomic_file(inode))
+		return 0;
+
 	f2fs_balance_fs(sbi);
 
+	mutex_lock(&inode->i_mutex);
+	F2FS_I(inode)->inmem_isize = i_size_read(inode);
+	F2FS_I(inode)->inmem_file = filp;
 	set_inode_flag(F2FS_I(inode), FI_ATOMIC_FILE);
+	mutex_unlock(&inode->i_mutex);
 
 	return f2fs_convert_inline_data(inode, MAX_INLINE_DATA + 1, NULL);
 }
 
+/* forget the blocks appended by a failed or aborted atomic write */
+static void truncate_atomic_tail(struct inode *inode)
+{
+	loff_t isize = F2FS_I(inode)->inmem_isize;
+
+	if (i_size_read(inode) > isize) {
+		truncate_setsize(inode, isize);
+		f2fs_truncate(inode);
+	}
+}
+
+/* drop the staged pages of an atomic write, called with i_mutex held */
+static void abort_atomic_write(struct inode *inode, bool truncate)
+{
+	commit_inmem_pages(inode, true);
+	clear_inode_flag(F2FS_I(inode), FI_ATOMIC_FILE);
+	F2FS_I(inode)->inmem_file = NULL;
+	if (truncate)
+		truncate_atomic_tail(inode);
+}
+
 static int f2fs_ioc_commit_atomic_write(struct file *filp)
 {
 	struct inode *inode = file_inode(filp);
@@ -892,10 +920,21 @@ static int f2fs_ioc_commit_atomic_write(struct file *filp)
 	if (ret)
 		return ret;
 
-	if (f2fs_is_atomic_file(inode))
-		commit_inmem_pages(inode, false);
+	/* no write may slip in between the staged pages and the commit */
+	mutex_lock(&inode->i_mutex);
+	if (f2fs_is_atomic_file(inode)) {
+		ret = commit_inmem_pages(inode, false);
+		clear_inode_flag(F2FS_I(inode), FI_ATOMIC_FILE);
+		F2FS_I(inode)->inmem_file = NULL;
+		if (ret) {
+			truncate_atomic_tail(inode);
+			goto out;
+		}
+	}
 
-	ret = f2fs_sync_file(filp, 0, LONG_MAX, 0);
+	ret = f2fs_sync_file(filp, 0, LLONG_MAX, 0);
+out:
+	mutex_unlock(&inode->i_mutex);
 	mnt_drop_write_file(filp);
 	return ret;
 }
@@ -911,6 +950,53 @@ static int f2fs_ioc_start_volatile_write(struct file *filp)
 	return 0;
 }
 
+static int f2fs_ioc_abort_volatile_write(struct file *filp)
+{
+	struct inode *inode = file_inode(filp);
+	int ret;
+
+	if (!inode_owner_or_capable(inode))
+		return -EACCES;
+
+	ret = mnt_want_write_file(filp);
+	if (ret)
+		return ret;
+
+	mutex_lock(&inode->i_mutex);
+	if (f2fs_is_atomic_file(inode)) {
+		abort_atomic_write(inode, true);
+	} else if (f2fs_is_volatile_file(inode)) {
+		commit_inmem_pages(inode, true);
+		clear_inode_flag(F2FS_I(inode), FI_VOLATILE_FILE);
+	}
+	mutex_unlock(&inode->i_mutex);
+
+	mnt_drop_write_file(filp);
+	return ret;
+}
+
+/*
+ * The writer that started an atomic write closed it or died before
+ * committing: roll the transaction back, so that nobody else's writes
+ * end up staged in it.
+ */
+static int f2fs_release_file(struct inode *inode, struct file *filp)
+{
+	bool writable;
+
+	if (F2FS_I(inode)->inmem_file != filp)
+		return 0;
+
+	writable = !mnt_want_write_file(filp);
+	mutex_lock(&inode->i_mutex);
+	if (f2fs_is_atomic_file(inode) && F2FS_I(inode)->inmem_file == filp)
+		abort_atomic_write(inode, writable);
+	mutex_unlock(&inode->i_mutex);
+	if (writable)
+		mnt_drop_write_file(filp);
+	return 0;
+}
+
 static int f2fs_ioc_fitrim(struct file *filp, unsigned long arg)
 {
 	struct inode *inode = file_inode(filp);
@@ -954,6 +1040,8 @@ long f2fs_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 		return f2fs_ioc_commit_atomic_write(filp);
 	case F2FS_IOC_START_VOLATILE_WRITE:
 		return f2fs_ioc_start_volatile_write(filp);
+	case F2FS_IOC_ABORT_VOLATILE_WRITE:
+		return f2fs_ioc_abort_volatile_write(filp);
 	case FITRIM:
 		return f2fs_ioc_fitrim(filp, arg);
 	default:
@@ -971,6 +1059,11 @@ long f2fs_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case F2FS_IOC32_SETFLAGS:
 		cmd = F2FS_IOC_SETFLAGS;
 		break;
+	case F2FS_IOC_START_ATOMIC_WRITE:
+	case F2FS_IOC_COMMIT_ATOMIC_WRITE:
+	case F2FS_IOC_START_VOLATILE_WRITE:
+	case F2FS_IOC_ABORT_VOLATILE_WRITE:
+		break;
 	default:
 		return -ENOIOCTLCMD;
 	}
@@ -985,6 +1078,7 @@ const struct file_operations f2fs_file_operations = {
 	.read_iter	= generic_file_read_iter,
 	.write_iter	= generic_file_write_iter,
 	.open		= generic_file_open,
+	.release	= f2fs_release_file,
 	.mmap		= f2fs_file_mmap,
 	.fsync		= f2fs_sync_file,
 	.fallocate	= f2fs_fallocate,
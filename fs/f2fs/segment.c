@@ -16,6 +16,8 @@
 #include <linux/kthread.h>
 #include <linux/vmalloc.h>
 #include <linux/swap.h>
+#include <linux/freezer.h>
+#include <linux/list_sort.h>
 
 #include "f2fs.h"
 #include "segment.h"
@@ -25,6 +27,7 @@
 #define __reverse_ffz(x) __reverse_ffs(~(x))
 
 static struct kmem_cache *discard_entry_slab;
+static struct kmem_cache *discard_range_slab;
 static struct kmem_cache *sit_entry_set_slab;
 static struct kmem_cache *inmem_entry_slab;
 
@@ -183,16 +186,43 @@ void register_inmem_page(struct inode *inode, struct page *page)
 
 	/* add atomic page indices to the list */
 	new->page = page;
+	new->old_blkaddr = NULL_ADDR;
 	INIT_LIST_HEAD(&new->list);
 
+	/* mark the page so that rewrites do not register it twice */
+	set_page_private(page, (unsigned long)ATOMIC_WRITTEN_PAGE);
+	SetPagePrivate(page);
+
 	/* increase reference count with clean state */
 	mutex_lock(&fi->inmem_lock);
 	get_page(page);
 	list_add_tail(&new->list, &fi->inmem_pages);
+	inc_page_count(F2FS_I_SB(inode), F2FS_INMEM_PAGES);
 	mutex_unlock(&fi->inmem_lock);
 }
 
-void commit_inmem_pages(struct inode *inode, bool abort)
+static int inmem_page_cmp(void *priv, struct list_head *a,
+						struct list_head *b)
+{
+	struct inmem_pages *ia = list_entry(a, struct inmem_pages, list);
+	struct inmem_pages *ib = list_entry(b, struct inmem_pages, list);
+
+	if (ia->page->index < ib->page->index)
+		return -1;
+	return ia->page->index > ib->page->index;
+}
+
+/*
+ * Write out the pages staged by an atomic write, or drop them if @abort.
+ *
+ * The pages are written out of place in file order under one
+ * f2fs_lock_op(), so a checkpoint sees either none or all of them, and
+ * the following fsync persists them with a single node chain.  If a page
+ * fails to be written, the ones already written are pointed back to their
+ * old blocks, and all of them are dropped from the page cache so that
+ * readers see the previous contents again.
+ */
+int commit_inmem_pages(struct inode *inode, bool abort)
 {
 	struct f2fs_sb_info *sbi = F2FS_I_SB(inode);
 	struct f2fs_inode_info *fi = F2FS_I(inode);
@@ -202,30 +232,65 @@ void commit_inmem_pages(struct inode *inode, bool abort)
 		.type = DATA,
 		.rw = WRITE_SYNC,
 	};
+	LIST_HEAD(written);
+	int err = 0;
 
 	f2fs_balance_fs(sbi);
 	f2fs_lock_op(sbi);
 
 	mutex_lock(&fi->inmem_lock);
+	list_sort(NULL, &fi->inmem_pages, inmem_page_cmp);
+
 	list_for_each_entry_safe(cur, tmp, &fi->inmem_pages, list) {
+		if (abort || err)
+			break;
 		lock_page(cur->page);
-		if (!abort && cur->page->mapping == inode->i_mapping) {
+		if (cur->page->mapping == inode->i_mapping) {
 			f2fs_wait_on_page_writeback(cur->page, DATA);
 			if (clear_page_dirty_for_io(cur->page))
 				inode_dec_dirty_pages(inode);
-			do_write_data_page(cur->page, &fio);
-			submit_bio = true;
+			err = do_write_data_page(cur->page, &fio);
+			if (!err) {
+				cur->old_blkaddr = fio.old_blkaddr;
+				list_move_tail(&cur->list, &written);
+				submit_bio = true;
+			}
+		}
+		unlock_page(cur->page);
+	}
+	if (submit_bio)
+		f2fs_submit_merged_bio(sbi, DATA, WRITE);
+
+	if (err) {
+		list_for_each_entry(cur, &written, list) {
+			lock_page(cur->page);
+			f2fs_wait_on_page_writeback(cur->page, DATA);
+			/* the node chain may not be left half committed */
+			if (revoke_data_page(cur->page, cur->old_blkaddr))
+				f2fs_stop_checkpoint(sbi);
+			unlock_page(cur->page);
+		}
+	}
+	list_splice_init(&written, &fi->inmem_pages);
+
+	list_for_each_entry_safe(cur, tmp, &fi->inmem_pages, list) {
+		lock_page(cur->page);
+		if (abort || err)
+			ClearPageUptodate(cur->page);
+		if (IS_ATOMIC_WRITTEN_PAGE(cur->page)) {
+			set_page_private(cur->page, 0);
+			ClearPagePrivate(cur->page);
 		}
 		f2fs_put_page(cur->page, 1);
 		list_del(&cur->list);
 		kmem_cache_free(inmem_entry_slab, cur);
+		dec_page_count(sbi, F2FS_INMEM_PAGES);
 	}
-	if (submit_bio)
-		f2fs_submit_merged_bio(sbi, DATA, WRITE);
 	mutex_unlock(&fi->inmem_lock);
 
 	filemap_fdatawait_range(inode->i_mapping, 0, LLONG_MAX);
 	f2fs_unlock_op(sbi);
+	return err;
 }
 
 /*
@@ -431,6 +496,339 @@ static int f2fs_issue_discard(struct f2fs_sb_info *sbi,
 	return blkdev_issue_discard(sbi->sb->s_bdev, start, len, GFP_NOFS, 0);
 }
 
+/*
+ * Discards are not issued from the checkpoint.  The ranges freed by a
+ * checkpoint are merged into a tree of pending ranges, and a per-device
+ * thread issues them once the device is idle, or after max_discard_delay
+ * at the latest.  Ranges shorter than discard_granularity are dropped.
+ * A segment taken by a current segment first has its pending ranges
+ * removed and waits for an overlapping discard in flight.
+ */
+
+/* first pending range ending at or after @blkaddr */
+static struct discard_range *__lookup_discard_range(
+			struct discard_cmd_control *dcc, block_t blkaddr)
+{
+	struct rb_node *node = dcc->root.rb_node;
+	struct discard_range *dr, *ret = NULL;
+
+	while (node) {
+		dr = rb_entry(node, struct discard_range, rb_node);
+		if (dr->start + dr->len >= blkaddr) {
+			ret = dr;
+			node = node->rb_left;
+		} else {
+			node = node->rb_right;
+		}
+	}
+	return ret;
+}
+
+static struct discard_range *__next_discard_range(struct discard_range *dr)
+{
+	struct rb_node *node = rb_next(&dr->rb_node);
+
+	return node ? rb_entry(node, struct discard_range, rb_node) : NULL;
+}
+
+static void __link_discard_range(struct f2fs_sm_info *sm,
+		struct discard_cmd_control *dcc, struct discard_range *new)
+{
+	struct rb_node **p = &dcc->root.rb_node, *parent = NULL;
+	struct discard_range *dr;
+
+	while (*p) {
+		parent = *p;
+		dr = rb_entry(parent, struct discard_range, rb_node);
+		if (new->start < dr->start)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+	rb_link_node(&new->rb_node, parent, p);
+	rb_insert_color(&new->rb_node, &dcc->root);
+	sm->nr_pending_ranges++;
+	sm->nr_pending_blocks += new->len;
+}
+
+static void __unlink_discard_range(struct f2fs_sm_info *sm,
+		struct discard_cmd_control *dcc, struct discard_range *dr)
+{
+	rb_erase(&dr->rb_node, &dcc->root);
+	sm->nr_pending_ranges--;
+	sm->nr_pending_blocks -= dr->len;
+	kmem_cache_free(discard_range_slab, dr);
+}
+
+static void queue_discard_range(struct f2fs_sb_info *sbi,
+				block_t blkstart, block_t blklen)
+{
+	struct f2fs_sm_info *sm = SM_I(sbi);
+	struct discard_cmd_control *dcc = sm->dcc_info;
+	struct discard_range *new, *dr, *next;
+	block_t end = blkstart + blklen;
+
+	new = f2fs_kmem_cache_alloc(discard_range_slab, GFP_NOFS);
+
+	spin_lock(&dcc->lock);
+	if (RB_EMPTY_ROOT(&dcc->root))
+		dcc->queued_since = jiffies;
+
+	/* absorb every range overlapping or adjacent to the new one */
+	dr = __lookup_discard_range(dcc, blkstart);
+	while (dr && dr->start <= end) {
+		next = __next_discard_range(dr);
+		blkstart = min(blkstart, dr->start);
+		end = max(end, dr->start + dr->len);
+		__unlink_discard_range(sm, dcc, dr);
+		sm->discard_merged++;
+		dr = next;
+	}
+	new->start = blkstart;
+	new->len = end - blkstart;
+	__link_discard_range(sm, dcc, new);
+	spin_unlock(&dcc->lock);
+}
+
+static bool discard_issuing(struct discard_cmd_control *dcc,
+				block_t start, block_t end)
+{
+	return dcc->issue_len && dcc->issue_start < end &&
+				dcc->issue_start + dcc->issue_len > start;
+}
+
+/*
+ * Blocks in [blkstart, blkstart + blklen) are about to be written, so
+ * their discards must not reach the device from now on.
+ */
+static void reclaim_discard_range(struct f2fs_sb_info *sbi,
+				block_t blkstart, block_t blklen)
+{
+	struct f2fs_sm_info *sm = SM_I(sbi);
+	struct discard_cmd_control *dcc = sm->dcc_info;
+	struct discard_range *dr, *next, *split = NULL;
+	block_t end = blkstart + blklen, dr_end;
+
+	if (!dcc)
+		return;
+retry:
+	spin_lock(&dcc->lock);
+	dr = __lookup_discard_range(dcc, blkstart + 1);
+	while (dr && dr->start < end) {
+		next = __next_discard_range(dr);
+		dr_end = dr->start + dr->len;
+
+		if (dr->start < blkstart && dr_end > end) {
+			/* only the first range may cover the whole segment */
+			if (!split) {
+				spin_unlock(&dcc->lock);
+				split = f2fs_kmem_cache_alloc(discard_range_slab,
+								GFP_NOFS);
+				goto retry;
+			}
+			dr->len = blkstart - dr->start;
+			sm->nr_pending_blocks -= dr_end - blkstart;
+			split->start = end;
+			split->len = dr_end - end;
+			__link_discard_range(sm, dcc, split);
+			split = NULL;
+			sm->discard_reused += blklen;
+			break;
+		} else if (dr->start < blkstart) {
+			dr->len = blkstart - dr->start;
+			sm->nr_pending_blocks -= dr_end - blkstart;
+			sm->discard_reused += dr_end - blkstart;
+		} else if (dr_end > end) {
+			sm->nr_pending_blocks -= end - dr->start;
+			sm->discard_reused += end - dr->start;
+			dr->start = end;
+			dr->len = dr_end - end;
+		} else {
+			sm->discard_reused += dr->len;
+			__unlink_discard_range(sm, dcc, dr);
+		}
+		dr = next;
+	}
+
+	if (discard_issuing(dcc, blkstart, end)) {
+		sm->discard_waits++;
+		spin_unlock(&dcc->lock);
+		wait_event(dcc->discard_done_queue,
+				!discard_issuing(dcc, blkstart, end));
+	} else {
+		spin_unlock(&dcc->lock);
+	}
+
+	if (split)
+		kmem_cache_free(discard_range_slab, split);
+}
+
+static bool discard_device_idle(struct f2fs_sb_info *sbi)
+{
+	struct block_device *bdev = sbi->sb->s_bdev;
+
+	return !part_in_flight(&bdev->bd_disk->part0) &&
+				!get_pages(sbi, F2FS_WRITEBACK);
+}
+
+static bool discard_drained(struct discard_cmd_control *dcc)
+{
+	return RB_EMPTY_ROOT(&dcc->root) && !dcc->issue_len;
+}
+
+static int issue_discard_thread(void *data)
+{
+	struct f2fs_sb_info *sbi = data;
+	struct f2fs_sm_info *sm = SM_I(sbi);
+	struct discard_cmd_control *dcc = sm->dcc_info;
+	wait_queue_head_t *q = &dcc->discard_wait_queue;
+	unsigned int max_len = sbi->blocks_per_seg * MAX_DISCARD_SEGMENTS;
+	struct discard_range *dr;
+	block_t start, len;
+	bool idle;
+	ktime_t t;
+
+	set_freezable();
+	do {
+		try_to_freeze();
+
+		spin_lock(&dcc->lock);
+		if (RB_EMPTY_ROOT(&dcc->root)) {
+			spin_unlock(&dcc->lock);
+			wait_event_interruptible(*q, kthread_should_stop() ||
+					!RB_EMPTY_ROOT(&dcc->root) ||
+					freezing(current));
+			continue;
+		}
+
+		idle = discard_device_idle(sbi);
+		if (!idle && !dcc->drain && time_before(jiffies,
+				dcc->queued_since +
+				msecs_to_jiffies(sm->max_discard_delay))) {
+			spin_unlock(&dcc->lock);
+			wait_event_interruptible_timeout(*q,
+					kthread_should_stop() || dcc->drain,
+					msecs_to_jiffies(DEF_DISCARD_POLL_TIME));
+			continue;
+		}
+
+		/* issue in ascending block order */
+		dr = rb_entry(rb_first(&dcc->root), struct discard_range,
+								rb_node);
+		if (!dcc->drain && dr->len < sm->discard_granularity) {
+			sm->discard_small += dr->len;
+			__unlink_discard_range(sm, dcc, dr);
+			spin_unlock(&dcc->lock);
+			wake_up_all(&dcc->discard_done_queue);
+			continue;
+		}
+
+		start = dr->start;
+		len = min_t(block_t, dr->len, max_len);
+		if (len == dr->len) {
+			__unlink_discard_range(sm, dcc, dr);
+		} else {
+			dr->start += len;
+			dr->len -= len;
+			sm->nr_pending_blocks -= len;
+		}
+		dcc->issue_start = start;
+		dcc->issue_len = len;
+		/* under load, issue one command per max_discard_delay */
+		if (!idle)
+			dcc->queued_since = jiffies;
+		spin_unlock(&dcc->lock);
+
+		t = ktime_get();
+		f2fs_issue_discard(sbi, start, len);
+
+		spin_lock(&dcc->lock);
+		dcc->issue_len = 0;
+		sm->discard_cmds++;
+		sm->discard_blocks += len;
+		sm->discard_time += ktime_us_delta(ktime_get(), t);
+		spin_unlock(&dcc->lock);
+		wake_up_all(&dcc->discard_done_queue);
+
+		cond_resched();
+	} while (!kthread_should_stop());
+	return 0;
+}
+
+/* issue every pending range, short ones included, and wait for them */
+static void drain_discard_ranges(struct f2fs_sb_info *sbi)
+{
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
+
+	if (!dcc)
+		return;
+
+	spin_lock(&dcc->lock);
+	dcc->drain++;
+	spin_unlock(&dcc->lock);
+	wake_up(&dcc->discard_wait_queue);
+
+	wait_event(dcc->discard_done_queue, discard_drained(dcc));
+
+	spin_lock(&dcc->lock);
+	dcc->drain--;
+	spin_unlock(&dcc->lock);
+}
+
+int create_discard_cmd_control(struct f2fs_sb_info *sbi)
+{
+	dev_t dev = sbi->sb->s_bdev->bd_dev;
+	struct discard_cmd_control *dcc;
+	int err = 0;
+
+	dcc = kzalloc(sizeof(struct discard_cmd_control), GFP_KERNEL);
+	if (!dcc)
+		return -ENOMEM;
+	init_waitqueue_head(&dcc->discard_wait_queue);
+	init_waitqueue_head(&dcc->discard_done_queue);
+	spin_lock_init(&dcc->lock);
+	dcc->root = RB_ROOT;
+
+	mutex_lock(&sbi->cp_mutex);
+	SM_I(sbi)->dcc_info = dcc;
+	dcc->f2fs_issue_discard = kthread_run(issue_discard_thread, sbi,
+				"f2fs_discard-%u:%u", MAJOR(dev), MINOR(dev));
+	if (IS_ERR(dcc->f2fs_issue_discard)) {
+		err = PTR_ERR(dcc->f2fs_issue_discard);
+		kfree(dcc);
+		SM_I(sbi)->dcc_info = NULL;
+	}
+	mutex_unlock(&sbi->cp_mutex);
+
+	return err;
+}
+
+void destroy_discard_cmd_control(struct f2fs_sb_info *sbi)
+{
+	struct f2fs_sm_info *sm = SM_I(sbi);
+	struct discard_cmd_control *dcc = sm->dcc_info;
+	struct discard_range *dr;
+	struct rb_node *node;
+
+	if (!dcc)
+		return;
+
+	mutex_lock(&sbi->cp_mutex);
+	kthread_stop(dcc->f2fs_issue_discard);
+
+	/* nobody can reuse these blocks before the next mount */
+	while ((node = rb_first(&dcc->root))) {
+		dr = rb_entry(node, struct discard_range, rb_node);
+		f2fs_issue_discard(sbi, dr->start, dr->len);
+		sm->discard_cmds++;
+		sm->discard_blocks += dr->len;
+		__unlink_discard_range(sm, dcc, dr);
+	}
+	kfree(dcc);
+	sm->dcc_info = NULL;
+	mutex_unlock(&sbi->cp_mutex);
+}
+
 void discard_next_dnode(struct f2fs_sb_info *sbi, block_t blkaddr)
 {
 	if (f2fs_issue_discard(sbi, blkaddr, 1)) {
@@ -542,6 +940,7 @@ void clear_prefree_segments(struct f2fs_sb_info *sbi)
 {
 	struct list_head *head = &(SM_I(sbi)->discard_list);
 	struct discard_entry *entry, *this;
+	struct discard_cmd_control *dcc = SM_I(sbi)->dcc_info;
 	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
 	unsigned long *prefree_map = dirty_i->dirty_segmap[PRE];
 	unsigned int start = 0, end = -1;
@@ -564,18 +963,32 @@ void clear_prefree_segments(struct f2fs_sb_info *sbi)
 		if (!test_opt(sbi, DISCARD))
 			continue;
 
-		f2fs_issue_discard(sbi, START_BLOCK(sbi, start),
+		if (dcc)
+			queue_discard_range(sbi, START_BLOCK(sbi, start),
+				(end - start) << sbi->log_blocks_per_seg);
+		else
+			f2fs_issue_discard(sbi, START_BLOCK(sbi, start),
 				(end - start) << sbi->log_blocks_per_seg);
 	}
 	mutex_unlock(&dirty_i->seglist_lock);
 
 	/* send small discards */
 	list_for_each_entry_safe(entry, this, head, list) {
-		f2fs_issue_discard(sbi, entry->blkaddr, entry->len);
+		/*
+		 * A current segment may reuse these blocks right after the
+		 * checkpoint without going through reset_curseg.
+		 */
+		if (dcc && !IS_CURSEG(sbi, GET_SEGNO(sbi, entry->blkaddr)))
+			queue_discard_range(sbi, entry->blkaddr, entry->len);
+		else
+			f2fs_issue_discard(sbi, entry->blkaddr, entry->len);
 		list_del(&entry->list);
 		SM_I(sbi)->nr_discards -= entry->len;
 		kmem_cache_free(discard_entry_slab, entry);
 	}
+
+	if (dcc)
+		wake_up(&dcc->discard_wait_queue);
 }
 
 static bool __mark_sit_entry_dirty(struct f2fs_sb_info *sbi, unsigned int segno)
@@ -648,6 +1061,31 @@ void refresh_sit_entry(struct f2fs_sb_info *sbi, block_t old, block_t new)
 	locate_dirty_segment(sbi, GET_SEGNO(sbi, new));
 }
 
+/*
+ * @new_blkaddr replaced @old_blkaddr, and is given up again: make
+ * @old_blkaddr valid again.  Its summary entry is still in place, since
+ * the block could not be reused before the next checkpoint.
+ */
+void revoke_data_block(struct f2fs_sb_info *sbi, block_t old_blkaddr,
+						block_t new_blkaddr)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	unsigned int segno = GET_SEGNO(sbi, old_blkaddr);
+
+	mutex_lock(&sit_i->sentry_lock);
+	update_sit_entry(sbi, new_blkaddr, -1);
+	update_sit_entry(sbi, old_blkaddr, 1);
+
+	/* the old segment may have become prefree meanwhile */
+	mutex_lock(&DIRTY_I(sbi)->seglist_lock);
+	__remove_dirty_segment(sbi, segno, PRE);
+	mutex_unlock(&DIRTY_I(sbi)->seglist_lock);
+
+	locate_dirty_segment(sbi, segno);
+	locate_dirty_segment(sbi, GET_SEGNO(sbi, new_blkaddr));
+	mutex_unlock(&sit_i->sentry_lock);
+}
+
 void invalidate_blocks(struct f2fs_sb_info *sbi, block_t addr)
 {
 	unsigned int segno = GET_SEGNO(sbi, addr);
@@ -837,6 +1275,9 @@ static void reset_curseg(struct f2fs_sb_info *sbi, int type, int modified)
 	curseg->next_blkoff = 0;
 	curseg->next_segno = NULL_SEGNO;
 
+	reclaim_discard_range(sbi, START_BLOCK(sbi, curseg->segno),
+						sbi->blocks_per_seg);
+
 	sum_footer = &(curseg->sum_blk->footer);
 	memset(sum_footer, 0, sizeof(struct summary_footer));
 	if (IS_DATASEG(type))
@@ -1019,6 +1460,11 @@ int f2fs_trim_fs(struct f2fs_sb_info *sbi, struct fstrim_range *range)
 
 	/* do checkpoint to issue discard commands safely */
 	write_checkpoint(sbi, &cpc);
+
+	/* and wait for them, FITRIM is synchronous */
+	mutex_lock(&sbi->cp_mutex);
+	drain_discard_ranges(sbi);
+	mutex_unlock(&sbi->cp_mutex);
 out:
 	range->len = cpc.trimmed << sbi->log_blocksize;
 	return 0;
@@ -2065,6 +2511,8 @@ int build_segment_manager(struct f2fs_sb_info *sbi)
 	INIT_LIST_HEAD(&sm_info->discard_list);
 	sm_info->nr_discards = 0;
 	sm_info->max_discards = 0;
+	sm_info->discard_granularity = DEF_DISCARD_GRANULARITY;
+	sm_info->max_discard_delay = DEF_MAX_DISCARD_DELAY;
 
 	INIT_LIST_HEAD(&sm_info->sit_entry_set);
 
@@ -2074,6 +2522,12 @@ int build_segment_manager(struct f2fs_sb_info *sbi)
 			return err;
 	}
 
+	if (test_opt(sbi, DISCARD) && !f2fs_readonly(sbi->sb)) {
+		err = create_discard_cmd_control(sbi);
+		if (err)
+			return err;
+	}
+
 	err = build_sit_info(sbi);
 	if (err)
 		return err;
@@ -2184,6 +2638,7 @@ void destroy_segment_manager(struct f2fs_sb_info *sbi)
 	if (!sm_info)
 		return;
 	destroy_flush_cmd_control(sbi);
+	destroy_discard_cmd_control(sbi);
 	destroy_dirty_segmap(sbi);
 	destroy_curseg(sbi);
 	destroy_free_segmap(sbi);
@@ -2208,8 +2663,15 @@ int __init create_segment_manager_caches(void)
 			sizeof(struct inmem_pages));
 	if (!inmem_entry_slab)
 		goto destroy_sit_entry_set;
+
+	discard_range_slab = f2fs_kmem_cache_create("discard_range",
+			sizeof(struct discard_range));
+	if (!discard_range_slab)
+		goto destroy_inmem_entry;
 	return 0;
 
+destroy_inmem_entry:
+	kmem_cache_destroy(inmem_entry_slab);
 destroy_sit_entry_set:
 	kmem_cache_destroy(sit_entry_set_slab);
 destory_discard_entry:
@@ -2223,4 +2685,5 @@ void destroy_segment_manager_caches(void)
 	kmem_cache_destroy(sit_entry_set_slab);
 	kmem_cache_destroy(discard_entry_slab);
 	kmem_cache_destroy(inmem_entry_slab);
+	kmem_cache_destroy(discard_range_slab);
 }
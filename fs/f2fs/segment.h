@@ -178,8 +178,15 @@ struct segment_allocation {
 struct inmem_pages {
 	struct list_head list;
 	struct page *page;
+	block_t old_blkaddr;		/* for revoking a failed commit */
 };
 
+/* page_private of the pages staged by an atomic write */
+#define ATOMIC_WRITTEN_PAGE		0x0000ffff
+
+#define IS_ATOMIC_WRITTEN_PAGE(page)			\
+		(page_private(page) == (unsigned long)ATOMIC_WRITTEN_PAGE)
+
 struct sit_info {
 	const struct segment_allocation *s_ops;
 
@@ -495,6 +502,18 @@ static inline int utilization(struct f2fs_sb_info *sbi)
 #define DEF_MIN_IPU_UTIL	70
 #define DEF_MIN_FSYNC_BLOCKS	8
 
+/*
+ * Pending discards shorter than discard_granularity blocks are dropped,
+ * and the others are issued when the device is idle, or at the latest
+ * max_discard_delay ms after they were queued.  One command covers at
+ * most MAX_DISCARD_SEGMENTS segments so that a segment being reused does
+ * not wait long for a discard in flight.
+ */
+#define DEF_DISCARD_GRANULARITY	16
+#define DEF_MAX_DISCARD_DELAY	5000
+#define DEF_DISCARD_POLL_TIME	50	/* ms */
+#define MAX_DISCARD_SEGMENTS	16
+
 enum {
 	F2FS_IPU_FORCE,
 	F2FS_IPU_SSR,
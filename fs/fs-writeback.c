@@ -249,13 +249,18 @@ static bool inode_dirtied_after(struct inode *inode, unsigned long t)
 
 /*
  * Move expired (dirtied before work->older_than_this) dirty inodes from
- * @delaying_queue to @dispatch_queue.
+ * @delaying_queue to @dispatch_queue.  With @fsync_first, inodes that
+ * have been fsync()ed since they were last written back (I_FSYNCED) are
+ * queued to be written before all the others, so that the next fsync()
+ * finds less to write and less in its way.
  */
 static int move_expired_inodes(struct list_head *delaying_queue,
 			       struct list_head *dispatch_queue,
-			       struct wb_writeback_work *work)
+			       struct wb_writeback_work *work,
+			       bool fsync_first)
 {
 	LIST_HEAD(tmp);
+	LIST_HEAD(fsynced);
 	struct list_head *pos, *node;
 	struct super_block *sb = NULL;
 	struct inode *inode;
@@ -267,8 +272,12 @@ static int move_expired_inodes(struct list_head *delaying_queue,
 		if (work->older_than_this &&
 		    inode_dirtied_after(inode, *work->older_than_this))
 			break;
-		list_move(&inode->i_wb_list, &tmp);
 		moved++;
+		if (fsync_first && (inode->i_state & I_FSYNCED)) {
+			list_move(&inode->i_wb_list, &fsynced);
+			continue;
+		}
+		list_move(&inode->i_wb_list, &tmp);
 		if (sb_is_blkdev_sb(inode->i_sb))
 			continue;
 		if (sb && sb != inode->i_sb)
@@ -292,6 +301,8 @@ static int move_expired_inodes(struct list_head *delaying_queue,
 		}
 	}
 out:
+	/* b_io is consumed from its tail */
+	list_splice_tail(&fsynced, dispatch_queue);
 	return moved;
 }
 
@@ -311,7 +322,8 @@ static void queue_io(struct bdi_writeback *wb, struct wb_writeback_work *work)
 	int moved;
 	assert_spin_locked(&wb->list_lock);
 	list_splice_init(&wb->b_more_io, &wb->b_io);
-	moved = move_expired_inodes(&wb->b_dirty, &wb->b_io, work);
+	moved = move_expired_inodes(&wb->b_dirty, &wb->b_io, work,
+				    wb->bdi->write_latency_target != 0);
 	trace_writeback_queue_io(wb, work, moved);
 }
 
@@ -724,6 +736,8 @@ static long writeback_sb_inodes(struct super_block *sb,
 		spin_lock(&inode->i_lock);
 		if (!(inode->i_state & I_DIRTY))
 			wrote++;
+		/* written back, no longer goes ahead of the others */
+		inode->i_state &= ~I_FSYNCED;
 		requeue_inode(inode, wb, &wbc);
 		inode_sync_complete(inode);
 		spin_unlock(&inode->i_lock);
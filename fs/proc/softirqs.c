@@ -1,5 +1,6 @@
 #include <linux/init.h>
 #include <linux/kernel_stat.h>
+#include <linux/math64.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
 
@@ -36,9 +37,54 @@ static const struct file_operations proc_softirqs_operations = {
 	.release	= single_release,
 };
 
+/*
+ * /proc/softirq_time ... display the usecs spent in each softirq and the
+ * number of times it overran its budget and was deferred to ksoftirqd
+ */
+static int show_softirq_time(struct seq_file *p, void *v)
+{
+	int i, j;
+
+	seq_puts(p, "                    ");
+	for_each_possible_cpu(i)
+		seq_printf(p, "CPU%-11d", i);
+	seq_putc(p, '\n');
+
+	for (i = 0; i < NR_SOFTIRQS; i++) {
+		seq_printf(p, "%12s:", softirq_to_name[i]);
+		for_each_possible_cpu(j)
+			seq_printf(p, " %13llu",
+				   div_u64(kstat_softirq_time_cpu(i, j),
+					   NSEC_PER_USEC));
+		seq_putc(p, '\n');
+	}
+
+	seq_puts(p, "deferred:\n");
+	for (i = 0; i < NR_SOFTIRQS; i++) {
+		seq_printf(p, "%12s:", softirq_to_name[i]);
+		for_each_possible_cpu(j)
+			seq_printf(p, " %13u", kstat_softirq_deferrals_cpu(i, j));
+		seq_putc(p, '\n');
+	}
+	return 0;
+}
+
+static int softirq_time_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, show_softirq_time, NULL);
+}
+
+static const struct file_operations proc_softirq_time_operations = {
+	.open		= softirq_time_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int __init proc_softirqs_init(void)
 {
 	proc_create("softirqs", 0, NULL, &proc_softirqs_operations);
+	proc_create("softirq_time", 0, NULL, &proc_softirq_time_operations);
 	return 0;
 }
 fs_initcall(proc_softirqs_init);
@@ -86,6 +86,16 @@ struct mmu_gather_batch {
  */
 #define MAX_GATHER_BATCH_COUNT	(10000UL/MAX_GATHER_BATCH)
 
+/*
+ * Tearing down a whole address space isn't latency sensitive, so on
+ * preemptible kernels gather more pages per TLB flush.
+ */
+#ifdef CONFIG_PREEMPT
+#define MAX_GATHER_BATCH_COUNT_FULLMM	(4 * MAX_GATHER_BATCH_COUNT)
+#else
+#define MAX_GATHER_BATCH_COUNT_FULLMM	MAX_GATHER_BATCH_COUNT
+#endif
+
 /* struct mmu_gather is an opaque type used by the mm code for passing around
  * any data needed by arch specific code for tlb_remove_page.
  */
@@ -91,6 +91,16 @@ struct backing_dev_info {
 	unsigned long last_thresh;  /* global/bdi thresh at the last throttle */
 	unsigned long last_nr_dirty; /* global/bdi dirty at the last throttle */
 	unsigned long paused_total; /* approximated sum of pauses. in jiffies */
+	unsigned long nr_paused;    /* number of pauses */
+	unsigned long nr_latency_paused; /* pauses with latency over target */
+
+	/*
+	 * Smoothed latency of the write requests of the device.  When a
+	 * target is set, dirtiers are throttled harder for as long as the
+	 * latency is over it, and the flusher writes fsync()ed inodes first.
+	 */
+	unsigned long write_latency;		/* in us */
+	unsigned int write_latency_target;	/* in us, 0 = no target */
 
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
@@ -131,6 +141,23 @@ extern struct list_head bdi_list;
 
 extern struct workqueue_struct *bdi_wq;
 
+/* called at the completion of every write request of the device */
+static inline void bdi_account_write_latency(struct backing_dev_info *bdi,
+					     u64 ns)
+{
+	unsigned long lat = ACCESS_ONCE(bdi->write_latency);
+
+	ACCESS_ONCE(bdi->write_latency) = lat - (lat >> 3) +
+		(div_u64(ns, NSEC_PER_USEC) >> 3);
+}
+
+/* should dirtiers on @bdi be throttled for its write latency? */
+static inline bool bdi_over_latency_target(struct backing_dev_info *bdi)
+{
+	return bdi->write_latency_target &&
+	       ACCESS_ONCE(bdi->write_latency) > bdi->write_latency_target;
+}
+
 static inline int wb_has_dirty_io(struct bdi_writeback *wb)
 {
 	return !list_empty(&wb->b_dirty) ||
@@ -15,6 +15,7 @@
 #include <linux/rculist.h>
 #include <linux/cgroupstats.h>
 #include <linux/rwsem.h>
+#include <linux/mutex.h>
 #include <linux/idr.h>
 #include <linux/workqueue.h>
 #include <linux/fs.h>
@@ -286,6 +287,13 @@ struct cgroup_root {
 
 	/* The name for this hierarchy - may be empty */
 	char name[MAX_CGROUP_ROOT_NAMELEN];
+
+	/*
+	 * Serializes task migrations into this hierarchy.  Migrations on
+	 * different hierarchies only share cgroup_migrate_rwsem for reading
+	 * and don't need cgroup_mutex.
+	 */
+	struct mutex attach_mutex;
 };
 
 /*
@@ -308,14 +316,11 @@ struct css_set {
 	struct hlist_node hlist;
 
 	/*
-	 * Lists running through all tasks using this cgroup group.
-	 * mg_tasks lists tasks which belong to this cset but are in the
-	 * process of being migrated out or in.  Protected by
-	 * css_set_rwsem, but, during migration, once tasks are moved to
-	 * mg_tasks, it can be read safely while holding cgroup_mutex.
+	 * List running through all tasks using this cgroup group.
+	 * Protected by css_set_rwsem.  Tasks being migrated stay on the
+	 * list of their source cset until the migration is committed.
 	 */
 	struct list_head tasks;
-	struct list_head mg_tasks;
 
 	/*
 	 * List of cgrp_cset_links pointing at cgroups referenced from this
@@ -333,23 +338,6 @@ struct css_set {
 	 */
 	struct cgroup_subsys_state *subsys[CGROUP_SUBSYS_COUNT];
 
-	/*
-	 * List of csets participating in the on-going migration either as
-	 * source or destination.  Protected by cgroup_mutex.
-	 */
-	struct list_head mg_preload_node;
-	struct list_head mg_node;
-
-	/*
-	 * If this cset is acting as the source of migration the following
-	 * two fields are set.  mg_src_cgrp is the source cgroup of the
-	 * on-going migration and mg_dst_cset is the destination cset the
-	 * target tasks on this cset should be migrated to.  Protected by
-	 * cgroup_mutex.
-	 */
-	struct cgroup *mg_src_cgrp;
-	struct css_set *mg_dst_cset;
-
 	/*
 	 * On the default hierarhcy, ->subsys[ssid] may point to a css
 	 * attached to an ancestor instead of the cgroup this css_set is
@@ -899,7 +887,6 @@ struct css_task_iter {
 
 	struct list_head		*task_pos;
 	struct list_head		*tasks_head;
-	struct list_head		*mg_tasks_head;
 };
 
 void css_task_iter_start(struct cgroup_subsys_state *css,
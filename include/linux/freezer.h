@@ -12,6 +12,8 @@
 extern atomic_t system_freezing_cnt;	/* nr of freezing conds in effect */
 extern bool pm_freezing;		/* PM freezing in effect */
 extern bool pm_nosig_freezing;		/* PM nosig freezing in effect */
+extern atomic_t pm_freeze_todo;		/* tasks the PM freezer waits for */
+extern wait_queue_head_t pm_freeze_wait;
 
 /*
  * Timeout for stopping processes
@@ -71,6 +73,8 @@ extern bool set_freezable(void);
 
 #ifdef CONFIG_CGROUP_FREEZER
 extern bool cgroup_freezing(struct task_struct *task);
+extern unsigned int cgroup_freezer_for_each_task(
+		void (*fn)(struct task_struct *, void *), void *data);
 #else /* !CONFIG_CGROUP_FREEZER */
 static inline bool cgroup_freezing(struct task_struct *task)
 {
@@ -15,6 +15,30 @@ struct irq_desc;
 struct irq_domain;
 struct pt_regs;
 
+#define IRQ_LAT_BUCKETS		12
+
+/**
+ * struct irq_balance_stats - handler time accounting of an interrupt
+ * @hardirq_ns:		total time spent in the hard irq handlers
+ * @thread_ns:		total time spent in the threaded handlers
+ * @hardirq_hist:	log2 usecs histogram of hard irq handler runs
+ * @thread_hist:	log2 usecs histogram of threaded handler runs
+ * @last_ns:		balancer: handler time at the previous pass
+ * @last_count:		balancer: interrupt count at the previous pass
+ * @cpu:		balancer: CPU the interrupt was last moved to
+ * @moved:		balancer: @cpu is valid
+ */
+struct irq_balance_stats {
+	u64			hardirq_ns;
+	u64			thread_ns;
+	unsigned int		hardirq_hist[IRQ_LAT_BUCKETS];
+	unsigned int		thread_hist[IRQ_LAT_BUCKETS];
+	u64			last_ns;
+	unsigned int		last_count;
+	unsigned int		cpu;
+	bool			moved;
+};
+
 /**
  * struct irq_desc - interrupt descriptor
  * @irq_data:		per irq and chip data passed down to chip functions
@@ -44,6 +68,7 @@ struct pt_regs;
  * @force_resume_depth:	number of irqactions on a irq descriptor with
  *			IRQF_FORCE_RESUME set
  * @dir:		/proc/irq/ procfs entry
+ * @bal:		handler time accounting for the irq balancer
  * @name:		flow handler name for /proc/interrupts output
  */
 struct irq_desc {
@@ -82,6 +107,9 @@ struct irq_desc {
 #endif
 #ifdef CONFIG_PROC_FS
 	struct proc_dir_entry	*dir;
+#endif
+#ifdef CONFIG_IRQ_BALANCE
+	struct irq_balance_stats bal;
 #endif
 	int			parent_irq;
 	struct module		*owner;
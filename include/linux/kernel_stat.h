@@ -38,6 +38,8 @@ struct kernel_cpustat {
 struct kernel_stat {
 	unsigned long irqs_sum;
 	unsigned int softirqs[NR_SOFTIRQS];
+	u64 softirq_time[NR_SOFTIRQS];		/* ns spent in each vector */
+	unsigned int softirq_deferrals[NR_SOFTIRQS];
 };
 
 DECLARE_PER_CPU(struct kernel_stat, kstat);
@@ -64,6 +66,17 @@ static inline unsigned int kstat_softirqs_cpu(unsigned int irq, int cpu)
        return kstat_cpu(cpu).softirqs[irq];
 }
 
+static inline u64 kstat_softirq_time_cpu(unsigned int irq, int cpu)
+{
+	return kstat_cpu(cpu).softirq_time[irq];
+}
+
+static inline unsigned int kstat_softirq_deferrals_cpu(unsigned int irq,
+						       int cpu)
+{
+	return kstat_cpu(cpu).softirq_deferrals[irq];
+}
+
 /*
  * Number of interrupts per specific IRQ source, since bootup
  */
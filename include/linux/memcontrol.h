@@ -448,7 +448,7 @@ memcg_kmem_newpage_charge(gfp_t gfp, struct mem_cgroup **memcg, int order)
 	 * __GFP_NOFAIL allocations will move on even if charging is not
 	 * possible. Therefore we don't even try, and have this allocation
 	 * unaccounted. We could in theory charge it with
-	 * res_counter_charge_nofail, but we hope those allocations are rare,
+	 * page_counter_charge, but we hope those allocations are rare,
 	 * and won't be worth the trouble.
 	 */
 	if (gfp & __GFP_NOFAIL)
@@ -459,6 +459,13 @@ struct mm_struct {
 	bool tlb_flush_pending;
 #endif
 	struct uprobes_state uprobes_state;
+
+	/* deferred teardown after SIGKILL, see mmput() */
+	struct list_head teardown_list;
+	u64 kill_time;			/* ktime_get_ns() of the SIGKILL */
+#ifdef CONFIG_MEMCG
+	struct mem_cgroup *teardown_memcg;	/* pinned while queued */
+#endif
 };
 
 static inline void mm_init_cpumask(struct mm_struct *mm)
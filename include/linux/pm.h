@@ -684,6 +684,7 @@ extern void dpm_resume_noirq(pm_message_t state);
 extern void dpm_resume_early(pm_message_t state);
 extern void dpm_resume(pm_message_t state);
 extern void dpm_complete(pm_message_t state);
+extern unsigned int dpm_resume_order_violations(void);
 
 extern void device_pm_unlock(void);
 extern int dpm_suspend_end(pm_message_t state);
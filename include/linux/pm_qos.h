@@ -112,11 +112,19 @@ enum pm_qos_type {
  */
 struct pm_qos_constraints {
 	struct plist_head list;
+	spinlock_t lock;	/* protects list and target_value */
 	s32 target_value;	/* Do not change to 64 bit */
 	s32 default_value;
 	s32 no_constraint_value;
 	enum pm_qos_type type;
 	struct blocking_notifier_head *notifiers;
+	/* deferred notification, see pm_qos_update_target() */
+	bool notify_deferred;
+	bool notify_force;
+	s32 notified_value;
+	unsigned int notify_updates;
+	u64 notify_time;
+	struct work_struct notify_work;
 };
 
 struct pm_qos_flags {
@@ -604,6 +604,7 @@ struct signal_struct {
 	 */
 	int			notify_count;
 	struct task_struct	*group_exit_task;
+	u64			kill_time;	/* when SIGKILL took the group down */
 
 	/* thread group stop support, overloads group_exit_code too */
 	int			group_stop_count;
@@ -1918,6 +1919,7 @@ static inline int is_global_init(struct task_struct *tsk)
 extern struct pid *cad_pid;
 
 extern void free_task(struct task_struct *tsk);
+extern void task_cache_drain_all(void);
 #define get_task_struct(tsk) do { atomic_inc(&(tsk)->usage); } while(0)
 
 extern void __put_task_struct(struct task_struct *t);
@@ -2484,6 +2486,10 @@ static inline void mmdrop(struct mm_struct * mm)
 
 /* mmput gets rid of the mappings and all user-space */
 extern void mmput(struct mm_struct *);
+/* deferred teardown of killed tasks' address spaces */
+extern bool mm_teardown_wait(gfp_t gfp_mask);
+struct mem_cgroup;
+extern bool mm_teardown_busy(struct mem_cgroup *memcg);
 /* Grab a reference to a task's mm, if it is not already going away */
 extern struct mm_struct *get_task_mm(struct task_struct *task);
 /*
@@ -209,6 +209,8 @@ extern void timer_stats_update_stats(void *timer, pid_t pid, void *startf,
 				     void *timerf, char *comm,
 				     unsigned int timer_flag);
 
+extern void timer_stats_update_wakeup(void *timerf, bool wakeup);
+
 extern void __timer_stats_timer_set_start_info(struct timer_list *timer,
 					       void *addr);
 
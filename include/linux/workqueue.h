@@ -104,6 +104,9 @@ struct work_struct {
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
 #endif
+#ifdef CONFIG_WQ_STATS
+	u64 queued_ns;
+#endif
 };
 
 #define WORK_DATA_INIT()	ATOMIC_LONG_INIT(WORK_STRUCT_NO_POOL)
@@ -131,6 +134,7 @@ struct workqueue_attrs {
 	int			nice;		/* nice level */
 	cpumask_var_t		cpumask;	/* allowed CPUs */
 	bool			no_numa;	/* disable NUMA affinity */
+	bool			latency;	/* latency-sensitive pool */
 };
 
 static inline struct delayed_work *to_delayed_work(struct work_struct *work)
@@ -313,6 +317,19 @@ enum {
 	 */
 	WQ_POWER_EFFICIENT	= 1 << 7,
 
+	/*
+	 * Work items on unbound workqueues all share the workers of the
+	 * pool matching their attributes, so a latency-sensitive item can
+	 * end up waiting behind bulk background work.  Workqueues marked
+	 * with WQ_LATENCY_SENSITIVE are served by a separate class of
+	 * unbound pools whose workers run at high priority.  On per-cpu
+	 * workqueues it implies WQ_HIGHPRI.  The workers of unbound ones
+	 * can be further restricted to a set of CPU clusters with the
+	 * workqueue.latency_clusters parameter, and later through the
+	 * "clusters" sysfs attribute of WQ_SYSFS workqueues.
+	 */
+	WQ_LATENCY_SENSITIVE	= 1 << 8,
+
 	__WQ_DRAINING		= 1 << 16, /* internal: workqueue is draining */
 	__WQ_ORDERED		= 1 << 17, /* internal: workqueue is ordered */
 	__WQ_ORDERED_EXPLICIT	= 1 << 19, /* internal: alloc_ordered_workqueue() */
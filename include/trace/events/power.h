@@ -436,6 +436,32 @@ DEFINE_EVENT_PRINT(pm_qos_update, pm_qos_update_flags,
 		  __entry->prev_value, __entry->curr_value)
 );
 
+TRACE_EVENT(pm_qos_notify,
+
+	TP_PROTO(const char *name, s32 value, unsigned int updates,
+		 u64 latency_ns),
+
+	TP_ARGS(name, value, updates, latency_ns),
+
+	TP_STRUCT__entry(
+		__string( name,                  name           )
+		__field( s32,                    value          )
+		__field( unsigned int,           updates        )
+		__field( u64,                    latency_ns     )
+	),
+
+	TP_fast_assign(
+		__assign_str(name, name);
+		__entry->value = value;
+		__entry->updates = updates;
+		__entry->latency_ns = latency_ns;
+	),
+
+	TP_printk("class=%s value=%d updates=%u latency_ns=%llu",
+		  __get_str(name), __entry->value, __entry->updates,
+		  (unsigned long long)__entry->latency_ns)
+);
+
 DECLARE_EVENT_CLASS(dev_pm_qos_request,
 
 	TP_PROTO(const char *name, enum dev_pm_qos_req_type type,
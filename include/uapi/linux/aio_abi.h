@@ -104,6 +104,54 @@ struct iocb {
 	__u32	aio_resfd;
 }; /* 64 bytes */
 
+/*
+ * Flags for io_setup(), or'ed into nr_events.  Kernels that do not know
+ * them fail such a call with -EINVAL, as nr_events is then over their
+ * limit.
+ *
+ * IOCTX_FLAG_SQRING   - Map a submission ring (struct aio_sq_ring) after
+ *                       the event ring.  iocbs queued there are picked up
+ *                       by io_submit(ctx, 0, NULL), or by the polling
+ *                       thread.
+ * IOCTX_FLAG_SQTHREAD - Have a kernel thread poll the submission ring, so
+ *                       that no syscall is needed to submit.  Requires
+ *                       IOCTX_FLAG_SQRING and CAP_SYS_ADMIN.
+ * IOCTX_FLAG_IOPOLL   - Busy-poll for completions in io_getevents()
+ *                       before going to sleep.
+ */
+#define IOCTX_FLAG_SQRING	(1 << 28)
+#define IOCTX_FLAG_SQTHREAD	(1 << 29)
+#define IOCTX_FLAG_IOPOLL	(1 << 30)
+#define IOCTX_FLAG_MASK		(IOCTX_FLAG_SQRING | IOCTX_FLAG_SQTHREAD | \
+				 IOCTX_FLAG_IOPOLL)
+
+/*
+ * Valid flags for the "flags" member of the "struct aio_sq_ring".
+ *
+ * AIO_SQ_NEED_WAKEUP - The polling thread went to sleep, queueing more
+ *                      iocbs requires an io_submit(ctx, 0, NULL) to wake
+ *                      it up.
+ */
+#define AIO_SQ_NEED_WAKEUP	(1 << 0)
+
+/*
+ * The submission ring starts on the first page boundary after the
+ * io_events of the event ring the aio_context_t points to.  Userland fills
+ * iocbs[tail] and then advances tail (modulo nr); the kernel advances head
+ * as it submits them.  iocbs that could not be submitted are skipped and
+ * counted in dropped.
+ */
+struct aio_sq_ring {
+	__u32	head;		/* written by the kernel */
+	__u32	tail;		/* written by userland */
+	__u32	nr;		/* number of iocbs */
+	__u32	flags;		/* AIO_SQ_* */
+	__u32	dropped;
+	__u32	reserved[3];
+
+	struct iocb	iocbs[0];
+}; /* 32 bytes + ring size */
+
 #undef IFBIG
 #undef IFLITTLE
 
@@ -91,6 +91,20 @@ static DEFINE_MUTEX(cgroup_mutex);
 static DECLARE_RWSEM(css_set_rwsem);
 #endif
 
+/*
+ * Task migration doesn't need cgroup_mutex.  It holds
+ * cgroup_migrate_rwsem for reading and the destination hierarchy's
+ * ->attach_mutex so that migrations on different hierarchies can proceed
+ * in parallel.  Operations which add or remove hierarchies or rebind
+ * subsystems hold cgroup_migrate_rwsem for writing.  Anything which must
+ * not race against migrations on a given hierarchy, e.g. marking a cgroup
+ * dead, grabs cgroup_attach_lock() on that hierarchy.
+ *
+ * The locking order is cgroup_mutex -> cgroup_migrate_rwsem ->
+ * ->attach_mutex -> threadgroup_lock -> css_set_rwsem.
+ */
+static DECLARE_RWSEM(cgroup_migrate_rwsem);
+
 /*
  * Protects cgroup_idr and css_idr so that IDs can be released without
  * grabbing cgroup_mutex.
@@ -418,9 +432,6 @@ struct css_set init_css_set = {
 	.refcount		= ATOMIC_INIT(1),
 	.cgrp_links		= LIST_HEAD_INIT(init_css_set.cgrp_links),
 	.tasks			= LIST_HEAD_INIT(init_css_set.tasks),
-	.mg_tasks		= LIST_HEAD_INIT(init_css_set.mg_tasks),
-	.mg_preload_node	= LIST_HEAD_INIT(init_css_set.mg_preload_node),
-	.mg_node		= LIST_HEAD_INIT(init_css_set.mg_node),
 };
 
 static int css_set_count	= 1;	/* 1 for init_css_set */
@@ -742,14 +753,14 @@ static struct css_set *find_css_set(struct css_set *old_cset,
 				    struct cgroup *cgrp)
 {
 	struct cgroup_subsys_state *template[CGROUP_SUBSYS_COUNT] = { };
-	struct css_set *cset;
+	struct css_set *cset, *existing;
 	struct list_head tmp_links;
 	struct cgrp_cset_link *link;
 	struct cgroup_subsys *ss;
 	unsigned long key;
 	int ssid;
 
-	lockdep_assert_held(&cgroup_mutex);
+	lockdep_assert_held(&cgroup_migrate_rwsem);
 
 	/* First see if we already have a cgroup group that matches
 	 * the desired set */
@@ -775,9 +786,6 @@ static struct css_set *find_css_set(struct css_set *old_cset,
 	atomic_set(&cset->refcount, 1);
 	INIT_LIST_HEAD(&cset->cgrp_links);
 	INIT_LIST_HEAD(&cset->tasks);
-	INIT_LIST_HEAD(&cset->mg_tasks);
-	INIT_LIST_HEAD(&cset->mg_preload_node);
-	INIT_LIST_HEAD(&cset->mg_node);
 	INIT_HLIST_NODE(&cset->hlist);
 
 	/* Copy the set of subsystem state objects generated in
@@ -785,6 +793,20 @@ static struct css_set *find_css_set(struct css_set *old_cset,
 	memcpy(cset->subsys, template, sizeof(cset->subsys));
 
 	down_write(&css_set_rwsem);
+
+	/*
+	 * Migrations on other hierarchies may be looking up the same
+	 * css_set concurrently.  Use theirs if they beat us to it.
+	 */
+	existing = find_existing_css_set(old_cset, cgrp, template);
+	if (existing) {
+		get_css_set(existing);
+		up_write(&css_set_rwsem);
+		free_cgrp_cset_links(&tmp_links);
+		kfree(cset);
+		return existing;
+	}
+
 	/* Add reference counts and links from the new css_set. */
 	list_for_each_entry(link, &old_cset->cgrp_links, cgrp_link) {
 		struct cgroup *c = link->cgrp;
@@ -859,6 +881,7 @@ static void cgroup_destroy_root(struct cgroup_root *root)
 	struct cgrp_cset_link *link, *tmp_link;
 
 	mutex_lock(&cgroup_mutex);
+	down_write(&cgroup_migrate_rwsem);
 
 	BUG_ON(atomic_read(&root->nr_cgrps));
 	BUG_ON(!list_empty(&cgrp->self.children));
@@ -886,6 +909,7 @@ static void cgroup_destroy_root(struct cgroup_root *root)
 
 	cgroup_exit_root_id(root);
 
+	up_write(&cgroup_migrate_rwsem);
 	mutex_unlock(&cgroup_mutex);
 
 	kernfs_destroy_root(root->kf_root);
@@ -898,7 +922,6 @@ static struct cgroup *cset_cgroup_from_root(struct css_set *cset,
 {
 	struct cgroup *res = NULL;
 
-	lockdep_assert_held(&cgroup_mutex);
 	lockdep_assert_held(&css_set_rwsem);
 
 	if (cset == &init_css_set) {
@@ -922,15 +945,16 @@ static struct cgroup *cset_cgroup_from_root(struct css_set *cset,
 
 /*
  * Return the cgroup for "task" from the given hierarchy. Must be
- * called with cgroup_mutex and css_set_rwsem held.
+ * called with css_set_rwsem held.
  */
 static struct cgroup *task_cgroup_from_root(struct task_struct *task,
 					    struct cgroup_root *root)
 {
 	/*
-	 * No need to lock the task - since we hold cgroup_mutex the
-	 * task can't change groups, so the only thing that can happen
-	 * is that it exits and its css is set back to init_css_set.
+	 * No need to lock the task - migrations commit under css_set_rwsem
+	 * held for writing, so the task can't change groups while we hold
+	 * it and the only thing that can happen is that it exits and its
+	 * css is set back to init_css_set.
 	 */
 	return cset_cgroup_from_root(task_css_set(task), root);
 }
@@ -1138,6 +1162,64 @@ static struct cgroup *cgroup_kn_lock_live(struct kernfs_node *kn)
 	return NULL;
 }
 
+/**
+ * cgroup_attach_lock - lock out task migrations on a hierarchy
+ * @root: the hierarchy of interest
+ *
+ * Task migrations on @root are serialized by this lock instead of
+ * cgroup_mutex.  If cgroup_mutex is also needed, it must be grabbed first.
+ */
+static void cgroup_attach_lock(struct cgroup_root *root)
+{
+	down_read(&cgroup_migrate_rwsem);
+	mutex_lock(&root->attach_mutex);
+}
+
+static void cgroup_attach_unlock(struct cgroup_root *root)
+{
+	mutex_unlock(&root->attach_mutex);
+	up_read(&cgroup_migrate_rwsem);
+}
+
+static void cgroup_kn_unlock_attach(struct kernfs_node *kn)
+{
+	struct cgroup *cgrp = kn->parent->priv;
+
+	cgroup_attach_unlock(cgrp->root);
+
+	kernfs_unbreak_active_protection(kn);
+	cgroup_put(cgrp);
+}
+
+/**
+ * cgroup_kn_lock_attach - locking helper for task migration kernfs methods
+ * @kn: the kernfs_node being serviced
+ *
+ * Similar to cgroup_kn_lock_live() but grabs cgroup_attach_lock() of the
+ * cgroup's hierarchy instead of cgroup_mutex so that migrations don't
+ * serialize against migrations on other hierarchies or unrelated cgroup
+ * operations.  Returns the cgroup if alive; otherwise, %NULL.  A
+ * successful return should be undone by a matching
+ * cgroup_kn_unlock_attach() invocation.
+ */
+static struct cgroup *cgroup_kn_lock_attach(struct kernfs_node *kn)
+{
+	struct cgroup *cgrp = kn->parent->priv;
+
+	if (!cgroup_tryget(cgrp))
+		return NULL;
+	kernfs_break_active_protection(kn);
+
+	cgroup_attach_lock(cgrp->root);
+
+	/* cgroup_destroy_locked() marks @cgrp dead under the same lock */
+	if (!cgroup_is_dead(cgrp))
+		return cgrp;
+
+	cgroup_kn_unlock_attach(kn);
+	return NULL;
+}
+
 static void cgroup_rm_file(struct cgroup *cgrp, const struct cftype *cft)
 {
 	char name[CGROUP_FILE_NAME_MAX];
@@ -1173,6 +1255,7 @@ static int rebind_subsystems(struct cgroup_root *dst_root, unsigned int ss_mask)
 	int ssid, i, ret;
 
 	lockdep_assert_held(&cgroup_mutex);
+	lockdep_assert_held(&cgroup_migrate_rwsem);
 
 	for_each_subsys(ss, ssid) {
 		if (!(ss_mask & (1 << ssid)))
@@ -1454,6 +1537,7 @@ static int cgroup_remount(struct kernfs_root *kf_root, int *flags, char *data)
 	}
 
 	mutex_lock(&cgroup_mutex);
+	down_write(&cgroup_migrate_rwsem);
 
 	/* See what subsystems are wanted */
 	ret = parse_cgroupfs_options(data, &opts);
@@ -1496,6 +1580,7 @@ static int cgroup_remount(struct kernfs_root *kf_root, int *flags, char *data)
  out_unlock:
 	kfree(opts.release_agent);
 	kfree(opts.name);
+	up_write(&cgroup_migrate_rwsem);
 	mutex_unlock(&cgroup_mutex);
 	return ret;
 }
@@ -1579,6 +1664,7 @@ static void init_cgroup_root(struct cgroup_root *root,
 
 	INIT_LIST_HEAD(&root->root_list);
 	atomic_set(&root->nr_cgrps, 1);
+	mutex_init(&root->attach_mutex);
 	cgrp->root = root;
 	init_cgroup_housekeeping(cgrp);
 	idr_init(&root->cgroup_idr);
@@ -1602,6 +1688,8 @@ static int cgroup_setup_root(struct cgroup_root *root, unsigned int ss_mask)
 
 	lockdep_assert_held(&cgroup_mutex);
 
+	down_write(&cgroup_migrate_rwsem);
+
 	ret = cgroup_idr_alloc(&root->cgroup_idr, root_cgrp, 1, 2, GFP_NOWAIT);
 	if (ret < 0)
 		goto out;
@@ -1615,8 +1703,8 @@ static int cgroup_setup_root(struct cgroup_root *root, unsigned int ss_mask)
 	/*
 	 * We're accessing css_set_count without locking css_set_rwsem here,
 	 * but that's OK - it can only be increased by someone holding
-	 * cgroup_lock, and that's us. The worst that can happen is that we
-	 * have some link structures left over
+	 * cgroup_migrate_rwsem, which we hold for writing.  The worst that
+	 * can happen is that we have some link structures left over
 	 */
 	ret = allocate_cgrp_cset_links(css_set_count, &tmp_links);
 	if (ret)
@@ -1680,6 +1768,7 @@ exit_root_id:
 cancel_ref:
 	percpu_ref_exit(&root_cgrp->self.refcnt);
 out:
+	up_write(&cgroup_migrate_rwsem);
 	free_cgrp_cset_links(&tmp_links);
 	return ret;
 }
@@ -1917,26 +2006,28 @@ char *task_cgroup_path(struct task_struct *task, char *buf, size_t buflen)
 }
 EXPORT_SYMBOL_GPL(task_cgroup_path);
 
-/* used to track tasks and other necessary states during migration */
-struct cgroup_taskset {
-	/* the src and dst cset list running through cset->mg_node */
-	struct list_head	src_csets;
-	struct list_head	dst_csets;
+/* a source css_set of an on-going migration and its destination */
+struct cgroup_mg_cset {
+	struct list_head	node;
+	struct css_set		*src_cset;
+	struct css_set		*dst_cset;
+};
 
-	/*
-	 * Fields for cgroup_taskset_*() iteration.
-	 *
-	 * Before migration is committed, the target migration tasks are on
-	 * ->mg_tasks of the csets on ->src_csets.  After, on ->mg_tasks of
-	 * the csets on ->dst_csets.  ->csets point to either ->src_csets
-	 * or ->dst_csets depending on whether migration is committed.
-	 *
-	 * ->cur_csets and ->cur_task point to the current task position
-	 * during iteration.
-	 */
-	struct list_head	*csets;
-	struct css_set		*cur_cset;
-	struct task_struct	*cur_task;
+/*
+ * Used to track tasks and other necessary states during migration.  All
+ * the migration state lives here instead of in the css_sets involved as
+ * migrations on different hierarchies may run in parallel and are likely
+ * to share css_sets.
+ */
+struct cgroup_taskset {
+	/* the target tasks, leader first, and their cgroup_mg_csets */
+	struct task_struct	**tasks;
+	struct cgroup_mg_cset	**mg_csets;
+	int			nr_tasks;
+	int			max_tasks;
+
+	/* iteration position for cgroup_taskset_*() */
+	int			cur;
 };
 
 /**
@@ -1947,8 +2038,7 @@ struct cgroup_taskset {
  */
 struct task_struct *cgroup_taskset_first(struct cgroup_taskset *tset)
 {
-	tset->cur_cset = list_first_entry(tset->csets, struct css_set, mg_node);
-	tset->cur_task = NULL;
+	tset->cur = 0;
 
 	return cgroup_taskset_next(tset);
 }
@@ -1962,44 +2052,25 @@ struct task_struct *cgroup_taskset_first(struct cgroup_taskset *tset)
  */
 struct task_struct *cgroup_taskset_next(struct cgroup_taskset *tset)
 {
-	struct css_set *cset = tset->cur_cset;
-	struct task_struct *task = tset->cur_task;
-
-	while (&cset->mg_node != tset->csets) {
-		if (!task)
-			task = list_first_entry(&cset->mg_tasks,
-						struct task_struct, cg_list);
-		else
-			task = list_next_entry(task, cg_list);
-
-		if (&task->cg_list != &cset->mg_tasks) {
-			tset->cur_cset = cset;
-			tset->cur_task = task;
-			return task;
-		}
-
-		cset = list_next_entry(cset, mg_node);
-		task = NULL;
-	}
+	if (tset->cur >= tset->nr_tasks)
+		return NULL;
 
-	return NULL;
+	return tset->tasks[tset->cur++];
 }
 
 /**
  * cgroup_task_migrate - move a task from one cgroup to another.
- * @old_cgrp: the cgroup @tsk is being migrated from
  * @tsk: the task being migrated
  * @new_cset: the new css_set @tsk is being attached to
  *
- * Must be called with cgroup_mutex, threadgroup and css_set_rwsem locked.
+ * Must be called with the destination hierarchy's attach_mutex,
+ * threadgroup and css_set_rwsem locked.
  */
-static void cgroup_task_migrate(struct cgroup *old_cgrp,
-				struct task_struct *tsk,
+static void cgroup_task_migrate(struct task_struct *tsk,
 				struct css_set *new_cset)
 {
 	struct css_set *old_cset;
 
-	lockdep_assert_held(&cgroup_mutex);
 	lockdep_assert_held(&css_set_rwsem);
 
 	/*
@@ -2012,107 +2083,163 @@ static void cgroup_task_migrate(struct cgroup *old_cgrp,
 
 	get_css_set(new_cset);
 	rcu_assign_pointer(tsk->cgroups, new_cset);
-
-	/*
-	 * Use move_tail so that cgroup_taskset_first() still returns the
-	 * leader after migration.  This works because cgroup_migrate()
-	 * ensures that the dst_cset of the leader is the first on the
-	 * tset's dst_csets list.
-	 */
-	list_move_tail(&tsk->cg_list, &new_cset->mg_tasks);
+	list_move_tail(&tsk->cg_list, &new_cset->tasks);
 
 	/*
 	 * We just gained a reference on old_cset by taking it from the
-	 * task. As trading it for new_cset is protected by cgroup_mutex,
-	 * we're safe to drop it here; it will be freed under RCU.
+	 * task.  As trading it for new_cset is protected by threadgroup
+	 * locking, we're safe to drop it here; it will be freed under RCU.
 	 */
 	put_css_set_locked(old_cset);
 }
 
 /**
  * cgroup_migrate_finish - cleanup after attach
- * @preloaded_csets: list of preloaded css_sets
+ * @mg_csets: list of cgroup_mg_csets
  *
  * Undo cgroup_migrate_add_src() and cgroup_migrate_prepare_dst().  See
  * those functions for details.
  */
-static void cgroup_migrate_finish(struct list_head *preloaded_csets)
+static void cgroup_migrate_finish(struct list_head *mg_csets)
 {
-	struct css_set *cset, *tmp_cset;
-
-	lockdep_assert_held(&cgroup_mutex);
+	struct cgroup_mg_cset *mgc, *tmp_mgc;
 
 	down_write(&css_set_rwsem);
-	list_for_each_entry_safe(cset, tmp_cset, preloaded_csets, mg_preload_node) {
-		cset->mg_src_cgrp = NULL;
-		cset->mg_dst_cset = NULL;
-		list_del_init(&cset->mg_preload_node);
-		put_css_set_locked(cset);
+	list_for_each_entry_safe(mgc, tmp_mgc, mg_csets, node) {
+		put_css_set_locked(mgc->src_cset);
+		if (mgc->dst_cset)
+			put_css_set_locked(mgc->dst_cset);
+		list_del(&mgc->node);
+		kfree(mgc);
 	}
 	up_write(&css_set_rwsem);
 }
 
+/**
+ * cgroup_mg_pool_fill - preallocate cgroup_mg_csets
+ * @pool: list to add the entries to
+ * @nr: number of entries to add
+ *
+ * cgroup_migrate_add_src() runs under css_set_rwsem and takes its entries
+ * from @pool.  Fill it before taking the lock and free what's left with
+ * cgroup_mg_pool_free() afterwards.
+ */
+static int cgroup_mg_pool_fill(struct list_head *pool, int nr)
+{
+	struct cgroup_mg_cset *mgc;
+
+	while (nr--) {
+		mgc = kzalloc(sizeof(*mgc), GFP_KERNEL);
+		if (!mgc)
+			return -ENOMEM;
+		list_add(&mgc->node, pool);
+	}
+	return 0;
+}
+
+static void cgroup_mg_pool_free(struct list_head *pool)
+{
+	struct cgroup_mg_cset *mgc, *tmp_mgc;
+
+	list_for_each_entry_safe(mgc, tmp_mgc, pool, node) {
+		list_del(&mgc->node);
+		kfree(mgc);
+	}
+}
+
+/**
+ * cgroup_taskset_alloc - preallocate the task arrays of a taskset
+ * @tset: taskset to allocate
+ * @leader: the leader of the process or the task to migrate
+ * @threadgroup: whether @leader points to the whole process or a single task
+ *
+ * Like the cgroup_mg_pool, allocated before the migration is set up so
+ * that cgroup_migrate() itself can't fail for lack of memory.  The number
+ * of threads can't grow while @leader's threadgroup is locked.  Free with
+ * cgroup_taskset_free().
+ */
+static int cgroup_taskset_alloc(struct cgroup_taskset *tset,
+				struct task_struct *leader, bool threadgroup)
+{
+	tset->max_tasks = threadgroup ? get_nr_threads(leader) : 1;
+	tset->tasks = kmalloc_array(tset->max_tasks, sizeof(tset->tasks[0]),
+				    GFP_KERNEL);
+	tset->mg_csets = kmalloc_array(tset->max_tasks,
+				       sizeof(tset->mg_csets[0]), GFP_KERNEL);
+	if (!tset->tasks || !tset->mg_csets)
+		return -ENOMEM;
+	return 0;
+}
+
+static void cgroup_taskset_free(struct cgroup_taskset *tset)
+{
+	kfree(tset->mg_csets);
+	kfree(tset->tasks);
+}
+
 /**
  * cgroup_migrate_add_src - add a migration source css_set
  * @src_cset: the source css_set to add
  * @dst_cgrp: the destination cgroup
- * @preloaded_csets: list of preloaded css_sets
+ * @mg_csets: list of cgroup_mg_csets
+ * @pool: preallocated cgroup_mg_csets
  *
  * Tasks belonging to @src_cset are about to be migrated to @dst_cgrp.  Pin
- * @src_cset and add it to @preloaded_csets, which should later be cleaned
- * up by cgroup_migrate_finish().
+ * @src_cset and add it to @mg_csets, which should later be cleaned up by
+ * cgroup_migrate_finish().  Called under css_set_rwsem and thus can't
+ * sleep; the tracking structure is taken from @pool and -EAGAIN is
+ * returned if @pool is empty.  The caller should then drop css_set_rwsem,
+ * refill @pool and retry.  Sources already on @mg_csets are skipped.
  *
- * This function may be called without holding threadgroup_lock even if the
- * target is a process.  Threads may be created and destroyed but as long
- * as cgroup_mutex is not dropped, no new css_set can be put into play and
- * the preloaded css_sets are guaranteed to cover all migrations.
+ * The css_set of a task may be changed by a migration on another
+ * hierarchy unless its threadgroup is locked.  The caller is responsible
+ * for holding threadgroup_lock of the target tasks if the sources need to
+ * stay accurate until cgroup_migrate().
  */
-static void cgroup_migrate_add_src(struct css_set *src_cset,
-				   struct cgroup *dst_cgrp,
-				   struct list_head *preloaded_csets)
+static int cgroup_migrate_add_src(struct css_set *src_cset,
+				  struct cgroup *dst_cgrp,
+				  struct list_head *mg_csets,
+				  struct list_head *pool)
 {
-	struct cgroup *src_cgrp;
+	struct cgroup_mg_cset *mgc;
 
-	lockdep_assert_held(&cgroup_mutex);
+	lockdep_assert_held(&dst_cgrp->root->attach_mutex);
 	lockdep_assert_held(&css_set_rwsem);
 
-	src_cgrp = cset_cgroup_from_root(src_cset, dst_cgrp->root);
-
-	if (!list_empty(&src_cset->mg_preload_node))
-		return;
+	list_for_each_entry(mgc, mg_csets, node)
+		if (mgc->src_cset == src_cset)
+			return 0;
 
-	WARN_ON(src_cset->mg_src_cgrp);
-	WARN_ON(!list_empty(&src_cset->mg_tasks));
-	WARN_ON(!list_empty(&src_cset->mg_node));
+	mgc = list_first_entry_or_null(pool, struct cgroup_mg_cset, node);
+	if (!mgc)
+		return -EAGAIN;
 
-	src_cset->mg_src_cgrp = src_cgrp;
+	mgc->src_cset = src_cset;
 	get_css_set(src_cset);
-	list_add(&src_cset->mg_preload_node, preloaded_csets);
+	list_move_tail(&mgc->node, mg_csets);
+	return 0;
 }
 
 /**
  * cgroup_migrate_prepare_dst - prepare destination css_sets for migration
  * @dst_cgrp: the destination cgroup (may be %NULL)
- * @preloaded_csets: list of preloaded source css_sets
+ * @mg_csets: list of cgroup_mg_csets
  *
  * Tasks are about to be moved to @dst_cgrp and all the source css_sets
- * have been preloaded to @preloaded_csets.  This function looks up and
- * pins all destination css_sets, links each to its source, and append them
- * to @preloaded_csets.  If @dst_cgrp is %NULL, the destination of each
- * source css_set is assumed to be its cgroup on the default hierarchy.
+ * have been added to @mg_csets.  This function looks up and pins the
+ * destination css_set of each source.  If @dst_cgrp is %NULL, the
+ * destination of each source css_set is assumed to be its cgroup on the
+ * default hierarchy.
  *
  * This function must be called after cgroup_migrate_add_src() has been
  * called on each migration source css_set.  After migration is performed
  * using cgroup_migrate(), cgroup_migrate_finish() must be called on
- * @preloaded_csets.
+ * @mg_csets.
  */
 static int cgroup_migrate_prepare_dst(struct cgroup *dst_cgrp,
-				      struct list_head *preloaded_csets)
+				      struct list_head *mg_csets)
 {
-	LIST_HEAD(csets);
-	struct css_set *src_cset, *tmp_cset;
-
-	lockdep_assert_held(&cgroup_mutex);
+	struct cgroup_mg_cset *mgc, *tmp_mgc;
 
 	/*
 	 * Except for the root, child_subsys_mask must be zero for a cgroup
@@ -2122,43 +2249,42 @@ static int cgroup_migrate_prepare_dst(struct cgroup *dst_cgrp,
 	    dst_cgrp->child_subsys_mask)
 		return -EBUSY;
 
-	/* look up the dst cset for each src cset and link it to src */
-	list_for_each_entry_safe(src_cset, tmp_cset, preloaded_csets, mg_preload_node) {
+	/* look up the dst cset for each src cset */
+	list_for_each_entry_safe(mgc, tmp_mgc, mg_csets, node) {
 		struct css_set *dst_cset;
 
-		dst_cset = find_css_set(src_cset,
-					dst_cgrp ?: src_cset->dfl_cgrp);
+		dst_cset = find_css_set(mgc->src_cset,
+					dst_cgrp ?: mgc->src_cset->dfl_cgrp);
 		if (!dst_cset)
-			goto err;
-
-		WARN_ON_ONCE(src_cset->mg_dst_cset || dst_cset->mg_dst_cset);
+			return -ENOMEM;
 
 		/*
-		 * If src cset equals dst, it's noop.  Drop the src.
-		 * cgroup_migrate() will skip the cset too.  Note that we
-		 * can't handle src == dst as some nodes are used by both.
+		 * If src cset equals dst, it's noop.  Drop the src and
+		 * cgroup_migrate() will skip its tasks.
 		 */
-		if (src_cset == dst_cset) {
-			src_cset->mg_src_cgrp = NULL;
-			list_del_init(&src_cset->mg_preload_node);
-			put_css_set(src_cset);
+		if (mgc->src_cset == dst_cset) {
+			list_del(&mgc->node);
+			put_css_set(mgc->src_cset);
 			put_css_set(dst_cset);
+			kfree(mgc);
 			continue;
 		}
 
-		src_cset->mg_dst_cset = dst_cset;
-
-		if (list_empty(&dst_cset->mg_preload_node))
-			list_add(&dst_cset->mg_preload_node, &csets);
-		else
-			put_css_set(dst_cset);
+		mgc->dst_cset = dst_cset;
 	}
 
-	list_splice_tail(&csets, preloaded_csets);
 	return 0;
-err:
-	cgroup_migrate_finish(&csets);
-	return -ENOMEM;
+}
+
+static struct cgroup_mg_cset *cgroup_mg_cset_find(struct list_head *mg_csets,
+						  struct css_set *cset)
+{
+	struct cgroup_mg_cset *mgc;
+
+	list_for_each_entry(mgc, mg_csets, node)
+		if (mgc->src_cset == cset)
+			return mgc;
+	return NULL;
 }
 
 /**
@@ -2166,12 +2292,19 @@ err:
  * @cgrp: the destination cgroup
  * @leader: the leader of the process or the task to migrate
  * @threadgroup: whether @leader points to the whole process or a single task
+ * @mg_csets: list of cgroup_mg_csets prepared for the migration
+ * @tset: taskset allocated by cgroup_taskset_alloc()
  *
- * Migrate a process or task denoted by @leader to @cgrp.  If migrating a
- * process, the caller must be holding threadgroup_lock of @leader.  The
- * caller is also responsible for invoking cgroup_migrate_add_src() and
- * cgroup_migrate_prepare_dst() on the targets before invoking this
- * function and following up with cgroup_migrate_finish().
+ * Migrate a process or task denoted by @leader to @cgrp.  The caller must
+ * be holding threadgroup_lock of @leader and the attach_mutex of @cgrp's
+ * hierarchy.  The caller is also responsible for invoking
+ * cgroup_migrate_add_src() and cgroup_migrate_prepare_dst() on the
+ * targets before invoking this function and following up with
+ * cgroup_migrate_finish().
+ *
+ * All the threads of a process are collected and committed at once, so
+ * migrating a process costs a single pass of the controller callbacks
+ * and a single css_set_rwsem write section regardless of its size.
  *
  * As long as a controller's ->can_attach() doesn't fail, this function is
  * guaranteed to succeed.  This means that, excluding ->can_attach()
@@ -2180,27 +2313,26 @@ err:
  * actually starting migrating.
  */
 static int cgroup_migrate(struct cgroup *cgrp, struct task_struct *leader,
-			  bool threadgroup)
+			  bool threadgroup, struct list_head *mg_csets,
+			  struct cgroup_taskset *tset)
 {
-	struct cgroup_taskset tset = {
-		.src_csets	= LIST_HEAD_INIT(tset.src_csets),
-		.dst_csets	= LIST_HEAD_INIT(tset.dst_csets),
-		.csets		= &tset.src_csets,
-	};
 	struct cgroup_subsys_state *css, *failed_css = NULL;
-	struct css_set *cset, *tmp_cset;
-	struct task_struct *task, *tmp_task;
+	struct task_struct *task;
 	int i, ret;
 
+	lockdep_assert_held(&cgrp->root->attach_mutex);
+
 	/*
 	 * Prevent freeing of tasks while we take a snapshot. Tasks that are
 	 * already PF_EXITING could be freed from underneath us unless we
 	 * take an rcu_read_lock.
 	 */
-	down_write(&css_set_rwsem);
+	down_read(&css_set_rwsem);
 	rcu_read_lock();
 	task = leader;
 	do {
+		struct cgroup_mg_cset *mgc;
+
 		/* @task either already exited or can't exit until the end */
 		if (task->flags & PF_EXITING)
 			goto next;
@@ -2209,35 +2341,29 @@ static int cgroup_migrate(struct cgroup *cgrp, struct task_struct *leader,
 		if (list_empty(&task->cg_list))
 			goto next;
 
-		cset = task_css_set(task);
-		if (!cset->mg_src_cgrp)
+		mgc = cgroup_mg_cset_find(mg_csets, task_css_set(task));
+		if (!mgc)
 			goto next;
 
-		/*
-		 * cgroup_taskset_first() must always return the leader.
-		 * Take care to avoid disturbing the ordering.
-		 */
-		list_move_tail(&task->cg_list, &cset->mg_tasks);
-		if (list_empty(&cset->mg_node))
-			list_add_tail(&cset->mg_node, &tset.src_csets);
-		if (list_empty(&cset->mg_dst_cset->mg_node))
-			list_move_tail(&cset->mg_dst_cset->mg_node,
-				       &tset.dst_csets);
+		/* cgroup_taskset_first() must always return the leader */
+		tset->tasks[tset->nr_tasks] = task;
+		tset->mg_csets[tset->nr_tasks] = mgc;
+		tset->nr_tasks++;
 	next:
-		if (!threadgroup)
+		if (!threadgroup || tset->nr_tasks == tset->max_tasks)
 			break;
 	} while_each_thread(leader, task);
 	rcu_read_unlock();
-	up_write(&css_set_rwsem);
+	up_read(&css_set_rwsem);
 
 	/* methods shouldn't be called if no task is actually migrating */
-	if (list_empty(&tset.src_csets))
+	if (!tset->nr_tasks)
 		return 0;
 
 	/* check that we can legitimately attach to the cgroup */
 	for_each_e_css(css, i, cgrp) {
 		if (css->ss->can_attach) {
-			ret = css->ss->can_attach(css, &tset);
+			ret = css->ss->can_attach(css, tset);
 			if (ret) {
 				failed_css = css;
 				goto out_cancel_attach;
@@ -2251,11 +2377,9 @@ static int cgroup_migrate(struct cgroup *cgrp, struct task_struct *leader,
 	 * is the commit point.
 	 */
 	down_write(&css_set_rwsem);
-	list_for_each_entry(cset, &tset.src_csets, mg_node) {
-		list_for_each_entry_safe(task, tmp_task, &cset->mg_tasks, cg_list)
-			cgroup_task_migrate(cset->mg_src_cgrp, task,
-					    cset->mg_dst_cset);
-	}
+	for (i = 0; i < tset->nr_tasks; i++)
+		cgroup_task_migrate(tset->tasks[i],
+				    tset->mg_csets[i]->dst_cset);
 	up_write(&css_set_rwsem);
 
 	/*
@@ -2263,67 +2387,81 @@ static int cgroup_migrate(struct cgroup *cgrp, struct task_struct *leader,
 	 * Nothing is sensitive to fork() after this point.  Notify
 	 * controllers that migration is complete.
 	 */
-	tset.csets = &tset.dst_csets;
-
 	for_each_e_css(css, i, cgrp)
 		if (css->ss->attach)
-			css->ss->attach(css, &tset);
+			css->ss->attach(css, tset);
 
-	ret = 0;
-	goto out_release_tset;
+	return 0;
 
 out_cancel_attach:
 	for_each_e_css(css, i, cgrp) {
 		if (css == failed_css)
 			break;
 		if (css->ss->cancel_attach)
-			css->ss->cancel_attach(css, &tset);
-	}
-out_release_tset:
-	down_write(&css_set_rwsem);
-	list_splice_init(&tset.dst_csets, &tset.src_csets);
-	list_for_each_entry_safe(cset, tmp_cset, &tset.src_csets, mg_node) {
-		list_splice_tail_init(&cset->mg_tasks, &cset->tasks);
-		list_del_init(&cset->mg_node);
+			css->ss->cancel_attach(css, tset);
 	}
-	up_write(&css_set_rwsem);
 	return ret;
 }
 
 /**
  * cgroup_attach_task - attach a task or a whole threadgroup to a cgroup
- * @dst_cgrp: the cgroup to attach to
+ * @dst_cgrp: the cgroup to attach to, %NULL to refresh the css
+ *	      associations of @leader's cgroup on the default hierarchy
  * @leader: the task or the leader of the threadgroup to be attached
  * @threadgroup: attach the whole threadgroup?
  *
- * Call holding cgroup_mutex and threadgroup_lock of @leader.
+ * Call holding the attach_mutex of @dst_cgrp's hierarchy and
+ * threadgroup_lock of @leader.
  */
 static int cgroup_attach_task(struct cgroup *dst_cgrp,
 			      struct task_struct *leader, bool threadgroup)
 {
-	LIST_HEAD(preloaded_csets);
+	struct cgroup *root_cgrp = dst_cgrp ?: &cgrp_dfl_root.cgrp;
+	struct cgroup_taskset tset = { };
+	LIST_HEAD(mg_csets);
+	LIST_HEAD(mg_pool);
 	struct task_struct *task;
+	struct cgroup *cgrp;
+	int nr_pool = 1;
 	int ret;
 
-	/* look up all src csets */
-	down_read(&css_set_rwsem);
-	rcu_read_lock();
-	task = leader;
+	ret = cgroup_taskset_alloc(&tset, leader, threadgroup);
+	if (ret)
+		goto out_free;
+
+	/* look up all src csets, threads usually share one */
 	do {
-		cgroup_migrate_add_src(task_css_set(task), dst_cgrp,
-				       &preloaded_csets);
-		if (!threadgroup)
+		ret = cgroup_mg_pool_fill(&mg_pool, nr_pool);
+		if (ret)
 			break;
-	} while_each_thread(leader, task);
-	rcu_read_unlock();
-	up_read(&css_set_rwsem);
+		nr_pool *= 2;
+
+		down_read(&css_set_rwsem);
+		rcu_read_lock();
+		cgrp = dst_cgrp ?: task_css_set(leader)->dfl_cgrp;
+		task = leader;
+		do {
+			ret = cgroup_migrate_add_src(task_css_set(task),
+						     root_cgrp, &mg_csets,
+						     &mg_pool);
+			if (ret || !threadgroup)
+				break;
+		} while_each_thread(leader, task);
+		rcu_read_unlock();
+		up_read(&css_set_rwsem);
+	} while (ret == -EAGAIN);
+	cgroup_mg_pool_free(&mg_pool);
 
 	/* prepare dst csets and commit */
-	ret = cgroup_migrate_prepare_dst(dst_cgrp, &preloaded_csets);
 	if (!ret)
-		ret = cgroup_migrate(dst_cgrp, leader, threadgroup);
+		ret = cgroup_migrate_prepare_dst(dst_cgrp, &mg_csets);
+	if (!ret)
+		ret = cgroup_migrate(cgrp, leader, threadgroup, &mg_csets,
+				     &tset);
 
-	cgroup_migrate_finish(&preloaded_csets);
+	cgroup_migrate_finish(&mg_csets);
+out_free:
+	cgroup_taskset_free(&tset);
 	return ret;
 }
 
@@ -2368,7 +2506,7 @@ static int cgroup_allow_attach(struct cgroup *cgrp, struct cgroup_taskset *tset)
 /*
  * Find the task_struct of the task to attach by vpid and pass it along to the
  * function to attach either it or all tasks in its threadgroup. Will lock
- * cgroup_mutex and threadgroup.
+ * the hierarchy's attach_mutex and threadgroup.
  */
 static ssize_t __cgroup_procs_write(struct kernfs_open_file *of, char *buf,
 				    size_t nbytes, loff_t off, bool threadgroup)
@@ -2382,7 +2520,7 @@ static ssize_t __cgroup_procs_write(struct kernfs_open_file *of, char *buf,
 	if (kstrtoint(strstrip(buf), 0, &pid) || pid < 0)
 		return -EINVAL;
 
-	cgrp = cgroup_kn_lock_live(of->kn);
+	cgrp = cgroup_kn_lock_attach(of->kn);
 	if (!cgrp)
 		return -ENODEV;
 
@@ -2408,15 +2546,11 @@ retry_find_task:
 			 * cgroup a chance to extend the permission check
 			 */
 			struct cgroup_taskset tset = {
-				.src_csets = LIST_HEAD_INIT(tset.src_csets),
-				.dst_csets = LIST_HEAD_INIT(tset.dst_csets),
-				.csets = &tset.src_csets,
+				.tasks = &tsk,
+				.nr_tasks = 1,
 			};
-			struct css_set *cset;
-			cset = task_css_set(tsk);
-			list_add(&cset->mg_node, &tset.src_csets);
+
 			ret = cgroup_allow_attach(cgrp, &tset);
-			list_del(&tset.src_csets);
 			if (ret) {
 				rcu_read_unlock();
 				goto out_unlock_cgroup;
@@ -2464,7 +2598,7 @@ retry_find_task:
 
 	put_task_struct(tsk);
 out_unlock_cgroup:
-	cgroup_kn_unlock(of->kn);
+	cgroup_kn_unlock_attach(of->kn);
 	return ret ?: nbytes;
 }
 
@@ -2478,6 +2612,7 @@ int cgroup_attach_task_all(struct task_struct *from, struct task_struct *tsk)
 	struct cgroup_root *root;
 	int retval = 0;
 
+	/* cgroup_mutex keeps the list of hierarchies stable */
 	mutex_lock(&cgroup_mutex);
 	for_each_root(root) {
 		struct cgroup *from_cgrp;
@@ -2485,11 +2620,17 @@ int cgroup_attach_task_all(struct task_struct *from, struct task_struct *tsk)
 		if (root == &cgrp_dfl_root)
 			continue;
 
+		cgroup_attach_lock(root);
+		threadgroup_lock(tsk);
+
 		down_read(&css_set_rwsem);
 		from_cgrp = task_cgroup_from_root(from, root);
 		up_read(&css_set_rwsem);
 
 		retval = cgroup_attach_task(from_cgrp, tsk, false);
+
+		threadgroup_unlock(tsk);
+		cgroup_attach_unlock(root);
 		if (retval)
 			break;
 	}
@@ -2603,40 +2744,64 @@ static int cgroup_subtree_control_show(struct seq_file *seq, void *v)
  */
 static int cgroup_update_dfl_csses(struct cgroup *cgrp)
 {
-	LIST_HEAD(preloaded_csets);
+	LIST_HEAD(src_csets);
+	LIST_HEAD(mg_pool);
 	struct cgroup_subsys_state *css;
-	struct css_set *src_cset;
-	int ret;
+	struct cgroup_mg_cset *mgc;
+	int nr_pool = 4;
+	int ret = 0;
 
+	/*
+	 * Migrations on other hierarchies copy the default hierarchy csses
+	 * of their source css_sets.  cgroup_migrate_rwsem must be held for
+	 * writing so that no task can move to a css_set with stale
+	 * associations while they're being updated.
+	 */
 	lockdep_assert_held(&cgroup_mutex);
+	lockdep_assert_held(&cgroup_migrate_rwsem);
+	lockdep_assert_held(&cgrp->root->attach_mutex);
 
 	/* look up all csses currently attached to @cgrp's subtree */
-	down_read(&css_set_rwsem);
-	css_for_each_descendant_pre(css, cgroup_css(cgrp, NULL)) {
-		struct cgrp_cset_link *link;
+	do {
+		ret = cgroup_mg_pool_fill(&mg_pool, nr_pool);
+		if (ret)
+			break;
+		nr_pool *= 2;
 
-		/* self is not affected by child_subsys_mask change */
-		if (css->cgroup == cgrp)
-			continue;
+		down_read(&css_set_rwsem);
+		css_for_each_descendant_pre(css, cgroup_css(cgrp, NULL)) {
+			struct cgrp_cset_link *link;
 
-		list_for_each_entry(link, &css->cgroup->cset_links, cset_link)
-			cgroup_migrate_add_src(link->cset, cgrp,
-					       &preloaded_csets);
-	}
-	up_read(&css_set_rwsem);
+			/* self is not affected by child_subsys_mask change */
+			if (css->cgroup == cgrp)
+				continue;
+
+			list_for_each_entry(link, &css->cgroup->cset_links,
+					    cset_link) {
+				ret = cgroup_migrate_add_src(link->cset, cgrp,
+							     &src_csets,
+							     &mg_pool);
+				if (ret)
+					break;
+			}
+			if (ret)
+				break;
+		}
+		up_read(&css_set_rwsem);
+	} while (ret == -EAGAIN);
+	cgroup_mg_pool_free(&mg_pool);
+	if (ret)
+		goto out_finish;
 
-	/* NULL dst indicates self on default hierarchy */
-	ret = cgroup_migrate_prepare_dst(NULL, &preloaded_csets);
+	/* NULL dst indicates self on default hierarchy, drops noop csets */
+	ret = cgroup_migrate_prepare_dst(NULL, &src_csets);
 	if (ret)
 		goto out_finish;
 
-	list_for_each_entry(src_cset, &preloaded_csets, mg_preload_node) {
+	list_for_each_entry(mgc, &src_csets, node) {
+		struct css_set *src_cset = mgc->src_cset;
 		struct task_struct *last_task = NULL, *task;
 
-		/* src_csets precede dst_csets, break on the first dst_cset */
-		if (!src_cset->mg_src_cgrp)
-			break;
-
 		/*
 		 * All tasks in src_cset need to be migrated to the
 		 * matching dst_cset.  Empty it process by process.  We
@@ -2651,7 +2816,6 @@ static int cgroup_update_dfl_csses(struct cgroup *cgrp)
 						struct task_struct, cg_list);
 			if (task) {
 				task = task->group_leader;
-				WARN_ON_ONCE(!task_css_set(task)->mg_src_cgrp);
 				get_task_struct(task);
 			}
 			up_read(&css_set_rwsem);
@@ -2673,7 +2837,7 @@ static int cgroup_update_dfl_csses(struct cgroup *cgrp)
 				continue;
 			}
 
-			ret = cgroup_migrate(src_cset->dfl_cgrp, task, true);
+			ret = cgroup_attach_task(NULL, task, true);
 
 			threadgroup_unlock(task);
 			put_task_struct(task);
@@ -2684,7 +2848,7 @@ static int cgroup_update_dfl_csses(struct cgroup *cgrp)
 	}
 
 out_finish:
-	cgroup_migrate_finish(&preloaded_csets);
+	cgroup_migrate_finish(&src_csets);
 	return ret;
 }
 
@@ -2797,13 +2961,17 @@ static ssize_t cgroup_subtree_control_write(struct kernfs_open_file *of,
 		goto out_unlock;
 	}
 
+	/* see cgroup_update_dfl_csses() */
+	down_write(&cgroup_migrate_rwsem);
+	mutex_lock(&cgrp->root->attach_mutex);
+
 	/*
 	 * Except for the root, subtree_control must be zero for a cgroup
 	 * with tasks so that child cgroups don't compete against tasks.
 	 */
 	if (enable && cgroup_parent(cgrp) && !list_empty(&cgrp->cset_links)) {
 		ret = -EBUSY;
-		goto out_unlock;
+		goto out_unlock_attach;
 	}
 
 	/*
@@ -2880,6 +3048,9 @@ static ssize_t cgroup_subtree_control_write(struct kernfs_open_file *of,
 
 	kernfs_activate(cgrp->kn);
 	ret = 0;
+out_unlock_attach:
+	mutex_unlock(&cgrp->root->attach_mutex);
+	up_write(&cgroup_migrate_rwsem);
 out_unlock:
 	cgroup_kn_unlock(of->kn);
 	return ret ?: nbytes;
@@ -2905,7 +3076,7 @@ err_undo_css:
 				cgroup_clear_dir(child, 1 << ssid);
 		}
 	}
-	goto out_unlock;
+	goto out_unlock_attach;
 }
 
 static int cgroup_populated_show(struct seq_file *seq, void *v)
@@ -3589,17 +3760,11 @@ static void css_advance_task_iter(struct css_task_iter *it)
 			link = list_entry(l, struct cgrp_cset_link, cset_link);
 			cset = link->cset;
 		}
-	} while (list_empty(&cset->tasks) && list_empty(&cset->mg_tasks));
+	} while (list_empty(&cset->tasks));
 
 	it->cset_pos = l;
-
-	if (!list_empty(&cset->tasks))
-		it->task_pos = cset->tasks.next;
-	else
-		it->task_pos = cset->mg_tasks.next;
-
+	it->task_pos = cset->tasks.next;
 	it->tasks_head = &cset->tasks;
-	it->mg_tasks_head = &cset->mg_tasks;
 }
 
 /**
@@ -3656,16 +3821,12 @@ struct task_struct *css_task_iter_next(struct css_task_iter *it)
 	res = list_entry(l, struct task_struct, cg_list);
 
 	/*
-	 * Advance iterator to find next entry.  cset->tasks is consumed
-	 * first and then ->mg_tasks.  After ->mg_tasks, we move onto the
-	 * next cset.
+	 * Advance iterator to find next entry.  After cset->tasks, we move
+	 * onto the next cset.
 	 */
 	l = l->next;
 
 	if (l == it->tasks_head)
-		l = it->mg_tasks_head->next;
-
-	if (l == it->mg_tasks_head)
 		css_advance_task_iter(it);
 	else
 		it->task_pos = l;
@@ -3698,27 +3859,17 @@ void css_task_iter_end(struct css_task_iter *it)
  */
 int cgroup_transfer_tasks(struct cgroup *to, struct cgroup *from)
 {
-	LIST_HEAD(preloaded_csets);
-	struct cgrp_cset_link *link;
 	struct css_task_iter it;
 	struct task_struct *task;
-	int ret;
-
-	mutex_lock(&cgroup_mutex);
-
-	/* all tasks in @from are being moved, all csets are source */
-	down_read(&css_set_rwsem);
-	list_for_each_entry(link, &from->cset_links, cset_link)
-		cgroup_migrate_add_src(link->cset, to, &preloaded_csets);
-	up_read(&css_set_rwsem);
+	int ret = 0;
 
-	ret = cgroup_migrate_prepare_dst(to, &preloaded_csets);
-	if (ret)
-		goto out_err;
+	cgroup_attach_lock(to->root);
 
 	/*
-	 * Migrate tasks one-by-one until @form is empty.  This fails iff
-	 * ->can_attach() fails.
+	 * Migrate tasks one-by-one until @from is empty.  This fails iff
+	 * ->can_attach() fails.  Each task is threadgroup locked so that
+	 * a migration on another hierarchy can't change its css_set while
+	 * its migration is being prepared.
 	 */
 	do {
 		css_task_iter_start(&from->self, &it);
@@ -3732,13 +3883,14 @@ int cgroup_transfer_tasks(struct cgroup *to, struct cgroup *from)
 		css_task_iter_end(&it);
 
 		if (task) {
-			ret = cgroup_migrate(to, task, false);
+			threadgroup_lock(task);
+			ret = cgroup_attach_task(to, task, false);
+			threadgroup_unlock(task);
 			put_task_struct(task);
 		}
 	} while (task && !ret);
-out_err:
-	cgroup_migrate_finish(&preloaded_csets);
-	mutex_unlock(&cgroup_mutex);
+
+	cgroup_attach_unlock(to->root);
 	return ret;
 }
 
@@ -4812,6 +4964,12 @@ static int cgroup_destroy_locked(struct cgroup *cgrp)
 
 	lockdep_assert_held(&cgroup_mutex);
 
+	/*
+	 * Task migrations don't hold cgroup_mutex.  Keep them out while
+	 * checking emptiness and marking @cgrp dead.
+	 */
+	cgroup_attach_lock(cgrp->root);
+
 	/*
 	 * css_set_rwsem synchronizes access to ->cset_links and prevents
 	 * @cgrp from being removed while put_css_set() is in progress.
@@ -4819,22 +4977,23 @@ static int cgroup_destroy_locked(struct cgroup *cgrp)
 	down_read(&css_set_rwsem);
 	empty = list_empty(&cgrp->cset_links);
 	up_read(&css_set_rwsem);
-	if (!empty)
-		return -EBUSY;
 
 	/*
 	 * Make sure there's no live children.  We can't test emptiness of
 	 * ->self.children as dead children linger on it while being
 	 * drained; otherwise, "rmdir parent/child parent" may fail.
 	 */
-	if (css_has_online_children(&cgrp->self))
+	if (!empty || css_has_online_children(&cgrp->self)) {
+		cgroup_attach_unlock(cgrp->root);
 		return -EBUSY;
+	}
 
 	/*
 	 * Mark @cgrp dead.  This prevents further task migration and child
 	 * creation by disabling cgroup_lock_live_group().
 	 */
 	cgrp->self.flags &= ~CSS_ONLINE;
+	cgroup_attach_unlock(cgrp->root);
 
 	/* initiate massacre of all css's */
 	for_each_css(css, ssid, cgrp)
@@ -5522,12 +5681,6 @@ static int cgroup_css_links_read(struct seq_file *seq, void *v)
 				goto overflow;
 			seq_printf(seq, "  task %d\n", task_pid_vnr(task));
 		}
-
-		list_for_each_entry(task, &cset->mg_tasks, cg_list) {
-			if (count++ > MAX_TASKS_SHOWN_PER_CSS)
-				goto overflow;
-			seq_printf(seq, "  task %d\n", task_pid_vnr(task));
-		}
 		continue;
 	overflow:
 		seq_puts(seq, "  ...\n");
@@ -73,6 +73,55 @@ bool cgroup_freezing(struct task_struct *task)
 	return ret;
 }
 
+/**
+ * cgroup_freezer_for_each_task - visit the tasks of all non-frozen cgroups
+ * @fn: function to call for each task
+ * @data: argument passed to @fn
+ *
+ * Used by the system freezer to send freeze requests without walking the
+ * tasks that FROZEN cgroups already hold in the refrigerator.  A FROZEN
+ * cgroup's descendants are all frozen too, so whole subtrees are skipped.
+ * Tasks migrating while this runs may be missed, the caller has to verify
+ * the result with a full scan.  Returns the number of subtrees skipped.
+ */
+unsigned int cgroup_freezer_for_each_task(
+		void (*fn)(struct task_struct *, void *), void *data)
+{
+	struct cgroup_subsys_state *root, *pos;
+	struct css_task_iter it;
+	struct task_struct *task;
+	unsigned int skipped = 0;
+
+	mutex_lock(&freezer_mutex);
+	rcu_read_lock();
+
+	root = task_css(&init_task, freezer_cgrp_id);
+	css_for_each_descendant_pre(pos, root) {
+		if (css_freezer(pos)->state & CGROUP_FROZEN) {
+			pos = css_rightmost_descendant(pos);
+			skipped++;
+			continue;
+		}
+
+		if (!css_tryget_online(pos))
+			continue;
+		rcu_read_unlock();
+
+		css_task_iter_start(pos, &it);
+		while ((task = css_task_iter_next(&it)))
+			fn(task, data);
+		css_task_iter_end(&it);
+
+		rcu_read_lock();
+		css_put(pos);
+	}
+
+	rcu_read_unlock();
+	mutex_unlock(&freezer_mutex);
+
+	return skipped;
+}
+
 static const char *freezer_state_strs(unsigned int state)
 {
 	if (state & CGROUP_FROZEN)
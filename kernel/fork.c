@@ -74,6 +74,7 @@
 #include <linux/uprobes.h>
 #include <linux/aio.h>
 #include <linux/compiler.h>
+#include <linux/kobject.h>
 
 #include <asm/pgtable.h>
 #include <asm/pgalloc.h>
@@ -122,17 +123,90 @@ void __weak arch_release_task_struct(struct task_struct *tsk)
 {
 }
 
+/*
+ * Small per-cpu caches of recently freed task structs and kernel stacks.
+ * Forks closely follow exits (zygote forks, thread pool churn), so handing
+ * back a cache warm object skips the slab and, for the stack, a high order
+ * page allocation under zone->lock which may even enter compaction.
+ */
+#define TASK_CACHE_SIZE		4
+
+enum {
+	TASK_CACHE_TASK,
+	TASK_CACHE_STACK,
+	NR_TASK_CACHES,
+};
+
+struct task_cache {
+	void		*objs[NR_TASK_CACHES][TASK_CACHE_SIZE];
+	unsigned int	nr[NR_TASK_CACHES];
+	unsigned long	hits[NR_TASK_CACHES];
+	unsigned long	misses[NR_TASK_CACHES];
+};
+
+static DEFINE_PER_CPU(struct task_cache, task_cache);
+static bool task_cache_enabled __read_mostly = true;
+
+static void *task_cache_get(int type, int node)
+{
+	struct task_cache *tc;
+	unsigned long flags;
+	void *obj = NULL;
+
+	/* cached objects are not charged to the new task's memcg */
+	if (!task_cache_enabled || memcg_kmem_enabled() ||
+	    (node != NUMA_NO_NODE && node != numa_node_id()))
+		return NULL;
+
+	local_irq_save(flags);
+	tc = this_cpu_ptr(&task_cache);
+	if (tc->nr[type]) {
+		obj = tc->objs[type][--tc->nr[type]];
+		tc->hits[type]++;
+	} else {
+		tc->misses[type]++;
+	}
+	local_irq_restore(flags);
+
+	return obj;
+}
+
+/* May be called from the RCU callback freeing the task */
+static bool task_cache_put(int type, void *obj)
+{
+	struct task_cache *tc;
+	unsigned long flags;
+	bool cached = false;
+
+	/* checked with irqs off, so that task_cache_drain_all() sees it */
+	local_irq_save(flags);
+	tc = this_cpu_ptr(&task_cache);
+	if (task_cache_enabled && !memcg_kmem_enabled() &&
+	    tc->nr[type] < TASK_CACHE_SIZE) {
+		tc->objs[type][tc->nr[type]++] = obj;
+		cached = true;
+	}
+	local_irq_restore(flags);
+
+	return cached;
+}
+
 #ifndef CONFIG_ARCH_TASK_STRUCT_ALLOCATOR
 static struct kmem_cache *task_struct_cachep;
 
 static inline struct task_struct *alloc_task_struct_node(int node)
 {
+	struct task_struct *tsk = task_cache_get(TASK_CACHE_TASK, node);
+
+	if (tsk)
+		return tsk;
 	return kmem_cache_alloc_node(task_struct_cachep, GFP_KERNEL, node);
 }
 
 static inline void free_task_struct(struct task_struct *tsk)
 {
-	kmem_cache_free(task_struct_cachep, tsk);
+	if (!task_cache_put(TASK_CACHE_TASK, tsk))
+		kmem_cache_free(task_struct_cachep, tsk);
 }
 #endif
 
@@ -150,15 +224,25 @@ void __weak arch_release_thread_info(struct thread_info *ti)
 static struct thread_info *alloc_thread_info_node(struct task_struct *tsk,
 						  int node)
 {
-	struct page *page = alloc_kmem_pages_node(node, THREADINFO_GFP,
-						  THREAD_SIZE_ORDER);
+	struct thread_info *ti;
+	struct page *page;
+
+	ti = task_cache_get(TASK_CACHE_STACK, node);
+	if (ti) {
+		if (THREADINFO_GFP & __GFP_ZERO)
+			memset(ti, 0, THREAD_SIZE);
+		return ti;
+	}
+
+	page = alloc_kmem_pages_node(node, THREADINFO_GFP, THREAD_SIZE_ORDER);
 
 	return page ? page_address(page) : NULL;
 }
 
 static inline void free_thread_info(struct thread_info *ti)
 {
-	free_kmem_pages((unsigned long)ti, THREAD_SIZE_ORDER);
+	if (!task_cache_put(TASK_CACHE_STACK, ti))
+		free_kmem_pages((unsigned long)ti, THREAD_SIZE_ORDER);
 }
 # else
 static struct kmem_cache *thread_info_cache;
@@ -183,6 +267,125 @@ void thread_info_cache_init(void)
 # endif
 #endif
 
+static void task_cache_drain(unsigned int cpu)
+{
+	struct task_cache *tc = &per_cpu(task_cache, cpu);
+	unsigned long flags;
+	void *obj;
+
+	local_irq_save(flags);
+	while (tc->nr[TASK_CACHE_TASK]) {
+		obj = tc->objs[TASK_CACHE_TASK][--tc->nr[TASK_CACHE_TASK]];
+#ifndef CONFIG_ARCH_TASK_STRUCT_ALLOCATOR
+		kmem_cache_free(task_struct_cachep, obj);
+#endif
+	}
+	while (tc->nr[TASK_CACHE_STACK]) {
+		obj = tc->objs[TASK_CACHE_STACK][--tc->nr[TASK_CACHE_STACK]];
+#if !defined(CONFIG_ARCH_THREAD_INFO_ALLOCATOR) && THREAD_SIZE >= PAGE_SIZE
+		free_kmem_pages((unsigned long)obj, THREAD_SIZE_ORDER);
+#endif
+	}
+	local_irq_restore(flags);
+}
+
+static int task_cache_cpu_notify(struct notifier_block *self,
+				 unsigned long action, void *hcpu)
+{
+	if ((action & ~CPU_TASKS_FROZEN) == CPU_DEAD)
+		task_cache_drain((unsigned long)hcpu);
+	return NOTIFY_OK;
+}
+
+static long task_cache_drain_local(void *unused)
+{
+	task_cache_drain(smp_processor_id());
+	return 0;
+}
+
+/*
+ * Free the cached objects of all cpus, once the cache was disabled or
+ * kmem accounting turned on: nothing is cached any more after that.
+ */
+void task_cache_drain_all(void)
+{
+	int cpu;
+
+	get_online_cpus();
+	for_each_online_cpu(cpu)
+		work_on_cpu(cpu, task_cache_drain_local, NULL);
+	put_online_cpus();
+}
+
+#ifdef CONFIG_SYSFS
+
+static ssize_t task_cache_enabled_show(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", task_cache_enabled);
+}
+
+static ssize_t task_cache_enabled_store(struct kobject *kobj,
+					struct kobj_attribute *attr,
+					const char *buf, size_t count)
+{
+	bool enabled;
+
+	if (strtobool(buf, &enabled))
+		return -EINVAL;
+
+	task_cache_enabled = enabled;
+	if (!enabled)
+		task_cache_drain_all();
+	return count;
+}
+static struct kobj_attribute task_cache_enabled_attr =
+	__ATTR(enabled, 0644, task_cache_enabled_show, task_cache_enabled_store);
+
+#define TASK_CACHE_STAT_ATTR(_name, _field, _type)			\
+static ssize_t _name##_show(struct kobject *kobj,			\
+			    struct kobj_attribute *attr, char *buf)	\
+{									\
+	unsigned long sum = 0;						\
+	int cpu;							\
+									\
+	for_each_possible_cpu(cpu)					\
+		sum += per_cpu(task_cache, cpu)._field[_type];		\
+	return sprintf(buf, "%lu\n", sum);				\
+}									\
+static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+
+TASK_CACHE_STAT_ATTR(task_hits, hits, TASK_CACHE_TASK);
+TASK_CACHE_STAT_ATTR(task_misses, misses, TASK_CACHE_TASK);
+TASK_CACHE_STAT_ATTR(stack_hits, hits, TASK_CACHE_STACK);
+TASK_CACHE_STAT_ATTR(stack_misses, misses, TASK_CACHE_STACK);
+
+static struct attribute *task_cache_attrs[] = {
+	&task_cache_enabled_attr.attr,
+	&task_hits_attr.attr,
+	&task_misses_attr.attr,
+	&stack_hits_attr.attr,
+	&stack_misses_attr.attr,
+	NULL,
+};
+
+static struct attribute_group task_cache_attr_group = {
+	.attrs = task_cache_attrs,
+	.name = "task_cache",
+};
+#endif /* CONFIG_SYSFS */
+
+static int __init task_cache_init(void)
+{
+	hotcpu_notifier(task_cache_cpu_notify, 0);
+#ifdef CONFIG_SYSFS
+	if (sysfs_create_group(mm_kobj, &task_cache_attr_group))
+		pr_err("fork: failed to register task_cache group\n");
+#endif
+	return 0;
+}
+subsys_initcall(task_cache_init);
+
 /* SLAB cache for signal_struct structures (tsk->signal) */
 static struct kmem_cache *signal_cachep;
 
@@ -659,6 +862,244 @@ void __mmdrop(struct mm_struct *mm)
 }
 EXPORT_SYMBOL_GPL(__mmdrop);
 
+/*
+ * Address space teardown of tasks killed with SIGKILL is handed off to
+ * a dedicated thread so that the dying task can finish exiting while
+ * its memory is being freed.  The thread runs at normal priority and is
+ * boosted while allocators are waiting for it in the slow path.
+ */
+static LIST_HEAD(mm_teardown_list);
+static DEFINE_SPINLOCK(mm_teardown_lock);
+static DECLARE_WAIT_QUEUE_HEAD(mm_teardown_wait_queue);
+static DECLARE_WAIT_QUEUE_HEAD(mm_teardown_done_queue);
+static struct task_struct *mm_teardown_task;
+static struct mem_cgroup *mm_teardown_current;	/* of the mm being freed */
+static bool mm_teardown_enabled __read_mostly = true;
+static bool mm_teardown_boosted;
+static atomic_t mm_teardown_pending = ATOMIC_INIT(0);
+static atomic_t mm_teardown_seq = ATOMIC_INIT(0);
+static unsigned long mm_teardown_progress;	/* jiffies */
+
+/* maximum time an allocation waits for a pending teardown */
+#define MM_TEARDOWN_WAIT	(HZ / 50)
+/* pending teardowns stop holding off the OOM killers after this long */
+#define MM_TEARDOWN_STALL	HZ
+
+/* SIGKILL to memory freed statistics, in microseconds */
+static DEFINE_SPINLOCK(mm_teardown_stats_lock);
+static unsigned long mm_teardown_count;
+static u64 mm_teardown_last_us;
+static u64 mm_teardown_max_us;
+static u64 mm_teardown_total_us;
+
+static void __mmput(struct mm_struct *mm)
+{
+	u64 kill_time = mm->kill_time;
+
+	uprobe_clear_state(mm);
+	exit_aio(mm);
+	ksm_exit(mm);
+	khugepaged_exit(mm); /* must run before exit_mmap */
+	exit_mmap(mm);
+
+	if (kill_time) {
+		u64 us = div_u64(ktime_get_ns() - kill_time, NSEC_PER_USEC);
+
+		spin_lock(&mm_teardown_stats_lock);
+		mm_teardown_count++;
+		mm_teardown_last_us = us;
+		mm_teardown_max_us = max(mm_teardown_max_us, us);
+		mm_teardown_total_us += us;
+		spin_unlock(&mm_teardown_stats_lock);
+	}
+
+	set_mm_exe_file(mm, NULL);
+	if (!list_empty(&mm->mmlist)) {
+		spin_lock(&mmlist_lock);
+		list_del(&mm->mmlist);
+		spin_unlock(&mmlist_lock);
+	}
+	if (mm->binfmt)
+		module_put(mm->binfmt->module);
+	mmdrop(mm);
+}
+
+#ifdef CONFIG_MEMCG
+/* the memcg the exiting task's memory is charged to */
+static void mm_teardown_set_memcg(struct mm_struct *mm)
+{
+	rcu_read_lock();
+	mm->teardown_memcg = mem_cgroup_from_task(current);
+	css_get(mem_cgroup_css(mm->teardown_memcg));
+	rcu_read_unlock();
+}
+
+static inline struct mem_cgroup *mm_teardown_memcg(struct mm_struct *mm)
+{
+	return mm->teardown_memcg;
+}
+
+static bool mm_teardown_charged_to(struct mem_cgroup *charged,
+				   struct mem_cgroup *memcg)
+{
+	return charged && __mem_cgroup_same_or_subtree(memcg, charged);
+}
+#else
+static inline void mm_teardown_set_memcg(struct mm_struct *mm)
+{
+}
+
+static inline struct mem_cgroup *mm_teardown_memcg(struct mm_struct *mm)
+{
+	return NULL;
+}
+
+static bool mm_teardown_charged_to(struct mem_cgroup *charged,
+				   struct mem_cgroup *memcg)
+{
+	return true;
+}
+#endif
+
+static int mm_teardown_thread(void *unused)
+{
+	struct mem_cgroup *memcg;
+	struct mm_struct *mm;
+
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(mm_teardown_wait_queue,
+				     atomic_read(&mm_teardown_pending) ||
+				     kthread_should_stop());
+
+		spin_lock(&mm_teardown_lock);
+		while (!list_empty(&mm_teardown_list)) {
+			mm = list_first_entry(&mm_teardown_list,
+					      struct mm_struct, teardown_list);
+			list_del(&mm->teardown_list);
+			memcg = mm_teardown_memcg(mm);
+			mm_teardown_current = memcg;
+			spin_unlock(&mm_teardown_lock);
+
+			__mmput(mm);
+			spin_lock(&mm_teardown_lock);
+			mm_teardown_current = NULL;
+			spin_unlock(&mm_teardown_lock);
+			if (memcg)
+				css_put(mem_cgroup_css(memcg));
+			mm_teardown_progress = jiffies;
+			atomic_dec(&mm_teardown_pending);
+			atomic_inc(&mm_teardown_seq);
+			wake_up_all(&mm_teardown_done_queue);
+			cond_resched();
+
+			spin_lock(&mm_teardown_lock);
+		}
+		if (mm_teardown_boosted) {
+			mm_teardown_boosted = false;
+			set_user_nice(current, 0);
+		}
+		spin_unlock(&mm_teardown_lock);
+	}
+	return 0;
+}
+
+/*
+ * Queue @mm for teardown if its last user is a task exiting on SIGKILL.
+ * Returns false if the caller has to tear it down itself.
+ */
+static bool mm_teardown_queue(struct mm_struct *mm)
+{
+	struct signal_struct *sig = current->signal;
+
+	if (!(current->flags & PF_EXITING) || !sig->kill_time)
+		return false;
+
+	mm->kill_time = sig->kill_time;
+	if (!mm_teardown_enabled || !mm_teardown_task)
+		return false;
+
+	mm_teardown_set_memcg(mm);
+	spin_lock(&mm_teardown_lock);
+	list_add_tail(&mm->teardown_list, &mm_teardown_list);
+	if (atomic_inc_return(&mm_teardown_pending) == 1)
+		mm_teardown_progress = jiffies;
+	spin_unlock(&mm_teardown_lock);
+
+	wake_up(&mm_teardown_wait_queue);
+	return true;
+}
+
+/**
+ * mm_teardown_wait - let pending address space teardowns make progress
+ * @gfp_mask: gfp mask of the allocation
+ *
+ * Called from the page allocator slow path once direct reclaim failed,
+ * before going OOM.  If killed tasks are still handing their memory
+ * back, boost the teardown thread and wait a short while for it.
+ *
+ * Returns true if the caller waited and should retry the freelists.
+ */
+bool mm_teardown_wait(gfp_t gfp_mask)
+{
+	int seq;
+
+	if ((gfp_mask & (__GFP_WAIT | __GFP_FS)) != (__GFP_WAIT | __GFP_FS))
+		return false;
+	if (!mm_teardown_busy(NULL) || current == mm_teardown_task)
+		return false;
+
+	seq = atomic_read(&mm_teardown_seq);
+
+	spin_lock(&mm_teardown_lock);
+	if (!mm_teardown_boosted && atomic_read(&mm_teardown_pending)) {
+		mm_teardown_boosted = true;
+		set_user_nice(mm_teardown_task, MIN_NICE);
+	}
+	spin_unlock(&mm_teardown_lock);
+
+	wait_event_timeout(mm_teardown_done_queue,
+			   atomic_read(&mm_teardown_seq) != seq,
+			   MM_TEARDOWN_WAIT);
+	return true;
+}
+
+/**
+ * mm_teardown_busy - is the memory of killed tasks still being freed?
+ * @memcg: only count teardowns charged to this memcg's hierarchy, or
+ *         all of them if %NULL
+ *
+ * Like for a TIF_MEMDIE task, the OOM killers wait for pending teardowns
+ * rather than pick another victim, unless the teardown thread has not
+ * finished one in a while.  A memcg OOM only waits for the memory that
+ * frees its own charges: a stream of kills elsewhere keeps the teardown
+ * thread busy indefinitely.
+ */
+bool mm_teardown_busy(struct mem_cgroup *memcg)
+{
+	struct mm_struct *mm;
+	bool busy = false;
+
+	if (!atomic_read(&mm_teardown_pending) ||
+	    time_after_eq(jiffies, ACCESS_ONCE(mm_teardown_progress) +
+				   MM_TEARDOWN_STALL))
+		return false;
+	if (!memcg)
+		return true;
+
+	spin_lock(&mm_teardown_lock);
+	busy = mm_teardown_charged_to(mm_teardown_current, memcg);
+	list_for_each_entry(mm, &mm_teardown_list, teardown_list) {
+		if (busy)
+			break;
+		busy = mm_teardown_charged_to(mm_teardown_memcg(mm), memcg);
+	}
+	spin_unlock(&mm_teardown_lock);
+	return busy;
+}
+EXPORT_SYMBOL_GPL(mm_teardown_busy);
+
 /*
  * Decrement the use count and release all resources for an mm.
  */
@@ -667,24 +1108,96 @@ void mmput(struct mm_struct *mm)
 	might_sleep();
 
 	if (atomic_dec_and_test(&mm->mm_users)) {
-		uprobe_clear_state(mm);
-		exit_aio(mm);
-		ksm_exit(mm);
-		khugepaged_exit(mm); /* must run before exit_mmap */
-		exit_mmap(mm);
-		set_mm_exe_file(mm, NULL);
-		if (!list_empty(&mm->mmlist)) {
-			spin_lock(&mmlist_lock);
-			list_del(&mm->mmlist);
-			spin_unlock(&mmlist_lock);
-		}
-		if (mm->binfmt)
-			module_put(mm->binfmt->module);
-		mmdrop(mm);
+		if (mm_teardown_queue(mm))
+			return;
+		__mmput(mm);
 	}
 }
 EXPORT_SYMBOL_GPL(mmput);
 
+#ifdef CONFIG_SYSFS
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", mm_teardown_enabled);
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	bool enabled;
+
+	if (strtobool(buf, &enabled))
+		return -EINVAL;
+
+	mm_teardown_enabled = enabled;
+	return count;
+}
+static struct kobj_attribute enabled_attr =
+	__ATTR(enabled, 0644, enabled_show, enabled_store);
+
+static ssize_t pending_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", atomic_read(&mm_teardown_pending));
+}
+static struct kobj_attribute pending_attr = __ATTR_RO(pending);
+
+#define MM_TEARDOWN_STAT_ATTR(_name, _expr)				\
+static ssize_t _name##_show(struct kobject *kobj,			\
+			    struct kobj_attribute *attr, char *buf)	\
+{									\
+	u64 val;							\
+									\
+	spin_lock(&mm_teardown_stats_lock);				\
+	val = (_expr);							\
+	spin_unlock(&mm_teardown_stats_lock);				\
+	return sprintf(buf, "%llu\n", (unsigned long long)val);		\
+}									\
+static struct kobj_attribute _name##_attr = __ATTR_RO(_name)
+
+MM_TEARDOWN_STAT_ATTR(kill_to_free_count, mm_teardown_count);
+MM_TEARDOWN_STAT_ATTR(kill_to_free_last_us, mm_teardown_last_us);
+MM_TEARDOWN_STAT_ATTR(kill_to_free_max_us, mm_teardown_max_us);
+MM_TEARDOWN_STAT_ATTR(kill_to_free_avg_us, mm_teardown_count ?
+		      div64_u64(mm_teardown_total_us, mm_teardown_count) : 0);
+
+static struct attribute *mm_teardown_attrs[] = {
+	&enabled_attr.attr,
+	&pending_attr.attr,
+	&kill_to_free_count_attr.attr,
+	&kill_to_free_last_us_attr.attr,
+	&kill_to_free_max_us_attr.attr,
+	&kill_to_free_avg_us_attr.attr,
+	NULL,
+};
+
+static struct attribute_group mm_teardown_attr_group = {
+	.attrs = mm_teardown_attrs,
+	.name = "exit_teardown",
+};
+#endif /* CONFIG_SYSFS */
+
+static int __init mm_teardown_init(void)
+{
+	struct task_struct *tsk;
+
+	tsk = kthread_run(mm_teardown_thread, NULL, "kmm_teardown");
+	if (IS_ERR(tsk)) {
+		pr_err("mm: failed to start teardown thread\n");
+		return PTR_ERR(tsk);
+	}
+	mm_teardown_task = tsk;
+
+#ifdef CONFIG_SYSFS
+	if (sysfs_create_group(mm_kobj, &mm_teardown_attr_group))
+		pr_err("mm: failed to register exit_teardown group\n");
+#endif
+	return 0;
+}
+subsys_initcall(mm_teardown_init);
+
 void set_mm_exe_file(struct mm_struct *mm, struct file *new_exe_file)
 {
 	if (new_exe_file)
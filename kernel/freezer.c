@@ -28,6 +28,21 @@ EXPORT_SYMBOL_GPL(pm_freezing);
 /* protects freezing and frozen transitions */
 static DEFINE_SPINLOCK(freezer_lock);
 
+/*
+ * Number of freeze requests try_to_freeze_tasks() is still waiting for.
+ * Tasks entering the refrigerator count it down and the last one wakes
+ * the freezer up, so it does not have to poll.
+ */
+atomic_t pm_freeze_todo = ATOMIC_INIT(0);
+DECLARE_WAIT_QUEUE_HEAD(pm_freeze_wait);
+
+static void pm_freeze_task_done(void)
+{
+	if (atomic_add_unless(&pm_freeze_todo, -1, 0) &&
+	    !atomic_read(&pm_freeze_todo))
+		wake_up(&pm_freeze_wait);
+}
+
 /**
  * freezing_slow_path - slow path for testing whether a task needs to be frozen
  * @p: task to be tested
@@ -77,6 +92,8 @@ bool __refrigerator(bool check_kthr_stop)
 
 		if (!(current->flags & PF_FROZEN))
 			break;
+		if (!was_frozen)
+			pm_freeze_task_done();
 		was_frozen = true;
 		schedule();
 	}
@@ -0,0 +1,242 @@
+/*
+ * linux/kernel/irq/balance.c
+ *
+ * In-kernel interrupt balancer.
+ *
+ * Every interrupt accounts the time spent in its hard and threaded
+ * handlers.  Periodically the balancer charges each online CPU with the
+ * handler time of the interrupts routed to it, plus a fixed entry/exit
+ * cost per interrupt, and moves interrupts from the busiest CPU to the
+ * idlest one as long as that lowers the maximum.  Threaded handlers
+ * follow the affinity of their interrupt, so they move along.
+ *
+ * Interrupts whose affinity was set by userspace or by a driver are left
+ * where they are, but their load is still taken into account.
+ */
+
+#include <linux/irq.h>
+#include <linux/interrupt.h>
+#include <linux/cpu.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+#include <linux/moduleparam.h>
+
+#include "internals.h"
+
+#undef MODULE_PARAM_PREFIX
+#define MODULE_PARAM_PREFIX "irq_balance."
+
+static bool enable = true;
+module_param(enable, bool, 0644);
+
+/* Interval between two balancing passes */
+static unsigned int interval_ms = 2000;
+module_param(interval_ms, uint, 0644);
+
+/* Estimated cost of taking one interrupt, on top of the handler time */
+static unsigned int entry_cost_ns = 2000;
+module_param(entry_cost_ns, uint, 0644);
+
+/* Do not bother for imbalances below this per mille of the interval */
+static unsigned int min_imbalance = 10;
+module_param(min_imbalance, uint, 0644);
+
+struct irq_load {
+	unsigned int	irq;
+	unsigned int	cpu;
+	u64		load;
+};
+
+static u64 cpu_load[NR_CPUS];
+
+static void irq_balance_fn(struct work_struct *work);
+static DECLARE_DEFERRABLE_WORK(irq_balance_work, irq_balance_fn);
+
+void irq_balance_account(struct irq_desc *desc, u64 start, bool thread)
+{
+	u64 ns = local_clock() - start;
+	int bucket = min_t(int, fls64(div_u64(ns, NSEC_PER_USEC)),
+			   IRQ_LAT_BUCKETS - 1);
+
+	if (thread) {
+		desc->bal.thread_ns += ns;
+		desc->bal.thread_hist[bucket]++;
+	} else {
+		desc->bal.hardirq_ns += ns;
+		desc->bal.hardirq_hist[bucket]++;
+	}
+}
+
+/* May the balancer move @irq, or is someone else in charge of it? */
+static bool irq_balance_movable(unsigned int irq, struct irq_desc *desc)
+{
+	struct irq_data *d = &desc->irq_data;
+
+	if (!desc->action || !irq_can_set_affinity(irq))
+		return false;
+	if (!irqd_affinity_was_set(d))
+		return true;
+
+	/* set by us, and either unchanged or migrated away by hotplug */
+	return desc->bal.moved &&
+	       (cpumask_equal(d->affinity, cpumask_of(desc->bal.cpu)) ||
+		!cpu_online(desc->bal.cpu));
+}
+
+/*
+ * Move @desc to @cpu.  irq_set_affinity_locked() forgets any earlier move
+ * by the balancer, so it is recorded under the same lock hold: a change
+ * from userspace or a driver in between always wins.
+ */
+static int irq_balance_move(struct irq_desc *desc, unsigned int cpu)
+{
+	unsigned long flags;
+	int ret;
+
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	ret = irq_set_affinity_locked(&desc->irq_data, cpumask_of(cpu), false);
+	if (!ret) {
+		desc->bal.cpu = cpu;
+		desc->bal.moved = true;
+	}
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+	return ret;
+}
+
+/*
+ * Charge every online CPU with the load of the interrupts routed to it
+ * and collect the movable ones in @loads.  Returns their number.
+ */
+static int irq_balance_collect(struct irq_load *loads, int max)
+{
+	struct irq_desc *desc;
+	unsigned int irq, count, cpu;
+	int nr = 0;
+	u64 ns, load;
+
+	for_each_online_cpu(cpu)
+		cpu_load[cpu] = 0;
+
+	for_each_active_irq(irq) {
+		desc = irq_to_desc(irq);
+		if (!desc || irqd_is_per_cpu(&desc->irq_data))
+			continue;
+
+		ns = desc->bal.hardirq_ns + desc->bal.thread_ns;
+		count = kstat_irqs(irq);
+		load = (ns - desc->bal.last_ns) +
+		       (u64)(count - desc->bal.last_count) * entry_cost_ns;
+		desc->bal.last_ns = ns;
+		desc->bal.last_count = count;
+
+		cpu = cpumask_first_and(desc->irq_data.affinity,
+					cpu_online_mask);
+		if (cpu >= nr_cpu_ids || !load)
+			continue;
+		cpu_load[cpu] += load;
+
+		if (nr < max && irq_balance_movable(irq, desc)) {
+			loads[nr].irq = irq;
+			loads[nr].cpu = cpu;
+			loads[nr].load = load;
+			nr++;
+		}
+	}
+	return nr;
+}
+
+static void irq_balance_fn(struct work_struct *work)
+{
+	u64 threshold = (u64)interval_ms * NSEC_PER_MSEC * min_imbalance / 1000;
+	unsigned int cpu, busiest, idlest;
+	struct irq_load *loads, *best;
+	int nr, i, moves;
+
+	loads = kmalloc_array(nr_irqs, sizeof(*loads), GFP_KERNEL);
+	if (!loads)
+		goto out;
+
+	get_online_cpus();
+	irq_lock_sparse();
+	nr = irq_balance_collect(loads, nr_irqs);
+
+	for (moves = 0; enable && moves < num_online_cpus(); moves++) {
+		busiest = idlest = cpumask_first(cpu_online_mask);
+		for_each_online_cpu(cpu) {
+			if (cpu_load[cpu] > cpu_load[busiest])
+				busiest = cpu;
+			if (cpu_load[cpu] < cpu_load[idlest])
+				idlest = cpu;
+		}
+		if (cpu_load[busiest] - cpu_load[idlest] <= threshold)
+			break;
+
+		/* biggest interrupt whose move lowers the maximum */
+		best = NULL;
+		for (i = 0; i < nr; i++) {
+			if (loads[i].cpu != busiest ||
+			    loads[i].load >= cpu_load[busiest] - cpu_load[idlest])
+				continue;
+			if (!best || loads[i].load > best->load)
+				best = &loads[i];
+		}
+		if (!best)
+			break;
+
+		if (irq_balance_move(irq_to_desc(best->irq), idlest)) {
+			best->cpu = nr_cpu_ids;
+			continue;
+		}
+
+		cpu_load[busiest] -= best->load;
+		cpu_load[idlest] += best->load;
+		best->cpu = idlest;
+	}
+
+	irq_unlock_sparse();
+	put_online_cpus();
+	kfree(loads);
+out:
+	queue_delayed_work(system_power_efficient_wq, &irq_balance_work,
+			   msecs_to_jiffies(interval_ms));
+}
+
+/* Rebalance right away when the hotplug governor adds or removes a CPU */
+static int irq_balance_cpu_notify(struct notifier_block *self,
+				  unsigned long action, void *hcpu)
+{
+	switch (action) {
+	case CPU_ONLINE:
+	case CPU_DEAD:
+		mod_delayed_work(system_power_efficient_wq, &irq_balance_work, 0);
+		break;
+	}
+	return NOTIFY_OK;
+}
+
+static struct notifier_block irq_balance_cpu_nb = {
+	.notifier_call = irq_balance_cpu_notify,
+};
+
+static int __init irq_balance_init(void)
+{
+	struct irq_desc *desc;
+	unsigned int irq;
+
+	/* the first pass only charges what happened since now */
+	irq_lock_sparse();
+	for_each_active_irq(irq) {
+		desc = irq_to_desc(irq);
+		if (!desc)
+			continue;
+		desc->bal.last_ns = desc->bal.hardirq_ns + desc->bal.thread_ns;
+		desc->bal.last_count = kstat_irqs(irq);
+	}
+	irq_unlock_sparse();
+
+	register_hotcpu_notifier(&irq_balance_cpu_nb);
+	queue_delayed_work(system_power_efficient_wq, &irq_balance_work,
+			   msecs_to_jiffies(interval_ms));
+	return 0;
+}
+late_initcall(irq_balance_init);
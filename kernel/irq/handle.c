@@ -135,6 +135,7 @@ handle_irq_event_percpu(struct irq_desc *desc, struct irqaction *action)
 {
 	irqreturn_t retval = IRQ_NONE;
 	unsigned int flags = 0, irq = desc->irq_data.irq;
+	u64 start = irq_balance_start();
 
 	do {
 		irqreturn_t res;
@@ -175,6 +176,8 @@ handle_irq_event_percpu(struct irq_desc *desc, struct irqaction *action)
 		action = action->next;
 	} while (action);
 
+	irq_balance_account(desc, start, false);
+
 	add_interrupt_randomness(irq, flags);
 
 	if (!noirqdebug)
@@ -199,6 +199,25 @@ static inline void kstat_incr_irqs_this_cpu(unsigned int irq, struct irq_desc *d
 	__this_cpu_inc(kstat.irqs_sum);
 }
 
+#ifdef CONFIG_IRQ_BALANCE
+static inline u64 irq_balance_start(void)
+{
+	return local_clock();
+}
+void irq_balance_account(struct irq_desc *desc, u64 start, bool thread);
+
+/* An affinity change from outside the balancer pins the interrupt */
+static inline void irq_balance_forget(struct irq_desc *desc)
+{
+	desc->bal.moved = false;
+}
+#else
+static inline u64 irq_balance_start(void) { return 0; }
+static inline void
+irq_balance_account(struct irq_desc *desc, u64 start, bool thread) { }
+static inline void irq_balance_forget(struct irq_desc *desc) { }
+#endif
+
 #ifdef CONFIG_PM_SLEEP
 bool irq_pm_check_wakeup(struct irq_desc *desc);
 void irq_pm_install_action(struct irq_desc *desc, struct irqaction *action);
@@ -95,6 +95,9 @@ static void desc_set_defaults(unsigned int irq, struct irq_desc *desc, int node,
 	desc->depth = 1;
 	desc->irq_count = 0;
 	desc->irqs_unhandled = 0;
+#ifdef CONFIG_IRQ_BALANCE
+	memset(&desc->bal, 0, sizeof(desc->bal));
+#endif
 	desc->name = NULL;
 	desc->owner = owner;
 	for_each_possible_cpu(cpu)
@@ -202,6 +202,8 @@ int irq_set_affinity_locked(struct irq_data *data, const struct cpumask *mask,
 	if (!chip || !chip->irq_set_affinity)
 		return -EINVAL;
 
+	irq_balance_forget(desc);
+
 	if (irq_can_move_pcntxt(data)) {
 		ret = irq_do_set_affinity(data, mask, force);
 	} else {
@@ -241,6 +243,7 @@ int irq_set_affinity_hint(unsigned int irq, const struct cpumask *m)
 	if (!desc)
 		return -EINVAL;
 	desc->affinity_hint = m;
+	irq_balance_forget(desc);
 	irq_put_desc_unlock(desc, flags);
 	return 0;
 }
@@ -369,6 +372,7 @@ int irq_select_affinity_usr(unsigned int irq, struct cpumask *mask)
 	int ret;
 
 	raw_spin_lock_irqsave(&desc->lock, flags);
+	irq_balance_forget(desc);
 	ret = setup_affinity(irq, desc, mask);
 	raw_spin_unlock_irqrestore(&desc->lock, flags);
 	return ret;
@@ -864,10 +868,13 @@ static int irq_thread(void *data)
 
 	while (!irq_wait_for_interrupt(action)) {
 		irqreturn_t action_ret;
+		u64 start;
 
 		irq_thread_check_affinity(desc, action);
 
+		start = irq_balance_start();
 		action_ret = handler_fn(desc, action);
+		irq_balance_account(desc, start, true);
 		if (action_ret == IRQ_HANDLED)
 			atomic_inc(&desc->threads_handled);
 
@@ -284,6 +284,47 @@ static const struct file_operations irq_spurious_proc_fops = {
 	.release	= single_release,
 };
 
+#ifdef CONFIG_IRQ_BALANCE
+static void irq_latency_show_hist(struct seq_file *m, const char *name,
+				  const unsigned int *hist, u64 ns)
+{
+	int i;
+
+	seq_printf(m, "%-8s", name);
+	for (i = 0; i < IRQ_LAT_BUCKETS; i++)
+		seq_printf(m, " %8u", hist[i]);
+	seq_printf(m, "  total %llu us\n", div_u64(ns, NSEC_PER_USEC));
+}
+
+static int irq_latency_proc_show(struct seq_file *m, void *v)
+{
+	struct irq_desc *desc = irq_to_desc((long) m->private);
+	int i;
+
+	seq_printf(m, "%-8s", "usecs");
+	for (i = 0; i < IRQ_LAT_BUCKETS; i++)
+		seq_printf(m, " %7s%u", "<", 1U << i);
+	seq_putc(m, '\n');
+	irq_latency_show_hist(m, "hardirq", desc->bal.hardirq_hist,
+			      desc->bal.hardirq_ns);
+	irq_latency_show_hist(m, "thread", desc->bal.thread_hist,
+			      desc->bal.thread_ns);
+	return 0;
+}
+
+static int irq_latency_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, irq_latency_proc_show, PDE_DATA(inode));
+}
+
+static const struct file_operations irq_latency_proc_fops = {
+	.open		= irq_latency_proc_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+#endif
+
 #define MAX_NAMELEN 128
 
 static int name_unique(unsigned int irq, struct irqaction *new_action)
@@ -371,6 +412,11 @@ void register_irq_proc(unsigned int irq, struct irq_desc *desc)
 	proc_create_data("spurious", 0444, desc->dir,
 			 &irq_spurious_proc_fops, (void *)(long)irq);
 
+#ifdef CONFIG_IRQ_BALANCE
+	proc_create_data("latency", 0444, desc->dir,
+			 &irq_latency_proc_fops, (void *)(long)irq);
+#endif
+
 out_unlock:
 	mutex_unlock(&register_lock);
 }
@@ -388,6 +434,9 @@ void unregister_irq_proc(unsigned int irq, struct irq_desc *desc)
 	remove_proc_entry("node", desc->dir);
 #endif
 	remove_proc_entry("spurious", desc->dir);
+#ifdef CONFIG_IRQ_BALANCE
+	remove_proc_entry("latency", desc->dir);
+#endif
 
 	memset(name, 0, MAX_NAMELEN);
 	sprintf(name, "%u", irq);
@@ -74,6 +74,38 @@ static ssize_t pm_async_store(struct kobject *kobj, struct kobj_attribute *attr,
 
 power_attr(pm_async);
 
+/*
+ * If set, device tree devices are resumed in parallel, each waiting only
+ * for the parent and the providers referenced from its node.  Off by
+ * default: devices without a node, or with dependencies the node does not
+ * describe, no longer resume after everything in front of them.
+ */
+int pm_async_resume_enabled;
+
+static ssize_t pm_async_resume_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", pm_async_resume_enabled);
+}
+
+static ssize_t pm_async_resume_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t n)
+{
+	unsigned long val;
+
+	if (kstrtoul(buf, 10, &val))
+		return -EINVAL;
+
+	if (val > 1)
+		return -EINVAL;
+
+	pm_async_resume_enabled = val;
+	return n;
+}
+
+power_attr(pm_async_resume);
+
 #ifdef CONFIG_PM_DEBUG
 int pm_test_level = TEST_NONE;
 
@@ -226,10 +258,45 @@ static const struct file_operations suspend_stats_operations = {
 	.release        = single_release,
 };
 
+static void suspend_entry_show_freeze(struct seq_file *s, const char *name,
+				      struct freeze_stats *st)
+{
+	seq_printf(s, "%s: %llu us (scan %llu us, wait %llu us, "
+		   "rounds %u, requests %u, cgroups skipped %u)\n",
+		   name, st->total_us, st->scan_us, st->wait_us,
+		   st->rounds, st->requests, st->cgroup_skips);
+}
+
+static int suspend_entry_show(struct seq_file *s, void *unused)
+{
+	struct suspend_entry_stats *st = &suspend_entry_stats;
+
+	seq_printf(s, "sync: %llu us\n", st->sync_us);
+	seq_printf(s, "prepare_notifiers: %llu us\n", st->prepare_us);
+	suspend_entry_show_freeze(s, "freeze_user", &st->user);
+	suspend_entry_show_freeze(s, "freeze_kernel", &st->kernel);
+
+	return 0;
+}
+
+static int suspend_entry_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, suspend_entry_show, NULL);
+}
+
+static const struct file_operations suspend_entry_operations = {
+	.open           = suspend_entry_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
 static int __init pm_debugfs_init(void)
 {
 	debugfs_create_file("suspend_stats", S_IFREG | S_IRUGO,
 			NULL, NULL, &suspend_stats_operations);
+	debugfs_create_file("suspend_entry_time", S_IFREG | S_IRUGO,
+			NULL, NULL, &suspend_entry_operations);
 	return 0;
 }
 
@@ -657,6 +724,7 @@ static struct attribute * g[] = {
 #endif
 #ifdef CONFIG_PM_SLEEP
 	&pm_async_attr.attr,
+	&pm_async_resume_attr.attr,
 	&wakeup_count_attr.attr,
 #ifdef CONFIG_PM_AUTOSLEEP
 	&autosleep_attr.attr,
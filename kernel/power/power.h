@@ -228,6 +228,28 @@ enum {
 
 extern int pm_test_level;
 
+#ifdef CONFIG_FREEZER
+/* kernel/power/process.c */
+struct freeze_stats {
+	u64 total_us;			/* whole try_to_freeze_tasks() */
+	u64 scan_us;			/* sending freeze requests */
+	u64 wait_us;			/* waiting for tasks to freeze */
+	unsigned int rounds;
+	unsigned int requests;
+	unsigned int cgroup_skips;	/* frozen cgroup subtrees skipped */
+};
+
+/* Where the time of the last suspend entry went. */
+struct suspend_entry_stats {
+	u64 sync_us;
+	u64 prepare_us;			/* PM_SUSPEND_PREPARE notifiers */
+	struct freeze_stats user;
+	struct freeze_stats kernel;
+};
+
+extern struct suspend_entry_stats suspend_entry_stats;
+#endif
+
 #ifdef CONFIG_SUSPEND_FREEZER
 static inline int suspend_freeze_processes(void)
 {
@@ -17,22 +17,74 @@
 #include <linux/delay.h>
 #include <linux/workqueue.h>
 #include <linux/kmod.h>
+#include <linux/ktime.h>
 #include <trace/events/power.h>
 #include <linux/wakeup_reason.h>
 
+#include "power.h"
+
 /* 
  * Timeout for stopping processes
  */
 unsigned int __read_mostly freeze_timeout_msecs = 20 * MSEC_PER_SEC;
 
+struct suspend_entry_stats suspend_entry_stats;
+
+/*
+ * Send a freeze request to @p.  The request is counted in pm_freeze_todo
+ * before it is sent, so a task that freezes right away finds it accounted.
+ */
+static void freeze_one_task(struct task_struct *p, void *data)
+{
+	unsigned int *todo = data;
+
+	if (p == current)
+		return;
+
+	atomic_inc(&pm_freeze_todo);
+	if (!freeze_task(p) || freezer_should_skip(p)) {
+		atomic_dec(&pm_freeze_todo);
+		return;
+	}
+
+	(*todo)++;
+}
+
+/*
+ * Send freeze requests to every task that still needs one.  Tasks of
+ * frozen cgroups are already in the refrigerator and are skipped; once the
+ * cgroup walk finds nothing left, a full pass over all threads confirms it
+ * and catches tasks that moved between cgroups during the walk.
+ */
+static unsigned int freeze_scan(struct freeze_stats *stats)
+{
+	struct task_struct *g, *p;
+	unsigned int todo = 0;
+
+#ifdef CONFIG_CGROUP_FREEZER
+	stats->cgroup_skips += cgroup_freezer_for_each_task(freeze_one_task,
+							    &todo);
+	if (todo)
+		return todo;
+#endif
+
+	read_lock(&tasklist_lock);
+	for_each_process_thread(g, p)
+		freeze_one_task(p, &todo);
+	read_unlock(&tasklist_lock);
+
+	return todo;
+}
+
 static int try_to_freeze_tasks(bool user_only)
 {
+	struct freeze_stats *stats = user_only ? &suspend_entry_stats.user :
+						 &suspend_entry_stats.kernel;
 	struct task_struct *g, *p;
 	unsigned long end_time;
 	unsigned int todo;
 	bool wq_busy = false;
-	struct timeval start, end;
-	u64 elapsed_msecs64;
+	ktime_t start, t;
 	unsigned int elapsed_msecs;
 	bool wakeup = false;
 	int sleep_usecs = USEC_PER_MSEC;
@@ -40,7 +92,8 @@ static int try_to_freeze_tasks(bool user_only)
 	char suspend_abort[MAX_SUSPEND_ABORT_LEN];
 #endif
 
-	do_gettimeofday(&start);
+	memset(stats, 0, sizeof(*stats));
+	start = ktime_get();
 
 	end_time = jiffies + msecs_to_jiffies(freeze_timeout_msecs);
 
@@ -48,16 +101,12 @@ static int try_to_freeze_tasks(bool user_only)
 		freeze_workqueues_begin();
 
 	while (true) {
-		todo = 0;
-		read_lock(&tasklist_lock);
-		for_each_process_thread(g, p) {
-			if (p == current || !freeze_task(p))
-				continue;
-
-			if (!freezer_should_skip(p))
-				todo++;
-		}
-		read_unlock(&tasklist_lock);
+		t = ktime_get();
+		atomic_set(&pm_freeze_todo, 0);
+		todo = freeze_scan(stats);
+		stats->requests += todo;
+		stats->rounds++;
+		stats->scan_us += ktime_us_delta(ktime_get(), t);
 
 		if (!user_only) {
 			wq_busy = freeze_workqueues_busy();
@@ -79,18 +128,21 @@ static int try_to_freeze_tasks(bool user_only)
 
 		/*
 		 * We need to retry, but first give the freezing tasks some
-		 * time to enter the refrigerator.  Start with an initial
-		 * 1 ms sleep followed by exponential backoff until 8 ms.
+		 * time to enter the refrigerator.  The last task to freeze
+		 * wakes us up; otherwise (exiting tasks, busy workqueues)
+		 * time out after 1 ms with exponential backoff until 8 ms.
 		 */
-		usleep_range(sleep_usecs / 2, sleep_usecs);
+		t = ktime_get();
+		wait_event_hrtimeout(pm_freeze_wait,
+				     !atomic_read(&pm_freeze_todo),
+				     ns_to_ktime(sleep_usecs * NSEC_PER_USEC));
+		stats->wait_us += ktime_us_delta(ktime_get(), t);
 		if (sleep_usecs < 8 * USEC_PER_MSEC)
 			sleep_usecs *= 2;
 	}
 
-	do_gettimeofday(&end);
-	elapsed_msecs64 = timeval_to_ns(&end) - timeval_to_ns(&start);
-	do_div(elapsed_msecs64, NSEC_PER_MSEC);
-	elapsed_msecs = elapsed_msecs64;
+	stats->total_us = ktime_us_delta(ktime_get(), start);
+	elapsed_msecs = div_u64(stats->total_us, USEC_PER_MSEC);
 
 	if (wakeup) {
 		printk("\n");
@@ -243,6 +295,9 @@ void thaw_processes(void)
 	for_each_process_thread(g, p) {
 		/* No other threads should have PF_SUSPEND_TASK set */
 		WARN_ON((p != curr) && (p->flags & PF_SUSPEND_TASK));
+		/* a frozen cgroup would send it right back */
+		if (cgroup_freezing(p))
+			continue;
 		__thaw_task(p);
 	}
 	read_unlock(&tasklist_lock);
@@ -34,6 +34,7 @@
 #include <linux/spinlock.h>
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/ktime.h>
 #include <linux/fs.h>
 #include <linux/device.h>
 #include <linux/miscdevice.h>
@@ -49,9 +50,16 @@
 #include <trace/events/power.h>
 
 /*
- * locking rule: all changes to constraints or notifiers lists
- * or pm_qos_object list and pm_qos_objects need to happen with pm_qos_lock
- * held, taken with _irqsave.  One lock to rule them all
+ * locking rule: changes to a class's constraints list and target value
+ * happen with that class's constraints->lock held, taken with _irqsave,
+ * so updates to unrelated classes do not contend.  pm_qos_lock only
+ * protects the PM QoS flags lists.
+ *
+ * Notifiers of the global classes are not called from the updater's
+ * context.  The update queues the class's notify_work on a high priority
+ * workqueue and the work calls the chain once with the latest target, so
+ * a burst of updates collapses into a single notification and a target
+ * that returns to the last notified value is not notified at all.
  */
 struct pm_qos_object {
 	struct pm_qos_constraints *constraints;
@@ -61,11 +69,14 @@ struct pm_qos_object {
 
 static DEFINE_SPINLOCK(pm_qos_lock);
 
+static struct workqueue_struct *pm_qos_notify_wq;
+
 static struct pm_qos_object null_pm_qos;
 
 static BLOCKING_NOTIFIER_HEAD(cpu_dma_lat_notifier);
 static struct pm_qos_constraints cpu_dma_constraints = {
 	.list = PLIST_HEAD_INIT(cpu_dma_constraints.list),
+	.lock = __SPIN_LOCK_UNLOCKED(cpu_dma_constraints.lock),
 	.target_value = PM_QOS_CPU_DMA_LAT_DEFAULT_VALUE,
 	.default_value = PM_QOS_CPU_DMA_LAT_DEFAULT_VALUE,
 	.no_constraint_value = PM_QOS_CPU_DMA_LAT_DEFAULT_VALUE,
@@ -80,6 +91,7 @@ static struct pm_qos_object cpu_dma_pm_qos = {
 static BLOCKING_NOTIFIER_HEAD(network_lat_notifier);
 static struct pm_qos_constraints network_lat_constraints = {
 	.list = PLIST_HEAD_INIT(network_lat_constraints.list),
+	.lock = __SPIN_LOCK_UNLOCKED(network_lat_constraints.lock),
 	.target_value = PM_QOS_NETWORK_LAT_DEFAULT_VALUE,
 	.default_value = PM_QOS_NETWORK_LAT_DEFAULT_VALUE,
 	.no_constraint_value = PM_QOS_NETWORK_LAT_DEFAULT_VALUE,
@@ -95,6 +107,7 @@ static struct pm_qos_object network_lat_pm_qos = {
 static BLOCKING_NOTIFIER_HEAD(device_throughput_notifier);
 static struct pm_qos_constraints device_tput_constraints = {
 	.list = PLIST_HEAD_INIT(device_tput_constraints.list),
+	.lock = __SPIN_LOCK_UNLOCKED(device_tput_constraints.lock),
 	.target_value = PM_QOS_DEVICE_THROUGHPUT_DEFAULT_VALUE,
 	.default_value = PM_QOS_DEVICE_THROUGHPUT_DEFAULT_VALUE,
 	.type = PM_QOS_FORCE_MAX,
@@ -108,6 +121,7 @@ static struct pm_qos_object device_throughput_pm_qos = {
 static BLOCKING_NOTIFIER_HEAD(bus_throughput_notifier);
 static struct pm_qos_constraints bus_tput_constraints = {
 	.list = PLIST_HEAD_INIT(bus_tput_constraints.list),
+	.lock = __SPIN_LOCK_UNLOCKED(bus_tput_constraints.lock),
 	.target_value = PM_QOS_BUS_THROUGHPUT_DEFAULT_VALUE,
 	.default_value = PM_QOS_BUS_THROUGHPUT_DEFAULT_VALUE,
 	.type = PM_QOS_MAX,
@@ -121,6 +135,7 @@ static struct pm_qos_object bus_throughput_pm_qos = {
 static BLOCKING_NOTIFIER_HEAD(bus_throughput_max_notifier);
 static struct pm_qos_constraints bus_tput_max_constraints = {
 	.list = PLIST_HEAD_INIT(bus_tput_max_constraints.list),
+	.lock = __SPIN_LOCK_UNLOCKED(bus_tput_max_constraints.lock),
 	.target_value = PM_QOS_BUS_THROUGHPUT_MAX_DEFAULT_VALUE,
 	.default_value = PM_QOS_BUS_THROUGHPUT_MAX_DEFAULT_VALUE,
 	.type = PM_QOS_MIN,
@@ -134,6 +149,7 @@ static struct pm_qos_object bus_throughput_max_pm_qos = {
 static BLOCKING_NOTIFIER_HEAD(network_throughput_notifier);
 static struct pm_qos_constraints network_tput_constraints = {
 	.list = PLIST_HEAD_INIT(network_tput_constraints.list),
+	.lock = __SPIN_LOCK_UNLOCKED(network_tput_constraints.lock),
 	.target_value = PM_QOS_NETWORK_THROUGHPUT_DEFAULT_VALUE,
 	.default_value = PM_QOS_NETWORK_THROUGHPUT_DEFAULT_VALUE,
 	.no_constraint_value = PM_QOS_NETWORK_THROUGHPUT_DEFAULT_VALUE,
@@ -148,6 +164,7 @@ static struct pm_qos_object network_throughput_pm_qos = {
 static BLOCKING_NOTIFIER_HEAD(cluster1_freq_min_notifier);
 static struct pm_qos_constraints cluster1_freq_min_constraints = {
 	.list = PLIST_HEAD_INIT(cluster1_freq_min_constraints.list),
+	.lock = __SPIN_LOCK_UNLOCKED(cluster1_freq_min_constraints.lock),
 	.target_value = PM_QOS_CLUSTER1_FREQ_MIN_DEFAULT_VALUE,
 	.default_value = PM_QOS_CLUSTER1_FREQ_MIN_DEFAULT_VALUE,
 	.type = PM_QOS_MAX,
@@ -161,6 +178,7 @@ static struct pm_qos_object cluster1_freq_min_pm_qos = {
 static BLOCKING_NOTIFIER_HEAD(memory_bandwidth_notifier);
 static struct pm_qos_constraints memory_bw_constraints = {
 	.list = PLIST_HEAD_INIT(memory_bw_constraints.list),
+	.lock = __SPIN_LOCK_UNLOCKED(memory_bw_constraints.lock),
 	.target_value = PM_QOS_MEMORY_BANDWIDTH_DEFAULT_VALUE,
 	.default_value = PM_QOS_MEMORY_BANDWIDTH_DEFAULT_VALUE,
 	.no_constraint_value = PM_QOS_MEMORY_BANDWIDTH_DEFAULT_VALUE,
@@ -175,6 +193,7 @@ static struct pm_qos_object memory_bandwidth_pm_qos = {
 static BLOCKING_NOTIFIER_HEAD(cluster1_freq_max_notifier);
 static struct pm_qos_constraints cluster1_freq_max_constraints = {
 	.list = PLIST_HEAD_INIT(cluster1_freq_max_constraints.list),
+	.lock = __SPIN_LOCK_UNLOCKED(cluster1_freq_max_constraints.lock),
 	.target_value = PM_QOS_CLUSTER1_FREQ_MAX_DEFAULT_VALUE,
 	.default_value = PM_QOS_CLUSTER1_FREQ_MAX_DEFAULT_VALUE,
 	.type = PM_QOS_MIN,
@@ -188,6 +207,7 @@ static struct pm_qos_object cluster1_freq_max_pm_qos = {
 static BLOCKING_NOTIFIER_HEAD(cluster0_freq_min_notifier);
 static struct pm_qos_constraints cluster0_freq_min_constraints = {
 	.list = PLIST_HEAD_INIT(cluster0_freq_min_constraints.list),
+	.lock = __SPIN_LOCK_UNLOCKED(cluster0_freq_min_constraints.lock),
 	.target_value = PM_QOS_CLUSTER0_FREQ_MIN_DEFAULT_VALUE,
 	.default_value = PM_QOS_CLUSTER0_FREQ_MIN_DEFAULT_VALUE,
 	.type = PM_QOS_MAX,
@@ -201,6 +221,7 @@ static struct pm_qos_object cluster0_freq_min_pm_qos = {
 static BLOCKING_NOTIFIER_HEAD(cluster0_freq_max_notifier);
 static struct pm_qos_constraints cluster0_freq_max_constraints = {
 	.list = PLIST_HEAD_INIT(cluster0_freq_max_constraints.list),
+	.lock = __SPIN_LOCK_UNLOCKED(cluster0_freq_max_constraints.lock),
 	.target_value = PM_QOS_CLUSTER0_FREQ_MAX_DEFAULT_VALUE,
 	.default_value = PM_QOS_CLUSTER0_FREQ_MAX_DEFAULT_VALUE,
 	.type = PM_QOS_MIN,
@@ -214,6 +235,7 @@ static struct pm_qos_object cluster0_freq_max_pm_qos = {
 static BLOCKING_NOTIFIER_HEAD(display_throughput_notifier);
 static struct pm_qos_constraints display_tput_constraints = {
 	.list = PLIST_HEAD_INIT(display_tput_constraints.list),
+	.lock = __SPIN_LOCK_UNLOCKED(display_tput_constraints.lock),
 	.target_value = PM_QOS_DISPLAY_THROUGHPUT_DEFAULT_VALUE,
 	.default_value = PM_QOS_DISPLAY_THROUGHPUT_DEFAULT_VALUE,
 	.type = PM_QOS_MAX,
@@ -227,6 +249,7 @@ static struct pm_qos_object display_throughput_pm_qos = {
 static BLOCKING_NOTIFIER_HEAD(cam_throughput_notifier);
 static struct pm_qos_constraints cam_tput_constraints = {
 	.list = PLIST_HEAD_INIT(cam_tput_constraints.list),
+	.lock = __SPIN_LOCK_UNLOCKED(cam_tput_constraints.lock),
 	.target_value = PM_QOS_CAM_THROUGHPUT_DEFAULT_VALUE,
 	.default_value = PM_QOS_CAM_THROUGHPUT_DEFAULT_VALUE,
 	.type = PM_QOS_MAX,
@@ -240,6 +263,7 @@ static struct pm_qos_object cam_throughput_pm_qos = {
 static BLOCKING_NOTIFIER_HEAD(cpu_online_min_notifier);
 static struct pm_qos_constraints cpu_online_min_constraints = {
 	.list = PLIST_HEAD_INIT(cpu_online_min_constraints.list),
+	.lock = __SPIN_LOCK_UNLOCKED(cpu_online_min_constraints.lock),
 	.target_value = PM_QOS_CPU_ONLINE_MIN_DEFAULT_VALUE,
 	.default_value = PM_QOS_CPU_ONLINE_MIN_DEFAULT_VALUE,
 	.type = PM_QOS_MAX,
@@ -253,6 +277,7 @@ static struct pm_qos_object cpu_online_min_pm_qos = {
 static BLOCKING_NOTIFIER_HEAD(cpu_online_max_notifier);
 static struct pm_qos_constraints cpu_online_max_constraints = {
 	.list = PLIST_HEAD_INIT(cpu_online_max_constraints.list),
+	.lock = __SPIN_LOCK_UNLOCKED(cpu_online_max_constraints.lock),
 	.target_value = PM_QOS_CPU_ONLINE_MAX_DEFAULT_VALUE,
 	.default_value = PM_QOS_CPU_ONLINE_MAX_DEFAULT_VALUE,
 	.type = PM_QOS_MIN,
@@ -347,13 +372,15 @@ static inline void pm_qos_set_value(struct pm_qos_constraints *c, s32 value)
  * @value: value of the request to add or update
  *
  * This function returns 1 if the aggregated constraint value has changed, 0
- *  otherwise.
+ *  otherwise.  Notifiers of the global classes run later from
+ *  pm_qos_notify_wq, the others are called before returning.
  */
 int pm_qos_update_target(struct pm_qos_constraints *c, struct plist_node *node,
 			 enum pm_qos_req_action action, int value)
 {
 	unsigned long flags;
 	int prev_value, curr_value, new_value;
+	bool force, deferred;
 	int ret;
 
 #ifdef CONFIG_ARCH_EXYNOS
@@ -361,7 +388,7 @@ int pm_qos_update_target(struct pm_qos_constraints *c, struct plist_node *node,
 	struct pm_qos_constraints *cluster0_max_const;
 #endif
 
-	spin_lock_irqsave(&pm_qos_lock, flags);
+	spin_lock_irqsave(&c->lock, flags);
 
 #ifdef CONFIG_ARCH_EXYNOS
 	cluster1_max_const = cluster1_freq_max_pm_qos.constraints;
@@ -401,29 +428,79 @@ int pm_qos_update_target(struct pm_qos_constraints *c, struct plist_node *node,
 	curr_value = pm_qos_get_value(c);
 	pm_qos_set_value(c, curr_value);
 
-	spin_unlock_irqrestore(&pm_qos_lock, flags);
+	force = c->type == PM_QOS_FORCE_MAX;
+	ret = force || prev_value != curr_value;
+	deferred = ret && c->notifiers && c->notify_deferred;
+	if (deferred) {
+		if (!c->notify_updates++)
+			c->notify_time = ktime_get_ns();
+		c->notify_force |= force;
+	}
+
+	spin_unlock_irqrestore(&c->lock, flags);
 
 	trace_pm_qos_update_target(action, prev_value, curr_value);
 
-	if (c->type == PM_QOS_FORCE_MAX) {
+	if (deferred)
+		queue_work(pm_qos_notify_wq, &c->notify_work);
+	else if (ret && c->notifiers)
 		blocking_notifier_call_chain(c->notifiers,
 					     (unsigned long)curr_value,
 					     NULL);
-		return 1;
-	}
 
-	if (prev_value != curr_value) {
-		ret = 1;
-		if (c->notifiers)
-			blocking_notifier_call_chain(c->notifiers,
-						     (unsigned long)curr_value,
-						     NULL);
-	} else {
-		ret = 0;
-	}
 	return ret;
 }
 
+static const char *pm_qos_class_name(struct pm_qos_constraints *c)
+{
+	int i;
+
+	for (i = PM_QOS_CPU_DMA_LATENCY; i < PM_QOS_NUM_CLASSES; i++)
+		if (pm_qos_array[i]->constraints == c)
+			return pm_qos_array[i]->name;
+
+	return "unknown";
+}
+
+/**
+ * pm_qos_notify_work_fn - deliver a class's deferred notification
+ * @work: the class's notify_work
+ *
+ * Calls the notifier chain with the current target value unless it has
+ * already been delivered.  FORCE_MAX classes are always notified.
+ */
+static void pm_qos_notify_work_fn(struct work_struct *work)
+{
+	struct pm_qos_constraints *c = container_of(work,
+						    struct pm_qos_constraints,
+						    notify_work);
+	unsigned long flags;
+	unsigned int updates;
+	u64 queued;
+	s32 value;
+	bool force;
+
+	spin_lock_irqsave(&c->lock, flags);
+	value = c->target_value;
+	force = c->notify_force;
+	updates = c->notify_updates;
+	queued = c->notify_time;
+	c->notify_force = false;
+	c->notify_updates = 0;
+	if (!force && value == c->notified_value) {
+		spin_unlock_irqrestore(&c->lock, flags);
+		return;
+	}
+	c->notified_value = value;
+	spin_unlock_irqrestore(&c->lock, flags);
+
+	blocking_notifier_call_chain(c->notifiers, (unsigned long)value, NULL);
+
+	if (trace_pm_qos_notify_enabled())
+		trace_pm_qos_notify(pm_qos_class_name(c), value, updates,
+				    ktime_get_ns() - queued);
+}
+
 /**
  * pm_qos_update_constraints - update new constraints attributes
  * @pm_qos_class: identification of which qos value is requested
@@ -435,6 +512,7 @@ int pm_qos_update_constraints(int pm_qos_class,
 			struct pm_qos_constraints *constraints)
 {
 	struct pm_qos_constraints *r_constraints;
+	unsigned long flags;
 	int ret = -EINVAL;
 	int i;
 
@@ -450,6 +528,7 @@ int pm_qos_update_constraints(int pm_qos_class,
 
 		r_constraints = pm_qos_array[i]->constraints;
 
+		spin_lock_irqsave(&r_constraints->lock, flags);
 		if (constraints->target_value)
 			r_constraints->target_value = constraints->target_value;
 		if (constraints->default_value)
@@ -458,6 +537,7 @@ int pm_qos_update_constraints(int pm_qos_class,
 			r_constraints->type = constraints->type;
 		if (constraints->notifiers)
 			r_constraints->notifiers = constraints->notifiers;
+		spin_unlock_irqrestore(&r_constraints->lock, flags);
 
 		return 0;
 	}
@@ -796,6 +876,7 @@ static ssize_t pm_qos_power_read(struct file *filp, char __user *buf,
 {
 	s32 value;
 	unsigned long flags;
+	struct pm_qos_constraints *c;
 	struct pm_qos_request *req = filp->private_data;
 
 	if (!req)
@@ -803,9 +884,10 @@ static ssize_t pm_qos_power_read(struct file *filp, char __user *buf,
 	if (!pm_qos_request_active(req))
 		return -EINVAL;
 
-	spin_lock_irqsave(&pm_qos_lock, flags);
-	value = pm_qos_get_value(pm_qos_array[req->pm_qos_class]->constraints);
-	spin_unlock_irqrestore(&pm_qos_lock, flags);
+	c = pm_qos_array[req->pm_qos_class]->constraints;
+	spin_lock_irqsave(&c->lock, flags);
+	value = pm_qos_get_value(c);
+	spin_unlock_irqrestore(&c->lock, flags);
 
 	return simple_read_from_buffer(buf, count, f_pos, &value, sizeof(s32));
 }
@@ -838,11 +920,13 @@ static void pm_qos_debug_show_one(struct seq_file *s, struct pm_qos_object *qos)
 	struct plist_node *p;
 	unsigned long flags;
 
-	spin_lock_irqsave(&pm_qos_lock, flags);
+	spin_lock_irqsave(&qos->constraints->lock, flags);
 
 	seq_printf(s, "%s\n", qos->name);
 	seq_printf(s, "   default value: %d\n", qos->constraints->default_value);
 	seq_printf(s, "   target value: %d\n", qos->constraints->target_value);
+	seq_printf(s, "   notified value: %d\n",
+		   qos->constraints->notified_value);
 	seq_printf(s, "   requests:\n");
 	plist_for_each(p, &qos->constraints->list)
 		seq_printf(s, "      %pK(%s:%d): %d\n",
@@ -851,7 +935,7 @@ static void pm_qos_debug_show_one(struct seq_file *s, struct pm_qos_object *qos)
 				(container_of(p, struct pm_qos_request, node))->line,
 				p->prio);
 
-	spin_unlock_irqrestore(&pm_qos_lock, flags);
+	spin_unlock_irqrestore(&qos->constraints->lock, flags);
 }
 
 static int pm_qos_debug_show(struct seq_file *s, void *d)
@@ -898,3 +982,27 @@ static int __init pm_qos_power_init(void)
 }
 
 late_initcall(pm_qos_power_init);
+
+static int __init pm_qos_notify_init(void)
+{
+	struct pm_qos_constraints *c;
+	unsigned long flags;
+	int i;
+
+	pm_qos_notify_wq = alloc_workqueue("pm_qos_notify", WQ_HIGHPRI, 0);
+	if (!pm_qos_notify_wq)
+		return -ENOMEM;
+
+	/* requests added before this point were notified synchronously */
+	for (i = PM_QOS_CPU_DMA_LATENCY; i < PM_QOS_NUM_CLASSES; i++) {
+		c = pm_qos_array[i]->constraints;
+		INIT_WORK(&c->notify_work, pm_qos_notify_work_fn);
+		spin_lock_irqsave(&c->lock, flags);
+		c->notified_value = c->target_value;
+		c->notify_deferred = true;
+		spin_unlock_irqrestore(&c->lock, flags);
+	}
+
+	return 0;
+}
+core_initcall(pm_qos_notify_init);
@@ -227,6 +227,7 @@ static int suspend_test(int level)
  */
 static int suspend_prepare(suspend_state_t state)
 {
+	ktime_t starttime;
 	int error;
 
 	if (!sleep_state_supported(state))
@@ -234,7 +235,9 @@ static int suspend_prepare(suspend_state_t state)
 
 	pm_prepare_console();
 
+	starttime = ktime_get();
 	error = pm_notifier_call_chain(PM_SUSPEND_PREPARE);
+	suspend_entry_stats.prepare_us = ktime_us_delta(ktime_get(), starttime);
 	if (error)
 		goto Finish;
 
@@ -443,6 +446,7 @@ static void suspend_finish(void)
  */
 static int enter_state(suspend_state_t state)
 {
+	ktime_t starttime;
 	int error;
 
 	trace_suspend_resume(TPS("suspend_enter"), state, true);
@@ -465,12 +469,14 @@ static int enter_state(suspend_state_t state)
 
 	trace_suspend_resume(TPS("sync_filesystems"), 0, true);
 	printk(KERN_INFO "PM: Syncing filesystems ... ");
+	starttime = ktime_get();
 	if (intr_sync(NULL)) {
 		printk("canceled.\n");
 		trace_suspend_resume(TPS("sync_filesystems"), 0, false);
 		error = -EBUSY;
 		goto Unlock;
 	}
+	suspend_entry_stats.sync_us = ktime_us_delta(ktime_get(), starttime);
 	printk("done.\n");
 	trace_suspend_resume(TPS("sync_filesystems"), 0, false);
 
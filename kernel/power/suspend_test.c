@@ -8,6 +8,7 @@
 
 #include <linux/init.h>
 #include <linux/rtc.h>
+#include <linux/pm.h>
 
 #include "power.h"
 
@@ -55,6 +56,23 @@ void suspend_test_finish(const char *label)
 	     "Component: %s, time: %u\n", label, msec);
 }
 
+/*
+ * dpm_resume() lets devices resume in parallel as soon as their parent and
+ * device tree suppliers are done.  After every test cycle make sure that
+ * no device ran its resume callbacks before one it depends on.
+ */
+static void __init test_resume_order(void)
+{
+	unsigned int errors = dpm_resume_order_violations();
+
+	if (errors) {
+		pr_err("PM: resume order test failed, %u violations\n", errors);
+		WARN_ON(1);
+	} else {
+		pr_info("PM: resume order test passed\n");
+	}
+}
+
 /*
  * To test system suspend, we need a hands-off mechanism to resume the
  * system.  RTCs wake alarms are a common self-contained mechanism.
@@ -113,6 +131,8 @@ repeat:
 
 	if (status < 0)
 		printk(err_suspend, status);
+	else
+		test_resume_order();
 
 	test_repeat_count_current++;
 	if (test_repeat_count_current < test_repeat_count_max)
@@ -351,6 +351,9 @@ struct rcu_data {
 	wait_queue_head_t nocb_wq;	/* For nocb kthreads to sleep on. */
 	struct task_struct *nocb_kthread;
 	int nocb_defer_wakeup;		/* Defer wakeup of nocb_kthread. */
+	long nocb_max_backlog;		/* Most CBs seen waiting for kthread. */
+	unsigned long n_nocb_batches;	/* # of CB batches invoked by kthread. */
+	long nocb_max_batch;		/* Largest CB batch invoked. */
 
 	/* The following fields are used by the leader, hence own cacheline. */
 	struct rcu_head *nocb_gp_head ____cacheline_internodealigned_in_smp;
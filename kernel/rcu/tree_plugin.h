@@ -43,6 +43,8 @@
 static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
 static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
 static bool __read_mostly rcu_nocb_poll;    /* Offload kthread are to poll. */
+static cpumask_var_t rcu_nocb_affinity; /* CPUs the rcuo kthreads run on. */
+static bool have_rcu_nocb_affinity; /* Was rcu_nocb_affinity allocated? */
 static char __initdata nocb_buf[NR_CPUS * 5];
 #endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 
@@ -1996,6 +1998,29 @@ static int __init parse_rcu_nocb_poll(char *arg)
 }
 early_param("rcu_nocb_poll", parse_rcu_nocb_poll);
 
+/*
+ * Parse the boot-time CPU list the rcuo kthreads are to be confined to,
+ * for example the little cluster, so that callback invocation stays away
+ * from the CPUs running latency-sensitive work.
+ */
+static int __init rcu_nocb_affinity_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_affinity);
+	have_rcu_nocb_affinity = true;
+	cpulist_parse(str, rcu_nocb_affinity);
+	return 1;
+}
+__setup("rcu_nocb_affinity=", rcu_nocb_affinity_setup);
+
+/*
+ * Let a grace period that is already in progress end before collecting
+ * callbacks?  Callbacks collected during a grace period have to wait for
+ * the next one anyway, so this batches more of them under the same
+ * grace period at no extra latency.
+ */
+static bool rcu_nocb_gp_batch = true;
+module_param(rcu_nocb_gp_batch, bool, 0644);
+
 /*
  * Wake up any no-CBs CPUs' kthreads that were waiting on the just-ended
  * grace period.
@@ -2102,6 +2127,10 @@ static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
 	atomic_long_add(rhcount_lazy, &rdp->nocb_q_count_lazy);
 	smp_mb__after_atomic(); /* Store *old_rhpp before _wake test. */
 
+	len = atomic_long_read(&rdp->nocb_q_count);
+	if (len > rdp->nocb_max_backlog)
+		rdp->nocb_max_backlog = len;
+
 	/* If we are not being polled and there is a kthread, awaken it ... */
 	t = ACCESS_ONCE(rdp->nocb_kthread);
 	if (rcu_nocb_poll || !t) {
@@ -2109,7 +2138,6 @@ static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
 				    TPS("WakeNotPoll"));
 		return;
 	}
-	len = atomic_long_read(&rdp->nocb_q_count);
 	if (old_rhpp == &rdp->nocb_head) {
 		if (!irqs_disabled_flags(flags)) {
 			/* ... if queue was empty ... */
@@ -2251,6 +2279,25 @@ static void rcu_nocb_wait_gp(struct rcu_data *rdp)
 	smp_mb(); /* Ensure that CB invocation happens after GP end. */
 }
 
+/*
+ * If a grace period is in progress, wait for it to end.  This does not
+ * request a grace period, it only lets the leader pick up everything
+ * queued during the current one in a single batch.
+ */
+static void rcu_nocb_wait_current_gp(struct rcu_data *rdp)
+{
+	struct rcu_node *rnp = rdp->mynode;
+	unsigned long c = ACCESS_ONCE(rnp->gpnum);
+
+	if (ULONG_CMP_GE(ACCESS_ONCE(rnp->completed), c))
+		return;
+
+	trace_rcu_future_gp(rnp, rdp, c, TPS("BatchWait"));
+	wait_event_interruptible(rnp->nocb_gp_wq[c & 0x1],
+			ULONG_CMP_GE(ACCESS_ONCE(rnp->completed), c));
+	trace_rcu_future_gp(rnp, rdp, c, TPS("EndBatchWait"));
+}
+
 /*
  * Leaders come here to wait for additional callbacks to show up.
  * This function does not return until callbacks appear.
@@ -2275,6 +2322,9 @@ wait_again:
 		trace_rcu_nocb_wake(my_rdp->rsp->name, my_rdp->cpu, "Poll");
 	}
 
+	if (rcu_nocb_gp_batch)
+		rcu_nocb_wait_current_gp(my_rdp);
+
 	/*
 	 * Each pass through the following loop checks a follower for CBs.
 	 * We are our own first follower.  Any CBs found are moved to
@@ -2448,6 +2498,9 @@ static int rcu_nocb_kthread(void *arg)
 		ACCESS_ONCE(rdp->nocb_p_count_lazy) =
 						rdp->nocb_p_count_lazy - cl;
 		rdp->n_nocbs_invoked += c;
+		rdp->n_nocb_batches++;
+		if (c > rdp->nocb_max_batch)
+			rdp->nocb_max_batch = c;
 	}
 	return 0;
 }
@@ -2518,6 +2571,19 @@ void __init rcu_init_nohz(void)
 	pr_info("\tOffload RCU callbacks from CPUs: %s.\n", nocb_buf);
 	if (rcu_nocb_poll)
 		pr_info("\tPoll for callbacks from no-CBs CPUs.\n");
+	if (have_rcu_nocb_affinity) {
+		cpumask_and(rcu_nocb_affinity, rcu_nocb_affinity,
+			    cpu_possible_mask);
+		if (cpumask_empty(rcu_nocb_affinity)) {
+			pr_info("\tNote: kernel parameter 'rcu_nocb_affinity=' contains no existing CPUs, ignored.\n");
+			have_rcu_nocb_affinity = false;
+		} else {
+			cpulist_scnprintf(nocb_buf, sizeof(nocb_buf),
+					  rcu_nocb_affinity);
+			pr_info("\tRun offloaded RCU callbacks on CPUs: %s.\n",
+				nocb_buf);
+		}
+	}
 
 	for_each_rcu_flavor(rsp) {
 		for_each_cpu(cpu, rcu_nocb_mask) {
@@ -2582,9 +2648,12 @@ static void rcu_spawn_one_nocb_kthread(struct rcu_state *rsp, int cpu)
 	}
 
 	/* Spawn the kthread for this CPU and RCU flavor. */
-	t = kthread_run(rcu_nocb_kthread, rdp_spawn,
-			"rcuo%c/%d", rsp->abbr, cpu);
+	t = kthread_create(rcu_nocb_kthread, rdp_spawn,
+			   "rcuo%c/%d", rsp->abbr, cpu);
 	BUG_ON(IS_ERR(t));
+	if (have_rcu_nocb_affinity)
+		set_cpus_allowed_ptr(t, rcu_nocb_affinity);
+	wake_up_process(t);
 	ACCESS_ONCE(rdp_spawn->nocb_kthread) = t;
 }
 
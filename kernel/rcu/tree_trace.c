@@ -177,6 +177,54 @@ static const struct file_operations rcudata_fops = {
 	.release = seq_release,
 };
 
+#ifdef CONFIG_RCU_NOCB_CPU
+static void print_one_rcu_nocb(struct seq_file *m, struct rcu_data *rdp)
+{
+	long ql, qll;
+
+	if (!rcu_is_nocb_cpu(rdp->cpu))
+		return;
+	rcu_nocb_q_lengths(rdp, &ql, &qll);
+	seq_printf(m, "%3d%c%c ql=%ld/%ld mbl=%ld nb=%lu mbs=%ld nci=%lu",
+		   rdp->cpu,
+		   cpu_is_offline(rdp->cpu) ? '!' : ' ',
+		   rdp->nocb_leader == rdp ? 'L' : ' ',
+		   ql, qll, rdp->nocb_max_backlog, rdp->n_nocb_batches,
+		   rdp->nocb_max_batch, rdp->n_nocbs_invoked);
+	if (rdp->nocb_kthread)
+		seq_printf(m, " kt=%d@%d\n", task_pid_nr(rdp->nocb_kthread),
+			   task_cpu(rdp->nocb_kthread));
+	else
+		seq_puts(m, " kt=-\n");
+}
+
+static int show_rcunocb(struct seq_file *m, void *v)
+{
+	print_one_rcu_nocb(m, (struct rcu_data *)v);
+	return 0;
+}
+
+static const struct seq_operations rcunocb_op = {
+	.start = r_start,
+	.next  = r_next,
+	.stop  = r_stop,
+	.show  = show_rcunocb,
+};
+
+static int rcunocb_open(struct inode *inode, struct file *file)
+{
+	return r_open(inode, file, &rcunocb_op);
+}
+
+static const struct file_operations rcunocb_fops = {
+	.owner = THIS_MODULE,
+	.open = rcunocb_open,
+	.read = seq_read,
+	.llseek = no_llseek,
+	.release = seq_release,
+};
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+
 static int show_rcuexp(struct seq_file *m, void *v)
 {
 	struct rcu_state *rsp = (struct rcu_state *)m->private;
@@ -457,6 +505,13 @@ static int __init rcutree_trace_init(void)
 		if (!retval)
 			goto free_out;
 
+#ifdef CONFIG_RCU_NOCB_CPU
+		retval = debugfs_create_file("rcunocb", 0444,
+				rspdir, rsp, &rcunocb_fops);
+		if (!retval)
+			goto free_out;
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+
 #ifdef CONFIG_RCU_BOOST
 		if (rsp == &rcu_preempt_state) {
 			retval = debugfs_create_file("rcuboost", 0444,
@@ -986,6 +986,8 @@ static void complete_signal(int sig, struct task_struct *p, int group)
 			signal->flags = SIGNAL_GROUP_EXIT;
 			signal->group_exit_code = sig;
 			signal->group_stop_count = 0;
+			if (sig == SIGKILL)
+				signal->kill_time = ktime_get_ns();
 			t = p;
 			do {
 				task_clear_jobctl_pending(t, JOBCTL_PENDING_MASK);
@@ -12,6 +12,7 @@
 
 #include <linux/export.h>
 #include <linux/kernel_stat.h>
+#include <linux/moduleparam.h>
 #include <linux/interrupt.h>
 #include <linux/init.h>
 #include <linux/mm.h>
@@ -191,6 +192,59 @@ EXPORT_SYMBOL(__local_bh_enable_ip);
 #define MAX_SOFTIRQ_TIME  msecs_to_jiffies(2)
 #define MAX_SOFTIRQ_RESTART 10
 
+/*
+ * Per-vector time budget, in usecs, for one __do_softirq() run outside of
+ * ksoftirqd.  A vector that overruns its budget is handed to ksoftirqd
+ * and no longer run inline until ksoftirqd has processed it, while the
+ * other vectors keep being served from irq exit as usual.  This keeps
+ * e.g. a NET_RX storm from eating the time slice of whatever task the
+ * interrupts happen to land on.  0 means no budget.
+ */
+static unsigned int softirq_budget_us[NR_SOFTIRQS];
+module_param_array_named(budget_us, softirq_budget_us, uint, NULL, 0644);
+
+/* Vectors that overran their budget and wait for ksoftirqd. */
+static DEFINE_PER_CPU(__u32, softirq_deferred);
+/* Pending softirqs of deferred vectors, to be run by ksoftirqd. */
+static DEFINE_PER_CPU(__u32, softirq_deferred_pending);
+
+/*
+ * Move the pending bits of deferred vectors over to ksoftirqd and return
+ * what is left to run inline.  Must be called with irqs disabled.
+ */
+static __u32 softirq_defer_pending(bool in_ksoftirqd)
+{
+	__u32 pending = local_softirq_pending();
+	__u32 deferred = pending & __this_cpu_read(softirq_deferred);
+
+	if (!deferred || in_ksoftirqd)
+		return pending;
+
+	set_softirq_pending(pending & ~deferred);
+	__this_cpu_or(softirq_deferred_pending, deferred);
+	wakeup_softirqd();
+	return pending & ~deferred;
+}
+
+/* Charge @delta ns to @vec_nr, deferring it if it overran its budget. */
+static void softirq_account(unsigned int vec_nr, u64 delta, u64 *spent,
+			    bool in_ksoftirqd)
+{
+	unsigned int budget = ACCESS_ONCE(softirq_budget_us[vec_nr]);
+
+	__this_cpu_add(kstat.softirq_time[vec_nr], delta);
+
+	if (!budget || in_ksoftirqd)
+		return;
+
+	*spent += delta;
+	if (*spent > (u64)budget * NSEC_PER_USEC &&
+	    !(__this_cpu_read(softirq_deferred) & (1 << vec_nr))) {
+		__this_cpu_or(softirq_deferred, 1 << vec_nr);
+		__this_cpu_inc(kstat.softirq_deferrals[vec_nr]);
+	}
+}
+
 #ifdef CONFIG_TRACE_IRQFLAGS
 /*
  * When we run softirqs from irq_exit() and thus on the hardirq stack we need
@@ -229,6 +283,8 @@ asmlinkage __visible void __do_softirq(void)
 	unsigned long end = jiffies + MAX_SOFTIRQ_TIME;
 	unsigned long old_flags = current->flags;
 	int max_restart = MAX_SOFTIRQ_RESTART;
+	bool in_ksoftirqd = current == __this_cpu_read(ksoftirqd);
+	u64 spent[NR_SOFTIRQS] = { };
 	struct softirq_action *h;
 	bool in_hardirq;
 	__u32 pending;
@@ -241,7 +297,7 @@ asmlinkage __visible void __do_softirq(void)
 	 */
 	current->flags &= ~PF_MEMALLOC;
 
-	pending = local_softirq_pending();
+	pending = softirq_defer_pending(in_ksoftirqd);
 	account_irq_enter_time(current);
 
 	__local_bh_disable_ip(_RET_IP_, SOFTIRQ_OFFSET);
@@ -258,6 +314,7 @@ restart:
 	while ((softirq_bit = ffs(pending))) {
 		unsigned int vec_nr;
 		int prev_count;
+		u64 start;
 
 		h += softirq_bit - 1;
 
@@ -268,7 +325,10 @@ restart:
 
 		trace_softirq_entry(vec_nr);
 		exynos_ss_irq(ESS_FLAG_SOFTIRQ, h->action, vec_nr, ESS_FLAG_IN);
+		start = local_clock();
 		h->action(h);
+		softirq_account(vec_nr, local_clock() - start, &spent[vec_nr],
+				in_ksoftirqd);
 		exynos_ss_irq(ESS_FLAG_SOFTIRQ, h->action, local_softirq_pending(), ESS_FLAG_OUT);
 		trace_softirq_exit(vec_nr);
 		if (unlikely(prev_count != preempt_count())) {
@@ -284,7 +344,7 @@ restart:
 	rcu_bh_qs();
 	local_irq_disable();
 
-	pending = local_softirq_pending();
+	pending = softirq_defer_pending(in_ksoftirqd);
 	if (pending) {
 		if (time_before(jiffies, end) && !need_resched() &&
 		    --max_restart)
@@ -655,12 +715,22 @@ void __init softirq_init(void)
 
 static int ksoftirqd_should_run(unsigned int cpu)
 {
-	return local_softirq_pending();
+	return local_softirq_pending() ||
+	       __this_cpu_read(softirq_deferred_pending);
 }
 
 static void run_ksoftirqd(unsigned int cpu)
 {
+	__u32 deferred;
+
 	local_irq_disable();
+	/* Take the deferred vectors back, they get a fresh budget after this. */
+	deferred = __this_cpu_read(softirq_deferred_pending);
+	if (deferred) {
+		__this_cpu_write(softirq_deferred_pending, 0);
+		__this_cpu_write(softirq_deferred, 0);
+		or_softirq_pending(deferred);
+	}
 	if (local_softirq_pending()) {
 		/*
 		 * We can safely run softirq on inline stack, as we are not deep
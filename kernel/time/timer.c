@@ -49,6 +49,8 @@
 #include <asm/timex.h>
 #include <asm/io.h>
 
+#include "tick-internal.h"
+
 #define CREATE_TRACE_POINTS
 #include <trace/events/timer.h>
 
@@ -94,6 +96,19 @@ struct tvec_base boot_tvec_bases;
 EXPORT_SYMBOL(boot_tvec_bases);
 static DEFINE_PER_CPU(struct tvec_base *, tvec_bases) = &boot_tvec_bases;
 
+#if defined(CONFIG_NO_HZ_COMMON) && defined(CONFIG_SMP)
+/*
+ * Deferrable timers which are not pinned to a CPU all live on a single
+ * base which is run by the CPU doing the jiffies update.  That way they
+ * expire on a CPU which is awake anyway instead of waiting for the CPU
+ * they happened to be queued on to leave idle.
+ */
+static struct tvec_base tvec_base_deferrable;
+#define deferrable_base()	(&tvec_base_deferrable)
+#else
+#define deferrable_base()	NULL
+#endif
+
 /* Functions below help us manage 'deferrable' flag */
 static inline unsigned int tbase_get_deferrable(struct tvec_base *base)
 {
@@ -424,6 +439,8 @@ static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 	 * require special care against races with idle_cpu(), lets deal
 	 * with that later.
 	 */
+	if (base == deferrable_base())
+		return;
 	if (!tbase_get_deferrable(base) || tick_nohz_full_cpu(base->cpu))
 		wake_up_nohz_cpu(base->cpu);
 }
@@ -452,8 +469,27 @@ static void timer_stats_account_timer(struct timer_list *timer)
 				 timer->function, timer->start_comm, flag);
 }
 
+/*
+ * When the timer softirq runs on the idle task, the first non-deferrable
+ * timer is charged with waking the CPU up and the ones after it rode
+ * along on that wakeup.
+ */
+static void timer_stats_account_wakeup(struct timer_list *timer, bool *wakeup)
+{
+	if (likely(!timer_stats_active) || !is_idle_task(current))
+		return;
+
+	if (*wakeup && !tbase_get_deferrable(timer->base)) {
+		timer_stats_update_wakeup(timer->function, true);
+		*wakeup = false;
+	} else {
+		timer_stats_update_wakeup(timer->function, false);
+	}
+}
 #else
 static void timer_stats_account_timer(struct timer_list *timer) {}
+static void timer_stats_account_wakeup(struct timer_list *timer,
+				       bool *wakeup) {}
 #endif
 
 #ifdef CONFIG_DEBUG_OBJECTS_TIMERS
@@ -758,13 +794,23 @@ static struct tvec_base *lock_timer_base(struct timer_list *timer,
 	}
 }
 
+static struct tvec_base *timer_target_base(struct timer_list *timer,
+					   int pinned)
+{
+#if defined(CONFIG_NO_HZ_COMMON) && defined(CONFIG_SMP)
+	if (tbase_get_deferrable(timer->base) && !pinned)
+		return &tvec_base_deferrable;
+#endif
+	return per_cpu(tvec_bases, get_nohz_timer_target(pinned));
+}
+
 static inline int
 __mod_timer(struct timer_list *timer, unsigned long expires,
 						bool pending_only, int pinned)
 {
 	struct tvec_base *base, *new_base;
 	unsigned long flags;
-	int ret = 0 , cpu;
+	int ret = 0;
 
 	timer_stats_timer_set_start_info(timer);
 	BUG_ON(!timer->function);
@@ -777,8 +823,7 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 
 	debug_activate(timer, expires);
 
-	cpu = get_nohz_timer_target(pinned);
-	new_base = per_cpu(tvec_bases, cpu);
+	new_base = timer_target_base(timer, pinned);
 
 	if (base != new_base) {
 		/*
@@ -823,20 +868,73 @@ int mod_timer_pending(struct timer_list *timer, unsigned long expires)
 }
 EXPORT_SYMBOL(mod_timer_pending);
 
+/*
+ * Timers beyond tv1 are cascaded down one wheel level at a time on their
+ * way to expiry.  Rounding a long timeout up to the granularity of the
+ * level it lands in makes it expire exactly when its bucket is cascaded,
+ * so it moves straight to the expiring slot and fires together with the
+ * other timers of that bucket.  Only do it while the granularity stays
+ * below an eighth of the timeout.
+ */
+static unsigned long round_expires_to_level(unsigned long expires, long delta)
+{
+	unsigned long mask;
+	int shift;
+
+	if (delta < 1 << (TVR_BITS + TVN_BITS))
+		shift = TVR_BITS;
+	else if (delta < 1 << (TVR_BITS + 2 * TVN_BITS))
+		shift = TVR_BITS + TVN_BITS;
+	else if (delta < 1 << (TVR_BITS + 3 * TVN_BITS))
+		shift = TVR_BITS + 2 * TVN_BITS;
+	else
+		shift = TVR_BITS + 3 * TVN_BITS;
+
+	mask = (1UL << shift) - 1;
+	if (mask >= delta / 8)
+		return expires;
+
+	return (expires + mask) & ~mask;
+}
+
+/*
+ * If this CPU is already going to wake up for another timer within
+ * [expires, expires_limit], use that wakeup.  The lockless read of the
+ * base is only a hint, a stale value just means a missed opportunity.
+ */
+static unsigned long coalesce_expires(struct timer_list *timer,
+				      unsigned long expires,
+				      unsigned long expires_limit)
+{
+	struct tvec_base *base = raw_cpu_read(tvec_bases);
+	unsigned long next = ACCESS_ONCE(base->next_timer);
+
+	if (tbase_get_deferrable(timer->base) || !ACCESS_ONCE(base->active_timers))
+		return 0;
+
+	if (time_after_eq(next, expires) && time_before_eq(next, expires_limit))
+		return next;
+	return 0;
+}
+
 /*
  * Decide where to put the timer while taking the slack into account
  *
  * Algorithm:
  *   1) calculate the maximum (absolute) time
- *   2) calculate the highest bit where the expires and new max are different
- *   3) use this bit to make a mask
- *   4) use the bitmask to round down the maximum time, so that all last
+ *   2) if the CPU already has a timer pending in that range, use it
+ *   3) calculate the highest bit where the expires and new max are different
+ *   4) use this bit to make a mask
+ *   5) use the bitmask to round down the maximum time, so that all last
  *      bits are zeros
+ *
+ * Timers with the default slack and a long timeout are instead rounded up
+ * to the granularity of their wheel level, see round_expires_to_level().
  */
 static inline
 unsigned long apply_slack(struct timer_list *timer, unsigned long expires)
 {
-	unsigned long expires_limit, mask;
+	unsigned long expires_limit, mask, next;
 	int bit;
 
 	if (timer->slack >= 0) {
@@ -847,12 +945,20 @@ unsigned long apply_slack(struct timer_list *timer, unsigned long expires)
 		if (delta < 256)
 			return expires;
 
+		expires_limit = round_expires_to_level(expires, delta);
+		if (expires_limit != expires)
+			return expires_limit;
+
 		expires_limit = expires + delta / 256;
 	}
 	mask = expires ^ expires_limit;
 	if (mask == 0)
 		return expires;
 
+	next = coalesce_expires(timer, expires, expires_limit);
+	if (next)
+		return next;
+
 	bit = find_last_bit(&mask, BITS_PER_LONG);
 
 	mask = (1UL << bit) - 1;
@@ -1184,6 +1290,7 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 static inline void __run_timers(struct tvec_base *base)
 {
 	struct timer_list *timer;
+	bool wakeup = true;
 
 	spin_lock_irq(&base->lock);
 	if (catchup_timer_jiffies(base)) {
@@ -1216,6 +1323,7 @@ static inline void __run_timers(struct tvec_base *base)
 			irqsafe = tbase_get_irqsafe(timer->base);
 
 			timer_stats_account_timer(timer);
+			timer_stats_account_wakeup(timer, &wakeup);
 
 			base->running_timer = timer;
 			detach_expired_timer(timer, base);
@@ -1418,6 +1526,12 @@ static void run_timer_softirq(struct softirq_action *h)
 
 	if (time_after_eq(jiffies, base->timer_jiffies))
 		__run_timers(base);
+
+#if defined(CONFIG_NO_HZ_COMMON) && defined(CONFIG_SMP)
+	if (smp_processor_id() == tick_do_timer_cpu &&
+	    time_after_eq(jiffies, tvec_base_deferrable.timer_jiffies))
+		__run_timers(&tvec_base_deferrable);
+#endif
 }
 
 /*
@@ -1549,9 +1663,27 @@ signed long __sched schedule_timeout_uninterruptible(signed long timeout)
 }
 EXPORT_SYMBOL(schedule_timeout_uninterruptible);
 
-static int init_timers_cpu(int cpu)
+static void init_timer_vectors(struct tvec_base *base)
 {
 	int j;
+
+	for (j = 0; j < TVN_SIZE; j++) {
+		INIT_LIST_HEAD(base->tv5.vec + j);
+		INIT_LIST_HEAD(base->tv4.vec + j);
+		INIT_LIST_HEAD(base->tv3.vec + j);
+		INIT_LIST_HEAD(base->tv2.vec + j);
+	}
+	for (j = 0; j < TVR_SIZE; j++)
+		INIT_LIST_HEAD(base->tv1.vec + j);
+
+	base->timer_jiffies = jiffies;
+	base->next_timer = base->timer_jiffies;
+	base->active_timers = 0;
+	base->all_timers = 0;
+}
+
+static int init_timers_cpu(int cpu)
+{
 	struct tvec_base *base;
 	static char tvec_base_done[NR_CPUS];
 
@@ -1590,20 +1722,7 @@ static int init_timers_cpu(int cpu)
 		base = per_cpu(tvec_bases, cpu);
 	}
 
-
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
-	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
-
-	base->timer_jiffies = jiffies;
-	base->next_timer = base->timer_jiffies;
-	base->active_timers = 0;
-	base->all_timers = 0;
+	init_timer_vectors(base);
 	return 0;
 }
 
@@ -1695,6 +1814,11 @@ void __init init_timers(void)
 			       (void *)(long)smp_processor_id());
 	BUG_ON(err != NOTIFY_OK);
 
+#if defined(CONFIG_NO_HZ_COMMON) && defined(CONFIG_SMP)
+	spin_lock_init(&tvec_base_deferrable.lock);
+	init_timer_vectors(&tvec_base_deferrable);
+#endif
+
 	init_timer_stats();
 	register_cpu_notifier(&timers_nb);
 	open_softirq(TIMER_SOFTIRQ, run_timer_softirq);
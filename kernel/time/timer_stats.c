@@ -31,6 +31,10 @@
  * Display the information collected so far:
  * # cat /proc/timer_stats
  *
+ * Display the CPU wakeups caused by each timer function during the same
+ * collection period:
+ * # cat /proc/timer_wakeups
+ *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License version 2 as
  * published by the Free Software Foundation.
@@ -42,6 +46,8 @@
 #include <linux/sched.h>
 #include <linux/seq_file.h>
 #include <linux/kallsyms.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
 
 #include <asm/uaccess.h>
 
@@ -135,11 +141,33 @@ static atomic_t overflow_count;
 
 static struct entry *tstat_hash_table[TSTAT_HASH_SIZE] __read_mostly;
 
+/*
+ * Wakeup accounting, keyed by the timer function only: a timer expiring
+ * on an idle CPU either woke the CPU up or was run on a wakeup caused by
+ * an earlier timer of the same batch.
+ */
+struct wakeup_entry {
+	struct wakeup_entry	*next;
+	void			*expire_func;
+	unsigned long		wakeups;
+	unsigned long		coalesced;
+};
+
+#define MAX_WAKEUP_ENTRIES	(MAX_ENTRIES / 4)
+#define WAKEUP_HASH_SIZE	(MAX_WAKEUP_ENTRIES / 2)
+
+static unsigned long nr_wakeup_entries;
+static struct wakeup_entry wakeup_entries[MAX_WAKEUP_ENTRIES];
+static struct wakeup_entry *wakeup_hash_table[WAKEUP_HASH_SIZE] __read_mostly;
+
 static void reset_entries(void)
 {
 	nr_entries = 0;
 	memset(entries, 0, sizeof(entries));
 	memset(tstat_hash_table, 0, sizeof(tstat_hash_table));
+	nr_wakeup_entries = 0;
+	memset(wakeup_entries, 0, sizeof(wakeup_entries));
+	memset(wakeup_hash_table, 0, sizeof(wakeup_hash_table));
 	atomic_set(&overflow_count, 0);
 }
 
@@ -267,6 +295,85 @@ void timer_stats_update_stats(void *timer, pid_t pid, void *startf,
 	raw_spin_unlock_irqrestore(lock, flags);
 }
 
+/*
+ * Same scheme as tstat_lookup(): lockless walk of the hash chain under
+ * the lookup lock, table lock for insertion.
+ */
+static struct wakeup_entry *wakeup_lookup(void *timerf)
+{
+	struct wakeup_entry **head, *curr, *prev;
+
+	head = wakeup_hash_table +
+		hash_ptr(timerf, ilog2(WAKEUP_HASH_SIZE));
+
+	for (curr = *head; curr; curr = curr->next)
+		if (curr->expire_func == timerf)
+			return curr;
+
+	prev = NULL;
+	curr = *head;
+
+	raw_spin_lock(&table_lock);
+	while (curr) {
+		if (curr->expire_func == timerf)
+			goto out_unlock;
+
+		prev = curr;
+		curr = curr->next;
+	}
+
+	if (nr_wakeup_entries < MAX_WAKEUP_ENTRIES) {
+		curr = wakeup_entries + nr_wakeup_entries++;
+		curr->expire_func = timerf;
+		curr->next = NULL;
+
+		smp_mb(); /* Ensure that curr is initialized before insert */
+
+		if (prev)
+			prev->next = curr;
+		else
+			*head = curr;
+	}
+ out_unlock:
+	raw_spin_unlock(&table_lock);
+
+	return curr;
+}
+
+/**
+ * timer_stats_update_wakeup - Account a timer expiry on an idle CPU.
+ * @timerf:	pointer to the timer callback function of the timer
+ * @wakeup:	whether the timer woke the CPU up
+ */
+void timer_stats_update_wakeup(void *timerf, bool wakeup)
+{
+	struct wakeup_entry *entry;
+	raw_spinlock_t *lock;
+	unsigned long flags;
+
+	if (likely(!timer_stats_active))
+		return;
+
+	lock = &per_cpu(tstats_lookup_lock, raw_smp_processor_id());
+
+	raw_spin_lock_irqsave(lock, flags);
+	if (!timer_stats_active)
+		goto out_unlock;
+
+	entry = wakeup_lookup(timerf);
+	if (likely(entry)) {
+		if (wakeup)
+			entry->wakeups++;
+		else
+			entry->coalesced++;
+	} else {
+		atomic_inc(&overflow_count);
+	}
+
+ out_unlock:
+	raw_spin_unlock_irqrestore(lock, flags);
+}
+
 static void print_name_offset(struct seq_file *m, unsigned long addr)
 {
 	char symname[KSYM_NAME_LEN];
@@ -338,6 +445,49 @@ static int tstats_show(struct seq_file *m, void *v)
 	return 0;
 }
 
+static int twakeups_show(struct seq_file *m, void *v)
+{
+	struct wakeup_entry *entry;
+	struct timespec period;
+	unsigned long ms, wakeups = 0;
+	int i;
+
+	mutex_lock(&show_mutex);
+	if (timer_stats_active)
+		time_stop = ktime_get();
+
+	period = ktime_to_timespec(ktime_sub(time_stop, time_start));
+	ms = period.tv_sec * 1000 + period.tv_nsec / 1000000;
+	if (!ms)
+		ms = 1;
+
+	seq_printf(m, "Sample period: %ld.%03ld s\n", period.tv_sec,
+		   period.tv_nsec / 1000000);
+	seq_printf(m, "Collection: %s\n", timer_stats_active ? "active" : "inactive");
+	seq_printf(m, "%10s %12s %10s  %s\n", "wakeups", "wakeups/sec",
+		   "coalesced", "function");
+
+	for (i = 0; i < nr_wakeup_entries; i++) {
+		entry = wakeup_entries + i;
+
+		seq_printf(m, "%10lu %8lu.%03lu %10lu  ", entry->wakeups,
+			   entry->wakeups * 1000 / ms,
+			   (entry->wakeups * 1000000 / ms) % 1000,
+			   entry->coalesced);
+		print_name_offset(m, (unsigned long)entry->expire_func);
+		seq_putc(m, '\n');
+
+		wakeups += entry->wakeups;
+	}
+
+	seq_printf(m, "%lu total wakeups, %lu.%03lu wakeups/sec\n", wakeups,
+		   wakeups * 1000 / ms, (wakeups * 1000000 / ms) % 1000);
+
+	mutex_unlock(&show_mutex);
+
+	return 0;
+}
+
 /*
  * After a state change, make sure all concurrent lookup/update
  * activities have stopped:
@@ -405,6 +555,18 @@ static const struct file_operations tstats_fops = {
 	.release	= single_release,
 };
 
+static int twakeups_open(struct inode *inode, struct file *filp)
+{
+	return single_open(filp, twakeups_show, NULL);
+}
+
+static const struct file_operations twakeups_fops = {
+	.open		= twakeups_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 void __init init_timer_stats(void)
 {
 	int cpu;
@@ -418,6 +580,9 @@ static int __init init_tstats_procfs(void)
 	struct proc_dir_entry *pe;
 
 	pe = proc_create("timer_stats", 0644, NULL, &tstats_fops);
+	if (!pe)
+		return -ENOMEM;
+	pe = proc_create("timer_wakeups", 0444, NULL, &twakeups_fops);
 	if (!pe)
 		return -ENOMEM;
 	return 0;
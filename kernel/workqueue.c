@@ -48,6 +48,9 @@
 #include <linux/nodemask.h>
 #include <linux/moduleparam.h>
 #include <linux/uaccess.h>
+#include <linux/topology.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include <linux/exynos-ss.h>
 
 #include "workqueue_internal.h"
@@ -250,6 +253,10 @@ struct workqueue_struct {
 	struct workqueue_attrs	*unbound_attrs;	/* WQ: only for unbound wqs */
 	struct pool_workqueue	*dfl_pwq;	/* WQ: only for unbound wqs */
 
+#ifdef CONFIG_WQ_STATS
+	struct wq_stats __percpu *stats;	/* I: latency histograms */
+#endif
+
 #ifdef CONFIG_SYSFS
 	struct wq_device	*wq_dev;	/* I: for sysfs interface */
 #endif
@@ -281,6 +288,25 @@ static bool wq_power_efficient;
 
 module_param_named(power_efficient, wq_power_efficient, bool, 0444);
 
+/*
+ * Bitmask of CPU clusters, by physical package id, the workers of
+ * latency-sensitive unbound workqueues are confined to from the start.
+ * Zero leaves them on all CPUs.  The "clusters" sysfs attribute changes
+ * it later for WQ_SYSFS workqueues.
+ */
+static unsigned long wq_latency_clusters;
+module_param_named(latency_clusters, wq_latency_clusters, ulong, 0444);
+
+/* cluster bit of @cpu, 0 if its package id is unknown or out of range */
+static unsigned long wq_cpu_cluster(int cpu)
+{
+	int id = topology_physical_package_id(cpu);
+
+	if (id < 0 || id >= BITS_PER_LONG)
+		return 0;
+	return 1UL << id;
+}
+
 static bool wq_numa_enabled;		/* unbound NUMA affinity enabled */
 
 /* buf for wq_update_unbound_numa_attrs(), protected by CPU hotplug exclusion */
@@ -1258,6 +1284,78 @@ fail:
 	return -EAGAIN;
 }
 
+#ifdef CONFIG_WQ_STATS
+/*
+ * Per-workqueue queueing delay and execution time histograms, exported
+ * through debugfs as workqueue/latency.  Bucket i counts the events which
+ * took [2^(i-1), 2^i) usecs, the last bucket everything longer.
+ */
+#define WQ_STATS_BUCKETS	16
+
+struct wq_stats {
+	unsigned long		queue_hist[WQ_STATS_BUCKETS];
+	unsigned long		exec_hist[WQ_STATS_BUCKETS];
+	u64			max_exec_ns;
+	work_func_t		max_exec_func;
+};
+
+static int wq_stats_alloc(struct workqueue_struct *wq)
+{
+	wq->stats = alloc_percpu(struct wq_stats);
+	return wq->stats ? 0 : -ENOMEM;
+}
+
+static void wq_stats_free(struct workqueue_struct *wq)
+{
+	free_percpu(wq->stats);
+}
+
+static int wq_stats_bucket(u64 ns)
+{
+	return min_t(int, fls64(div_u64(ns, NSEC_PER_USEC)),
+		     WQ_STATS_BUCKETS - 1);
+}
+
+static void wq_stats_queued(struct work_struct *work)
+{
+	work->queued_ns = local_clock();
+}
+
+/* account the queueing delay of @work and return its execution start */
+static u64 wq_stats_start(struct workqueue_struct *wq,
+			  struct work_struct *work)
+{
+	u64 now = local_clock();
+	u64 delay = now > work->queued_ns ? now - work->queued_ns : 0;
+
+	this_cpu_inc(wq->stats->queue_hist[wq_stats_bucket(delay)]);
+	return now;
+}
+
+static void wq_stats_end(struct workqueue_struct *wq, work_func_t func,
+			 u64 start)
+{
+	u64 ns = local_clock() - start;
+	struct wq_stats *stats;
+
+	stats = get_cpu_ptr(wq->stats);
+	stats->exec_hist[wq_stats_bucket(ns)]++;
+	if (ns > stats->max_exec_ns) {
+		stats->max_exec_ns = ns;
+		stats->max_exec_func = func;
+	}
+	put_cpu_ptr(wq->stats);
+}
+#else
+static inline int wq_stats_alloc(struct workqueue_struct *wq) { return 0; }
+static inline void wq_stats_free(struct workqueue_struct *wq) { }
+static inline void wq_stats_queued(struct work_struct *work) { }
+static inline u64 wq_stats_start(struct workqueue_struct *wq,
+				 struct work_struct *work) { return 0; }
+static inline void wq_stats_end(struct workqueue_struct *wq,
+				work_func_t func, u64 start) { }
+#endif	/* CONFIG_WQ_STATS */
+
 /**
  * insert_work - insert a work into a pool
  * @pwq: pwq @work belongs to
@@ -1279,6 +1377,7 @@ static void insert_work(struct pool_workqueue *pwq, struct work_struct *work,
 	/* we own @work, set data and link */
 	set_work_pwq(work, pwq, extra_flags);
 	list_add_tail(&work->entry, head);
+	wq_stats_queued(work);
 	get_pwq(pwq);
 
 	/*
@@ -1687,6 +1786,14 @@ static void worker_detach_from_pool(struct worker *worker,
 		complete(detach_completion);
 }
 
+/* the nice level of workers, latency pools never run below high priority */
+static int wq_attrs_nice(const struct workqueue_attrs *attrs)
+{
+	if (attrs->latency)
+		return min_t(int, attrs->nice, HIGHPRI_NICE_LEVEL);
+	return attrs->nice;
+}
+
 /**
  * create_worker - create a new workqueue worker
  * @pool: pool the new worker will belong to
@@ -1721,14 +1828,15 @@ static struct worker *create_worker(struct worker_pool *pool)
 		snprintf(id_buf, sizeof(id_buf), "%d:%d%s", pool->cpu, id,
 			 pool->attrs->nice < 0  ? "H" : "");
 	else
-		snprintf(id_buf, sizeof(id_buf), "u%d:%d", pool->id, id);
+		snprintf(id_buf, sizeof(id_buf), "u%d:%d%s", pool->id, id,
+			 pool->attrs->latency ? "L" : "");
 
 	worker->task = kthread_create_on_node(worker_thread, worker, pool->node,
 					      "kworker/%s", id_buf);
 	if (IS_ERR(worker->task))
 		goto fail;
 
-	set_user_nice(worker->task, pool->attrs->nice);
+	set_user_nice(worker->task, wq_attrs_nice(pool->attrs));
 
 	/* prevent userland from meddling with cpumask of workqueue workers */
 	worker->task->flags |= PF_NO_SETAFFINITY;
@@ -1972,6 +2080,7 @@ __acquires(&pool->lock)
 	bool cpu_intensive = pwq->wq->flags & WQ_CPU_INTENSIVE;
 	int work_color;
 	struct worker *collision;
+	u64 start;
 #ifdef CONFIG_LOCKDEP
 	/*
 	 * It is permissible to free the struct work_struct from
@@ -2037,6 +2146,8 @@ __acquires(&pool->lock)
 	 */
 	set_work_pool_and_clear_pending(work, pool->id);
 
+	start = wq_stats_start(pwq->wq, work);
+
 	spin_unlock_irq(&pool->lock);
 
 	lock_map_acquire_read(&pwq->wq->lockdep_map);
@@ -2050,6 +2161,7 @@ __acquires(&pool->lock)
 	 * point will only record its address.
 	 */
 	trace_workqueue_execute_end(work);
+	wq_stats_end(pwq->wq, worker->current_func, start);
 	lock_map_release(&lockdep_map);
 	lock_map_release(&pwq->wq->lockdep_map);
 
@@ -3016,8 +3128,11 @@ EXPORT_SYMBOL_GPL(execute_in_process_context);
  * Unbound workqueues have the following extra attributes.
  *
  *  id		RO int	: the associated pool ID
- *  nice	RW int	: nice value of the workers
+ *  nice	RW int	: nice value of the workers, at most HIGHPRI_NICE_LEVEL
+ *			  in latency pools
  *  cpumask	RW mask	: bitmask of allowed CPUs for the workers
+ *  clusters	RW mask	: bitmask of allowed CPU clusters, sets cpumask
+ *  latency	RW bool	: whether the workers come from latency pools
  */
 struct wq_device {
 	struct workqueue_struct		*wq;
@@ -3097,7 +3212,8 @@ static ssize_t wq_nice_show(struct device *dev, struct device_attribute *attr,
 	int written;
 
 	mutex_lock(&wq->mutex);
-	written = scnprintf(buf, PAGE_SIZE, "%d\n", wq->unbound_attrs->nice);
+	written = scnprintf(buf, PAGE_SIZE, "%d\n",
+			    wq_attrs_nice(wq->unbound_attrs));
 	mutex_unlock(&wq->mutex);
 
 	return written;
@@ -3208,11 +3324,95 @@ static ssize_t wq_numa_store(struct device *dev, struct device_attribute *attr,
 	return ret ?: count;
 }
 
+static ssize_t wq_clusters_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	unsigned long clusters = 0;
+	int cpu;
+
+	mutex_lock(&wq->mutex);
+	for_each_cpu(cpu, wq->unbound_attrs->cpumask)
+		clusters |= wq_cpu_cluster(cpu);
+	mutex_unlock(&wq->mutex);
+
+	return scnprintf(buf, PAGE_SIZE, "%lx\n", clusters);
+}
+
+static ssize_t wq_clusters_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	unsigned long clusters;
+	int cpu, ret;
+
+	ret = kstrtoul(buf, 16, &clusters);
+	if (ret)
+		return ret;
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		return -ENOMEM;
+
+	cpumask_clear(attrs->cpumask);
+	for_each_possible_cpu(cpu)
+		if (clusters & wq_cpu_cluster(cpu))
+			cpumask_set_cpu(cpu, attrs->cpumask);
+
+	if (cpumask_empty(attrs->cpumask))
+		ret = -EINVAL;
+	else
+		ret = apply_workqueue_attrs(wq, attrs);
+
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+static ssize_t wq_latency_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq->mutex);
+	written = scnprintf(buf, PAGE_SIZE, "%d\n",
+			    wq->unbound_attrs->latency);
+	mutex_unlock(&wq->mutex);
+
+	return written;
+}
+
+static ssize_t wq_latency_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int v, ret;
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		return -ENOMEM;
+
+	ret = -EINVAL;
+	if (sscanf(buf, "%d", &v) == 1) {
+		attrs->latency = v;
+		ret = apply_workqueue_attrs(wq, attrs);
+	}
+
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
 static struct device_attribute wq_sysfs_unbound_attrs[] = {
 	__ATTR(pool_ids, 0444, wq_pool_ids_show, NULL),
 	__ATTR(nice, 0644, wq_nice_show, wq_nice_store),
 	__ATTR(cpumask, 0644, wq_cpumask_show, wq_cpumask_store),
 	__ATTR(numa, 0644, wq_numa_show, wq_numa_store),
+	__ATTR(clusters, 0644, wq_clusters_show, wq_clusters_store),
+	__ATTR(latency, 0644, wq_latency_show, wq_latency_store),
 	__ATTR_NULL,
 };
 
@@ -3366,6 +3566,7 @@ static void copy_workqueue_attrs(struct workqueue_attrs *to,
 				 const struct workqueue_attrs *from)
 {
 	to->nice = from->nice;
+	to->latency = from->latency;
 	cpumask_copy(to->cpumask, from->cpumask);
 	/*
 	 * Unlike hash and equality test, this function doesn't ignore
@@ -3381,6 +3582,7 @@ static u32 wqattrs_hash(const struct workqueue_attrs *attrs)
 	u32 hash = 0;
 
 	hash = jhash_1word(attrs->nice, hash);
+	hash = jhash_1word(attrs->latency, hash);
 	hash = jhash(cpumask_bits(attrs->cpumask),
 		     BITS_TO_LONGS(nr_cpumask_bits) * sizeof(long), hash);
 	return hash;
@@ -3392,6 +3594,8 @@ static bool wqattrs_equal(const struct workqueue_attrs *a,
 {
 	if (a->nice != b->nice)
 		return false;
+	if (a->latency != b->latency)
+		return false;
 	if (!cpumask_equal(a->cpumask, b->cpumask))
 		return false;
 	return true;
@@ -3621,6 +3825,7 @@ static void pwq_unbound_release_workfn(struct work_struct *work)
 	 */
 	if (is_last) {
 		free_workqueue_attrs(wq->unbound_attrs);
+		wq_stats_free(wq);
 		kfree(wq);
 	}
 }
@@ -4025,6 +4230,39 @@ out_unlock:
 	put_pwq_unlocked(old_pwq);
 }
 
+/*
+ * Apply @attrs to unbound @wq, moving it to latency pools, on the CPUs of
+ * wq_latency_clusters, if requested.
+ */
+static int apply_wq_class_attrs(struct workqueue_struct *wq,
+				const struct workqueue_attrs *attrs)
+{
+	struct workqueue_attrs *tmp_attrs;
+	int cpu, ret;
+
+	if (!(wq->flags & WQ_LATENCY_SENSITIVE))
+		return apply_workqueue_attrs(wq, attrs);
+
+	tmp_attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	if (!tmp_attrs)
+		return -ENOMEM;
+
+	copy_workqueue_attrs(tmp_attrs, attrs);
+	tmp_attrs->latency = true;
+	if (wq_latency_clusters) {
+		for_each_possible_cpu(cpu)
+			if (!(wq_latency_clusters & wq_cpu_cluster(cpu)))
+				cpumask_clear_cpu(cpu, tmp_attrs->cpumask);
+		/* no CPU in those clusters, ignore the parameter */
+		if (cpumask_empty(tmp_attrs->cpumask))
+			cpumask_copy(tmp_attrs->cpumask, attrs->cpumask);
+	}
+	ret = apply_workqueue_attrs(wq, tmp_attrs);
+
+	free_workqueue_attrs(tmp_attrs);
+	return ret;
+}
+
 static int alloc_and_link_pwqs(struct workqueue_struct *wq)
 {
 	bool highpri = wq->flags & WQ_HIGHPRI;
@@ -4049,14 +4287,14 @@ static int alloc_and_link_pwqs(struct workqueue_struct *wq)
 		}
 		return 0;
 	} else if (wq->flags & __WQ_ORDERED) {
-		ret = apply_workqueue_attrs(wq, ordered_wq_attrs[highpri]);
+		ret = apply_wq_class_attrs(wq, ordered_wq_attrs[highpri]);
 		/* there should only be single pwq for ordering guarantee */
 		WARN(!ret && (wq->pwqs.next != &wq->dfl_pwq->pwqs_node ||
 			      wq->pwqs.prev != &wq->dfl_pwq->pwqs_node),
 		     "ordering guarantee broken for workqueue %s\n", wq->name);
 		return ret;
 	} else {
-		return apply_workqueue_attrs(wq, unbound_std_wq_attrs[highpri]);
+		return apply_wq_class_attrs(wq, unbound_std_wq_attrs[highpri]);
 	}
 }
 
@@ -4097,6 +4335,10 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	if ((flags & WQ_POWER_EFFICIENT) && wq_power_efficient)
 		flags |= WQ_UNBOUND;
 
+	/* see the comment above the definition of WQ_LATENCY_SENSITIVE */
+	if ((flags & WQ_LATENCY_SENSITIVE) && !(flags & WQ_UNBOUND))
+		flags |= WQ_HIGHPRI;
+
 	/* allocate wq and format name */
 	if (flags & WQ_UNBOUND)
 		tbl_size = nr_node_ids * sizeof(wq->numa_pwq_tbl[0]);
@@ -4111,6 +4353,9 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 			goto err_free_wq;
 	}
 
+	if (wq_stats_alloc(wq))
+		goto err_free_wq;
+
 	va_start(args, lock_name);
 	vsnprintf(wq->name, sizeof(wq->name), fmt, args);
 	va_end(args);
@@ -4181,6 +4426,7 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 
 err_free_wq:
 	free_workqueue_attrs(wq->unbound_attrs);
+	wq_stats_free(wq);
 	kfree(wq);
 	return NULL;
 err_destroy:
@@ -4246,6 +4492,7 @@ void destroy_workqueue(struct workqueue_struct *wq)
 		 * free the pwqs and wq.
 		 */
 		free_percpu(wq->cpu_pwqs);
+		wq_stats_free(wq);
 		kfree(wq);
 	} else {
 		/*
@@ -4999,3 +5246,89 @@ static int __init init_workqueues(void)
 	return 0;
 }
 early_initcall(init_workqueues);
+
+#ifdef CONFIG_WQ_STATS
+static void wq_stats_print_hist(struct seq_file *m, const char *name,
+				struct workqueue_struct *wq, bool exec)
+{
+	unsigned long hist[WQ_STATS_BUCKETS] = { };
+	struct wq_stats *stats;
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		stats = per_cpu_ptr(wq->stats, cpu);
+		for (i = 0; i < WQ_STATS_BUCKETS; i++)
+			hist[i] += exec ? stats->exec_hist[i] :
+					  stats->queue_hist[i];
+	}
+
+	seq_printf(m, "%-24s %-5s", name, exec ? "exec" : "queue");
+	for (i = 0; i < WQ_STATS_BUCKETS; i++)
+		seq_printf(m, " %8lu", hist[i]);
+	seq_putc(m, '\n');
+}
+
+static int wq_stats_show(struct seq_file *m, void *v)
+{
+	struct workqueue_struct *wq;
+	struct wq_stats *stats;
+	work_func_t max_func;
+	u64 max_ns;
+	int cpu, i;
+
+	seq_printf(m, "%-24s %-5s", "workqueue", "usecs");
+	for (i = 0; i < WQ_STATS_BUCKETS; i++)
+		seq_printf(m, " %8lu", i ? 1UL << (i - 1) : 0);
+	seq_putc(m, '\n');
+
+	mutex_lock(&wq_pool_mutex);
+	list_for_each_entry(wq, &workqueues, list) {
+		wq_stats_print_hist(m, wq->name, wq, false);
+		wq_stats_print_hist(m, wq->name, wq, true);
+
+		max_ns = 0;
+		max_func = NULL;
+		for_each_possible_cpu(cpu) {
+			stats = per_cpu_ptr(wq->stats, cpu);
+			if (stats->max_exec_ns > max_ns) {
+				max_ns = stats->max_exec_ns;
+				max_func = stats->max_exec_func;
+			}
+		}
+		if (max_func)
+			seq_printf(m, "%-24s max   %llu us in %pf\n", wq->name,
+				   div_u64(max_ns, NSEC_PER_USEC), max_func);
+	}
+	mutex_unlock(&wq_pool_mutex);
+
+	return 0;
+}
+
+static int wq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wq_stats_show, NULL);
+}
+
+static const struct file_operations wq_stats_fops = {
+	.open		= wq_stats_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init wq_stats_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("workqueue", NULL);
+	if (!dir)
+		return -ENOMEM;
+
+	if (!debugfs_create_file("latency", 0444, dir, NULL, &wq_stats_fops)) {
+		debugfs_remove(dir);
+		return -ENOMEM;
+	}
+	return 0;
+}
+late_initcall(wq_stats_init);
+#endif	/* CONFIG_WQ_STATS */
@@ -95,6 +95,11 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "BdiDirtied:         %10lu kB\n"
 		   "BdiWritten:         %10lu kB\n"
 		   "BdiWriteBandwidth:  %10lu kBps\n"
+		   "BdiWriteLatency:    %10lu us\n"
+		   "BdiLatencyTarget:   %10u us\n"
+		   "BdiThrottleTime:    %10u ms\n"
+		   "BdiThrottled:       %10lu\n"
+		   "BdiLatencyThrottled:%10lu\n"
 		   "b_dirty:            %10lu\n"
 		   "b_io:               %10lu\n"
 		   "b_more_io:          %10lu\n"
@@ -108,6 +113,11 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   (unsigned long) K(bdi_stat(bdi, BDI_DIRTIED)),
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITTEN)),
 		   (unsigned long) K(bdi->write_bandwidth),
+		   bdi->write_latency,
+		   bdi->write_latency_target,
+		   jiffies_to_msecs(bdi->paused_total),
+		   bdi->nr_paused,
+		   bdi->nr_latency_paused,
 		   nr_dirty,
 		   nr_io,
 		   nr_more_io,
@@ -234,11 +244,48 @@ static ssize_t stable_pages_required_show(struct device *dev,
 }
 static DEVICE_ATTR_RO(stable_pages_required);
 
+static ssize_t write_latency_target_us_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct backing_dev_info *bdi = dev_get_drvdata(dev);
+	unsigned int target;
+	ssize_t ret;
+
+	ret = kstrtouint(buf, 10, &target);
+	if (ret < 0)
+		return ret;
+
+	bdi->write_latency_target = target;
+
+	return count;
+}
+BDI_SHOW(write_latency_target_us, bdi->write_latency_target)
+
+#define BDI_SHOW_RO(name, expr)						\
+static ssize_t name##_show(struct device *dev,				\
+			   struct device_attribute *attr, char *page)	\
+{									\
+	struct backing_dev_info *bdi = dev_get_drvdata(dev);		\
+									\
+	return snprintf(page, PAGE_SIZE-1, "%lld\n", (long long)expr);	\
+}									\
+static DEVICE_ATTR_RO(name);
+
+BDI_SHOW_RO(write_latency_us, bdi->write_latency)
+BDI_SHOW_RO(throttle_time_ms, jiffies_to_msecs(bdi->paused_total))
+BDI_SHOW_RO(throttle_count, bdi->nr_paused)
+BDI_SHOW_RO(latency_throttle_count, bdi->nr_latency_paused)
+
 static struct attribute *bdi_dev_attrs[] = {
 	&dev_attr_read_ahead_kb.attr,
 	&dev_attr_min_ratio.attr,
 	&dev_attr_max_ratio.attr,
 	&dev_attr_stable_pages_required.attr,
+	&dev_attr_write_latency_target_us.attr,
+	&dev_attr_write_latency_us.attr,
+	&dev_attr_throttle_time_ms.attr,
+	&dev_attr_throttle_count.attr,
+	&dev_attr_latency_throttle_count.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(bdi_dev);
@@ -461,6 +508,10 @@ int bdi_init(struct backing_dev_info *bdi)
 	bdi->last_thresh = 0;
 	bdi->last_nr_dirty = 0;
 	bdi->paused_total = 0;
+	bdi->nr_paused = 0;
+	bdi->nr_latency_paused = 0;
+	bdi->write_latency = 0;
+	bdi->write_latency_target = 0;
 
 	err = fprop_local_init_percpu(&bdi->completions, GFP_KERNEL);
 
@@ -2013,6 +2013,7 @@ void filemap_map_pages(struct vm_area_struct *vma, struct vm_fault *vmf)
 	struct page *page;
 	unsigned long address = (unsigned long) vmf->virtual_address;
 	unsigned long addr;
+	unsigned long nr_mapped = 0;
 	pte_t *pte;
 
 	rcu_read_lock();
@@ -2062,6 +2063,8 @@ repeat:
 		addr = address + (page->index - vmf->pgoff) * PAGE_SIZE;
 		do_set_pte(vma, addr, page, pte, false, false);
 		unlock_page(page);
+		if (page->index != vmf->fault_pgoff)
+			nr_mapped++;
 		goto next;
 unlock:
 		unlock_page(page);
@@ -2072,6 +2075,7 @@ next:
 			break;
 	}
 	rcu_read_unlock();
+	count_vm_events(FAULT_AROUND_MAPPED, nr_mapped);
 }
 EXPORT_SYMBOL(filemap_map_pages);
 
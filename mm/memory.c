@@ -62,6 +62,7 @@
 #include <linux/string.h>
 #include <linux/dma-debug.h>
 #include <linux/debugfs.h>
+#include <linux/kobject.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -191,7 +192,8 @@ static int tlb_next_batch(struct mmu_gather *tlb)
 		return 1;
 	}
 
-	if (tlb->batch_count == MAX_GATHER_BATCH_COUNT)
+	if (tlb->batch_count == (tlb->fullmm ? MAX_GATHER_BATCH_COUNT_FULLMM :
+						MAX_GATHER_BATCH_COUNT))
 		return 0;
 
 	batch = (void *)__get_free_pages(GFP_NOWAIT | __GFP_NOWARN, 0);
@@ -2735,19 +2737,12 @@ void do_set_pte(struct vm_area_struct *vma, unsigned long address,
 static unsigned long fault_around_bytes __read_mostly =
 	rounddown_pow_of_two(4096);
 
-#ifdef CONFIG_DEBUG_FS
-static int fault_around_bytes_get(void *data, u64 *val)
-{
-	*val = fault_around_bytes;
-	return 0;
-}
-
 /*
  * fault_around_pages() and fault_around_mask() expects fault_around_bytes
  * rounded down to nearest page order. It's what do_fault_around() expects to
  * see.
  */
-static int fault_around_bytes_set(void *data, u64 val)
+static int fault_around_bytes_update(u64 val)
 {
 	if (val / PAGE_SIZE > PTRS_PER_PTE)
 		return -EINVAL;
@@ -2757,6 +2752,18 @@ static int fault_around_bytes_set(void *data, u64 val)
 		fault_around_bytes = PAGE_SIZE; /* rounddown_pow_of_two(0) is undefined */
 	return 0;
 }
+
+#ifdef CONFIG_DEBUG_FS
+static int fault_around_bytes_get(void *data, u64 *val)
+{
+	*val = fault_around_bytes;
+	return 0;
+}
+
+static int fault_around_bytes_set(void *data, u64 val)
+{
+	return fault_around_bytes_update(val);
+}
 DEFINE_SIMPLE_ATTRIBUTE(fault_around_bytes_fops,
 		fault_around_bytes_get, fault_around_bytes_set, "%llu\n");
 
@@ -2773,6 +2780,62 @@ static int __init fault_around_debugfs(void)
 late_initcall(fault_around_debugfs);
 #endif
 
+#ifdef CONFIG_SYSFS
+/*
+ * /sys/kernel/mm/fault_around/fault_around_bytes: size of the window of
+ * already-cached pages mapped on a read fault. PAGE_SIZE disables
+ * fault-around.
+ */
+static ssize_t fault_around_bytes_show(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", fault_around_bytes);
+}
+
+static ssize_t fault_around_bytes_store(struct kobject *kobj,
+					struct kobj_attribute *attr,
+					const char *buf, size_t count)
+{
+	unsigned long val;
+	int err;
+
+	err = kstrtoul(buf, 10, &val);
+	if (err)
+		return err;
+
+	err = fault_around_bytes_update(val);
+	if (err)
+		return err;
+
+	return count;
+}
+
+static struct kobj_attribute fault_around_bytes_attr =
+	__ATTR(fault_around_bytes, 0644, fault_around_bytes_show,
+	       fault_around_bytes_store);
+
+static struct attribute *fault_around_attrs[] = {
+	&fault_around_bytes_attr.attr,
+	NULL,
+};
+
+static struct attribute_group fault_around_attr_group = {
+	.attrs = fault_around_attrs,
+	.name = "fault_around",
+};
+
+static int __init fault_around_sysfs(void)
+{
+	int err;
+
+	err = sysfs_create_group(mm_kobj, &fault_around_attr_group);
+	if (err)
+		pr_warn("Failed to create fault_around in sysfs\n");
+	return 0;
+}
+late_initcall(fault_around_sysfs);
+#endif
+
 /*
  * do_fault_around() tries to map few pages around the fault address. The hope
  * is that the pages will be needed soon and this will lower the number of
@@ -2804,6 +2867,7 @@ static void do_fault_around(struct vm_area_struct *vma, unsigned long address,
 	struct vm_fault vmf;
 	int off;
 
+	vmf.fault_pgoff = pgoff;
 	nr_pages = ACCESS_ONCE(fault_around_bytes) >> PAGE_SHIFT;
 	mask = ~(nr_pages * PAGE_SIZE - 1) & PAGE_MASK;
 
@@ -2836,6 +2900,7 @@ static void do_fault_around(struct vm_area_struct *vma, unsigned long address,
 	vmf.pgoff = pgoff;
 	vmf.max_pgoff = max_pgoff;
 	vmf.flags = flags;
+	count_vm_event(FAULT_AROUND);
 	vma->vm_ops->map_pages(vma, &vmf);
 }
 
@@ -2857,8 +2922,10 @@ static int do_read_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	    fault_around_bytes >> PAGE_SHIFT > 1) {
 		pte = pte_offset_map_lock(mm, pmd, address, &ptl);
 		do_fault_around(vma, address, pte, pgoff, flags);
-		if (!pte_same(*pte, orig_pte))
+		if (!pte_same(*pte, orig_pte)) {
+			count_vm_event(FAULT_AROUND_HIT);
 			goto unlock_out;
+		}
 		pte_unmap_unlock(pte, ptl);
 	}
 
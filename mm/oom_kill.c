@@ -654,6 +654,14 @@ void out_of_memory(struct zonelist *zonelist, gfp_t gfp_mask,
 		return;
 	}
 
+	/*
+	 * A killed task that already exited may still be handing its memory
+	 * back through the deferred mm teardown: wait for it, as for a
+	 * TIF_MEMDIE task.
+	 */
+	if (!force_kill && mm_teardown_busy(NULL))
+		return;
+
 	/*
 	 * Check if there were limitations on the allocation (only relevant for
 	 * NUMA) that may require different handling.
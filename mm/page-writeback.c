@@ -840,6 +840,17 @@ static unsigned long bdi_position_ratio(struct backing_dev_info *bdi,
 			pos_ratio *= 8;
 	}
 
+	/*
+	 * write latency over target: the device queue is too deep for the
+	 * sync writers behind it, scale the rate down in proportion, but by
+	 * no more than 8 times.  As dirty_ratelimit is estimated from the
+	 * same pos_ratio, it is not pushed back up to compensate.
+	 */
+	if (bdi_over_latency_target(bdi))
+		pos_ratio = max_t(long long, pos_ratio / 8,
+				  div_u64(pos_ratio * bdi->write_latency_target,
+					  ACCESS_ONCE(bdi->write_latency) | 1));
+
 	return pos_ratio;
 }
 
@@ -1400,7 +1411,8 @@ static void balance_dirty_pages(struct address_space *mapping,
 		 * and limits. Small writeouts when the bdi limits are ramping
 		 * up are the price we consciously pay for strictlimit-ing.
 		 */
-		if (dirty <= dirty_freerun_ceiling(thresh, bg_thresh)) {
+		if (dirty <= dirty_freerun_ceiling(thresh, bg_thresh) &&
+		    !(dirty > bg_thresh && bdi_over_latency_target(bdi))) {
 			current->dirty_paused_when = now;
 			current->nr_dirtied = 0;
 			current->nr_dirtied_pause =
@@ -1502,6 +1514,9 @@ pause:
 		bdi->last_nr_dirty = nr_dirty;
 #endif
 		bdi->paused_total += pause;
+		bdi->nr_paused++;
+		if (bdi_over_latency_target(bdi))
+			bdi->nr_latency_paused++;
 
 		__set_current_state(TASK_KILLABLE);
 		io_schedule_timeout(pause);
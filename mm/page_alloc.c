@@ -2819,6 +2819,20 @@ rebalance:
 			if ((current->flags & PF_DUMPCORE) &&
 			    !(gfp_mask & __GFP_NOFAIL))
 				goto nopage;
+			/*
+			 * Killed tasks may still be handing their memory
+			 * back.  Give the teardown a moment before going OOM.
+			 */
+			if (mm_teardown_wait(gfp_mask)) {
+				page = get_page_from_freelist(gfp_mask, nodemask,
+						order, zonelist, high_zoneidx,
+						alloc_flags & ~ALLOC_NO_WATERMARKS,
+						preferred_zone, classzone_idx,
+						migratetype);
+				if (page)
+					goto got_pg;
+				goto restart;
+			}
 			page = __alloc_pages_may_oom(gfp_mask, order,
 					zonelist, high_zoneidx,
 					nodemask, preferred_zone,
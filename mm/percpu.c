@@ -35,13 +35,18 @@
  * area in the chunk.  This helps the allocator not to iterate the
  * chunk maps unnecessarily.
  *
- * Allocation state in each chunk is kept using an array of integers
- * on chunk->map.  A positive value in the map represents a free
- * region and negative allocated.  Allocation inside a chunk is done
- * by scanning this map sequentially and serving the first matching
- * entry.  This is mostly copied from the percpu_modalloc() allocator.
- * Chunks can be determined from the address using the index field
- * in the page struct. The index field contains a pointer to the chunk.
+ * Allocation state in each chunk is kept in a bitmap, chunk->alloc_map,
+ * where each bit represents PCPU_MIN_ALLOC_SIZE bytes.  A second bitmap,
+ * chunk->bound_map, marks the start of each allocation and the first
+ * bit past its end so that frees don't need to be told the size.  The
+ * bitmap is divided into PCPU_BITMAP_BLOCK_SIZE blocks, each carrying
+ * metadata (struct pcpu_block_md) describing its largest free area and
+ * the free space touching its edges.  Allocation walks the block
+ * metadata to find a candidate region and only scans the bitmap of the
+ * block(s) it lands in, so the cost no longer grows with the number of
+ * allocations in the chunk.  Chunks can be determined from the address
+ * using the index field in the page struct. The index field contains a
+ * pointer to the chunk.
  *
  * To use this allocator, arch code should do the followings.
  *
@@ -76,9 +81,6 @@
 #include <asm/io.h>
 
 #define PCPU_SLOT_BASE_SHIFT		5	/* 1-31 shares the same slot */
-#define PCPU_DFL_MAP_ALLOC		16	/* start a map with 16 ents */
-#define PCPU_ATOMIC_MAP_MARGIN_LOW	32
-#define PCPU_ATOMIC_MAP_MARGIN_HIGH	64
 #define PCPU_EMPTY_POP_PAGES_LOW	2
 #define PCPU_EMPTY_POP_PAGES_HIGH	4
 
@@ -102,19 +104,40 @@
 #define __pcpu_ptr_to_addr(ptr)		(void __force *)(ptr)
 #endif	/* CONFIG_SMP */
 
+/*
+ * The allocation bitmap tracks PCPU_MIN_ALLOC_SIZE units.  It is split
+ * into blocks of PCPU_BITMAP_BLOCK_SIZE, one per page, and each block
+ * keeps the hints below so that the allocator only needs to scan the
+ * bitmap of blocks which can actually serve a request.
+ */
+#define PCPU_MIN_ALLOC_SHIFT		2
+#define PCPU_MIN_ALLOC_SIZE		(1 << PCPU_MIN_ALLOC_SHIFT)
+#define PCPU_BITMAP_BLOCK_SIZE		PAGE_SIZE
+#define PCPU_BITMAP_BLOCK_BITS		(PCPU_BITMAP_BLOCK_SIZE >>	\
+					 PCPU_MIN_ALLOC_SHIFT)
+
+/* all offsets and sizes are in bits of the allocation bitmap */
+struct pcpu_block_md {
+	int			contig_hint;	/* largest free area */
+	int			contig_hint_start; /* block relative start */
+	int			left_free;	/* free size at block start */
+	int			right_free;	/* free size at block end */
+	int			first_free;	/* no free below this */
+};
+
 struct pcpu_chunk {
 	struct list_head	list;		/* linked to pcpu_slot lists */
 	int			free_size;	/* free bytes in the chunk */
-	int			contig_hint;	/* max contiguous size hint */
+	int			contig_bits;	/* max contiguous free bits */
+	int			contig_bits_start; /* start of contig_bits */
 	void			*base_addr;	/* base address of this chunk */
 
-	int			map_used;	/* # of map entries used before the sentry */
-	int			map_alloc;	/* # of map entries allocated */
-	int			*map;		/* allocation map */
-	struct list_head	map_extend_list;/* on pcpu_map_extend_chunks */
+	unsigned long		*alloc_map;	/* allocation map */
+	unsigned long		*bound_map;	/* boundary map */
+	struct pcpu_block_md	*md_blocks;	/* per block metadata */
 
 	void			*data;		/* chunk data */
-	int			first_free;	/* no free below this */
+	int			first_bit;	/* no free below this */
 	bool			immutable;	/* no [de]population allowed */
 	int			nr_populated;	/* # of populated pages */
 	unsigned long		populated[];	/* populated bitmap */
@@ -161,13 +184,10 @@ static struct pcpu_chunk *pcpu_reserved_chunk;
 static int pcpu_reserved_chunk_limit;
 
 static DEFINE_SPINLOCK(pcpu_lock);	/* all internal data structures */
-static DEFINE_MUTEX(pcpu_alloc_mutex);	/* chunk create/destroy, [de]pop, map ext */
+static DEFINE_MUTEX(pcpu_alloc_mutex);	/* chunk create/destroy, [de]pop */
 
 static struct list_head *pcpu_slot __read_mostly; /* chunk list slots */
 
-/* chunks which need their map areas extended, protected by pcpu_lock */
-static LIST_HEAD(pcpu_map_extend_chunks);
-
 /*
  * The number of empty populated pages, protected by pcpu_lock.  The
  * reserved chunk doesn't contribute to the count.
@@ -221,7 +241,7 @@ static int pcpu_size_to_slot(int size)
 
 static int pcpu_chunk_slot(const struct pcpu_chunk *chunk)
 {
-	if (chunk->free_size < sizeof(int) || chunk->contig_hint < sizeof(int))
+	if (chunk->free_size < PCPU_MIN_ALLOC_SIZE || !chunk->contig_bits)
 		return 0;
 
 	return pcpu_size_to_slot(chunk->free_size);
@@ -321,38 +341,194 @@ static void pcpu_mem_free(void *ptr, size_t size)
 		vfree(ptr);
 }
 
+/*
+ * Bitmap helpers.  Offsets and sizes are in units of PCPU_MIN_ALLOC_SIZE,
+ * i.e. bits of chunk->alloc_map.  Each page of a unit is one metadata
+ * block.
+ */
+static int pcpu_chunk_map_bits(struct pcpu_chunk *chunk)
+{
+	return pcpu_unit_pages * PCPU_BITMAP_BLOCK_BITS;
+}
+
+static int pcpu_off_to_block_index(int off)
+{
+	return off / PCPU_BITMAP_BLOCK_BITS;
+}
+
+static int pcpu_off_to_block_off(int off)
+{
+	return off & (PCPU_BITMAP_BLOCK_BITS - 1);
+}
+
+static int pcpu_block_off_to_off(int index, int off)
+{
+	return index * PCPU_BITMAP_BLOCK_BITS + off;
+}
+
+static unsigned long *pcpu_index_alloc_map(struct pcpu_chunk *chunk, int index)
+{
+	return chunk->alloc_map +
+		(index * PCPU_BITMAP_BLOCK_BITS / BITS_PER_LONG);
+}
+
 /**
- * pcpu_count_occupied_pages - count the number of pages an area occupies
+ * pcpu_next_md_free_region - find the next free region using block hints
  * @chunk: chunk of interest
- * @i: index of the area in question
- *
- * Count the number of pages chunk's @i'th area occupies.  When the area's
- * start and/or end address isn't aligned to page boundary, the straddled
- * page is included in the count iff the rest of the page is free.
+ * @bit_off: chunk offset to start from, updated to the region start
+ * @bits: size of the free region found
+ *
+ * Walk the block metadata from @bit_off and return the next hint-sized
+ * free region: either a block's contig_hint or a run of free space
+ * spanning block boundaries.  Free areas smaller than the hints inside
+ * a block are skipped.  @bit_off is set past the end of the chunk when
+ * nothing is left.
  */
-static int pcpu_count_occupied_pages(struct pcpu_chunk *chunk, int i)
+static void pcpu_next_md_free_region(struct pcpu_chunk *chunk, int *bit_off,
+				     int *bits)
 {
-	int off = chunk->map[i] & ~1;
-	int end = chunk->map[i + 1] & ~1;
+	int i = pcpu_off_to_block_index(*bit_off);
+	int block_off = pcpu_off_to_block_off(*bit_off);
+	struct pcpu_block_md *block;
+
+	*bits = 0;
+	for (block = chunk->md_blocks + i; i < pcpu_unit_pages;
+	     block++, i++) {
+		/* handles contig area across blocks */
+		if (*bits) {
+			*bits += block->left_free;
+			if (block->left_free == PCPU_BITMAP_BLOCK_BITS)
+				continue;
+			return;
+		}
 
-	if (!PAGE_ALIGNED(off) && i > 0) {
-		int prev = chunk->map[i - 1];
+		/*
+		 * Report the contig_hint if there is one, it hasn't been
+		 * reported yet (it starts at or after @block_off) and it
+		 * doesn't run into the next block.  A hint that does is
+		 * the right_free area and is handled as a cross block
+		 * region below.
+		 */
+		*bits = block->contig_hint;
+		if (*bits && block->contig_hint_start >= block_off &&
+		    *bits + block->contig_hint_start < PCPU_BITMAP_BLOCK_BITS) {
+			*bit_off = pcpu_block_off_to_off(i,
+					block->contig_hint_start);
+			return;
+		}
+		/* only the first block can have been partially visited */
+		block_off = 0;
 
-		if (!(prev & 1) && prev <= round_down(off, PAGE_SIZE))
-			off = round_down(off, PAGE_SIZE);
+		*bits = block->right_free;
+		*bit_off = (i + 1) * PCPU_BITMAP_BLOCK_BITS - block->right_free;
 	}
+}
 
-	if (!PAGE_ALIGNED(end) && i + 1 < chunk->map_used) {
-		int next = chunk->map[i + 1];
-		int nend = chunk->map[i + 2] & ~1;
+/**
+ * pcpu_next_fit_region - find the next region which can fit an allocation
+ * @chunk: chunk of interest
+ * @alloc_bits: size of the allocation
+ * @align: alignment of the allocation, in bits
+ * @bit_off: chunk offset to start from, updated to the candidate start
+ * @bits: size of the candidate region
+ *
+ * Like pcpu_next_md_free_region() but only returns regions which are
+ * known to fit @alloc_bits at @align.  The returned region is a
+ * superset of the area pcpu_alloc_area() will end up using, which lets
+ * it limit its bitmap scan.  @bit_off is set to the end of the chunk if
+ * no region is found.
+ */
+static void pcpu_next_fit_region(struct pcpu_chunk *chunk, int alloc_bits,
+				 int align, int *bit_off, int *bits)
+{
+	int i = pcpu_off_to_block_index(*bit_off);
+	int block_off = pcpu_off_to_block_off(*bit_off);
+	struct pcpu_block_md *block;
+	int start = -1;		/* start of a region crossing blocks */
+	unsigned long pos;
+
+	*bits = 0;
+	for (block = chunk->md_blocks + i; i < pcpu_unit_pages;
+	     block++, i++) {
+		/* handles contig area across blocks */
+		if (start >= 0) {
+			*bits += block->left_free;
+			if (*bits >= alloc_bits) {
+				*bit_off = start;
+				return;
+			}
+			if (block->left_free == PCPU_BITMAP_BLOCK_BITS)
+				continue;
+		}
+
+		if (block->contig_hint >= alloc_bits) {
+			/* check block->contig_hint if it hasn't been already */
+			*bits = ALIGN(block->contig_hint_start, align) -
+				block->contig_hint_start;
+			if (block->contig_hint_start >= block_off &&
+			    block->contig_hint >= *bits + alloc_bits) {
+				*bits += alloc_bits + block->contig_hint_start -
+					 block->first_free;
+				*bit_off = pcpu_block_off_to_off(i,
+							block->first_free);
+				return;
+			}
+
+			/*
+			 * The hint was already visited or doesn't fit at
+			 * @align, but a smaller area of the block still may.
+			 */
+			pos = bitmap_find_next_zero_area(
+					pcpu_index_alloc_map(chunk, i),
+					PCPU_BITMAP_BLOCK_BITS,
+					max(block_off, block->first_free),
+					alloc_bits, align - 1);
+			if (pos + alloc_bits <= PCPU_BITMAP_BLOCK_BITS) {
+				*bits = alloc_bits;
+				*bit_off = pcpu_block_off_to_off(i, pos);
+				return;
+			}
+		}
+		/* only the first block can have been partially visited */
+		block_off = 0;
 
-		if (!(next & 1) && nend >= round_up(end, PAGE_SIZE))
-			end = round_up(end, PAGE_SIZE);
+		/*
+		 * Start a region from the aligned right_free.  If it is
+		 * empty, the region starts at the next block boundary.
+		 */
+		start = ALIGN(PCPU_BITMAP_BLOCK_BITS - block->right_free,
+			      align);
+		*bits = PCPU_BITMAP_BLOCK_BITS - start;
+		start = pcpu_block_off_to_off(i, start);
+		if (*bits >= alloc_bits) {
+			*bit_off = start;
+			return;
+		}
 	}
 
-	return max_t(int, PFN_DOWN(end) - PFN_UP(off), 0);
+	/* no valid offsets were found - fail condition */
+	*bit_off = pcpu_chunk_map_bits(chunk);
 }
 
+/*
+ * Metadata free area iterators.  These walk the hint-sized free regions
+ * of @chunk.  @bit_off and @bits should be integer variables and are
+ * set to the offset and size of the current region.
+ */
+#define pcpu_for_each_md_free_region(chunk, bit_off, bits)		\
+	for (pcpu_next_md_free_region((chunk), &(bit_off), &(bits));	\
+	     (bit_off) < pcpu_chunk_map_bits((chunk));			\
+	     (bit_off) += (bits) + 1,					\
+	     pcpu_next_md_free_region((chunk), &(bit_off), &(bits)))
+
+#define pcpu_for_each_fit_region(chunk, alloc_bits, align, bit_off, bits)     \
+	for (pcpu_next_fit_region((chunk), (alloc_bits), (align), &(bit_off), \
+				  &(bits));				      \
+	     (bit_off) < pcpu_chunk_map_bits((chunk));			      \
+	     (bit_off) += (bits),					      \
+	     pcpu_next_fit_region((chunk), (alloc_bits), (align), &(bit_off), \
+				  &(bits)))
+
 /**
  * pcpu_chunk_relocate - put chunk in the appropriate chunk slot
  * @chunk: chunk of interest
@@ -379,170 +555,372 @@ static void pcpu_chunk_relocate(struct pcpu_chunk *chunk, int oslot)
 }
 
 /**
- * pcpu_need_to_extend - determine whether chunk area map needs to be extended
+ * pcpu_chunk_update - update the chunk contig hint with a free region
+ * @chunk: chunk of interest
+ * @bit_off: chunk offset of the free region
+ * @bits: size of the free region
+ */
+static void pcpu_chunk_update(struct pcpu_chunk *chunk, int bit_off, int bits)
+{
+	if (bits > chunk->contig_bits) {
+		chunk->contig_bits_start = bit_off;
+		chunk->contig_bits = bits;
+	}
+}
+
+/**
+ * pcpu_chunk_refresh_hint - recompute the chunk contig hint
  * @chunk: chunk of interest
- * @is_atomic: the allocation context
- *
- * Determine whether area map of @chunk needs to be extended.  If
- * @is_atomic, only the amount necessary for a new allocation is
- * considered; however, async extension is scheduled if the left amount is
- * low.  If !@is_atomic, it aims for more empty space.  Combined, this
- * ensures that the map is likely to have enough available space to
- * accomodate atomic allocations which can't extend maps directly.
- *
- * CONTEXT:
- * pcpu_lock.
  *
- * RETURNS:
- * New target map allocation length if extension is necessary, 0
- * otherwise.
+ * Rebuild @chunk->contig_bits from the block metadata.  This only walks
+ * the blocks, never the allocation bitmap.
  */
-static int pcpu_need_to_extend(struct pcpu_chunk *chunk, bool is_atomic)
+static void pcpu_chunk_refresh_hint(struct pcpu_chunk *chunk)
 {
-	int margin, new_alloc;
+	int bit_off, bits;
 
-	lockdep_assert_held(&pcpu_lock);
+	chunk->contig_bits = 0;
 
-	if (is_atomic) {
-		margin = 3;
+	bit_off = chunk->first_bit;
+	bits = 0;
+	pcpu_for_each_md_free_region(chunk, bit_off, bits)
+		pcpu_chunk_update(chunk, bit_off, bits);
+}
 
-		if (chunk->map_alloc <
-		    chunk->map_used + PCPU_ATOMIC_MAP_MARGIN_LOW) {
-			if (list_empty(&chunk->map_extend_list)) {
-				list_add_tail(&chunk->map_extend_list,
-					      &pcpu_map_extend_chunks);
-				pcpu_schedule_balance_work();
-			}
-		}
-	} else {
-		margin = PCPU_ATOMIC_MAP_MARGIN_HIGH;
-	}
+/**
+ * pcpu_block_update - update a block's hints with a free area
+ * @block: block of interest
+ * @start: block relative start of the free area
+ * @end: block relative end of the free area
+ *
+ * The free area [@start, @end) must be maximal within the block.
+ */
+static void pcpu_block_update(struct pcpu_block_md *block, int start, int end)
+{
+	int contig = end - start;
 
-	if (chunk->map_alloc >= chunk->map_used + margin)
-		return 0;
+	block->first_free = min(block->first_free, start);
+	if (start == 0)
+		block->left_free = contig;
 
-	new_alloc = PCPU_DFL_MAP_ALLOC;
-	while (new_alloc < chunk->map_used + margin)
-		new_alloc *= 2;
+	if (end == PCPU_BITMAP_BLOCK_BITS)
+		block->right_free = contig;
 
-	return new_alloc;
+	if (contig > block->contig_hint) {
+		block->contig_hint_start = start;
+		block->contig_hint = contig;
+	}
 }
 
 /**
- * pcpu_extend_area_map - extend area map of a chunk
+ * pcpu_block_refresh_hint - rescan a block's bitmap to rebuild its hints
  * @chunk: chunk of interest
- * @new_alloc: new target allocation length of the area map
+ * @index: index of the block
  *
- * Extend area map of @chunk to have @new_alloc entries.
+ * Only the bitmap of the block is scanned, starting at its first_free.
+ */
+static void pcpu_block_refresh_hint(struct pcpu_chunk *chunk, int index)
+{
+	struct pcpu_block_md *block = chunk->md_blocks + index;
+	unsigned long *alloc_map = pcpu_index_alloc_map(chunk, index);
+	int rs, re;
+
+	block->contig_hint = 0;
+	block->left_free = block->right_free = 0;
+
+	/* iterate over free areas and update the contig hints */
+	rs = block->first_free;
+	while ((rs = find_next_zero_bit(alloc_map, PCPU_BITMAP_BLOCK_BITS,
+					rs)) < PCPU_BITMAP_BLOCK_BITS) {
+		re = find_next_bit(alloc_map, PCPU_BITMAP_BLOCK_BITS, rs + 1);
+		pcpu_block_update(block, rs, re);
+		rs = re + 1;
+	}
+}
+
+/**
+ * pcpu_block_update_hint_alloc - update hints on allocation path
+ * @chunk: chunk of interest
+ * @bit_off: chunk offset of the allocation
+ * @bits: size of the allocation
  *
- * CONTEXT:
- * Does GFP_KERNEL allocation.  Grabs and releases pcpu_lock.
+ * Update the metadata of the blocks covered by the allocation.  A block
+ * rescan is only necessary if the allocation broke its contig_hint and
+ * the chunk hint is only rebuilt if the chunk contig_bits was used.
  *
  * RETURNS:
- * 0 on success, -errno on failure.
+ * The number of pages which were completely free before the allocation.
  */
-static int pcpu_extend_area_map(struct pcpu_chunk *chunk, int new_alloc)
+static int pcpu_block_update_hint_alloc(struct pcpu_chunk *chunk, int bit_off,
+					int bits)
 {
-	int *old = NULL, *new = NULL;
-	size_t old_size = 0, new_size = new_alloc * sizeof(new[0]);
-	unsigned long flags;
+	struct pcpu_block_md *s_block, *e_block, *block;
+	int s_index, e_index;	/* block indexes of the allocation */
+	int s_off, e_off;	/* block offsets of the allocation */
+	int nr_empty_pages = 0;
+
+	/*
+	 * e_index is the index of the last block of the allocation and
+	 * e_off is the block offset just past its end, so the block ranges
+	 * are [s_off, e_off).
+	 */
+	s_index = pcpu_off_to_block_index(bit_off);
+	e_index = pcpu_off_to_block_index(bit_off + bits - 1);
+	s_off = pcpu_off_to_block_off(bit_off);
+	e_off = pcpu_off_to_block_off(bit_off + bits - 1) + 1;
+
+	s_block = chunk->md_blocks + s_index;
+	e_block = chunk->md_blocks + e_index;
+
+	for (block = s_block; block <= e_block; block++)
+		if (block->contig_hint == PCPU_BITMAP_BLOCK_BITS)
+			nr_empty_pages++;
+
+	/* update s_block */
+	if (s_off == s_block->first_free)
+		s_block->first_free = find_next_zero_bit(
+					pcpu_index_alloc_map(chunk, s_index),
+					PCPU_BITMAP_BLOCK_BITS,
+					s_off + bits);
+
+	if (s_off >= s_block->contig_hint_start &&
+	    s_off < s_block->contig_hint_start + s_block->contig_hint) {
+		/* block contig hint is broken - scan to fix it */
+		pcpu_block_refresh_hint(chunk, s_index);
+	} else {
+		/* update left and right contig manually */
+		s_block->left_free = min(s_block->left_free, s_off);
+		if (s_index == e_index)
+			s_block->right_free = min_t(int, s_block->right_free,
+					PCPU_BITMAP_BLOCK_BITS - e_off);
+		else
+			s_block->right_free = 0;
+	}
+
+	if (s_index != e_index) {
+		/*
+		 * The allocation spans blocks, so it occupies the left
+		 * part of e_block and everything in between.
+		 */
+		e_block->first_free = find_next_zero_bit(
+				pcpu_index_alloc_map(chunk, e_index),
+				PCPU_BITMAP_BLOCK_BITS, e_off);
+
+		if (e_off == PCPU_BITMAP_BLOCK_BITS) {
+			/* e_block is now full, reset it with the others */
+			e_block++;
+		} else {
+			if (e_off > e_block->contig_hint_start) {
+				/* contig hint is broken - scan to fix it */
+				pcpu_block_refresh_hint(chunk, e_index);
+			} else {
+				e_block->left_free = 0;
+				e_block->right_free =
+					min_t(int, e_block->right_free,
+					      PCPU_BITMAP_BLOCK_BITS - e_off);
+			}
+		}
 
-	lockdep_assert_held(&pcpu_alloc_mutex);
+		/* update in-between md_blocks */
+		for (block = s_block + 1; block < e_block; block++) {
+			block->first_free = PCPU_BITMAP_BLOCK_BITS;
+			block->contig_hint = 0;
+			block->left_free = 0;
+			block->right_free = 0;
+		}
+	}
 
-	new = pcpu_mem_zalloc(new_size);
-	if (!new)
-		return -ENOMEM;
+	/*
+	 * The chunk hint only needs to be rebuilt if the allocation was
+	 * carved out of it.  Otherwise a smaller area was used and the
+	 * hint is still correct.
+	 */
+	if (bit_off >= chunk->contig_bits_start &&
+	    bit_off < chunk->contig_bits_start + chunk->contig_bits)
+		pcpu_chunk_refresh_hint(chunk);
 
-	/* acquire pcpu_lock and switch to new area map */
-	spin_lock_irqsave(&pcpu_lock, flags);
+	return nr_empty_pages;
+}
 
-	if (new_alloc <= chunk->map_alloc)
-		goto out_unlock;
+/**
+ * pcpu_block_update_hint_free - update hints on free path
+ * @chunk: chunk of interest
+ * @bit_off: chunk offset of the freed area
+ * @bits: size of the freed area
+ *
+ * Merge the freed area with its free neighbours and update the block
+ * hints.  The neighbours are found through the block hints when
+ * possible, falling back to a bitmap scan bounded by the edge blocks.
+ *
+ * RETURNS:
+ * The number of pages which became completely free.
+ */
+static int pcpu_block_update_hint_free(struct pcpu_chunk *chunk, int bit_off,
+				       int bits)
+{
+	struct pcpu_block_md *s_block, *e_block, *block;
+	int s_index, e_index;	/* block indexes of the freed area */
+	int s_off, e_off;	/* block offsets of the freed area */
+	int start, end;		/* block relative bounds of the free area */
+	int nr_empty_pages = 0;
 
-	old_size = chunk->map_alloc * sizeof(chunk->map[0]);
-	old = chunk->map;
+	s_index = pcpu_off_to_block_index(bit_off);
+	e_index = pcpu_off_to_block_index(bit_off + bits - 1);
+	s_off = pcpu_off_to_block_off(bit_off);
+	e_off = pcpu_off_to_block_off(bit_off + bits - 1) + 1;
 
-	memcpy(new, old, old_size);
+	s_block = chunk->md_blocks + s_index;
+	e_block = chunk->md_blocks + e_index;
 
-	chunk->map_alloc = new_alloc;
-	chunk->map = new;
-	new = NULL;
+	/*
+	 * If the freed area borders the block contig_hint, the scan for
+	 * the start or end of the merged free area can be skipped.  Note
+	 * that [start, end) only covers the merged area within s_block and
+	 * e_block; it may continue into neighbouring blocks.
+	 */
+	start = s_off;
+	if (s_off == s_block->contig_hint + s_block->contig_hint_start) {
+		start = s_block->contig_hint_start;
+	} else {
+		/* find_last_bit() returns @size if there is no set bit */
+		int l_bit = find_last_bit(pcpu_index_alloc_map(chunk, s_index),
+					  start);
+		start = (start == l_bit) ? 0 : l_bit + 1;
+	}
 
-out_unlock:
-	spin_unlock_irqrestore(&pcpu_lock, flags);
+	end = e_off;
+	if (e_off == e_block->contig_hint_start)
+		end = e_block->contig_hint_start + e_block->contig_hint;
+	else
+		end = find_next_bit(pcpu_index_alloc_map(chunk, e_index),
+				    PCPU_BITMAP_BLOCK_BITS, end);
+
+	/* update s_block */
+	e_off = (s_index == e_index) ? end : PCPU_BITMAP_BLOCK_BITS;
+	pcpu_block_update(s_block, start, e_off);
+	if (s_block->contig_hint == PCPU_BITMAP_BLOCK_BITS)
+		nr_empty_pages++;
+
+	if (s_index != e_index) {
+		/* update e_block */
+		pcpu_block_update(e_block, 0, end);
+		if (e_block->contig_hint == PCPU_BITMAP_BLOCK_BITS)
+			nr_empty_pages++;
+
+		/* reset md_blocks in the middle */
+		for (block = s_block + 1; block < e_block; block++) {
+			block->first_free = 0;
+			block->contig_hint_start = 0;
+			block->contig_hint = PCPU_BITMAP_BLOCK_BITS;
+			block->left_free = PCPU_BITMAP_BLOCK_BITS;
+			block->right_free = PCPU_BITMAP_BLOCK_BITS;
+			nr_empty_pages++;
+		}
+	}
 
 	/*
-	 * pcpu_mem_free() might end up calling vfree() which uses
-	 * IRQ-unsafe lock and thus can't be called under pcpu_lock.
+	 * If the merged area touches a block boundary it may continue into
+	 * the neighbouring blocks and the chunk hint has to be rebuilt from
+	 * the block metadata.  Otherwise the area is wholly contained in
+	 * s_block and can be fed to the chunk hint directly.
 	 */
-	pcpu_mem_free(old, old_size);
-	pcpu_mem_free(new, new_size);
+	if (s_index != e_index || start == 0 || end == PCPU_BITMAP_BLOCK_BITS)
+		pcpu_chunk_refresh_hint(chunk);
+	else
+		pcpu_chunk_update(chunk, pcpu_block_off_to_off(s_index, start),
+				  end - start);
 
-	return 0;
+	return nr_empty_pages;
 }
 
 /**
- * pcpu_fit_in_area - try to fit the requested allocation in a candidate area
- * @chunk: chunk the candidate area belongs to
- * @off: the offset to the start of the candidate area
- * @this_size: the size of the candidate area
- * @size: the size of the target allocation
- * @align: the alignment of the target allocation
- * @pop_only: only allocate from already populated region
- *
- * We're trying to allocate @size bytes aligned at @align.  @chunk's area
- * at @off sized @this_size is a candidate.  This function determines
- * whether the target allocation fits in the candidate area and returns the
- * number of bytes to pad after @off.  If the target area doesn't fit, -1
- * is returned.
- *
- * If @pop_only is %true, this function only considers the already
- * populated part of the candidate area.
+ * pcpu_is_populated - determine if the region is populated
+ * @chunk: chunk of interest
+ * @bit_off: chunk offset
+ * @bits: size of area
+ * @next_off: return value for the next offset to start searching
+ *
+ * RETURNS:
+ * %true if the whole region is populated.  Otherwise %false and
+ * @next_off is set to the end of the first unpopulated area.
  */
-static int pcpu_fit_in_area(struct pcpu_chunk *chunk, int off, int this_size,
-			    int size, int align, bool pop_only)
+static bool pcpu_is_populated(struct pcpu_chunk *chunk, int bit_off, int bits,
+			      int *next_off)
 {
-	int cand_off = off;
+	int page_start, page_end, rs, re;
 
-	while (true) {
-		int head = ALIGN(cand_off, align) - off;
-		int page_start, page_end, rs, re;
+	page_start = PFN_DOWN(bit_off * PCPU_MIN_ALLOC_SIZE);
+	page_end = PFN_UP((bit_off + bits) * PCPU_MIN_ALLOC_SIZE);
 
-		if (this_size < head + size)
-			return -1;
+	rs = page_start;
+	pcpu_next_unpop(chunk, &rs, &re, page_end);
+	if (rs >= page_end)
+		return true;
 
-		if (!pop_only)
-			return head;
+	*next_off = re * PAGE_SIZE / PCPU_MIN_ALLOC_SIZE;
+	return false;
+}
 
-		/*
-		 * If the first unpopulated page is beyond the end of the
-		 * allocation, the whole allocation is populated;
-		 * otherwise, retry from the end of the unpopulated area.
-		 */
-		page_start = PFN_DOWN(head + off);
-		page_end = PFN_UP(head + off + size);
-
-		rs = page_start;
-		pcpu_next_unpop(chunk, &rs, &re, PFN_UP(off + this_size));
-		if (rs >= page_end)
-			return head;
-		cand_off = re * PAGE_SIZE;
+/**
+ * pcpu_find_block_fit - find the block index to start searching
+ * @chunk: chunk of interest
+ * @alloc_bits: size of request in allocation units
+ * @align: alignment of area (max PAGE_SIZE bytes), in bits
+ * @pop_only: use populated regions only
+ *
+ * Use the chunk and block hints to find a region which can serve the
+ * allocation without touching the allocation bitmap.  If @pop_only,
+ * regions with unpopulated pages are skipped.
+ *
+ * CONTEXT:
+ * pcpu_lock.
+ *
+ * RETURNS:
+ * The offset to start the bitmap scan from, -1 if no region fits.
+ */
+static int pcpu_find_block_fit(struct pcpu_chunk *chunk, int alloc_bits,
+			       int align, bool pop_only)
+{
+	int bit_off, bits, next_off;
+
+	/*
+	 * If the allocation can't fit in the chunk's contig hint, don't
+	 * bother walking the blocks.  The hint is exact, so this never
+	 * turns away an allocation which would have fit.
+	 */
+	if (alloc_bits > chunk->contig_bits)
+		return -1;
+
+	bit_off = chunk->first_bit;
+	bits = 0;
+	pcpu_for_each_fit_region(chunk, alloc_bits, align, bit_off, bits) {
+		if (!pop_only || pcpu_is_populated(chunk, bit_off, bits,
+						   &next_off))
+			break;
+
+		bit_off = next_off;
+		bits = 0;
 	}
+
+	if (bit_off >= pcpu_chunk_map_bits(chunk))
+		return -1;
+
+	return bit_off;
 }
 
 /**
  * pcpu_alloc_area - allocate area from a pcpu_chunk
  * @chunk: chunk of interest
- * @size: wanted size in bytes
- * @align: wanted align
- * @pop_only: allocate only from the populated area
+ * @alloc_bits: size of request in allocation units
+ * @align: alignment of area (max PAGE_SIZE bytes), in bits
+ * @start: bit_off to start searching, from pcpu_find_block_fit()
  * @occ_pages_p: out param for the number of pages the area occupies
  *
- * Try to allocate @size bytes area aligned at @align from @chunk.
- * Note that this function only allocates the offset.  It doesn't
- * populate or map the area.
- *
- * @chunk->map must have at least two free slots.
+ * Try to allocate @alloc_bits aligned at @align from @chunk, scanning
+ * the allocation bitmap from @start.  Only the region found by
+ * pcpu_find_block_fit() needs to be scanned, so the scan is bounded by
+ * a block past the request size.  Note that this function only
+ * allocates the offset.  It doesn't populate or map the area.
  *
  * CONTEXT:
  * pcpu_lock.
@@ -551,207 +929,159 @@ static int pcpu_fit_in_area(struct pcpu_chunk *chunk, int off, int this_size,
  * Allocated offset in @chunk on success, -1 if no matching area is
  * found.
  */
-static int pcpu_alloc_area(struct pcpu_chunk *chunk, int size, int align,
-			   bool pop_only, int *occ_pages_p)
+static int pcpu_alloc_area(struct pcpu_chunk *chunk, int alloc_bits,
+			   int align, int start, int *occ_pages_p)
 {
 	int oslot = pcpu_chunk_slot(chunk);
-	int max_contig = 0;
-	int i, off;
-	bool seen_free = false;
-	int *p;
+	int bit_off, end;
 
-	for (i = chunk->first_free, p = chunk->map + i; i < chunk->map_used; i++, p++) {
-		int head, tail;
-		int this_size;
-
-		off = *p;
-		if (off & 1)
-			continue;
-
-		this_size = (p[1] & ~1) - off;
-
-		head = pcpu_fit_in_area(chunk, off, this_size, size, align,
-					pop_only);
-		if (head < 0) {
-			if (!seen_free) {
-				chunk->first_free = i;
-				seen_free = true;
-			}
-			max_contig = max(this_size, max_contig);
-			continue;
-		}
-
-		/*
-		 * If head is small or the previous block is free,
-		 * merge'em.  Note that 'small' is defined as smaller
-		 * than sizeof(int), which is very small but isn't too
-		 * uncommon for percpu allocations.
-		 */
-		if (head && (head < sizeof(int) || !(p[-1] & 1))) {
-			*p = off += head;
-			if (p[-1] & 1)
-				chunk->free_size -= head;
-			else
-				max_contig = max(*p - p[-1], max_contig);
-			this_size -= head;
-			head = 0;
-		}
+	lockdep_assert_held(&pcpu_lock);
 
-		/* if tail is small, just keep it around */
-		tail = this_size - head - size;
-		if (tail < sizeof(int)) {
-			tail = 0;
-			size = this_size - head;
-		}
+	end = min(start + alloc_bits + PCPU_BITMAP_BLOCK_BITS,
+		  pcpu_chunk_map_bits(chunk));
+	bit_off = bitmap_find_next_zero_area(chunk->alloc_map, end, start,
+					     alloc_bits, align - 1);
+	if (bit_off >= end)
+		return -1;
 
-		/* split if warranted */
-		if (head || tail) {
-			int nr_extra = !!head + !!tail;
-
-			/* insert new subblocks */
-			memmove(p + nr_extra + 1, p + 1,
-				sizeof(chunk->map[0]) * (chunk->map_used - i));
-			chunk->map_used += nr_extra;
-
-			if (head) {
-				if (!seen_free) {
-					chunk->first_free = i;
-					seen_free = true;
-				}
-				*++p = off += head;
-				++i;
-				max_contig = max(head, max_contig);
-			}
-			if (tail) {
-				p[1] = off + size;
-				max_contig = max(tail, max_contig);
-			}
-		}
+	/* update alloc map */
+	bitmap_set(chunk->alloc_map, bit_off, alloc_bits);
 
-		if (!seen_free)
-			chunk->first_free = i + 1;
+	/* update boundary map */
+	set_bit(bit_off, chunk->bound_map);
+	bitmap_clear(chunk->bound_map, bit_off + 1, alloc_bits - 1);
+	set_bit(bit_off + alloc_bits, chunk->bound_map);
 
-		/* update hint and mark allocated */
-		if (i + 1 == chunk->map_used)
-			chunk->contig_hint = max_contig; /* fully scanned */
-		else
-			chunk->contig_hint = max(chunk->contig_hint,
-						 max_contig);
+	chunk->free_size -= alloc_bits * PCPU_MIN_ALLOC_SIZE;
 
-		chunk->free_size -= size;
-		*p |= 1;
+	/* update first free bit */
+	if (bit_off == chunk->first_bit)
+		chunk->first_bit = find_next_zero_bit(chunk->alloc_map,
+						      pcpu_chunk_map_bits(chunk),
+						      bit_off + alloc_bits);
 
-		*occ_pages_p = pcpu_count_occupied_pages(chunk, i);
-		pcpu_chunk_relocate(chunk, oslot);
-		return off;
-	}
+	*occ_pages_p = pcpu_block_update_hint_alloc(chunk, bit_off, alloc_bits);
 
-	chunk->contig_hint = max_contig;	/* fully scanned */
 	pcpu_chunk_relocate(chunk, oslot);
 
-	/* tell the upper layer that this chunk has no matching area */
-	return -1;
+	return bit_off * PCPU_MIN_ALLOC_SIZE;
 }
 
 /**
  * pcpu_free_area - free area to a pcpu_chunk
  * @chunk: chunk of interest
- * @freeme: offset of area to free
+ * @off: addr offset into chunk
  * @occ_pages_p: out param for the number of pages the area occupies
  *
- * Free area starting from @freeme to @chunk.  Note that this function
- * only modifies the allocation map.  It doesn't depopulate or unmap
- * the area.
+ * Free the area starting at @off.  The size is recovered from the
+ * boundary map.  Note that this function only modifies the allocation
+ * map.  It doesn't depopulate or unmap the area.
  *
  * CONTEXT:
  * pcpu_lock.
  */
-static void pcpu_free_area(struct pcpu_chunk *chunk, int freeme,
+static void pcpu_free_area(struct pcpu_chunk *chunk, int off,
 			   int *occ_pages_p)
 {
 	int oslot = pcpu_chunk_slot(chunk);
-	int off = 0;
-	unsigned i, j;
-	int to_free = 0;
-	int *p;
-
-	freeme |= 1;	/* we are searching for <given offset, in use> pair */
-
-	i = 0;
-	j = chunk->map_used;
-	while (i != j) {
-		unsigned k = (i + j) / 2;
-		off = chunk->map[k];
-		if (off < freeme)
-			i = k + 1;
-		else if (off > freeme)
-			j = k;
-		else
-			i = j = k;
-	}
-	BUG_ON(off != freeme);
+	int bit_off, bits, end;
+
+	lockdep_assert_held(&pcpu_lock);
 
-	if (i < chunk->first_free)
-		chunk->first_free = i;
+	bit_off = off / PCPU_MIN_ALLOC_SIZE;
+	BUG_ON(!test_bit(bit_off, chunk->alloc_map) ||
+	       !test_bit(bit_off, chunk->bound_map));
 
-	p = chunk->map + i;
-	*p = off &= ~1;
-	chunk->free_size += (p[1] & ~1) - off;
+	/* find end index */
+	end = find_next_bit(chunk->bound_map, pcpu_chunk_map_bits(chunk),
+			    bit_off + 1);
+	bits = end - bit_off;
+	bitmap_clear(chunk->alloc_map, bit_off, bits);
 
-	*occ_pages_p = pcpu_count_occupied_pages(chunk, i);
+	chunk->free_size += bits * PCPU_MIN_ALLOC_SIZE;
 
-	/* merge with next? */
-	if (!(p[1] & 1))
-		to_free++;
-	/* merge with previous? */
-	if (i > 0 && !(p[-1] & 1)) {
-		to_free++;
-		i--;
-		p--;
-	}
-	if (to_free) {
-		chunk->map_used -= to_free;
-		memmove(p + 1, p + 1 + to_free,
-			(chunk->map_used - i) * sizeof(chunk->map[0]));
-	}
+	/* update first free bit */
+	chunk->first_bit = min(chunk->first_bit, bit_off);
+
+	*occ_pages_p = pcpu_block_update_hint_free(chunk, bit_off, bits);
 
-	chunk->contig_hint = max(chunk->map[i + 1] - chunk->map[i] - 1, chunk->contig_hint);
 	pcpu_chunk_relocate(chunk, oslot);
 }
 
+/**
+ * pcpu_init_md_blocks - initialize the metadata of a completely free chunk
+ * @chunk: chunk of interest
+ */
+static void pcpu_init_md_blocks(struct pcpu_chunk *chunk)
+{
+	struct pcpu_block_md *md_block;
+
+	for (md_block = chunk->md_blocks;
+	     md_block != chunk->md_blocks + pcpu_unit_pages;
+	     md_block++) {
+		md_block->contig_hint = PCPU_BITMAP_BLOCK_BITS;
+		md_block->left_free = PCPU_BITMAP_BLOCK_BITS;
+		md_block->right_free = PCPU_BITMAP_BLOCK_BITS;
+	}
+
+	chunk->first_bit = 0;
+	chunk->contig_bits = pcpu_chunk_map_bits(chunk);
+	chunk->contig_bits_start = 0;
+	chunk->free_size = pcpu_unit_size;
+}
+
 static struct pcpu_chunk *pcpu_alloc_chunk(void)
 {
 	struct pcpu_chunk *chunk;
+	int map_bits = pcpu_unit_pages * PCPU_BITMAP_BLOCK_BITS;
 
 	chunk = pcpu_mem_zalloc(pcpu_chunk_struct_size);
 	if (!chunk)
 		return NULL;
 
-	chunk->map = pcpu_mem_zalloc(PCPU_DFL_MAP_ALLOC *
-						sizeof(chunk->map[0]));
-	if (!chunk->map) {
-		pcpu_mem_free(chunk, pcpu_chunk_struct_size);
-		return NULL;
-	}
+	chunk->alloc_map = pcpu_mem_zalloc(BITS_TO_LONGS(map_bits) *
+					   sizeof(chunk->alloc_map[0]));
+	if (!chunk->alloc_map)
+		goto alloc_map_fail;
+
+	chunk->bound_map = pcpu_mem_zalloc(BITS_TO_LONGS(map_bits + 1) *
+					   sizeof(chunk->bound_map[0]));
+	if (!chunk->bound_map)
+		goto bound_map_fail;
 
-	chunk->map_alloc = PCPU_DFL_MAP_ALLOC;
-	chunk->map[0] = 0;
-	chunk->map[1] = pcpu_unit_size | 1;
-	chunk->map_used = 1;
+	chunk->md_blocks = pcpu_mem_zalloc(pcpu_unit_pages *
+					   sizeof(chunk->md_blocks[0]));
+	if (!chunk->md_blocks)
+		goto md_blocks_fail;
 
 	INIT_LIST_HEAD(&chunk->list);
-	INIT_LIST_HEAD(&chunk->map_extend_list);
-	chunk->free_size = pcpu_unit_size;
-	chunk->contig_hint = pcpu_unit_size;
+	pcpu_init_md_blocks(chunk);
 
 	return chunk;
+
+md_blocks_fail:
+	pcpu_mem_free(chunk->bound_map, BITS_TO_LONGS(map_bits + 1) *
+		      sizeof(chunk->bound_map[0]));
+bound_map_fail:
+	pcpu_mem_free(chunk->alloc_map, BITS_TO_LONGS(map_bits) *
+		      sizeof(chunk->alloc_map[0]));
+alloc_map_fail:
+	pcpu_mem_free(chunk, pcpu_chunk_struct_size);
+	return NULL;
 }
 
 static void pcpu_free_chunk(struct pcpu_chunk *chunk)
 {
+	int map_bits = pcpu_unit_pages * PCPU_BITMAP_BLOCK_BITS;
+
 	if (!chunk)
 		return;
-	pcpu_mem_free(chunk->map, chunk->map_alloc * sizeof(chunk->map[0]));
+	pcpu_mem_free(chunk->md_blocks,
+		      pcpu_unit_pages * sizeof(chunk->md_blocks[0]));
+	pcpu_mem_free(chunk->bound_map, BITS_TO_LONGS(map_bits + 1) *
+		      sizeof(chunk->bound_map[0]));
+	pcpu_mem_free(chunk->alloc_map, BITS_TO_LONGS(map_bits) *
+		      sizeof(chunk->alloc_map[0]));
 	pcpu_mem_free(chunk, pcpu_chunk_struct_size);
 }
 
@@ -876,18 +1206,21 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 	const char *err;
 	bool is_atomic = (gfp & GFP_KERNEL) != GFP_KERNEL;
 	int occ_pages = 0;
-	int slot, off, new_alloc, cpu, ret;
+	int slot, off, cpu, ret;
+	int bits, bit_align;
 	unsigned long flags;
 	void __percpu *ptr;
 
 	/*
-	 * We want the lowest bit of offset available for in-use/free
-	 * indicator, so force >= 16bit alignment and make size even.
+	 * The allocation map tracks PCPU_MIN_ALLOC_SIZE units, so force
+	 * at least that alignment and round the size up to a whole unit.
 	 */
-	if (unlikely(align < 2))
-		align = 2;
+	if (unlikely(align < PCPU_MIN_ALLOC_SIZE))
+		align = PCPU_MIN_ALLOC_SIZE;
 
-	size = ALIGN(size, 2);
+	size = ALIGN(size, PCPU_MIN_ALLOC_SIZE);
+	bits = size >> PCPU_MIN_ALLOC_SHIFT;
+	bit_align = align >> PCPU_MIN_ALLOC_SHIFT;
 
 	if (unlikely(!size || size > PCPU_MIN_UNIT_SIZE || align > PAGE_SIZE)) {
 		WARN(true, "illegal size (%zu) or align (%zu) for "
@@ -904,23 +1237,13 @@ static void __percpu *pcpu_alloc(size_t size, size_t align, bool reserved,
 	if (reserved && pcpu_reserved_chunk) {
 		chunk = pcpu_reserved_chunk;
 
-		if (size > chunk->contig_hint) {
+		off = pcpu_find_block_fit(chunk, bits, bit_align, is_atomic);
+		if (off < 0) {
 			err = "alloc from reserved chunk failed";
 			goto fail_unlock;
 		}
 
-		while ((new_alloc = pcpu_need_to_extend(chunk, is_atomic))) {
-			spin_unlock_irqrestore(&pcpu_lock, flags);
-			if (is_atomic ||
-			    pcpu_extend_area_map(chunk, new_alloc) < 0) {
-				err = "failed to extend area map of reserved chunk";
-				goto fail;
-			}
-			spin_lock_irqsave(&pcpu_lock, flags);
-		}
-
-		off = pcpu_alloc_area(chunk, size, align, is_atomic,
-				      &occ_pages);
+		off = pcpu_alloc_area(chunk, bits, bit_align, off, &occ_pages);
 		if (off >= 0)
 			goto area_found;
 
@@ -932,28 +1255,12 @@ restart:
 	/* search through normal chunks */
 	for (slot = pcpu_size_to_slot(size); slot < pcpu_nr_slots; slot++) {
 		list_for_each_entry(chunk, &pcpu_slot[slot], list) {
-			if (size > chunk->contig_hint)
+			off = pcpu_find_block_fit(chunk, bits, bit_align,
+						  is_atomic);
+			if (off < 0)
 				continue;
 
-			new_alloc = pcpu_need_to_extend(chunk, is_atomic);
-			if (new_alloc) {
-				if (is_atomic)
-					continue;
-				spin_unlock_irqrestore(&pcpu_lock, flags);
-				if (pcpu_extend_area_map(chunk,
-							 new_alloc) < 0) {
-					err = "failed to extend area map";
-					goto fail;
-				}
-				spin_lock_irqsave(&pcpu_lock, flags);
-				/*
-				 * pcpu_lock has been dropped, need to
-				 * restart cpu_slot list walking.
-				 */
-				goto restart;
-			}
-
-			off = pcpu_alloc_area(chunk, size, align, is_atomic,
+			off = pcpu_alloc_area(chunk, bits, bit_align, off,
 					      &occ_pages);
 			if (off >= 0)
 				goto area_found;
@@ -1130,7 +1437,6 @@ static void pcpu_balance_workfn(struct work_struct *work)
 		if (chunk == list_first_entry(free_head, struct pcpu_chunk, list))
 			continue;
 
-		list_del_init(&chunk->map_extend_list);
 		list_move(&chunk->list, &to_free);
 	}
 
@@ -1148,25 +1454,6 @@ static void pcpu_balance_workfn(struct work_struct *work)
 		pcpu_destroy_chunk(chunk);
 	}
 
-	/* service chunks which requested async area map extension */
-	do {
-		int new_alloc = 0;
-
-		spin_lock_irq(&pcpu_lock);
-
-		chunk = list_first_entry_or_null(&pcpu_map_extend_chunks,
-					struct pcpu_chunk, map_extend_list);
-		if (chunk) {
-			list_del_init(&chunk->map_extend_list);
-			new_alloc = pcpu_need_to_extend(chunk, false);
-		}
-
-		spin_unlock_irq(&pcpu_lock);
-
-		if (new_alloc)
-			pcpu_extend_area_map(chunk, new_alloc);
-	} while (chunk);
-
 	/*
 	 * Ensure there are certain number of free populated pages for
 	 * atomic allocs.  Fill up from the most packed so that atomic
@@ -1488,6 +1775,78 @@ static void pcpu_dump_alloc_info(const char *lvl,
 	printk(KERN_CONT "\n");
 }
 
+/**
+ * pcpu_hide_area - mark an area of a first chunk as permanently in use
+ * @chunk: chunk of interest
+ * @bit_off: chunk offset of the area
+ * @bits: size of the area
+ *
+ * The first chunks share their unit with the static area and with each
+ * other.  Parts of the unit which don't belong to @chunk are hidden by
+ * allocating them up front.
+ */
+static void __init pcpu_hide_area(struct pcpu_chunk *chunk, int bit_off,
+				  int bits)
+{
+	if (!bits)
+		return;
+
+	bitmap_set(chunk->alloc_map, bit_off, bits);
+	set_bit(bit_off, chunk->bound_map);
+	set_bit(bit_off + bits, chunk->bound_map);
+	chunk->free_size -= bits * PCPU_MIN_ALLOC_SIZE;
+
+	if (bit_off == chunk->first_bit)
+		chunk->first_bit = find_next_zero_bit(chunk->alloc_map,
+						      pcpu_chunk_map_bits(chunk),
+						      bit_off + bits);
+
+	pcpu_block_update_hint_alloc(chunk, bit_off, bits);
+}
+
+/**
+ * pcpu_alloc_first_chunk - create a chunk serving part of the first unit
+ * @base_addr: base address of the first chunk
+ * @start: unit offset of the area served by the chunk
+ * @size: size of the area served by the chunk
+ *
+ * This is called before slab is available, so all of the chunk's
+ * metadata comes from memblock and is never freed.
+ *
+ * RETURNS:
+ * The new chunk.
+ */
+static struct pcpu_chunk * __init pcpu_alloc_first_chunk(void *base_addr,
+							 int start, int size)
+{
+	struct pcpu_chunk *chunk;
+	int map_bits = pcpu_unit_pages * PCPU_BITMAP_BLOCK_BITS;
+	int start_bits, end_bits;
+
+	chunk = memblock_virt_alloc(pcpu_chunk_struct_size, 0);
+	chunk->alloc_map = memblock_virt_alloc(BITS_TO_LONGS(map_bits) *
+					       sizeof(chunk->alloc_map[0]), 0);
+	chunk->bound_map = memblock_virt_alloc(BITS_TO_LONGS(map_bits + 1) *
+					       sizeof(chunk->bound_map[0]), 0);
+	chunk->md_blocks = memblock_virt_alloc(pcpu_unit_pages *
+					       sizeof(chunk->md_blocks[0]), 0);
+	INIT_LIST_HEAD(&chunk->list);
+	pcpu_init_md_blocks(chunk);
+
+	chunk->base_addr = base_addr;
+	chunk->immutable = true;
+	bitmap_fill(chunk->populated, pcpu_unit_pages);
+	chunk->nr_populated = pcpu_unit_pages;
+
+	/* hide everything outside [@start, @start + @size) */
+	start_bits = DIV_ROUND_UP(start, PCPU_MIN_ALLOC_SIZE);
+	end_bits = (start + size) / PCPU_MIN_ALLOC_SIZE;
+	pcpu_hide_area(chunk, 0, start_bits);
+	pcpu_hide_area(chunk, end_bits, map_bits - end_bits);
+
+	return chunk;
+}
+
 /**
  * pcpu_setup_first_chunk - initialize the first percpu chunk
  * @ai: pcpu_alloc_info describing how to percpu area is shaped
@@ -1548,11 +1907,10 @@ int __init pcpu_setup_first_chunk(const struct pcpu_alloc_info *ai,
 				  void *base_addr)
 {
 	static char cpus_buf[4096] __initdata;
-	static int smap[PERCPU_DYNAMIC_EARLY_SLOTS] __initdata;
-	static int dmap[PERCPU_DYNAMIC_EARLY_SLOTS] __initdata;
 	size_t dyn_size = ai->dyn_size;
 	size_t size_sum = ai->static_size + ai->reserved_size + dyn_size;
 	struct pcpu_chunk *schunk, *dchunk = NULL;
+	struct pcpu_block_md *md_block;
 	unsigned long *group_offsets;
 	size_t *group_sizes;
 	unsigned long *unit_off;
@@ -1665,57 +2023,30 @@ int __init pcpu_setup_first_chunk(const struct pcpu_alloc_info *ai,
 	 * covers static area + reserved area (mostly used for module
 	 * static percpu allocation).
 	 */
-	schunk = memblock_virt_alloc(pcpu_chunk_struct_size, 0);
-	INIT_LIST_HEAD(&schunk->list);
-	INIT_LIST_HEAD(&schunk->map_extend_list);
-	schunk->base_addr = base_addr;
-	schunk->map = smap;
-	schunk->map_alloc = ARRAY_SIZE(smap);
-	schunk->immutable = true;
-	bitmap_fill(schunk->populated, pcpu_unit_pages);
-	schunk->nr_populated = pcpu_unit_pages;
-
 	if (ai->reserved_size) {
-		schunk->free_size = ai->reserved_size;
+		schunk = pcpu_alloc_first_chunk(base_addr, ai->static_size,
+						ai->reserved_size);
 		pcpu_reserved_chunk = schunk;
 		pcpu_reserved_chunk_limit = ai->static_size + ai->reserved_size;
 	} else {
-		schunk->free_size = dyn_size;
+		schunk = pcpu_alloc_first_chunk(base_addr, ai->static_size,
+						dyn_size);
 		dyn_size = 0;			/* dynamic area covered */
 	}
-	schunk->contig_hint = schunk->free_size;
-
-	schunk->map[0] = 1;
-	schunk->map[1] = ai->static_size;
-	schunk->map_used = 1;
-	if (schunk->free_size)
-		schunk->map[++schunk->map_used] = 1 | (ai->static_size + schunk->free_size);
-	else
-		schunk->map[1] |= 1;
 
 	/* init dynamic chunk if necessary */
-	if (dyn_size) {
-		dchunk = memblock_virt_alloc(pcpu_chunk_struct_size, 0);
-		INIT_LIST_HEAD(&dchunk->list);
-		INIT_LIST_HEAD(&dchunk->map_extend_list);
-		dchunk->base_addr = base_addr;
-		dchunk->map = dmap;
-		dchunk->map_alloc = ARRAY_SIZE(dmap);
-		dchunk->immutable = true;
-		bitmap_fill(dchunk->populated, pcpu_unit_pages);
-		dchunk->nr_populated = pcpu_unit_pages;
-
-		dchunk->contig_hint = dchunk->free_size = dyn_size;
-		dchunk->map[0] = 1;
-		dchunk->map[1] = pcpu_reserved_chunk_limit;
-		dchunk->map[2] = (pcpu_reserved_chunk_limit + dchunk->free_size) | 1;
-		dchunk->map_used = 2;
-	}
+	if (dyn_size)
+		dchunk = pcpu_alloc_first_chunk(base_addr,
+						pcpu_reserved_chunk_limit,
+						dyn_size);
 
 	/* link the first chunk in */
 	pcpu_first_chunk = dchunk ?: schunk;
-	pcpu_nr_empty_pop_pages +=
-		pcpu_count_occupied_pages(pcpu_first_chunk, 1);
+	for (md_block = pcpu_first_chunk->md_blocks;
+	     md_block != pcpu_first_chunk->md_blocks + pcpu_unit_pages;
+	     md_block++)
+		if (md_block->contig_hint == PCPU_BITMAP_BLOCK_BITS)
+			pcpu_nr_empty_pop_pages++;
 	pcpu_chunk_relocate(pcpu_first_chunk, -1);
 
 	/* we're done */
@@ -2273,36 +2604,6 @@ void __init setup_per_cpu_areas(void)
 
 #endif	/* CONFIG_SMP */
 
-/*
- * First and reserved chunks are initialized with temporary allocation
- * map in initdata so that they can be used before slab is online.
- * This function is called after slab is brought up and replaces those
- * with properly allocated maps.
- */
-void __init percpu_init_late(void)
-{
-	struct pcpu_chunk *target_chunks[] =
-		{ pcpu_first_chunk, pcpu_reserved_chunk, NULL };
-	struct pcpu_chunk *chunk;
-	unsigned long flags;
-	int i;
-
-	for (i = 0; (chunk = target_chunks[i]); i++) {
-		int *map;
-		const size_t size = PERCPU_DYNAMIC_EARLY_SLOTS * sizeof(map[0]);
-
-		BUILD_BUG_ON(size > PAGE_SIZE);
-
-		map = pcpu_mem_zalloc(size);
-		BUG_ON(!map);
-
-		spin_lock_irqsave(&pcpu_lock, flags);
-		memcpy(map, chunk->map, size);
-		chunk->map = map;
-		spin_unlock_irqrestore(&pcpu_lock, flags);
-	}
-}
-
 /*
  * Percpu allocator is initialized early during boot when neither slab or
  * workqueue is available.  Plug async management until everything is up
@@ -23,6 +23,9 @@
 #include <linux/skbuff.h>
 #include <linux/percpu.h>
 #include <linux/list.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
 #include <net/sock.h>
 #include <linux/un.h>
 #include <net/af_unix.h>
@@ -40,9 +43,12 @@
 #endif
 // ] SEC_SELINUX_PORTING_COMMON
 
-#define AVC_CACHE_SLOTS			512
+#define AVC_MIN_CACHE_SLOTS		512
+#define AVC_MAX_CACHE_SLOTS		8192
 #define AVC_DEF_CACHE_THRESHOLD		512
+#define AVC_MAX_CACHE_THRESHOLD		AVC_MAX_CACHE_SLOTS
 #define AVC_CACHE_RECLAIM		16
+#define AVC_PCPU_SLOTS			32
 
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 #define avc_cache_stats_incr(field)	this_cpu_inc(avc_cache_stats.field)
@@ -74,12 +80,36 @@ struct avc_xperms_node {
 	struct list_head xpd_head; /* list head of extended_perms_decision */
 };
 
+struct avc_slots {
+	unsigned int		size;		/* power of two */
+	struct hlist_head	*slots;		/* head for avc_node->list */
+	spinlock_t		*slots_lock;	/* lock for writes */
+};
+
 struct avc_cache {
-	struct hlist_head	slots[AVC_CACHE_SLOTS]; /* head for avc_node->list */
-	spinlock_t		slots_lock[AVC_CACHE_SLOTS]; /* lock for writes */
+	struct avc_slots __rcu	*table;		/* replaced on resize */
 	atomic_t		lru_hint;	/* LRU hint for reclaim scan */
 	atomic_t		active_nodes;
 	u32			latest_notif;	/* latest revocation notification */
+	atomic_t		gen;		/* bumped when decisions change */
+	unsigned long		reclaim_start;	/* current reclaim window */
+	unsigned int		reclaimed;	/* nodes reclaimed in it */
+	unsigned int		resizes;
+};
+
+/*
+ * Per-cpu direct mapped cache in front of the hash table.  An entry is
+ * valid as long as avc_cache.gen has not moved since it was filled, i.e.
+ * no cached decision was revoked, granted or flushed in the meantime.
+ * Only used from process context so that an interrupt never sees an
+ * entry half written.
+ */
+struct avc_pcpu_entry {
+	u32			ssid;
+	u32			tsid;
+	u16			tclass;
+	u32			gen;
+	struct av_decision	avd;
 };
 
 struct avc_callback_node {
@@ -96,15 +126,77 @@ DEFINE_PER_CPU(struct avc_cache_stats, avc_cache_stats) = { 0 };
 #endif
 
 static struct avc_cache avc_cache;
+static DEFINE_PER_CPU(struct avc_pcpu_entry [AVC_PCPU_SLOTS], avc_pcpu_cache);
+static DEFINE_MUTEX(avc_resize_mutex);
 static struct avc_callback_node *avc_callbacks;
 static struct kmem_cache *avc_node_cachep;
 static struct kmem_cache *avc_xperms_data_cachep;
 static struct kmem_cache *avc_xperms_decision_cachep;
 static struct kmem_cache *avc_xperms_cachep;
 
-static inline int avc_hash(u32 ssid, u32 tsid, u16 tclass)
+static inline int avc_hash(struct avc_slots *table,
+			   u32 ssid, u32 tsid, u16 tclass)
+{
+	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (table->size - 1);
+}
+
+static inline struct avc_slots *avc_table(void)
+{
+	return rcu_dereference_check(avc_cache.table,
+				     lockdep_is_held(&avc_resize_mutex));
+}
+
+static inline struct avc_pcpu_entry *avc_pcpu_slot(u32 ssid, u32 tsid,
+						   u16 tclass)
 {
-	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
+	return this_cpu_ptr(&avc_pcpu_cache[(ssid ^ (tsid<<3) ^ tclass) &
+					    (AVC_PCPU_SLOTS - 1)]);
+}
+
+static inline bool avc_pcpu_lookup(u32 ssid, u32 tsid, u16 tclass, u32 gen,
+				   struct av_decision *avd)
+{
+	struct avc_pcpu_entry *e;
+	bool hit = false;
+
+	if (in_interrupt())
+		return false;
+
+	preempt_disable();
+	e = avc_pcpu_slot(ssid, tsid, tclass);
+	if (e->gen == gen && e->ssid == ssid && e->tsid == tsid &&
+	    e->tclass == tclass) {
+		memcpy(avd, &e->avd, sizeof(*avd));
+		hit = true;
+	}
+	preempt_enable();
+
+	return hit;
+}
+
+static inline void avc_pcpu_fill(u32 ssid, u32 tsid, u16 tclass, u32 gen,
+				 struct av_decision *avd)
+{
+	struct avc_pcpu_entry *e;
+
+	if (in_interrupt())
+		return;
+
+	preempt_disable();
+	e = avc_pcpu_slot(ssid, tsid, tclass);
+	e->ssid = ssid;
+	e->tsid = tsid;
+	e->tclass = tclass;
+	e->gen = gen;
+	memcpy(&e->avd, avd, sizeof(e->avd));
+	preempt_enable();
+}
+
+/* Invalidate every per-cpu entry, once the hash table reflects the change */
+static inline void avc_pcpu_invalidate(void)
+{
+	smp_mb__before_atomic();
+	atomic_inc(&avc_cache.gen);
 }
 
 /**
@@ -179,16 +271,37 @@ static void avc_dump_query(struct audit_buffer *ab, u32 ssid, u32 tsid, u16 tcla
  *
  * Initialize the access vector cache.
  */
-void __init avc_init(void)
+static struct avc_slots *avc_alloc_table(unsigned int size)
 {
+	struct avc_slots *table;
 	int i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		INIT_HLIST_HEAD(&avc_cache.slots[i]);
-		spin_lock_init(&avc_cache.slots_lock[i]);
+	table = vzalloc(sizeof(*table) + size * (sizeof(struct hlist_head) +
+						 sizeof(spinlock_t)));
+	if (!table)
+		return NULL;
+
+	table->size = size;
+	table->slots = (struct hlist_head *)(table + 1);
+	table->slots_lock = (spinlock_t *)(table->slots + size);
+	for (i = 0; i < size; i++) {
+		INIT_HLIST_HEAD(&table->slots[i]);
+		spin_lock_init(&table->slots_lock[i]);
 	}
+	return table;
+}
+
+void __init avc_init(void)
+{
+	struct avc_slots *table;
+
+	table = avc_alloc_table(AVC_MIN_CACHE_SLOTS);
+	BUG_ON(!table);
+	RCU_INIT_POINTER(avc_cache.table, table);
 	atomic_set(&avc_cache.active_nodes, 0);
 	atomic_set(&avc_cache.lru_hint, 0);
+	/* zeroed per-cpu entries must never look valid */
+	atomic_set(&avc_cache.gen, 1);
 
 	avc_node_cachep = kmem_cache_create("avc_node", sizeof(struct avc_node),
 					0, SLAB_PANIC, NULL);
@@ -211,13 +324,17 @@ int avc_get_hash_stats(char *page)
 	int i, chain_len, max_chain_len, slots_used;
 	struct avc_node *node;
 	struct hlist_head *head;
+	struct avc_slots *table;
+	int size;
 
 	rcu_read_lock();
 
+	table = avc_table();
+	size = table->size;
 	slots_used = 0;
 	max_chain_len = 0;
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
+	for (i = 0; i < size; i++) {
+		head = &table->slots[i];
 		if (!hlist_empty(head)) {
 			slots_used++;
 			chain_len = 0;
@@ -231,9 +348,9 @@ int avc_get_hash_stats(char *page)
 	rcu_read_unlock();
 
 	return scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
-			 "longest chain: %d\n",
+			 "longest chain: %d\nresizes: %u\n",
 			 atomic_read(&avc_cache.active_nodes),
-			 slots_used, AVC_CACHE_SLOTS, max_chain_len);
+			 slots_used, size, max_chain_len, avc_cache.resizes);
 }
 
 /*
@@ -515,6 +632,68 @@ static void avc_node_replace(struct avc_node *new, struct avc_node *old)
 	hlist_replace_rcu(&old->list, &new->list);
 	call_rcu(&old->rhead, avc_node_free);
 	atomic_dec(&avc_cache.active_nodes);
+	avc_pcpu_invalidate();
+}
+
+static void avc_flush_table(struct avc_slots *table);
+
+/*
+ * Resize the hash table to fit the current threshold.  Nodes are not
+ * rehashed, the old table is simply flushed once no walker can still be
+ * using it; the hot decisions are back after a few lookups.
+ */
+static void avc_resize(void)
+{
+	struct avc_slots *table, *old;
+	unsigned int size;
+
+	size = clamp_t(unsigned int,
+		       roundup_pow_of_two(max(avc_cache_threshold, 1U)),
+		       AVC_MIN_CACHE_SLOTS, AVC_MAX_CACHE_SLOTS);
+
+	mutex_lock(&avc_resize_mutex);
+	old = avc_table();
+	if (old->size == size)
+		goto out;
+
+	table = avc_alloc_table(size);
+	if (!table)
+		goto out;
+
+	rcu_assign_pointer(avc_cache.table, table);
+	synchronize_rcu();
+	avc_flush_table(old);
+	vfree(old);
+	avc_cache.resizes++;
+out:
+	mutex_unlock(&avc_resize_mutex);
+}
+
+/*
+ * Grow the cache when reclaim turns over the whole cache within a
+ * second: the working set of the policy does not fit.
+ */
+static void avc_grow_fn(struct work_struct *work)
+{
+	if (avc_cache_threshold >= AVC_MAX_CACHE_THRESHOLD)
+		return;
+
+	avc_cache_threshold = min(avc_cache_threshold * 2,
+				  (unsigned int)AVC_MAX_CACHE_THRESHOLD);
+	avc_resize();
+}
+static DECLARE_WORK(avc_grow_work, avc_grow_fn);
+
+static void avc_account_reclaim(int nr)
+{
+	if (time_after(jiffies, avc_cache.reclaim_start + HZ)) {
+		avc_cache.reclaim_start = jiffies;
+		avc_cache.reclaimed = 0;
+	}
+	avc_cache.reclaimed += nr;
+	if (avc_cache.reclaimed >= avc_cache_threshold &&
+	    avc_cache_threshold < AVC_MAX_CACHE_THRESHOLD)
+		schedule_work(&avc_grow_work);
 }
 
 static inline int avc_reclaim_node(void)
@@ -524,11 +703,12 @@ static inline int avc_reclaim_node(void)
 	unsigned long flags;
 	struct hlist_head *head;
 	spinlock_t *lock;
+	struct avc_slots *table = avc_table();
 
-	for (try = 0, ecx = 0; try < AVC_CACHE_SLOTS; try++) {
-		hvalue = atomic_inc_return(&avc_cache.lru_hint) & (AVC_CACHE_SLOTS - 1);
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+	for (try = 0, ecx = 0; try < table->size; try++) {
+		hvalue = atomic_inc_return(&avc_cache.lru_hint) & (table->size - 1);
+		head = &table->slots[hvalue];
+		lock = &table->slots_lock[hvalue];
 
 		if (!spin_trylock_irqsave(lock, flags))
 			continue;
@@ -548,6 +728,7 @@ static inline int avc_reclaim_node(void)
 		spin_unlock_irqrestore(lock, flags);
 	}
 out:
+	avc_account_reclaim(ecx);
 	return ecx;
 }
 
@@ -582,9 +763,10 @@ static inline struct avc_node *avc_search_node(u32 ssid, u32 tsid, u16 tclass)
 	struct avc_node *node, *ret = NULL;
 	int hvalue;
 	struct hlist_head *head;
+	struct avc_slots *table = avc_table();
 
-	hvalue = avc_hash(ssid, tsid, tclass);
-	head = &avc_cache.slots[hvalue];
+	hvalue = avc_hash(table, ssid, tsid, tclass);
+	head = &table->slots[hvalue];
 	hlist_for_each_entry_rcu(node, head, list) {
 		if (ssid == node->ae.ssid &&
 		    tclass == node->ae.tclass &&
@@ -676,19 +858,20 @@ static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass,
 
 	node = avc_alloc_node();
 	if (node) {
+		struct avc_slots *table = avc_table();
 		struct hlist_head *head;
 		spinlock_t *lock;
 		int rc = 0;
 
-		hvalue = avc_hash(ssid, tsid, tclass);
+		hvalue = avc_hash(table, ssid, tsid, tclass);
 		avc_node_populate(node, ssid, tsid, tclass, avd);
 		rc = avc_xperms_populate(node, xp_node);
 		if (rc) {
 			kmem_cache_free(avc_node_cachep, node);
 			return NULL;
 		}
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+		head = &table->slots[hvalue];
+		lock = &table->slots_lock[hvalue];
 
 		spin_lock_irqsave(lock, flag);
 		hlist_for_each_entry(pos, head, list) {
@@ -835,6 +1018,7 @@ static int avc_update_node(u32 event, u32 perms, u8 driver, u8 xperm, u32 ssid,
 	int hvalue, rc = 0;
 	unsigned long flag;
 	struct avc_node *pos, *node, *orig = NULL;
+	struct avc_slots *table = avc_table();
 	struct hlist_head *head;
 	spinlock_t *lock;
 
@@ -845,10 +1029,10 @@ static int avc_update_node(u32 event, u32 perms, u8 driver, u8 xperm, u32 ssid,
 	}
 
 	/* Lock the target slot */
-	hvalue = avc_hash(ssid, tsid, tclass);
+	hvalue = avc_hash(table, ssid, tsid, tclass);
 
-	head = &avc_cache.slots[hvalue];
-	lock = &avc_cache.slots_lock[hvalue];
+	head = &table->slots[hvalue];
+	lock = &table->slots_lock[hvalue];
 
 	spin_lock_irqsave(lock, flag);
 
@@ -915,10 +1099,7 @@ out:
 	return rc;
 }
 
-/**
- * avc_flush - Flush the cache
- */
-static void avc_flush(void)
+static void avc_flush_table(struct avc_slots *table)
 {
 	struct hlist_head *head;
 	struct avc_node *node;
@@ -926,9 +1107,9 @@ static void avc_flush(void)
 	unsigned long flag;
 	int i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
-		lock = &avc_cache.slots_lock[i];
+	for (i = 0; i < table->size; i++) {
+		head = &table->slots[i];
+		lock = &table->slots_lock[i];
 
 		spin_lock_irqsave(lock, flag);
 		/*
@@ -943,6 +1124,30 @@ static void avc_flush(void)
 	}
 }
 
+/**
+ * avc_flush - Flush the cache
+ */
+static void avc_flush(void)
+{
+	rcu_read_lock();
+	avc_flush_table(avc_table());
+	rcu_read_unlock();
+	avc_pcpu_invalidate();
+}
+
+/**
+ * avc_set_cache_threshold - Set the number of cached decisions
+ * @threshold: new threshold
+ *
+ * Resize the hash table along with the threshold, so that chains stay
+ * short however many decisions the policy keeps hot.
+ */
+void avc_set_cache_threshold(unsigned int threshold)
+{
+	avc_cache_threshold = threshold;
+	avc_resize();
+}
+
 /**
  * avc_ss_reset - Flush the cache and revalidate migrated permissions.
  * @seqno: policy sequence number
@@ -1168,17 +1373,28 @@ inline int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 	struct avc_node *node;
 	struct avc_xperms_node xp_node;
 	int rc = 0;
-	u32 denied;
+	u32 denied, gen;
 
 	BUG_ON(!requested);
 
 	rcu_read_lock();
 
-	node = avc_lookup(ssid, tsid, tclass);
-	if (unlikely(!node))
-		node = avc_compute_av(ssid, tsid, tclass, avd, &xp_node);
-	else
-		memcpy(avd, &node->ae.avd, sizeof(*avd));
+	/* pairs with avc_pcpu_invalidate() */
+	gen = atomic_read(&avc_cache.gen);
+	smp_rmb();
+
+	if (avc_pcpu_lookup(ssid, tsid, tclass, gen, avd)) {
+		avc_cache_stats_incr(lookups);
+		avc_cache_stats_incr(pcpu_hits);
+	} else {
+		node = avc_lookup(ssid, tsid, tclass);
+		if (unlikely(!node))
+			node = avc_compute_av(ssid, tsid, tclass, avd, &xp_node);
+		else
+			memcpy(avd, &node->ae.avd, sizeof(*avd));
+		if (node)
+			avc_pcpu_fill(ssid, tsid, tclass, gen, avd);
+	}
 
 	denied = requested & ~(avd->allowed);
 	if (unlikely(denied))
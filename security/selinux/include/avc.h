@@ -44,6 +44,7 @@ struct avc_cache_stats {
 	unsigned int allocations;
 	unsigned int reclaims;
 	unsigned int frees;
+	unsigned int pcpu_hits;
 };
 
 /*
@@ -172,6 +173,7 @@ int avc_add_callback(int (*callback)(u32 event), u32 events);
 /* Exported to selinuxfs */
 int avc_get_hash_stats(char *page);
 extern unsigned int avc_cache_threshold;
+void avc_set_cache_threshold(unsigned int threshold);
 
 /* Attempt to free avc node cache */
 void avc_disable(void);
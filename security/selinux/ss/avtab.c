@@ -19,6 +19,7 @@
 
 #include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/errno.h>
 #include "avtab.h"
 #include "policydb.h"
@@ -253,10 +254,13 @@ void avtab_destroy(struct avtab *h)
 			if (temp->key.specified & AVTAB_XPERMS)
 				kmem_cache_free(avtab_xperms_cachep,
 						temp->datum.u.xperms);
-			kmem_cache_free(avtab_node_cachep, temp);
+			if (!h->flat)
+				kmem_cache_free(avtab_node_cachep, temp);
 		}
 		h->htable[i] = NULL;
 	}
+	vfree(h->flat);
+	h->flat = NULL;
 	kfree(h->htable);
 	h->htable = NULL;
 	h->nslot = 0;
@@ -266,6 +270,7 @@ void avtab_destroy(struct avtab *h)
 int avtab_init(struct avtab *h)
 {
 	h->htable = NULL;
+	h->flat = NULL;
 	h->nel = 0;
 	return 0;
 }
@@ -304,6 +309,43 @@ int avtab_alloc(struct avtab *h, u32 nrules)
 	return 0;
 }
 
+/*
+ * Move the nodes of a table that is not going to change any more into a
+ * single array laid out in hash chain order, so that lookups walk
+ * adjacent memory instead of nodes scattered all over the slab.  Nothing
+ * may hold on to node pointers across this, which rules out conditional
+ * tables.
+ */
+int avtab_flatten(struct avtab *h)
+{
+	struct avtab_node *flat, *pos, *cur, *next, **prev;
+	int i;
+
+	if (!h->htable || !h->nel || h->flat)
+		return 0;
+
+	flat = vmalloc(h->nel * sizeof(*flat));
+	if (!flat)
+		return -ENOMEM;
+
+	pos = flat;
+	for (i = 0; i < h->nslot; i++) {
+		prev = &h->htable[i];
+		for (cur = h->htable[i]; cur; cur = next) {
+			next = cur->next;
+			*pos = *cur;
+			*prev = pos;
+			prev = &pos->next;
+			kmem_cache_free(avtab_node_cachep, cur);
+			pos++;
+		}
+		*prev = NULL;
+	}
+	h->flat = flat;
+
+	return 0;
+}
+
 void avtab_hash_eval(struct avtab *h, char *tag)
 {
 	int i, chain_len, slots_used, max_chain_len;
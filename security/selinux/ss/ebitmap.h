@@ -65,11 +65,21 @@ static inline unsigned int ebitmap_next_positive(struct ebitmap *e,
 						 struct ebitmap_node **n,
 						 unsigned int bit)
 {
-	unsigned int ofs;
-
-	ofs = find_next_bit((*n)->maps, EBITMAP_SIZE, bit - (*n)->startbit + 1);
-	if (ofs < EBITMAP_SIZE)
-		return ofs + (*n)->startbit;
+	unsigned int ofs = bit - (*n)->startbit + 1;
+	unsigned long word;
+
+	if (ofs < EBITMAP_SIZE) {
+		/* most often the next bit is in the same word */
+		word = (*n)->maps[ofs / EBITMAP_UNIT_SIZE] >>
+			(ofs % EBITMAP_UNIT_SIZE);
+		if (word)
+			return bit + 1 + __ffs(word);
+
+		ofs = find_next_bit((*n)->maps, EBITMAP_SIZE,
+				    round_up(ofs, EBITMAP_UNIT_SIZE));
+		if (ofs < EBITMAP_SIZE)
+			return ofs + (*n)->startbit;
+	}
 
 	for (*n = (*n)->next; *n; *n = (*n)->next) {
 		ofs = find_first_bit((*n)->maps, EBITMAP_SIZE);
@@ -782,6 +782,23 @@ static void ocontext_destroy(struct ocontext *c, int i)
 	kfree(c);
 }
 
+static void type_attr_array_destroy(struct policydb *p, struct flex_array *fa)
+{
+	struct ebitmap *e;
+	int i;
+
+	if (!fa)
+		return;
+
+	for (i = 0; i < p->p_types.nprim; i++) {
+		e = flex_array_get(fa, i);
+		if (!e)
+			continue;
+		ebitmap_destroy(e);
+	}
+	flex_array_free(fa);
+}
+
 /*
  * Free any memory allocated by a policy database structure.
  */
@@ -861,17 +878,9 @@ void policydb_destroy(struct policydb *p)
 	hashtab_map(p->range_tr, range_tr_destroy, NULL);
 	hashtab_destroy(p->range_tr);
 
-	if (p->type_attr_map_array) {
-		for (i = 0; i < p->p_types.nprim; i++) {
-			struct ebitmap *e;
-
-			e = flex_array_get(p->type_attr_map_array, i);
-			if (!e)
-				continue;
-			ebitmap_destroy(e);
-		}
-		flex_array_free(p->type_attr_map_array);
-	}
+	type_attr_array_destroy(p, p->type_attr_map_array);
+	type_attr_array_destroy(p, p->type_attr_src_array);
+	type_attr_array_destroy(p, p->type_attr_tgt_array);
 
 	ebitmap_destroy(&p->filename_trans_ttypes);
 	ebitmap_destroy(&p->policycaps);
@@ -1805,6 +1814,97 @@ static int policydb_bounds_sanity_check(struct policydb *p)
 	return 0;
 }
 
+/* Record the source and target types of all access vector rules in @a */
+static int avtab_mark_types(struct avtab *a, struct ebitmap *src,
+			    struct ebitmap *tgt)
+{
+	struct avtab_node *cur;
+	int i, rc;
+
+	for (i = 0; i < a->nslot; i++) {
+		for (cur = a->htable[i]; cur; cur = cur->next) {
+			if (!(cur->key.specified & (AVTAB_AV | AVTAB_XPERMS)))
+				continue;
+			rc = ebitmap_set_bit(src, cur->key.source_type - 1, 1);
+			if (rc)
+				return rc;
+			rc = ebitmap_set_bit(tgt, cur->key.target_type - 1, 1);
+			if (rc)
+				return rc;
+		}
+	}
+	return 0;
+}
+
+static struct flex_array *type_attr_array_filter(struct policydb *p,
+						 struct ebitmap *used)
+{
+	struct ebitmap *e, *map;
+	struct ebitmap_node *node;
+	struct flex_array *fa;
+	unsigned int i, bit;
+
+	fa = flex_array_alloc(sizeof(struct ebitmap), p->p_types.nprim,
+			      GFP_KERNEL | __GFP_ZERO);
+	if (!fa)
+		return NULL;
+	if (flex_array_prealloc(fa, 0, p->p_types.nprim,
+				GFP_KERNEL | __GFP_ZERO))
+		goto bad;
+
+	for (i = 0; i < p->p_types.nprim; i++) {
+		e = flex_array_get(fa, i);
+		map = flex_array_get(p->type_attr_map_array, i);
+		ebitmap_init(e);
+		ebitmap_for_each_positive_bit(map, node, bit) {
+			if (ebitmap_get_bit(used, bit) &&
+			    ebitmap_set_bit(e, bit, 1))
+				goto bad;
+		}
+	}
+	return fa;
+bad:
+	type_attr_array_destroy(p, fa);
+	return NULL;
+}
+
+/*
+ * Precompute what context_struct_compute_av() needs at load time.  Most
+ * attributes a type belongs to never show up in an access vector rule on
+ * one side or the other, so iterating the attribute maps restricted to
+ * the attributes that do skips most of the avtab lookups of a miss.  The
+ * unconditional avtab does not change after load and is flattened.
+ */
+static int policydb_build_av_maps(struct policydb *p)
+{
+	struct ebitmap src, tgt;
+	int rc;
+
+	ebitmap_init(&src);
+	ebitmap_init(&tgt);
+
+	rc = avtab_mark_types(&p->te_avtab, &src, &tgt);
+	if (rc)
+		goto out;
+	rc = avtab_mark_types(&p->te_cond_avtab, &src, &tgt);
+	if (rc)
+		goto out;
+
+	rc = -ENOMEM;
+	p->type_attr_src_array = type_attr_array_filter(p, &src);
+	if (!p->type_attr_src_array)
+		goto out;
+	p->type_attr_tgt_array = type_attr_array_filter(p, &tgt);
+	if (!p->type_attr_tgt_array)
+		goto out;
+
+	rc = avtab_flatten(&p->te_avtab);
+out:
+	ebitmap_destroy(&src);
+	ebitmap_destroy(&tgt);
+	return rc;
+}
+
 u16 string_to_security_class(struct policydb *p, const char *name)
 {
 	struct class_datum *cladatum;
@@ -2509,6 +2609,10 @@ int policydb_read(struct policydb *p, void *fp)
 	if (rc)
 		goto bad;
 
+	rc = policydb_build_av_maps(p);
+	if (rc)
+		goto bad;
+
 	rc = 0;
 out:
 	return rc;
@@ -285,6 +285,13 @@ struct policydb {
 	/* type -> attribute reverse mapping */
 	struct flex_array *type_attr_map_array;
 
+	/*
+	 * type_attr_map_array restricted to the types and attributes used
+	 * as source, respectively target, of an access vector rule
+	 */
+	struct flex_array *type_attr_src_array;
+	struct flex_array *type_attr_tgt_array;
+
 	struct ebitmap policycaps;
 
 	struct ebitmap permissive_map;
@@ -7,6 +7,11 @@
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/errno.h>
+#include <linux/jhash.h>
+#include <linux/dcache.h>
+#include <linux/rcupdate.h>
+#include <linux/ktime.h>
+#include <linux/init.h>
 #include "flask.h"
 #include "security.h"
 #include "sidtab.h"
@@ -14,6 +19,9 @@
 #define SIDTAB_HASH(sid) \
 (sid & SIDTAB_HASH_MASK)
 
+#define SIDTAB_CONTEXT_HASH(hash) \
+((hash) & (SIDTAB_CONTEXT_SIZE - 1))
+
 int sidtab_init(struct sidtab *s)
 {
 	int i;
@@ -21,8 +29,17 @@ int sidtab_init(struct sidtab *s)
 	s->htable = kmalloc(sizeof(*(s->htable)) * SIDTAB_SIZE, GFP_ATOMIC);
 	if (!s->htable)
 		return -ENOMEM;
+	s->context_htable = kmalloc(sizeof(*(s->context_htable)) *
+				    SIDTAB_CONTEXT_SIZE, GFP_ATOMIC);
+	if (!s->context_htable) {
+		kfree(s->htable);
+		s->htable = NULL;
+		return -ENOMEM;
+	}
 	for (i = 0; i < SIDTAB_SIZE; i++)
-		s->htable[i] = NULL;
+		RCU_INIT_POINTER(s->htable[i], NULL);
+	for (i = 0; i < SIDTAB_CONTEXT_SIZE; i++)
+		RCU_INIT_POINTER(s->context_htable[i], NULL);
 	s->nel = 0;
 	s->next_sid = 1;
 	s->shutdown = 0;
@@ -30,6 +47,41 @@ int sidtab_init(struct sidtab *s)
 	return 0;
 }
 
+static u32 ebitmap_hash(struct ebitmap *e, u32 hash)
+{
+	struct ebitmap_node *n;
+
+	for (n = e->node; n; n = n->next) {
+		hash = jhash_1word(n->startbit, hash);
+		hash = jhash(n->maps, sizeof(n->maps), hash);
+	}
+	return hash;
+}
+
+static u32 sidtab_context_hash(struct context *c)
+{
+	u32 hash;
+
+	if (c->len)
+		return full_name_hash(c->str, c->len);
+
+	hash = jhash_3words(c->user, c->role, c->type, 0);
+	hash = jhash_2words(c->range.level[0].sens, c->range.level[1].sens,
+			    hash);
+	hash = ebitmap_hash(&c->range.level[0].cat, hash);
+	return ebitmap_hash(&c->range.level[1].cat, hash);
+}
+
+static void sidtab_context_link(struct sidtab *s, struct sidtab_node *node)
+{
+	struct sidtab_node __rcu **head;
+
+	node->hash = sidtab_context_hash(&node->context);
+	head = &s->context_htable[SIDTAB_CONTEXT_HASH(node->hash)];
+	RCU_INIT_POINTER(node->context_next, rcu_dereference_protected(*head, 1));
+	rcu_assign_pointer(*head, node);
+}
+
 int sidtab_insert(struct sidtab *s, u32 sid, struct context *context)
 {
 	int hvalue, rc = 0;
@@ -42,10 +94,10 @@ int sidtab_insert(struct sidtab *s, u32 sid, struct context *context)
 
 	hvalue = SIDTAB_HASH(sid);
 	prev = NULL;
-	cur = s->htable[hvalue];
+	cur = rcu_dereference_protected(s->htable[hvalue], 1);
 	while (cur && sid > cur->sid) {
 		prev = cur;
-		cur = cur->next;
+		cur = rcu_dereference_protected(cur->next, 1);
 	}
 
 	if (cur && sid == cur->sid) {
@@ -65,15 +117,12 @@ int sidtab_insert(struct sidtab *s, u32 sid, struct context *context)
 		goto out;
 	}
 
-	if (prev) {
-		newnode->next = prev->next;
-		wmb();
-		prev->next = newnode;
-	} else {
-		newnode->next = s->htable[hvalue];
-		wmb();
-		s->htable[hvalue] = newnode;
-	}
+	RCU_INIT_POINTER(newnode->next, cur);
+	if (prev)
+		rcu_assign_pointer(prev->next, newnode);
+	else
+		rcu_assign_pointer(s->htable[hvalue], newnode);
+	sidtab_context_link(s, newnode);
 
 	s->nel++;
 	if (sid >= s->next_sid)
@@ -82,34 +131,34 @@ out:
 	return rc;
 }
 
+static struct sidtab_node *sidtab_search_sid(struct sidtab *s, u32 sid)
+{
+	struct sidtab_node *cur;
+
+	cur = rcu_dereference(s->htable[SIDTAB_HASH(sid)]);
+	while (cur && sid > cur->sid)
+		cur = rcu_dereference(cur->next);
+
+	return cur && cur->sid == sid ? cur : NULL;
+}
+
 static struct context *sidtab_search_core(struct sidtab *s, u32 sid, int force)
 {
-	int hvalue;
 	struct sidtab_node *cur;
 
 	if (!s)
 		return NULL;
 
-	hvalue = SIDTAB_HASH(sid);
-	cur = s->htable[hvalue];
-	while (cur && sid > cur->sid)
-		cur = cur->next;
-
-	if (force && cur && sid == cur->sid && cur->context.len)
-		return &cur->context;
-
-	if (cur == NULL || sid != cur->sid || cur->context.len) {
-		/* Remap invalid SIDs to the unlabeled SID. */
-		sid = SECINITSID_UNLABELED;
-		hvalue = SIDTAB_HASH(sid);
-		cur = s->htable[hvalue];
-		while (cur && sid > cur->sid)
-			cur = cur->next;
-		if (!cur || sid != cur->sid)
-			return NULL;
-	}
+	rcu_read_lock();
+	cur = sidtab_search_sid(s, sid);
+	if (cur && (force || !cur->context.len))
+		goto out;
 
-	return &cur->context;
+	/* Remap invalid SIDs to the unlabeled SID. */
+	cur = sidtab_search_sid(s, SECINITSID_UNLABELED);
+out:
+	rcu_read_unlock();
+	return cur ? &cur->context : NULL;
 }
 
 struct context *sidtab_search(struct sidtab *s, u32 sid)
@@ -134,83 +183,76 @@ int sidtab_map(struct sidtab *s,
 	if (!s)
 		goto out;
 
+	/* @apply may sleep; the callers make sure no insertion is running */
 	for (i = 0; i < SIDTAB_SIZE; i++) {
-		cur = s->htable[i];
+		cur = rcu_dereference_raw(s->htable[i]);
 		while (cur) {
 			rc = apply(cur->sid, &cur->context, args);
 			if (rc)
 				goto out;
-			cur = cur->next;
+			cur = rcu_dereference_raw(cur->next);
 		}
 	}
 out:
 	return rc;
 }
 
-static void sidtab_update_cache(struct sidtab *s, struct sidtab_node *n, int loc)
+/*
+ * Rebuild the context index after the contexts of a table have been
+ * changed in place, e.g. converted to a new policy.  The table must not
+ * be visible to anyone else yet.
+ */
+void sidtab_rehash_contexts(struct sidtab *s)
 {
-	BUG_ON(loc >= SIDTAB_CACHE_LEN);
+	struct sidtab_node *cur;
+	int i;
 
-	while (loc > 0) {
-		s->cache[loc] = s->cache[loc - 1];
-		loc--;
+	for (i = 0; i < SIDTAB_CONTEXT_SIZE; i++)
+		RCU_INIT_POINTER(s->context_htable[i], NULL);
+
+	for (i = 0; i < SIDTAB_SIZE; i++) {
+		cur = rcu_dereference_protected(s->htable[i], 1);
+		for (; cur; cur = rcu_dereference_protected(cur->next, 1))
+			sidtab_context_link(s, cur);
 	}
-	s->cache[0] = n;
 }
 
 static inline u32 sidtab_search_context(struct sidtab *s,
-						  struct context *context)
+						  struct context *context,
+						  u32 hash)
 {
-	int i;
 	struct sidtab_node *cur;
-
-	for (i = 0; i < SIDTAB_SIZE; i++) {
-		cur = s->htable[i];
-		while (cur) {
-			if (context_cmp(&cur->context, context)) {
-				sidtab_update_cache(s, cur, SIDTAB_CACHE_LEN - 1);
-				return cur->sid;
-			}
-			cur = cur->next;
+	u32 sid = 0;
+
+	rcu_read_lock();
+	cur = rcu_dereference(s->context_htable[SIDTAB_CONTEXT_HASH(hash)]);
+	for (; cur; cur = rcu_dereference(cur->context_next)) {
+		if (cur->hash == hash && context_cmp(&cur->context, context)) {
+			sid = cur->sid;
+			break;
 		}
 	}
-	return 0;
-}
+	rcu_read_unlock();
 
-static inline u32 sidtab_search_cache(struct sidtab *s, struct context *context)
-{
-	int i;
-	struct sidtab_node *node;
-
-	for (i = 0; i < SIDTAB_CACHE_LEN; i++) {
-		node = s->cache[i];
-		if (unlikely(!node))
-			return 0;
-		if (context_cmp(&node->context, context)) {
-			sidtab_update_cache(s, node, i);
-			return node->sid;
-		}
-	}
-	return 0;
+	return sid;
 }
 
 int sidtab_context_to_sid(struct sidtab *s,
 			  struct context *context,
 			  u32 *out_sid)
 {
-	u32 sid;
+	u32 sid, hash;
 	int ret = 0;
 	unsigned long flags;
 
 	*out_sid = SECSID_NULL;
 
-	sid  = sidtab_search_cache(s, context);
-	if (!sid)
-		sid = sidtab_search_context(s, context);
+	hash = sidtab_context_hash(context);
+	sid = sidtab_search_context(s, context, hash);
 	if (!sid) {
 		spin_lock_irqsave(&s->lock, flags);
 		/* Rescan now that we hold the lock. */
-		sid = sidtab_search_context(s, context);
+		sid = sidtab_search_context(s, context, hash);
 		if (sid)
 			goto unlock_out;
 		/* No SID exists for the context.  Allocate a new one. */
@@ -245,13 +287,13 @@ void sidtab_hash_eval(struct sidtab *h, char *tag)
 	slots_used = 0;
 	max_chain_len = 0;
 	for (i = 0; i < SIDTAB_SIZE; i++) {
-		cur = h->htable[i];
+		cur = rcu_dereference_raw(h->htable[i]);
 		if (cur) {
 			slots_used++;
 			chain_len = 0;
 			while (cur) {
 				chain_len++;
-				cur = cur->next;
+				cur = rcu_dereference_raw(cur->next);
 			}
 
 			if (chain_len > max_chain_len)
@@ -273,17 +315,19 @@ void sidtab_destroy(struct sidtab *s)
 		return;
 
 	for (i = 0; i < SIDTAB_SIZE; i++) {
-		cur = s->htable[i];
+		cur = rcu_dereference_protected(s->htable[i], 1);
 		while (cur) {
 			temp = cur;
-			cur = cur->next;
+			cur = rcu_dereference_protected(cur->next, 1);
 			context_destroy(&temp->context);
 			kfree(temp);
 		}
-		s->htable[i] = NULL;
+		RCU_INIT_POINTER(s->htable[i], NULL);
 	}
 	kfree(s->htable);
 	s->htable = NULL;
+	kfree(s->context_htable);
+	s->context_htable = NULL;
 	s->nel = 0;
 	s->next_sid = 1;
 }
@@ -291,15 +335,13 @@ void sidtab_destroy(struct sidtab *s)
 void sidtab_set(struct sidtab *dst, struct sidtab *src)
 {
 	unsigned long flags;
-	int i;
 
 	spin_lock_irqsave(&src->lock, flags);
 	dst->htable = src->htable;
+	dst->context_htable = src->context_htable;
 	dst->nel = src->nel;
 	dst->next_sid = src->next_sid;
 	dst->shutdown = 0;
-	for (i = 0; i < SIDTAB_CACHE_LEN; i++)
-		dst->cache[i] = NULL;
 	spin_unlock_irqrestore(&src->lock, flags);
 }
 
@@ -311,3 +353,85 @@ void sidtab_shutdown(struct sidtab *s)
 	s->shutdown = 1;
 	spin_unlock_irqrestore(&s->lock, flags);
 }
+
+#ifdef CONFIG_SECURITY_SELINUX_SIDTAB_SELFTEST
+#define SIDTAB_SELFTEST_NR	4096
+
+/* distinct contexts with categories, like those of Android apps */
+static int __init sidtab_selftest_context(struct context *c, int i)
+{
+	context_init(c);
+	c->user = 1 + i % 4;
+	c->role = 1 + i % 3;
+	c->type = 1 + i % 97;
+	if (ebitmap_set_bit(&c->range.level[0].cat, i % 256, 1) ||
+	    ebitmap_set_bit(&c->range.level[0].cat, 256 + i / 256, 1))
+		return -ENOMEM;
+	return 0;
+}
+
+static int __init sidtab_selftest(void)
+{
+	struct context *ctx, *found;
+	struct sidtab s;
+	s64 insert_ns, c2s_ns, s2c_ns;
+	ktime_t start;
+	int i, rc, errors = 0;
+	u32 *sids, sid;
+
+	ctx = kcalloc(SIDTAB_SELFTEST_NR, sizeof(*ctx), GFP_KERNEL);
+	sids = kcalloc(SIDTAB_SELFTEST_NR, sizeof(*sids), GFP_KERNEL);
+	rc = -ENOMEM;
+	if (!ctx || !sids)
+		goto out;
+
+	for (i = 0; i < SIDTAB_SELFTEST_NR; i++) {
+		rc = sidtab_selftest_context(&ctx[i], i);
+		if (rc)
+			goto out;
+	}
+
+	rc = sidtab_init(&s);
+	if (rc)
+		goto out;
+
+	start = ktime_get();
+	for (i = 0; i < SIDTAB_SELFTEST_NR; i++)
+		if (sidtab_context_to_sid(&s, &ctx[i], &sids[i]))
+			errors++;
+	insert_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (i = 0; i < SIDTAB_SELFTEST_NR; i++)
+		if (sidtab_context_to_sid(&s, &ctx[i], &sid) ||
+		    sid != sids[i])
+			errors++;
+	c2s_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	start = ktime_get();
+	for (i = 0; i < SIDTAB_SELFTEST_NR; i++) {
+		found = sidtab_search(&s, sids[i]);
+		if (!found || !context_cmp(found, &ctx[i]))
+			errors++;
+	}
+	s2c_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	printk(KERN_INFO "SELinux:  sidtab self-test: %d entries, %d errors, "
+	       "per entry: insert %lld ns, context to sid %lld ns, "
+	       "sid to context %lld ns\n", SIDTAB_SELFTEST_NR, errors,
+	       div_s64(insert_ns, SIDTAB_SELFTEST_NR),
+	       div_s64(c2s_ns, SIDTAB_SELFTEST_NR),
+	       div_s64(s2c_ns, SIDTAB_SELFTEST_NR));
+	sidtab_hash_eval(&s, "sidtab self-test");
+	sidtab_destroy(&s);
+	rc = errors ? -EINVAL : 0;
+out:
+	if (ctx)
+		for (i = 0; i < SIDTAB_SELFTEST_NR; i++)
+			context_destroy(&ctx[i]);
+	kfree(ctx);
+	kfree(sids);
+	return rc;
+}
+late_initcall(sidtab_selftest);
+#endif /* CONFIG_SECURITY_SELINUX_SIDTAB_SELFTEST */
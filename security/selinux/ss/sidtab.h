@@ -1,6 +1,7 @@
 /*
  * A security identifier table (sidtab) is a hash table
- * of security context structures indexed by SID value.
+ * of security context structures indexed by SID value,
+ * with a second hash index from context to SID.
  *
  * Author : Stephen Smalley, <sds@epoch.ncsc.mil>
  */
@@ -11,8 +12,10 @@
 
 struct sidtab_node {
 	u32 sid;		/* security identifier */
+	u32 hash;		/* hash of the context */
 	struct context context;	/* security context structure */
-	struct sidtab_node *next;
+	struct sidtab_node __rcu *next;
+	struct sidtab_node __rcu *context_next;
 };
 
 #define SIDTAB_HASH_BITS 7
@@ -21,13 +24,20 @@ struct sidtab_node {
 
 #define SIDTAB_SIZE SIDTAB_HASH_BUCKETS
 
+#define SIDTAB_CONTEXT_HASH_BITS 9
+#define SIDTAB_CONTEXT_SIZE (1 << SIDTAB_CONTEXT_HASH_BITS)
+
+/*
+ * Nodes are only ever added while the table is live and freed by
+ * sidtab_destroy() once nobody can find the table any more, so lookups
+ * need no lock; insertions serialize on @lock.
+ */
 struct sidtab {
-	struct sidtab_node **htable;
+	struct sidtab_node __rcu **htable;
+	struct sidtab_node __rcu **context_htable;
 	unsigned int nel;	/* number of elements */
 	unsigned int next_sid;	/* next SID to allocate */
 	unsigned char shutdown;
-#define SIDTAB_CACHE_LEN	3
-	struct sidtab_node *cache[SIDTAB_CACHE_LEN];
 	spinlock_t lock;
 };
 
@@ -45,6 +55,7 @@ int sidtab_map(struct sidtab *s,
 int sidtab_context_to_sid(struct sidtab *s,
 			  struct context *context,
 			  u32 *sid);
+void sidtab_rehash_contexts(struct sidtab *s);
 
 void sidtab_hash_eval(struct sidtab *h, char *tag);
 void sidtab_destroy(struct sidtab *s);
@@ -0,0 +1,69 @@
+/*
+ * Helpers shared by the selftest benchmarks: a monotonic clock, readers
+ * for single-number sysfs/procfs statistics and the usage message.
+ */
+
+#ifndef __SELFTESTS_BENCH_H
+#define __SELFTESTS_BENCH_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <limits.h>
+
+/* seconds on the monotonic clock */
+static inline double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the number in a sysfs or procfs file, -1 if it is missing */
+static inline long read_stat(const char *path)
+{
+	long val = -1;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "%ld", &val) != 1)
+		val = -1;
+	fclose(f);
+	return val;
+}
+
+/* the value of a "Key: value" line in /proc/meminfo, -1 if missing */
+static inline long read_meminfo(const char *key)
+{
+	char line[256];
+	size_t len = strlen(key);
+	long val = -1;
+	FILE *f;
+
+	f = fopen("/proc/meminfo", "r");
+	if (!f)
+		err(2, "open /proc/meminfo");
+	while (fgets(line, sizeof(line), f))
+		if (!strncmp(line, key, len) && line[len] == ':') {
+			val = atol(line + len + 1);
+			break;
+		}
+	fclose(f);
+	return val;
+}
+
+static inline void __attribute__((noreturn))
+usage(const char *prog, const char *args)
+{
+	errx(1, "usage: %s %s", prog, args);
+}
+
+#endif /* __SELFTESTS_BENCH_H */
@@ -0,0 +1,311 @@
+/*
+ * Queue depth N O_DIRECT random read benchmark for the aio rings.
+ *
+ * Keeps a number of reads in flight on a file or block device, either
+ * through io_submit()/io_getevents(), or through the submission ring of a
+ * context set up with IOCTX_FLAG_SQRING, with completions reaped straight
+ * from the mapped event ring, with and without the kernel polling thread.  Reports IOPS
+ * and syscalls per I/O for each mode that the kernel supports:
+ *
+ *	aio-ring-bench [-f file or device] [-m syscall|ring|thread]
+ *		       [-b block size] [-s size MB] [-q depth] [-d secs]
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/aio_abi.h>
+#include <linux/fs.h>
+
+#include "../bench.h"
+
+#ifndef IOCTX_FLAG_SQRING
+#define IOCTX_FLAG_SQRING	(1 << 28)
+#define IOCTX_FLAG_SQTHREAD	(1 << 29)
+#define AIO_SQ_NEED_WAKEUP	(1 << 0)
+#endif
+
+#define MAX_DEPTH	256
+
+/* the event ring header, as mapped at the aio_context_t */
+struct event_ring {
+	unsigned	id;
+	unsigned	nr;
+	unsigned	head;
+	unsigned	tail;
+	unsigned	magic;
+	unsigned	compat_features;
+	unsigned	incompat_features;
+	unsigned	header_length;
+	struct io_event	events[0];
+};
+
+struct sq_ring {
+	unsigned	head;
+	unsigned	tail;
+	unsigned	nr;
+	unsigned	flags;
+	unsigned	dropped;
+	unsigned	reserved[3];
+	struct iocb	iocbs[0];
+};
+
+enum { MODE_SYSCALL, MODE_RING, MODE_THREAD, NR_MODES };
+static const char *mode_names[] = { "syscall", "ring", "thread" };
+
+static const char *path = "aio-ring-bench.dat";
+static size_t bs = 4096;
+static unsigned long long nr_blocks;
+static int depth = 32;
+static double secs = 5;
+static int fd;
+
+static struct iocb iocbs[MAX_DEPTH];
+static void *bufs[MAX_DEPTH];
+static long syscalls;
+
+static void prep(int i, unsigned int *seed)
+{
+	unsigned long long blk;
+
+	blk = ((unsigned long long)rand_r(seed) << 31 ^ rand_r(seed)) %
+	      nr_blocks;
+	memset(&iocbs[i], 0, sizeof(iocbs[i]));
+	iocbs[i].aio_data = i;
+	iocbs[i].aio_lio_opcode = IOCB_CMD_PREAD;
+	iocbs[i].aio_fildes = fd;
+	iocbs[i].aio_buf = (unsigned long)bufs[i];
+	iocbs[i].aio_nbytes = bs;
+	iocbs[i].aio_offset = blk * bs;
+}
+
+static void check(struct io_event *ev)
+{
+	if (ev->res != (long long)bs)
+		errx(2, "read %s: %s", path, ev->res < 0 ?
+		     strerror(-ev->res) : "short read");
+}
+
+static long run_syscall(void)
+{
+	struct iocb *ptrs[MAX_DEPTH];
+	struct io_event evs[MAX_DEPTH];
+	aio_context_t ctx = 0;
+	unsigned int seed = 1;
+	double end = now() + secs;
+	long ios = 0;
+	int i, n;
+
+	if (syscall(__NR_io_setup, depth, &ctx))
+		err(2, "io_setup");
+
+	for (i = 0; i < depth; i++) {
+		prep(i, &seed);
+		ptrs[i] = &iocbs[i];
+	}
+	n = depth;
+	while (now() < end) {
+		if (syscall(__NR_io_submit, ctx, n, ptrs) != n)
+			err(2, "io_submit");
+		n = syscall(__NR_io_getevents, ctx, 1, depth, evs, NULL);
+		if (n < 0)
+			err(2, "io_getevents");
+		syscalls += 2;
+		for (i = 0; i < n; i++) {
+			check(&evs[i]);
+			prep(evs[i].data, &seed);
+			ptrs[i] = &iocbs[evs[i].data];
+		}
+		ios += n;
+	}
+
+	syscall(__NR_io_destroy, ctx);
+	return ios;
+}
+
+static void queue(struct sq_ring *sq, int i)
+{
+	unsigned tail = sq->tail;
+
+	sq->iocbs[tail] = iocbs[i];
+	__sync_synchronize();
+	sq->tail = (tail + 1) % sq->nr;
+}
+
+static void kick(aio_context_t ctx, struct sq_ring *sq, int thread)
+{
+	/* order the tail store against the flags load */
+	__sync_synchronize();
+	if (thread && !(sq->flags & AIO_SQ_NEED_WAKEUP))
+		return;
+	if (syscall(__NR_io_submit, ctx, 0, NULL) < 0 && errno != EAGAIN)
+		err(2, "io_submit");
+	syscalls++;
+}
+
+static long run_ring(int thread)
+{
+	aio_context_t ctx = 0;
+	struct event_ring *ring;
+	struct sq_ring *sq;
+	unsigned int seed = 1;
+	double end = now() + secs;
+	unsigned head, tail;
+	unsigned long off;
+	long ios = 0, pg = sysconf(_SC_PAGESIZE);
+	int i, n;
+
+	/* flags are or'ed into nr_events, older kernels fail with EINVAL */
+	if (syscall(__NR_io_setup, depth | IOCTX_FLAG_SQRING |
+		    (thread ? IOCTX_FLAG_SQTHREAD : 0), &ctx))
+		return -errno;
+
+	ring = (struct event_ring *)ctx;
+	off = ring->header_length + ring->nr * sizeof(struct io_event);
+	sq = (struct sq_ring *)(ctx + (off + pg - 1) / pg * pg);
+
+	for (i = 0; i < depth; i++) {
+		prep(i, &seed);
+		queue(sq, i);
+	}
+	kick(ctx, sq, thread);
+
+	while (now() < end) {
+		/* reap without entering the kernel */
+		head = ring->head;
+		tail = ring->tail;
+		__sync_synchronize();
+		for (n = 0; head != tail; n++) {
+			check(&ring->events[head]);
+			i = ring->events[head].data;
+			head = (head + 1) % ring->nr;
+			prep(i, &seed);
+			queue(sq, i);
+		}
+		if (!n)
+			continue;
+		__sync_synchronize();
+		ring->head = head;
+		kick(ctx, sq, thread);
+		ios += n;
+	}
+
+	if (sq->dropped)
+		errx(2, "%u iocbs dropped", sq->dropped);
+	syscall(__NR_io_destroy, ctx);
+	return ios;
+}
+
+static void run(int mode)
+{
+	double start, elapsed;
+	long ios;
+
+	syscalls = 0;
+	start = now();
+	if (mode == MODE_SYSCALL)
+		ios = run_syscall();
+	else
+		ios = run_ring(mode == MODE_THREAD);
+	elapsed = now() - start;
+
+	if (ios < 0) {
+		printf("%-8s: not supported (%s)\n", mode_names[mode],
+		       strerror(-ios));
+		return;
+	}
+	printf("%-8s: bs=%zu depth=%d: %.0f IOPS, %.3f syscalls/IO\n",
+	       mode_names[mode], bs, depth, ios / elapsed,
+	       ios ? (double)syscalls / ios : 0);
+}
+
+int main(int argc, char **argv)
+{
+	int mode = -1, created = 0, i, opt;
+	unsigned long long size = 64 << 20;
+	struct stat st;
+	void *buf;
+
+	while ((opt = getopt(argc, argv, "f:m:b:s:q:d:")) != -1) {
+		switch (opt) {
+		case 'f':
+			path = optarg;
+			break;
+		case 'm':
+			for (mode = 0; mode < NR_MODES; mode++)
+				if (!strcmp(optarg, mode_names[mode]))
+					break;
+			if (mode == NR_MODES)
+				errx(1, "unknown mode %s", optarg);
+			break;
+		case 'b':
+			bs = atoi(optarg);
+			break;
+		case 's':
+			size = (unsigned long long)atoi(optarg) << 20;
+			break;
+		case 'q':
+			depth = atoi(optarg);
+			break;
+		case 'd':
+			secs = atof(optarg);
+			break;
+		default:
+			usage(argv[0], "[-f path] [-m syscall|ring|thread] [-b bs] [-s MB] [-q depth] [-d secs]");
+		}
+	}
+	if (depth < 1 || depth > MAX_DEPTH)
+		errx(1, "depth must be between 1 and %d", MAX_DEPTH);
+	if (!bs || bs % 512)
+		errx(1, "block size must be a multiple of 512");
+
+	if (stat(path, &st) && !access(".", W_OK)) {
+		/* lay out a file to read from */
+		fd = open(path, O_WRONLY | O_CREAT, 0644);
+		if (fd < 0 || posix_memalign(&buf, 4096, 1 << 20))
+			err(2, "create %s", path);
+		memset(buf, 0x5a, 1 << 20);
+		for (st.st_size = 0; st.st_size < (off_t)size;
+		     st.st_size += 1 << 20)
+			if (write(fd, buf, 1 << 20) != 1 << 20)
+				err(2, "write %s", path);
+		fsync(fd);
+		close(fd);
+		free(buf);
+		created = 1;
+	}
+
+	fd = open(path, O_RDONLY | O_DIRECT);
+	if (fd < 0)
+		err(2, "open %s", path);
+	if (fstat(fd, &st))
+		err(2, "stat %s", path);
+	if (S_ISBLK(st.st_mode)) {
+		if (ioctl(fd, BLKGETSIZE64, &size))
+			err(2, "BLKGETSIZE64 %s", path);
+	} else {
+		size = st.st_size;
+	}
+	nr_blocks = size / bs;
+	if (!nr_blocks)
+		errx(1, "%s is smaller than one block", path);
+
+	for (i = 0; i < depth; i++)
+		if (posix_memalign(&bufs[i], 4096, bs))
+			errx(2, "out of memory");
+
+	if (mode >= 0) {
+		run(mode);
+	} else {
+		for (mode = 0; mode < NR_MODES; mode++)
+			run(mode);
+	}
+
+	close(fd);
+	if (created)
+		unlink(path);
+	return 0;
+}
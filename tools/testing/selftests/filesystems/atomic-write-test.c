@@ -0,0 +1,183 @@
+/*
+ * Rollback test for f2fs atomic writes.
+ *
+ * Overwrites and extends a file between F2FS_IOC_START_ATOMIC_WRITE and
+ * the end of the transaction, which is never committed: it is aborted
+ * with F2FS_IOC_ABORT_VOLATILE_WRITE, the file is closed, or the writer
+ * dies.  Each time the file must keep its old contents and size, and
+ * later writes through another descriptor must go through as usual:
+ *
+ *	atomic-write-test [-d dir]
+ *
+ * Skips when the directory is not on f2fs.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define PAGE_SIZE	4096
+#define NR_PAGES	16
+
+#define F2FS_IOCTL_MAGIC		0xf5
+#define F2FS_IOC_START_ATOMIC_WRITE	_IO(F2FS_IOCTL_MAGIC, 1)
+#define F2FS_IOC_ABORT_VOLATILE_WRITE	_IO(F2FS_IOCTL_MAGIC, 5)
+
+enum { ABORT, CLOSE, EXIT };
+
+static const char *cases[] = { "abort", "close", "exit" };
+static char path[PATH_MAX];
+static char page[PAGE_SIZE];
+static int failed;
+
+static void fill(int fd, char c, int first, int nr)
+{
+	int i;
+
+	memset(page, c, sizeof(page));
+	for (i = first; i < first + nr; i++)
+		if (pwrite(fd, page, PAGE_SIZE, (off_t)i * PAGE_SIZE) !=
+		    PAGE_SIZE)
+			err(2, "write %s", path);
+}
+
+/* check that pages [first, first + nr) hold @c and the size is @size */
+static int check(int fd, char c, int first, int nr, off_t size)
+{
+	struct stat st;
+	int i, j;
+
+	if (fstat(fd, &st))
+		err(2, "stat %s", path);
+	if (st.st_size != size) {
+		printf("size %lld, expected %lld\n", (long long)st.st_size,
+		       (long long)size);
+		return 1;
+	}
+	for (i = first; i < first + nr; i++) {
+		if (pread(fd, page, PAGE_SIZE, (off_t)i * PAGE_SIZE) !=
+		    PAGE_SIZE)
+			err(2, "read %s", path);
+		for (j = 0; j < PAGE_SIZE; j++)
+			if (page[j] != c) {
+				printf("page %d holds %#x, expected %#x\n", i,
+				       page[j], c);
+				return 1;
+			}
+	}
+	return 0;
+}
+
+/* a transaction overwriting the file and appending a page, not committed */
+static void start_txn(int fd)
+{
+	if (ioctl(fd, F2FS_IOC_START_ATOMIC_WRITE))
+		err(2, "F2FS_IOC_START_ATOMIC_WRITE");
+	fill(fd, 'B', 0, NR_PAGES + 1);
+}
+
+static void run(int type)
+{
+	off_t size = (off_t)NR_PAGES * PAGE_SIZE;
+	int fd, txn, status, ret;
+	pid_t pid;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		err(2, "open %s", path);
+	fill(fd, 'A', 0, NR_PAGES);
+	if (fsync(fd))
+		err(2, "fsync %s", path);
+
+	switch (type) {
+	case ABORT:
+		start_txn(fd);
+		if (ioctl(fd, F2FS_IOC_ABORT_VOLATILE_WRITE))
+			err(2, "F2FS_IOC_ABORT_VOLATILE_WRITE");
+		break;
+	case CLOSE:
+		txn = open(path, O_RDWR);
+		if (txn < 0)
+			err(2, "open %s", path);
+		start_txn(txn);
+		close(txn);
+		break;
+	case EXIT:
+		pid = fork();
+		if (pid < 0)
+			err(2, "fork");
+		if (!pid) {
+			txn = open(path, O_RDWR);
+			if (txn < 0)
+				err(2, "open %s", path);
+			start_txn(txn);
+			_exit(0);
+		}
+		if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+		    WEXITSTATUS(status))
+			errx(2, "transaction writer failed");
+		break;
+	}
+
+	ret = check(fd, 'A', 0, NR_PAGES, size);
+
+	/* the transaction is gone, plain writes work as before */
+	if (!ret) {
+		fill(fd, 'C', 0, 1);
+		if (fsync(fd))
+			err(2, "fsync %s", path);
+		ret = check(fd, 'C', 0, 1, size) ||
+		      check(fd, 'A', 1, NR_PAGES - 1, size);
+	}
+
+	printf("%s: %s\n", cases[type], ret ? "[FAIL]" : "[PASS]");
+	failed |= ret;
+	close(fd);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = ".";
+	int fd, opt, type;
+
+	while ((opt = getopt(argc, argv, "d:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dir = optarg;
+			break;
+		default:
+			errx(1, "usage: %s [-d dir]", argv[0]);
+		}
+	}
+
+	snprintf(path, sizeof(path), "%s/atomic-write-test.db", dir);
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		err(2, "open %s", path);
+	if (ioctl(fd, F2FS_IOC_START_ATOMIC_WRITE)) {
+		if (errno != ENOTTY && errno != EOPNOTSUPP)
+			err(2, "F2FS_IOC_START_ATOMIC_WRITE");
+		printf("atomic writes not supported on %s: [SKIP]\n", dir);
+		close(fd);
+		unlink(path);
+		return 0;
+	}
+	ioctl(fd, F2FS_IOC_ABORT_VOLATILE_WRITE);
+	close(fd);
+
+	for (type = ABORT; type <= EXIT; type++)
+		run(type);
+
+	unlink(path);
+	return failed;
+}
@@ -0,0 +1,203 @@
+/*
+ * SQLite-like transaction benchmark.
+ *
+ * Every transaction updates a few random pages of a database file and
+ * makes them durable the way SQLite does in one of its journal modes:
+ *
+ *  rollback - copy the old pages to a journal and fsync it, write the
+ *             pages to the database and fsync it, then truncate and
+ *             fsync the journal (journal_mode=TRUNCATE);
+ *  wal      - append the pages to a write-ahead log and fsync it, and
+ *             copy the log back to the database every 1000 frames;
+ *  atomic   - write the pages to the database between the f2fs
+ *             F2FS_IOC_START_ATOMIC_WRITE and F2FS_IOC_COMMIT_ATOMIC_WRITE
+ *             ioctls, which commit them with a single fsync.
+ *
+ * Reports transactions per second:
+ *
+ *	db-txn-bench [-d dir] [-m rollback|wal|atomic] [-p pages] [-n txns]
+ *		     [-s db pages]
+ */
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+
+#include "../bench.h"
+
+#define PAGE_SIZE	4096
+#define WAL_CKPT	1000
+
+#define F2FS_IOCTL_MAGIC		0xf5
+#define F2FS_IOC_START_ATOMIC_WRITE	_IO(F2FS_IOCTL_MAGIC, 1)
+#define F2FS_IOC_COMMIT_ATOMIC_WRITE	_IO(F2FS_IOCTL_MAGIC, 2)
+#define F2FS_IOC_ABORT_VOLATILE_WRITE	_IO(F2FS_IOCTL_MAGIC, 5)
+
+enum { ROLLBACK, WAL, ATOMIC };
+
+static const char *modes[] = { "rollback", "wal", "atomic" };
+static char page[PAGE_SIZE];
+static int db, jnl, wal_frames;
+static long *wal_pgnos;	/* database page of each wal frame */
+static long dbpages = 1024;
+
+static void pwrite_page(int fd, long pgno, const char *what)
+{
+	if (pwrite(fd, page, PAGE_SIZE, pgno * PAGE_SIZE) != PAGE_SIZE)
+		err(2, "write %s", what);
+}
+
+static void do_fsync(int fd, const char *what)
+{
+	if (fsync(fd))
+		err(2, "fsync %s", what);
+}
+
+static void txn_rollback(long *pgnos, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (pread(db, page, PAGE_SIZE, pgnos[i] * PAGE_SIZE) < 0)
+			err(2, "read db");
+		pwrite_page(jnl, i + 1, "journal");
+	}
+	/* the header goes last, as it makes the journal hot */
+	pwrite_page(jnl, 0, "journal");
+	do_fsync(jnl, "journal");
+
+	for (i = 0; i < nr; i++)
+		pwrite_page(db, pgnos[i], "db");
+	do_fsync(db, "db");
+
+	if (ftruncate(jnl, 0))
+		err(2, "truncate journal");
+	do_fsync(jnl, "journal");
+}
+
+static void txn_wal(long *pgnos, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		wal_pgnos[wal_frames] = pgnos[i];
+		pwrite_page(jnl, wal_frames++, "wal");
+	}
+	do_fsync(jnl, "wal");
+
+	if (wal_frames < WAL_CKPT)
+		return;
+
+	/* checkpoint: copy the frames back to their database pages */
+	for (i = 0; i < wal_frames; i++)
+		pwrite_page(db, wal_pgnos[i], "db");
+	do_fsync(db, "db");
+	if (ftruncate(jnl, 0))
+		err(2, "truncate wal");
+	do_fsync(jnl, "wal");
+	wal_frames = 0;
+}
+
+static void txn_atomic(long *pgnos, int nr)
+{
+	int i;
+
+	if (ioctl(db, F2FS_IOC_START_ATOMIC_WRITE))
+		err(2, "F2FS_IOC_START_ATOMIC_WRITE");
+	for (i = 0; i < nr; i++)
+		pwrite_page(db, pgnos[i], "db");
+	if (ioctl(db, F2FS_IOC_COMMIT_ATOMIC_WRITE)) {
+		ioctl(db, F2FS_IOC_ABORT_VOLATILE_WRITE);
+		err(2, "F2FS_IOC_COMMIT_ATOMIC_WRITE");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = ".";
+	char dbpath[PATH_MAX], jpath[PATH_MAX];
+	int mode = ROLLBACK, pages = 4, txns = 1000, i, j, opt;
+	long *pgnos;
+	double start, elapsed;
+
+	while ((opt = getopt(argc, argv, "d:m:p:n:s:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dir = optarg;
+			break;
+		case 'm':
+			for (mode = 0; mode <= ATOMIC; mode++)
+				if (!strcmp(optarg, modes[mode]))
+					break;
+			if (mode > ATOMIC)
+				errx(1, "unknown mode %s", optarg);
+			break;
+		case 'p':
+			pages = atoi(optarg);
+			break;
+		case 'n':
+			txns = atoi(optarg);
+			break;
+		case 's':
+			dbpages = atol(optarg);
+			break;
+		default:
+			usage(argv[0], "[-d dir] [-m rollback|wal|atomic] [-p pages] [-n txns] [-s db pages]");
+		}
+	}
+	if (pages < 1 || dbpages < pages)
+		errx(1, "need at least one page and a larger database");
+
+	pgnos = calloc(pages, sizeof(*pgnos));
+	/* a checkpoint runs once a transaction takes the wal past WAL_CKPT */
+	wal_pgnos = calloc(WAL_CKPT + pages, sizeof(*wal_pgnos));
+	if (!pgnos || !wal_pgnos)
+		err(2, "calloc");
+
+	snprintf(dbpath, sizeof(dbpath), "%s/txn-bench.db", dir);
+	snprintf(jpath, sizeof(jpath), "%s/txn-bench.db-%s", dir,
+		 mode == WAL ? "wal" : "journal");
+	db = open(dbpath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (db < 0)
+		err(2, "open %s", dbpath);
+	if (mode != ATOMIC) {
+		jnl = open(jpath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (jnl < 0)
+			err(2, "open %s", jpath);
+	}
+
+	memset(page, 0x5a, sizeof(page));
+	for (i = 0; i < dbpages; i++)
+		pwrite_page(db, i, "db");
+	do_fsync(db, "db");
+
+	start = now();
+	for (i = 0; i < txns; i++) {
+		for (j = 0; j < pages; j++)
+			pgnos[j] = rand() % dbpages;
+		page[0] = i;
+		switch (mode) {
+		case ROLLBACK:
+			txn_rollback(pgnos, pages);
+			break;
+		case WAL:
+			txn_wal(pgnos, pages);
+			break;
+		case ATOMIC:
+			txn_atomic(pgnos, pages);
+			break;
+		}
+	}
+	elapsed = now() - start;
+
+	printf("%s: %d txns of %d pages in %.3f s, %.0f txns/sec\n",
+	       modes[mode], txns, pages, elapsed, txns / elapsed);
+
+	close(db);
+	unlink(dbpath);
+	if (mode != ATOMIC) {
+		close(jnl);
+		unlink(jpath);
+	}
+	return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * Small direct I/O benchmark.
+ *
+ * A number of threads issue synchronous O_DIRECT reads or writes of one
+ * block size at random (or sequential) offsets of a file or block device
+ * and the IOPS, bandwidth and average latency are reported, fio style.
+ * With -c the run is done twice, with the block device direct I/O fast
+ * path disabled and then enabled:
+ *
+ *	dio-bench [-f file or device] [-m randread|randwrite|read|write]
+ *		  [-b block size] [-s size MB] [-t threads] [-d secs] [-c]
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <linux/fs.h>
+
+#include "../bench.h"
+
+#define MAX_THREADS	64
+#define FAST_PATH	"/sys/module/block_dev/parameters/dio_fast_path"
+
+static const char *path = "dio-bench.dat";
+static int writes, sequential;
+static size_t bs = 4096;
+static unsigned long long nr_blocks;
+static double secs = 5;
+static int fd;
+
+struct result {
+	long ios;
+	double lat;
+};
+
+static void *worker(void *arg)
+{
+	unsigned int seed = (unsigned long)arg;
+	unsigned long long blk = seed * (nr_blocks / MAX_THREADS);
+	struct result *res;
+	double end = now() + secs, t;
+	ssize_t ret;
+	void *buf;
+
+	res = calloc(1, sizeof(*res));
+	if (!res || posix_memalign(&buf, 4096, bs))
+		errx(2, "out of memory");
+	memset(buf, 0x5a, bs);
+
+	while ((t = now()) < end) {
+		if (sequential)
+			blk = (blk + 1) % nr_blocks;
+		else
+			blk = ((unsigned long long)rand_r(&seed) << 31 ^
+			       rand_r(&seed)) % nr_blocks;
+		if (writes)
+			ret = pwrite(fd, buf, bs, blk * bs);
+		else
+			ret = pread(fd, buf, bs, blk * bs);
+		if (ret != (ssize_t)bs)
+			err(2, "%s %s", writes ? "write" : "read", path);
+		res->lat += now() - t;
+		res->ios++;
+	}
+	free(buf);
+	return res;
+}
+
+static void set_fast_path(const char *val)
+{
+	FILE *f;
+
+	f = fopen(FAST_PATH, "w");
+	if (!f)
+		err(2, "open %s", FAST_PATH);
+	fputs(val, f);
+	if (fclose(f))
+		err(2, "write %s", FAST_PATH);
+}
+
+static void run(int threads, const char *label)
+{
+	pthread_t th[MAX_THREADS];
+	double start, elapsed, lat = 0;
+	struct result *res;
+	long ios = 0;
+	int i;
+
+	start = now();
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&th[i], NULL, worker,
+				   (void *)(unsigned long)(i + 1)))
+			errx(2, "pthread_create");
+	for (i = 0; i < threads; i++) {
+		pthread_join(th[i], (void **)&res);
+		ios += res->ios;
+		lat += res->lat;
+		free(res);
+	}
+	elapsed = now() - start;
+
+	printf("%s%s bs=%zu threads=%d: %.0f IOPS, %.1f MB/s, %.1f us avg lat\n",
+	       label, writes ? (sequential ? "write" : "randwrite") :
+				(sequential ? "read" : "randread"),
+	       bs, threads, ios / elapsed, ios * bs / elapsed / (1 << 20),
+	       ios ? lat / ios * 1e6 : 0);
+}
+
+int main(int argc, char **argv)
+{
+	int threads = 1, compare = 0, created = 0, opt;
+	unsigned long long size = 64 << 20;
+	struct stat st;
+	void *buf;
+
+	while ((opt = getopt(argc, argv, "f:m:b:s:t:d:c")) != -1) {
+		switch (opt) {
+		case 'f':
+			path = optarg;
+			break;
+		case 'm':
+			writes = strstr(optarg, "write") != NULL;
+			sequential = strncmp(optarg, "rand", 4) != 0;
+			break;
+		case 'b':
+			bs = atoi(optarg);
+			break;
+		case 's':
+			size = (unsigned long long)atoi(optarg) << 20;
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'd':
+			secs = atof(optarg);
+			break;
+		case 'c':
+			compare = 1;
+			break;
+		default:
+			usage(argv[0], "[-f path] [-m randread|randwrite|read|write] [-b bs] [-s MB] [-t threads] [-d secs] [-c]");
+		}
+	}
+	if (threads < 1 || threads > MAX_THREADS)
+		errx(1, "threads must be between 1 and %d", MAX_THREADS);
+	if (!bs || bs % 512)
+		errx(1, "block size must be a multiple of 512");
+
+	if (stat(path, &st) && !access(".", W_OK)) {
+		/* lay out a file to do I/O to */
+		fd = open(path, O_WRONLY | O_CREAT, 0644);
+		if (fd < 0 || posix_memalign(&buf, 4096, 1 << 20))
+			err(2, "create %s", path);
+		memset(buf, 0x5a, 1 << 20);
+		for (st.st_size = 0; st.st_size < (off_t)size;
+		     st.st_size += 1 << 20)
+			if (write(fd, buf, 1 << 20) != 1 << 20)
+				err(2, "write %s", path);
+		fsync(fd);
+		close(fd);
+		free(buf);
+		created = 1;
+	}
+
+	fd = open(path, (writes ? O_RDWR : O_RDONLY) | O_DIRECT);
+	if (fd < 0)
+		err(2, "open %s", path);
+	if (fstat(fd, &st))
+		err(2, "stat %s", path);
+	if (S_ISBLK(st.st_mode)) {
+		if (ioctl(fd, BLKGETSIZE64, &size))
+			err(2, "BLKGETSIZE64 %s", path);
+	} else {
+		size = st.st_size;
+	}
+	nr_blocks = size / bs;
+	if (!nr_blocks)
+		errx(1, "%s is smaller than one block", path);
+
+	if (compare) {
+		if (!S_ISBLK(st.st_mode))
+			errx(1, "-c needs a block device");
+		set_fast_path("N");
+		run(threads, "generic:   ");
+		set_fast_path("Y");
+		run(threads, "fast path: ");
+	} else {
+		run(threads, "");
+	}
+
+	close(fd);
+	if (created)
+		unlink(path);
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Parallel random read benchmark for the ext4 extent status cache.
+ *
+ * Creates a file (every block its own extent with -F), then has a number
+ * of threads read random blocks of it with O_DIRECT, so that every read
+ * maps its block through the extent status tree of the same inode.
+ * Reports reads per second:
+ *
+ *	es-read-bench [-f file] [-s size MB] [-t threads] [-d secs] [-F]
+ */
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../bench.h"
+
+#define BLOCK_SIZE	4096
+#define MAX_THREADS	64
+
+static const char *path = "es-read-bench.dat";
+static size_t nr_blocks;
+static double secs = 5;
+static int fd;
+
+/* write blocks first, first + step, ... and make them stable */
+static void fill(int wfd, size_t first, size_t step)
+{
+	char buf[BLOCK_SIZE];
+	size_t i;
+
+	memset(buf, 0x5a, sizeof(buf));
+	for (i = first; i < nr_blocks; i += step)
+		if (pwrite(wfd, buf, BLOCK_SIZE, (off_t)i * BLOCK_SIZE) !=
+		    BLOCK_SIZE)
+			err(2, "write %s", path);
+	if (fsync(wfd))
+		err(2, "fsync %s", path);
+}
+
+static void create(int fragment)
+{
+	int wfd;
+
+	wfd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (wfd < 0)
+		err(2, "open %s", path);
+	if (fragment) {
+		/* the even blocks land away from their odd neighbours */
+		fill(wfd, 1, 2);
+		fill(wfd, 0, 2);
+	} else {
+		fill(wfd, 0, 1);
+	}
+	close(wfd);
+}
+
+static void *reader(void *arg)
+{
+	unsigned int seed = (unsigned long)arg;
+	double end = now() + secs;
+	long reads = 0;
+	size_t blk;
+	void *buf;
+
+	if (posix_memalign(&buf, BLOCK_SIZE, BLOCK_SIZE))
+		errx(2, "posix_memalign");
+
+	while (now() < end) {
+		blk = ((size_t)rand_r(&seed) << 16 ^ rand_r(&seed)) % nr_blocks;
+		if (pread(fd, buf, BLOCK_SIZE, (off_t)blk * BLOCK_SIZE) !=
+		    BLOCK_SIZE)
+			err(2, "read %s", path);
+		reads++;
+	}
+	free(buf);
+	return (void *)reads;
+}
+
+int main(int argc, char **argv)
+{
+	int threads = 4, fragment = 0, i, opt;
+	pthread_t th[MAX_THREADS];
+	size_t size = 256;
+	double start, elapsed;
+	long reads = 0;
+	void *n;
+
+	while ((opt = getopt(argc, argv, "f:s:t:d:F")) != -1) {
+		switch (opt) {
+		case 'f':
+			path = optarg;
+			break;
+		case 's':
+			size = atoi(optarg);
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'd':
+			secs = atof(optarg);
+			break;
+		case 'F':
+			fragment = 1;
+			break;
+		default:
+			usage(argv[0], "[-f file] [-s MB] [-t threads] [-d secs] [-F]");
+		}
+	}
+	if (threads < 1 || threads > MAX_THREADS)
+		errx(1, "threads must be between 1 and %d", MAX_THREADS);
+	nr_blocks = (size << 20) / BLOCK_SIZE;
+	if (!nr_blocks)
+		errx(1, "file too small");
+
+	create(fragment);
+	fd = open(path, O_RDONLY | O_DIRECT);
+	if (fd < 0)
+		err(2, "open %s", path);
+
+	start = now();
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&th[i], NULL, reader,
+				   (void *)(unsigned long)(i + 1)))
+			errx(2, "pthread_create");
+	for (i = 0; i < threads; i++) {
+		pthread_join(th[i], &n);
+		reads += (long)n;
+	}
+	elapsed = now() - start;
+
+	printf("%zu blocks%s, %d threads: %.0f reads/sec\n", nr_blocks,
+	       fragment ? " (fragmented)" : "", threads, reads / elapsed);
+
+	close(fd);
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,175 @@
+/*
+ * Replay AVC misses through the security server.
+ *
+ * Reads avc: lines as logged by the kernel (dmesg, logcat) and asks the
+ * security server for each (scontext, tcontext, tclass) triple through
+ * selinuxfs' access file, which computes the decision without going
+ * through the AVC, i.e. every query is a miss.  Without a trace the
+ * current context is checked against itself for every class of the
+ * loaded policy.  Reports the number of decisions computed per second:
+ *
+ *	avc-replay-bench [-m selinuxfs mount] [-l loops] [trace]
+ */
+
+#include <fcntl.h>
+#include <dirent.h>
+
+#include "../bench.h"
+
+struct query {
+	char *scon;
+	char *tcon;
+	int tclass;
+};
+
+static const char *mnt = "/sys/fs/selinux";
+static struct query *queries;
+static int nr_queries, max_queries;
+
+static int class_index(const char *name)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/class/%s/index", mnt, name);
+	return read_stat(path);
+}
+
+static void add_query(const char *scon, const char *tcon, int tclass)
+{
+	if (nr_queries == max_queries) {
+		max_queries = max_queries ? max_queries * 2 : 256;
+		queries = realloc(queries, max_queries * sizeof(*queries));
+		if (!queries)
+			err(2, "realloc");
+	}
+	queries[nr_queries].scon = strdup(scon);
+	queries[nr_queries].tcon = strdup(tcon);
+	queries[nr_queries].tclass = tclass;
+	nr_queries++;
+}
+
+/* copy the value of "key=value" in @line into @buf */
+static int field(const char *line, const char *key, char *buf, size_t len)
+{
+	const char *p = strstr(line, key);
+	size_t n;
+
+	if (!p)
+		return -1;
+	p += strlen(key);
+	n = strcspn(p, " \t\n");
+	if (!n || n >= len)
+		return -1;
+	memcpy(buf, p, n);
+	buf[n] = '\0';
+	return 0;
+}
+
+static void load_trace(const char *file)
+{
+	char line[4096], scon[1024], tcon[1024], tclass[256];
+	FILE *f;
+	int idx;
+
+	f = fopen(file, "r");
+	if (!f)
+		err(2, "open %s", file);
+	while (fgets(line, sizeof(line), f)) {
+		if (field(line, "scontext=", scon, sizeof(scon)) ||
+		    field(line, "tcontext=", tcon, sizeof(tcon)) ||
+		    field(line, "tclass=", tclass, sizeof(tclass)))
+			continue;
+		idx = class_index(tclass);
+		if (idx > 0)
+			add_query(scon, tcon, idx);
+	}
+	fclose(f);
+}
+
+static void load_self(void)
+{
+	char path[PATH_MAX], con[1024];
+	struct dirent *d;
+	ssize_t len;
+	DIR *dir;
+	int fd, idx;
+
+	fd = open("/proc/self/attr/current", O_RDONLY);
+	if (fd < 0)
+		err(2, "open /proc/self/attr/current");
+	len = read(fd, con, sizeof(con) - 1);
+	if (len <= 0)
+		err(2, "read /proc/self/attr/current");
+	close(fd);
+	con[len] = '\0';
+	con[strcspn(con, "\n")] = '\0';
+
+	snprintf(path, sizeof(path), "%s/class", mnt);
+	dir = opendir(path);
+	if (!dir)
+		err(2, "open %s", path);
+	while ((d = readdir(dir))) {
+		if (d->d_name[0] == '.')
+			continue;
+		idx = class_index(d->d_name);
+		if (idx > 0)
+			add_query(con, con, idx);
+	}
+	closedir(dir);
+}
+
+static void compute(struct query *q)
+{
+	char path[PATH_MAX], buf[256];
+	int fd, len;
+
+	snprintf(path, sizeof(path), "%s/access", mnt);
+	fd = open(path, O_RDWR);
+	if (fd < 0)
+		err(2, "open %s", path);
+	len = snprintf(buf, sizeof(buf), "%s %s %d", q->scon, q->tcon,
+		       q->tclass);
+	if (write(fd, buf, len) != len && errno != EINVAL)
+		err(2, "write %s", path);
+	if (read(fd, buf, sizeof(buf)) < 0 && errno != EINVAL)
+		err(2, "read %s", path);
+	close(fd);
+}
+
+int main(int argc, char **argv)
+{
+	int loops = 10, i, j, opt;
+	double start, elapsed;
+
+	while ((opt = getopt(argc, argv, "m:l:")) != -1) {
+		switch (opt) {
+		case 'm':
+			mnt = optarg;
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		default:
+			usage(argv[0], "[-m mnt] [-l loops] [trace]");
+		}
+	}
+
+	if (optind < argc)
+		load_trace(argv[optind]);
+	else
+		load_self();
+	if (!nr_queries)
+		errx(1, "no queries to replay");
+
+	start = now();
+	for (i = 0; i < loops; i++)
+		for (j = 0; j < nr_queries; j++)
+			compute(&queries[j]);
+	elapsed = now() - start;
+
+	printf("%d queries x %d loops: %.0f decisions/sec, %.2f us each\n",
+	       nr_queries, loops, nr_queries * loops / elapsed,
+	       elapsed * 1e6 / (nr_queries * loops));
+
+	return 0;
+}
@@ -0,0 +1,188 @@
+/*
+ * Benchmark app foreground/background switches as cgroup moves.
+ *
+ * Starts a target process with a number of threads and moves it back and
+ * forth between a "fg" and a "bg" cgroup in each of the given hierarchies
+ * through cgroup.procs, the way the framework does when an app changes
+ * state.  By default every hierarchy is driven by its own process so that
+ * moves on different hierarchies may run concurrently; -s drives all of
+ * them from a single process instead.  Reports moves per second:
+ *
+ *	cgroup-switch-bench [-m hierarchy mount]... [-t threads] [-d secs] [-s]
+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "../bench.h"
+
+#define MAX_MNTS	8
+
+static const char *mnts[MAX_MNTS];
+static int nr_mnts;
+static int fds[MAX_MNTS][2];
+
+static void *idle_thread(void *arg)
+{
+	for (;;)
+		pause();
+	return arg;
+}
+
+static pid_t start_target(int threads)
+{
+	pthread_t th;
+	pid_t pid;
+	int i;
+
+	pid = fork();
+	if (pid < 0)
+		err(2, "fork");
+	if (pid)
+		return pid;
+
+	for (i = 1; i < threads; i++)
+		if (pthread_create(&th, NULL, idle_thread, NULL))
+			errx(2, "pthread_create");
+	idle_thread(NULL);
+	exit(0);
+}
+
+static void setup(int i)
+{
+	static const char *names[] = { "fg", "bg" };
+	char path[PATH_MAX];
+	int j;
+
+	for (j = 0; j < 2; j++) {
+		snprintf(path, sizeof(path), "%s/switch-bench-%s", mnts[i],
+			 names[j]);
+		if (mkdir(path, 0755) && errno != EEXIST)
+			err(2, "mkdir %s", path);
+		snprintf(path, sizeof(path), "%s/switch-bench-%s/cgroup.procs",
+			 mnts[i], names[j]);
+		fds[i][j] = open(path, O_WRONLY);
+		if (fds[i][j] < 0)
+			err(2, "open %s", path);
+	}
+}
+
+static void cleanup(int i)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/switch-bench-fg", mnts[i]);
+	rmdir(path);
+	snprintf(path, sizeof(path), "%s/switch-bench-bg", mnts[i]);
+	rmdir(path);
+}
+
+static void move(int i, int bg, const char *pid, size_t len)
+{
+	if (write(fds[i][bg], pid, len) != (ssize_t)len)
+		err(2, "move to %s/switch-bench-%s", mnts[i], bg ? "bg" : "fg");
+}
+
+/* switch the target on hierarchies [first, last) and return the moves */
+static long run(int first, int last, pid_t target, double secs)
+{
+	char pid[16];
+	size_t len;
+	double end = now() + secs;
+	long moves = 0;
+	int bg = 0, i;
+
+	len = snprintf(pid, sizeof(pid), "%d", target);
+	while (now() < end) {
+		bg = !bg;
+		for (i = first; i < last; i++, moves++)
+			move(i, bg, pid, len);
+	}
+	/* leave the target in fg */
+	for (i = first; i < last; i++)
+		move(i, 0, pid, len);
+	return moves;
+}
+
+int main(int argc, char **argv)
+{
+	int threads = 16, serial = 0, i, opt, pfd[2];
+	double secs = 5, start, elapsed;
+	long moves = 0, n;
+	pid_t target, workers[MAX_MNTS];
+
+	while ((opt = getopt(argc, argv, "m:t:d:s")) != -1) {
+		switch (opt) {
+		case 'm':
+			if (nr_mnts == MAX_MNTS)
+				errx(1, "at most %d hierarchies", MAX_MNTS);
+			mnts[nr_mnts++] = optarg;
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'd':
+			secs = atof(optarg);
+			break;
+		case 's':
+			serial = 1;
+			break;
+		default:
+			usage(argv[0], "[-m mnt]... [-t threads] [-d secs] [-s]");
+		}
+	}
+	if (!nr_mnts) {
+		mnts[nr_mnts++] = "/dev/cpuset";
+		mnts[nr_mnts++] = "/dev/cpuctl";
+		mnts[nr_mnts++] = "/dev/stune";
+		mnts[nr_mnts++] = "/dev/memcg";
+	}
+	if (threads < 1)
+		errx(1, "need at least one thread");
+
+	for (i = 0; i < nr_mnts; i++)
+		setup(i);
+	target = start_target(threads);
+
+	start = now();
+	if (serial) {
+		moves = run(0, nr_mnts, target, secs);
+	} else {
+		if (pipe(pfd))
+			err(2, "pipe");
+		for (i = 0; i < nr_mnts; i++) {
+			workers[i] = fork();
+			if (workers[i] < 0)
+				err(2, "fork");
+			if (!workers[i]) {
+				n = run(i, i + 1, target, secs);
+				if (write(pfd[1], &n, sizeof(n)) != sizeof(n))
+					err(2, "write");
+				exit(0);
+			}
+		}
+		for (i = 0; i < nr_mnts; i++) {
+			if (read(pfd[0], &n, sizeof(n)) != sizeof(n))
+				err(2, "read");
+			moves += n;
+		}
+		for (i = 0; i < nr_mnts; i++)
+			waitpid(workers[i], NULL, 0);
+	}
+	elapsed = now() - start;
+
+	printf("%d hierarchies, %d threads, %s: %.0f moves/sec, %.0f app switches/sec\n",
+	       nr_mnts, threads, serial ? "serial" : "parallel",
+	       moves / elapsed, moves / elapsed / nr_mnts);
+
+	kill(target, SIGKILL);
+	waitpid(target, NULL, 0);
+	for (i = 0; i < nr_mnts; i++)
+		cleanup(i);
+
+	return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * Measure process and thread creation latency.
+ *
+ * Repeatedly forks a child that exits right away and waits for it, or
+ * with -t creates and joins a thread, and reports the average round trip
+ * together with the hit rates of the kernel's task struct and stack
+ * caches from /sys/kernel/mm/task_cache when available:
+ *
+ *	fork-bench [-l loops] [-t]
+ */
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "../bench.h"
+
+#define STATS		"/sys/kernel/mm/task_cache"
+
+static long cache_stat(const char *name)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s", STATS, name);
+	return read_stat(path);
+}
+
+static void *thread_fn(void *arg)
+{
+	return arg;
+}
+
+static void do_fork(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0)
+		err(2, "fork");
+	if (!pid)
+		_exit(0);
+	if (waitpid(pid, NULL, 0) != pid)
+		err(2, "waitpid");
+}
+
+static void do_thread(void)
+{
+	pthread_t th;
+
+	if (pthread_create(&th, NULL, thread_fn, NULL))
+		errx(2, "pthread_create");
+	pthread_join(th, NULL);
+}
+
+static void print_hits(const char *what, long hits0, long misses0)
+{
+	char name[32];
+	long hits, misses;
+
+	snprintf(name, sizeof(name), "%s_hits", what);
+	hits = cache_stat(name);
+	snprintf(name, sizeof(name), "%s_misses", what);
+	misses = cache_stat(name);
+	if (hits < 0 || misses < 0 || hits0 < 0 || misses0 < 0)
+		return;
+
+	hits -= hits0;
+	misses -= misses0;
+	if (hits + misses)
+		printf("  %s cache: %ld hits, %ld misses (%.1f%%)\n", what,
+		       hits, misses, 100.0 * hits / (hits + misses));
+}
+
+int main(int argc, char **argv)
+{
+	int loops = 10000, threads = 0, i, opt;
+	long task_hits, task_misses, stack_hits, stack_misses;
+	double start, elapsed;
+
+	while ((opt = getopt(argc, argv, "l:t")) != -1) {
+		switch (opt) {
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		case 't':
+			threads = 1;
+			break;
+		default:
+			usage(argv[0], "[-l loops] [-t]");
+		}
+	}
+	if (loops < 1)
+		errx(1, "need at least one loop");
+
+	task_hits = cache_stat("task_hits");
+	task_misses = cache_stat("task_misses");
+	stack_hits = cache_stat("stack_hits");
+	stack_misses = cache_stat("stack_misses");
+
+	start = now();
+	for (i = 0; i < loops; i++) {
+		if (threads)
+			do_thread();
+		else
+			do_fork();
+	}
+	elapsed = now() - start;
+
+	printf("%s: %d loops, %.2f us per create/exit, %.0f per second\n",
+	       threads ? "thread" : "fork", loops, elapsed * 1e6 / loops,
+	       loops / elapsed);
+	print_hits("task", task_hits, task_misses);
+	print_hits("stack", stack_hits, stack_misses);
+
+	return 0;
+}
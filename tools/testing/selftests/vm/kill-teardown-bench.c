@@ -0,0 +1,88 @@
+/*
+ * Measure how long it takes to get memory back after SIGKILL.
+ *
+ * Forks a child that faults in a large anonymous buffer, kills it and
+ * polls MemFree until the buffer has been returned.  The kernel's own
+ * SIGKILL to memory freed figure is read from
+ * /sys/kernel/mm/exit_teardown when available:
+ *
+ *	kill-teardown-bench [-s size MB] [-l loops]
+ */
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "../bench.h"
+
+#define PAGE_SIZE	4096
+#define STATS		"/sys/kernel/mm/exit_teardown/kill_to_free_last_us"
+
+int main(int argc, char **argv)
+{
+	size_t size = 512 << 20, off;
+	int loops = 5, i, opt, pfd[2];
+	double start, waited, freed;
+	long before, target;
+	pid_t pid;
+	char c;
+
+	while ((opt = getopt(argc, argv, "s:l:")) != -1) {
+		switch (opt) {
+		case 's':
+			size = (size_t)atoi(optarg) << 20;
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		default:
+			usage(argv[0], "[-s MB] [-l loops]");
+		}
+	}
+
+	for (i = 0; i < loops; i++) {
+		if (pipe(pfd))
+			err(2, "pipe");
+
+		pid = fork();
+		if (pid < 0)
+			err(2, "fork");
+		if (!pid) {
+			char *buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+					 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+			if (buf == MAP_FAILED)
+				err(2, "mmap");
+			for (off = 0; off < size; off += PAGE_SIZE)
+				buf[off] = 1;
+			if (write(pfd[1], "x", 1) != 1)
+				err(2, "write");
+			pause();
+			exit(0);
+		}
+
+		if (read(pfd[0], &c, 1) != 1)
+			err(2, "read");
+		close(pfd[0]);
+		close(pfd[1]);
+
+		before = read_meminfo("MemFree");
+		/* expect most of the buffer back */
+		target = before + (size >> 10) * 9 / 10;
+
+		start = now();
+		kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+		waited = now() - start;
+
+		while (read_meminfo("MemFree") < target && now() - start < 10)
+			usleep(100);
+		freed = now() - start;
+
+		printf("loop %d: reaped in %.3f ms, memory back in %.3f ms, kernel %ld us\n",
+		       i, waited * 1e3, freed * 1e3, read_stat(STATS));
+	}
+
+	return 0;
+}
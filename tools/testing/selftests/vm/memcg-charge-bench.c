@@ -0,0 +1,114 @@
+/*
+ * Memory cgroup charge/uncharge microbenchmark.
+ *
+ * Moves itself into a chain of nested memory cgroups and repeatedly
+ * faults in and unmaps an anonymous buffer, reporting the number of
+ * pages charged and uncharged per second.  Run it with different
+ * depths to see the cost of hierarchical charging:
+ *
+ *	memcg-charge-bench [-m memcg mount] [-d depth] [-s size MB] [-l loops]
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../bench.h"
+
+#define PAGE_SIZE	4096
+
+static char paths[16][PATH_MAX];
+
+static void move_self(const char *dir)
+{
+	char file[PATH_MAX];
+	FILE *f;
+
+	snprintf(file, sizeof(file), "%s/tasks", dir);
+	f = fopen(file, "w");
+	if (!f)
+		err(2, "open %s", file);
+	fprintf(f, "%d\n", getpid());
+	if (fclose(f))
+		err(2, "write %s", file);
+}
+
+static void set_use_hierarchy(const char *dir)
+{
+	char file[PATH_MAX];
+	FILE *f;
+
+	snprintf(file, sizeof(file), "%s/memory.use_hierarchy", dir);
+	f = fopen(file, "w");
+	if (!f)
+		return;
+	fprintf(f, "1\n");
+	fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+	const char *mnt = "/sys/fs/cgroup/memory";
+	int depth = 4, loops = 50, i, opt;
+	size_t size = 64 << 20, off, len;
+	double start, elapsed;
+	char *buf;
+
+	while ((opt = getopt(argc, argv, "m:d:s:l:")) != -1) {
+		switch (opt) {
+		case 'm':
+			mnt = optarg;
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 's':
+			size = (size_t)atoi(optarg) << 20;
+			break;
+		case 'l':
+			loops = atoi(optarg);
+			break;
+		default:
+			usage(argv[0], "[-m mnt] [-d depth] [-s MB] [-l loops]");
+		}
+	}
+	if (depth < 0 || depth > 15)
+		errx(1, "depth must be between 0 and 15");
+
+	set_use_hierarchy(mnt);
+	snprintf(paths[0], PATH_MAX, "%s/charge-bench", mnt);
+	for (i = 0; i <= depth; i++) {
+		if (i) {
+			len = strlen(paths[i - 1]);
+			if (len + sizeof("/l15") > PATH_MAX)
+				errx(1, "%s: path too long", mnt);
+			memcpy(paths[i], paths[i - 1], len);
+			sprintf(paths[i] + len, "/l%d", i);
+		}
+		if (mkdir(paths[i], 0755) && errno != EEXIST)
+			err(2, "mkdir %s", paths[i]);
+	}
+	move_self(paths[depth]);
+
+	start = now();
+	for (i = 0; i < loops; i++) {
+		buf = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (buf == MAP_FAILED)
+			err(2, "mmap");
+		for (off = 0; off < size; off += PAGE_SIZE)
+			buf[off] = 1;
+		munmap(buf, size);
+	}
+	elapsed = now() - start;
+
+	printf("depth %d: %.0f pages/sec (%.3f s for %zu pages)\n", depth,
+	       (double)loops * (size / PAGE_SIZE) / elapsed, elapsed,
+	       (size_t)loops * (size / PAGE_SIZE));
+
+	move_self(mnt);
+	for (i = depth; i >= 0; i--)
+		rmdir(paths[i]);
+
+	return 0;
+}
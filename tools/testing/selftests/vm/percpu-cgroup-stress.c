@@ -0,0 +1,100 @@
+/*
+ * Percpu allocator stress test.
+ *
+ * Every memory cgroup allocates a number of percpu counters, so mass
+ * creation and destruction of cgroups exercises the percpu chunk
+ * allocator.  Each round creates a batch of cgroups, removes every other
+ * one to fragment the percpu chunks, refills the holes and finally tears
+ * everything down, reporting the rate of each phase:
+ *
+ *	percpu-cgroup-stress [-m cgroup mount] [-n cgroups] [-l rounds]
+ */
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "../bench.h"
+
+static const char *base;
+
+static void cg_path(char *buf, int i)
+{
+	snprintf(buf, PATH_MAX, "%s/cg%d", base, i);
+}
+
+static void create(int i)
+{
+	char path[PATH_MAX];
+
+	cg_path(path, i);
+	if (mkdir(path, 0755))
+		err(2, "mkdir %s", path);
+}
+
+static void destroy(int i)
+{
+	char path[PATH_MAX];
+
+	cg_path(path, i);
+	if (rmdir(path))
+		err(2, "rmdir %s", path);
+}
+
+/* create or destroy cgroups [0, nr) with @step and return the rate */
+static double phase(void (*fn)(int), int start, int nr, int step)
+{
+	double t = now();
+	int i, done = 0;
+
+	for (i = start; i < nr; i += step, done++)
+		fn(i);
+
+	return done / (now() - t);
+}
+
+int main(int argc, char **argv)
+{
+	const char *mnt = "/sys/fs/cgroup/memory";
+	char path[PATH_MAX];
+	int nr = 4096, rounds = 4, i, opt;
+
+	while ((opt = getopt(argc, argv, "m:n:l:")) != -1) {
+		switch (opt) {
+		case 'm':
+			mnt = optarg;
+			break;
+		case 'n':
+			nr = atoi(optarg);
+			break;
+		case 'l':
+			rounds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0], "[-m mnt] [-n cgroups] [-l rounds]");
+		}
+	}
+	if (nr < 2)
+		errx(1, "need at least 2 cgroups");
+
+	snprintf(path, sizeof(path), "%s/percpu-stress", mnt);
+	if (mkdir(path, 0755) && errno != EEXIST)
+		err(2, "mkdir %s", path);
+	base = path;
+
+	printf("%8s %12s %12s %12s %12s\n", "round", "create/s",
+	       "punch/s", "refill/s", "destroy/s");
+	for (i = 0; i < rounds; i++) {
+		double c, p, f, d;
+
+		c = phase(create, 0, nr, 1);
+		/* free every other cgroup to leave holes in the chunks */
+		p = phase(destroy, 1, nr, 2);
+		f = phase(create, 1, nr, 2);
+		d = phase(destroy, 0, nr, 1);
+
+		printf("%8d %12.0f %12.0f %12.0f %12.0f\n", i, c, p, f, d);
+	}
+
+	rmdir(path);
+	return 0;
+}